@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "Renderer.h"
+using namespace std;
+
+// Fixed views, so numbers from different commits can be compared
+// Run with --benchmark_out=results.json --benchmark_out_format=json to keep them, and compare two runs with
+// compare.py from Google Benchmark's tools
+
+struct View
+{
+	const char * Name;
+	double CenterX;
+	double CenterY;
+	double Zoom;
+};
+
+static const View Views[] =
+{
+	{ "full", -0.5, 0.0, 1.0 }, // Whole set, most samples escape right away and the cardioid check takes the inside
+	{ "seahorse", -0.743643887, 0.131825904, 0.005 }, // Seahorse valley, spirals with a wide spread of counts
+	{ "interior", -0.1226, 0.7449, 0.01 }, // Inside the period 3 bulb, all cycle detection
+	{ "boundary", -0.7746806106269039, -0.1374168856037867, 1e-9 }, // Deep filaments, double only and long orbits
+};
+
+static const uint32_t IterationCaps[] = { 256, 1024, 4096 };
+
+// Views where a few samples take far more iterations than the rest, Direct against Compact mode
+static const View DeepViews[] =
+{
+	{ "minibrot", -1.7864402555, 0.0, 3e-7 }, // Period 3 minibrot on the needle, its inside and the samples around it
+	{ "seahorse", -0.743643887, 0.131825904, 0.0001 },
+};
+static const uint32_t DeepIterations = 65536;
+
+// Kernels run on the calling thread, the thread scaling runs on bigger frames so every worker gets enough tiles
+static const uint32_t KernelSize = 256;
+static const uint32_t ScalingSize = 512;
+static const uint32_t ScalingIterations = 1024;
+
+static RenderRequest MakeRequest(const View& V, uint32_t Iterations, uint32_t Size, KernelPrecision Precision)
+{
+	RenderRequest request;
+	request.CenterX = V.CenterX;
+	request.CenterY = V.CenterY;
+	request.Zoom = V.Zoom;
+	request.Iterations = Iterations;
+	request.Width = Size;
+	request.Height = Size;
+	request.Precision = Precision;
+	return request;
+}
+
+// Sum of every sample's count, on the set counts as the full cap (cardioid and cycle checks included)
+// so it's the iterations a plain kernel would have done, and the same for every kernel
+static uint64_t TotalIterations(Renderer& Render, const RenderRequest& Request)
+{
+	uint64_t total = 0;
+	for (uint32_t count : Render.RenderIterations(Request))
+		total += count;
+	return total;
+}
+
+static void SetRates(benchmark::State& State, const RenderRequest& Request, uint64_t Iterations)
+{
+	const double frames = double(State.iterations());
+	State.counters["Pixels/s"] = benchmark::Counter(frames * Request.Width * Request.Height, benchmark::Counter::kIsRate);
+	State.counters["Iterations/s"] = benchmark::Counter(frames * double(Iterations), benchmark::Counter::kIsRate);
+}
+
+// The block kernel alone, called on every block of the frame in turn. No pool, scheduling or shading
+static void BM_Kernel(benchmark::State& State, View V, uint32_t Iterations, KernelISA ISA, KernelPrecision Precision)
+{
+	Renderer render(1);
+	render.SetISA(ISA);
+	const RenderRequest request = MakeRequest(V, Iterations, KernelSize, Precision);
+	const uint64_t iterations = TotalIterations(render, request);
+
+	const FrameParams frame = MakeFrameParams(request);
+	const BlockKernel kernel = GetBlockKernel(ISA, UseSinglePrecision(frame, ISA, Precision));
+	const uint32_t block = Renderer::MaxBlockSize;
+	vector<uint32_t> iters(4 * size_t(block) * block);
+	for (auto _ : State)
+	{
+		for (uint32_t y = 0; y < frame.Height; y += block)
+		{
+			for (uint32_t x = 0; x < frame.Width; x += block)
+				kernel(frame, x, y, min(block, frame.Width - x), min(block, frame.Height - y), iters.data());
+		}
+		benchmark::DoNotOptimize(iters.data());
+		benchmark::ClobberMemory();
+	}
+	SetRates(State, request, iterations);
+}
+
+static void BM_Mode(benchmark::State& State, View V, KernelISA ISA, RenderMode Mode)
+{
+	Renderer render(1);
+	render.SetISA(ISA);
+	RenderRequest request = MakeRequest(V, DeepIterations, KernelSize, KernelPrecision::Double);
+	request.Mode = Mode;
+	const uint64_t iterations = TotalIterations(render, request);
+
+	vector<uint8_t> buffer(size_t(request.Width) * request.Height * 4);
+	for (auto _ : State)
+		render.Render(request, buffer.data());
+	SetRates(State, request, iterations);
+}
+
+// Seconds per frame on one worker, what the other worker counts are compared against
+// Normally from the 1 worker run, which goes first, measured here only if it was filtered out
+static map<string, double> SingleWorkerTimes;
+
+static double SingleWorkerTime(const View& V)
+{
+	auto found = SingleWorkerTimes.find(V.Name);
+	if (found != SingleWorkerTimes.end())
+		return found->second;
+
+	Renderer render(1);
+	const RenderRequest request = MakeRequest(V, ScalingIterations, ScalingSize, KernelPrecision::Auto);
+	vector<uint8_t> buffer(size_t(request.Width) * request.Height * 4);
+	render.Render(request, buffer.data());
+
+	const int runs = 3;
+	auto start = chrono::high_resolution_clock::now();
+	for (int run = 0; run < runs; run++)
+		render.Render(request, buffer.data());
+	auto end = chrono::high_resolution_clock::now();
+	return SingleWorkerTimes[V.Name] = chrono::duration<double>(end - start).count() / runs;
+}
+
+// Whole renderer, so the pool, the cost pre-pass and tile scheduling are part of it
+// Efficiency is the speedup over one worker divided by the worker count, 1 is perfect scaling
+static void BM_Threads(benchmark::State& State, View V)
+{
+	const uint32_t workers = uint32_t(State.range(0));
+	Renderer render(workers);
+	const RenderRequest request = MakeRequest(V, ScalingIterations, ScalingSize, KernelPrecision::Auto);
+	const uint64_t iterations = TotalIterations(render, request);
+
+	vector<uint8_t> buffer(size_t(request.Width) * request.Height * 4);
+	double elapsed = 0.0;
+	for (auto _ : State)
+	{
+		auto start = chrono::high_resolution_clock::now();
+		render.Render(request, buffer.data());
+		auto end = chrono::high_resolution_clock::now();
+		elapsed += chrono::duration<double>(end - start).count();
+	}
+	SetRates(State, request, iterations);
+
+	if (workers == 1)
+		SingleWorkerTimes[V.Name] = elapsed / double(State.iterations());
+	if (elapsed > 0.0)
+		State.counters["Efficiency"] = SingleWorkerTime(V) * double(State.iterations()) / (elapsed * workers);
+}
+
+// Dispatch overhead alone, jobs that do nothing
+static void BM_WorkerPool(benchmark::State& State)
+{
+	const uint32_t jobs = 4096;
+	WorkerPool pool(uint32_t(State.range(0)));
+	for (auto _ : State)
+		pool.Dispatch(jobs, [](int, int) {}).get();
+	State.counters["Jobs/s"] = benchmark::Counter(double(State.iterations()) * jobs, benchmark::Counter::kIsRate);
+}
+
+// 1, 2, 4... up to the core count, and the core count itself
+static vector<int64_t> WorkerCounts()
+{
+	const int64_t cores = max<int64_t>(thread::hardware_concurrency(), 1);
+	vector<int64_t> counts;
+	for (int64_t count = 1; count < cores; count *= 2)
+		counts.push_back(count);
+	counts.push_back(cores);
+	return counts;
+}
+
+int main(int argc, char ** argv)
+{
+	const KernelISA isas[] = { KernelISA::AVX, KernelISA::AVX2, KernelISA::AVX512 };
+	const KernelPrecision precisions[] = { KernelPrecision::Single, KernelPrecision::Double };
+
+	// Only what the CPU runs, and single precision only on views it resolves
+	Renderer probe(1);
+	for (const View& view : Views)
+	{
+		for (uint32_t cap : IterationCaps)
+		{
+			for (KernelISA isa : isas)
+			{
+				if (isa > DetectISA())
+					continue;
+				probe.SetISA(isa);
+
+				for (KernelPrecision precision : precisions)
+				{
+					if (precision == KernelPrecision::Single && !probe.IsSinglePrecision(MakeRequest(view, cap, KernelSize, KernelPrecision::Auto)))
+						continue;
+
+					const string name = string("Kernel/") + view.Name + "/" + ISAName(isa) + (precision == KernelPrecision::Single ? "/single" : "/double") + "/iterations:" + to_string(cap);
+					benchmark::RegisterBenchmark(name.c_str(), BM_Kernel, view, cap, isa, precision)->Unit(benchmark::kMillisecond)->UseRealTime();
+				}
+			}
+		}
+	}
+
+	for (const View& view : DeepViews)
+	{
+		for (KernelISA isa : isas)
+		{
+			if (isa > DetectISA())
+				continue;
+
+			const string name = string("Mode/") + view.Name + "/" + ISAName(isa);
+			benchmark::RegisterBenchmark((name + "/direct").c_str(), BM_Mode, view, isa, RenderMode::Direct)->Unit(benchmark::kMillisecond)->UseRealTime();
+			benchmark::RegisterBenchmark((name + "/compact").c_str(), BM_Mode, view, isa, RenderMode::Compact)->Unit(benchmark::kMillisecond)->UseRealTime();
+		}
+	}
+
+	for (const View& view : Views)
+	{
+		auto bench = benchmark::RegisterBenchmark((string("Threads/") + view.Name).c_str(), BM_Threads, view)->ArgName("workers")->Unit(benchmark::kMillisecond)->UseRealTime();
+		for (int64_t count : WorkerCounts())
+			bench->Arg(count);
+	}
+
+	auto pool = benchmark::RegisterBenchmark("WorkerPool/dispatch", BM_WorkerPool)->ArgName("workers")->Unit(benchmark::kMicrosecond)->UseRealTime();
+	for (int64_t count : WorkerCounts())
+		pool->Arg(count);
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,621 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include "Renderer.h"
+#include "Animation.h"
+#include "ImageWriter.h"
+#include "LargeImage.h"
+using namespace std;
+
+static void PrintUsage()
+{
+	cout << "Usage : MandelbrotCLI [options]" << endl;
+	cout << "	--center X Y       View center (default 0 0), with as many digits as the zoom needs" << endl;
+	cout << "	--zoom Z           The shorter side of the frame spans 4*Z (default 1)" << endl;
+	cout << "	--iterations N     Max iterations (default 100)" << endl;
+	cout << "	--fractal NAME     mandelbrot, burningship, tricorn, multibrot3 or multibrot4 (default mandelbrot)" << endl;
+	cout << "	--julia X Y        Julia set of the fractal for c = X + iY. Perturbation is Mandelbrot only, double is used instead" << endl;
+	cout << "	--size W H         Output resolution (default 1024 1024)" << endl;
+	cout << "	--threads N        Worker count (default hardware concurrency, or the core count with --pin cores)" << endl;
+	cout << "	--pin P            none, cores or smt : pin workers to physical cores only, or to cores first and then their other" << endl;
+	cout << "	                   hardware threads. Spreads them over NUMA nodes, each node renders its own band (default none)" << endl;
+	cout << "	--isa NAME         Force a kernel : avx, avx2 or avx512 (default widest supported)" << endl;
+	cout << "	--precision P      auto, single, double or perturbation (default auto, picks the first one that resolves the zoom)" << endl;
+	cout << "	--mode M           direct, subdivide or compact (default direct). Subdivide fills uniform rectangles from their border," << endl;
+	cout << "	                   compact iterates in batches of 256 steps and packs the samples still going between them" << endl;
+	cout << "	                   Subdivide needs a connected set, so the Burning Ship and Julia sets of c outside their set go direct" << endl;
+	cout << "	--verify           With subdivide, also iterate the filled samples and report the ones that were wrong" << endl;
+	cout << "	--smooth           Smooth gradients instead of color bands" << endl;
+	cout << "	--aa N             Adaptive antialiasing : 1 sample per pixel, NxN (2, 4 or 8) only on edges. Direct mode only" << endl;
+	cout << "	--palette N        Number of hues the colors cycle through, a power of 2 (default 32)" << endl;
+	cout << "	--palette-offset N Shifts the colors by N iterations" << endl;
+	cout << "	--out FILE         Output file, .png or .ppm (default mandelbrot.ppm), or .dzi for a Deep Zoom tile pyramid" << endl;
+	cout << "	--streamed         Render in bands and write each one as it's done, for images bigger than memory" << endl;
+	cout << "	--budget MS        Render like a view that stays still : frames of MS milliseconds each, every one iterating what's" << endl;
+	cout << "	                   still going a bit further, until every count is final. Shows how fast deep views fill in" << endl;
+	cout << "	--tile-size N      Tiles of the .dzi pyramid (default 256)" << endl;
+	cout << "	--resume           With --streamed to a .ppm, a .dzi or --animate, keep what an interrupted run already wrote" << endl;
+	cout << "	--cache DIR        Keep the iteration counts of rendered tiles in DIR and reuse them on later runs" << endl;
+	cout << "	--cache-size MB    Memory for cached tiles, compressed (default 256). Caches even without --cache" << endl;
+	cout << "	--profile          Print where the time went : busy and idle time per worker, samples and iterations, wake latency" << endl;
+	cout << "	--trace FILE       Write every job of every frame to a Chrome trace (chrome://tracing or ui.perfetto.dev)" << endl;
+	cout << "	--save-iters FILE  Also write the iteration counts, to color them again with --recolor" << endl;
+	cout << "	--recolor FILE     Color counts saved with --save-iters instead of rendering" << endl;
+	cout << "	--batch FILE       Render one frame per line : X Y ZOOM ITERATIONS W H OUT" << endl;
+	cout << "	--animate FILE     Render a zoom path, one keyframe per line : TIME X Y ZOOM ITERATIONS. --out is then a" << endl;
+	cout << "	                   pattern like frame%05d.png, or - for raw RGB24 frames on stdout" << endl;
+	cout << "	--fps N            Frames per second of --animate (default 30)" << endl;
+}
+
+struct Job
+{
+	RenderRequest Request;
+	string OutPath;
+	string ItersPath; // Empty to not save the counts
+};
+
+// --profile and --trace, the traced frames pile up until the end
+static bool PrintProfile = false;
+static string TracePath;
+static vector<FrameStats> TracedFrames;
+
+// Takes what the renderer profiled since the last call, one summary for all of it
+static void ReportProfile(Renderer& Render)
+{
+	vector<FrameStats> frames = Render.TakeFrameStats();
+	if (frames.empty())
+		return;
+
+	if (PrintProfile)
+	{
+		double wall = 0.0, first_job = 0.0;
+		uint64_t iterations = 0, escaped = 0, in_set = 0;
+		vector<WorkerFrameStats> workers(frames[0].Workers.size());
+		for (const FrameStats& frame : frames)
+		{
+			wall += frame.WallMs;
+			first_job = max(first_job, frame.FirstJobMs);
+			iterations += frame.Iterations;
+			escaped += frame.Escaped;
+			in_set += frame.InSet;
+			for (size_t w = 0; w < workers.size() && w < frame.Workers.size(); w++)
+			{
+				workers[w].BusyMs += frame.Workers[w].BusyMs;
+				workers[w].IdleMs += frame.Workers[w].IdleMs;
+				workers[w].Jobs += frame.Workers[w].Jobs;
+			}
+		}
+
+		cout << "	" << frames.size() << (frames.size() == 1 ? " frame, " : " frames, ") << wall << "ms of wall time, first job after at most " << first_job << "ms" << endl;
+		cout << "	" << iterations << " iterations at most, " << escaped << " samples escaped, " << in_set << " on the set" << endl;
+		for (size_t w = 0; w < workers.size(); w++)
+			cout << "	worker " << w << " : " << workers[w].Jobs << " jobs, busy " << workers[w].BusyMs << "ms, idle " << workers[w].IdleMs << "ms" << endl;
+
+		WorkerPool::WakeStats wake = Render.GetWakeStats();
+		Render.ResetWakeStats();
+		cout << "	" << wake.Wakeups << " wake ups, " << (wake.Wakeups ? wake.TotalLatencyUs / wake.Wakeups : 0.0) << "us on average, " << wake.MaxLatencyUs << "us at most" << endl;
+	}
+
+	if (!TracePath.empty())
+		TracedFrames.insert(TracedFrames.end(), frames.begin(), frames.end());
+}
+
+// Exit code, writes the trace on the way out
+static int Finish(bool Ok)
+{
+	if (!TracePath.empty() && !WriteChromeTrace(TracePath, TracedFrames))
+	{
+		cerr << "Failed to write " << TracePath << endl;
+		return 1;
+	}
+	return Ok ? 0 : 1;
+}
+
+static bool RenderJob(Renderer& Render, const Job& J)
+{
+	// Not cleared here, the pages get touched first by the workers that render them
+	const size_t size = size_t(J.Request.Width) * J.Request.Height * 4;
+	unique_ptr<uint8_t[]> buffer(new uint8_t[size]);
+	vector<uint32_t> iters(J.ItersPath.empty() ? 0 : size);
+
+	RenderRequest request = J.Request;
+	request.Stride = 0;
+
+	auto start = chrono::high_resolution_clock::now();
+	if (iters.empty())
+		Render.Render(request, buffer.get());
+	else
+		Render.RenderIterationsAsync(request, iters.data(), buffer.get()).get();
+	auto end = chrono::high_resolution_clock::now();
+
+	if (!iters.empty() && !WriteIterations(J.ItersPath, iters.data(), request.Width, request.Height, request.Iterations, MakeFrameParams(request).Smooth))
+	{
+		cerr << "Failed to write " << J.ItersPath << endl;
+		return false;
+	}
+
+	if (!WriteImage(J.OutPath, buffer.get(), J.Request.Width, J.Request.Height))
+	{
+		cerr << "Failed to write " << J.OutPath << endl;
+		return false;
+	}
+
+	const bool perturbation = Render.IsPerturbation(J.Request);
+	cout << J.OutPath << " : " << J.Request.Width << "x" << J.Request.Height << (perturbation ? " PT" : Render.IsSinglePrecision(J.Request) ? " SP" : " DP")
+		 << " in " << chrono::duration<double, milli>(end - start).count() << "ms" << endl;
+
+	if (perturbation)
+	{
+		PerturbationStats stats = Render.GetPerturbationStats();
+		cout << "	" << stats.References << " references" << (stats.Reused ? " (first one reused)" : "") << ", skipped " << stats.Skipped << " steps, " << stats.Glitched << " glitched samples";
+		if (stats.Unresolved)
+			cout << " (" << stats.Unresolved << " unresolved)";
+		cout << endl;
+	}
+
+	if (J.Request.AdaptiveAA && J.Request.Mode == RenderMode::Direct && !perturbation)
+	{
+		AdaptiveStats stats = Render.GetAdaptiveStats();
+		Render.ResetAdaptiveStats();
+		cout << "	supersampled " << stats.Supersampled << " of " << stats.Pixels << " pixels (" << (stats.Pixels ? 100.0 * stats.Supersampled / stats.Pixels : 0.0) << "%)" << endl;
+	}
+
+	if (auto cache = Render.GetIterationCache())
+	{
+		IterationCacheStats stats = cache->GetStats();
+		cache->ResetStats();
+		cout << "	tile cache : " << stats.MemoryHits + stats.DiskHits << " hits (" << stats.DiskHits << " from disk), " << stats.Misses << " misses, "
+			 << stats.Tiles << " tiles in " << stats.Bytes / 1024 << "KB (" << (stats.Bytes ? double(stats.RawBytes) / stats.Bytes : 0.0) << ":1)" << endl;
+	}
+
+	if (J.Request.Mode == RenderMode::Subdivide)
+	{
+		SubdivisionStats stats = Render.GetSubdivisionStats();
+		Render.ResetSubdivisionStats();
+
+		const uint64_t total = stats.Iterated + stats.Filled;
+		if (!total)
+			cout << "	rendered directly, subdivision doesn't hold on this set" << endl;
+		else
+		{
+			cout << "	iterated " << stats.Iterated << " of " << total << " samples (" << 100.0 * stats.Iterated / total << "%)";
+			if (Render.GetVerifySubdivision())
+				cout << ", " << stats.Mismatched << " filled wrong";
+			cout << endl;
+		}
+	}
+
+	ReportProfile(Render);
+	return true;
+}
+
+// Time budgeted frames of the same view until nothing is left to iterate, only the last one is written
+static bool BudgetJob(Renderer& Render, const Job& J, uint32_t BudgetMs)
+{
+	RenderRequest request = J.Request;
+	request.Stride = 0;
+	if (Render.IsPerturbation(request))
+	{
+		cout << "Perturbation frames can't be budgeted, rendering it whole" << endl;
+		return RenderJob(Render, J);
+	}
+
+	unique_ptr<uint8_t[]> buffer(new uint8_t[size_t(request.Width) * request.Height * 4]);
+	BudgetedFrame state;
+	uint32_t frames = 0;
+
+	auto start = chrono::high_resolution_clock::now();
+	do
+	{
+		Render.RenderBudgetedAsync(request, state, chrono::milliseconds(BudgetMs), buffer.get()).get();
+		frames++;
+		cout << "\r	frame " << frames << " : " << state.Unresolved() << " samples still going after " << state.Steps() << " iterations     " << flush;
+	} while (!Render.IsBudgetedComplete(request, state));
+	auto end = chrono::high_resolution_clock::now();
+	cout << endl;
+
+	if (!WriteImage(J.OutPath, buffer.get(), request.Width, request.Height))
+	{
+		cerr << "Failed to write " << J.OutPath << endl;
+		return false;
+	}
+
+	const double ms = chrono::duration<double, milli>(end - start).count();
+	cout << J.OutPath << " : " << request.Width << "x" << request.Height << (Render.IsSinglePrecision(request) ? " SP" : " DP") << " in " << frames
+		 << " frames of " << BudgetMs << "ms, " << ms << "ms in total" << endl;
+	ReportProfile(Render);
+	return true;
+}
+
+// Streamed image or tile pyramid, never holds more than a few pieces of the frame
+static bool LargeJob(Renderer& Render, const Job& J, const LargeImageOptions& Options)
+{
+	LargeImageOptions options = Options;
+	options.Progress = [](uint64_t Done, uint64_t Total)
+	{
+		cout << "\r	" << (100 * Done / Total) << "%" << flush;
+	};
+
+	const bool pyramid = J.OutPath.size() >= 4 && J.OutPath.compare(J.OutPath.size() - 4, 4, ".dzi") == 0;
+
+	auto start = chrono::high_resolution_clock::now();
+	const bool ok = pyramid ? RenderTilePyramid(Render, J.Request, J.OutPath, options) : RenderStreamedImage(Render, J.Request, J.OutPath, options);
+	auto end = chrono::high_resolution_clock::now();
+	cout << endl;
+
+	if (!ok)
+	{
+		cerr << "Failed to write " << J.OutPath << (Options.Resume ? ", or it has another view than the one resumed" : "") << endl;
+		return false;
+	}
+
+	cout << J.OutPath << " : " << J.Request.Width << "x" << J.Request.Height << (pyramid ? " pyramid" : " streamed") << " in " << chrono::duration<double, milli>(end - start).count() << "ms" << endl;
+	ReportProfile(Render);
+	return true;
+}
+
+// Keyframe path to an image sequence or raw video, frames are pipelined so there are no per frame stats
+static bool AnimationJob(Renderer& Render, const Job& J, const string& KeyframesPath, const AnimationOptions& Options)
+{
+	vector<Keyframe> keyframes;
+	if (!ReadKeyframes(KeyframesPath, keyframes))
+	{
+		cerr << "Can't read keyframes from " << KeyframesPath << endl;
+		return false;
+	}
+
+	AnimationOptions options = Options;
+	options.Progress = [](uint32_t Done, uint32_t Total)
+	{
+		cout << "\r	frame " << Done << " of " << Total << flush;
+	};
+
+	auto start = chrono::high_resolution_clock::now();
+	const bool ok = RenderAnimation(Render, keyframes, J.Request, J.OutPath, options);
+	auto end = chrono::high_resolution_clock::now();
+	cout << endl;
+
+	if (!ok)
+	{
+		cerr << "Failed to write " << J.OutPath << " (it needs a %d for the frame number, or - for stdout)" << endl;
+		return false;
+	}
+
+	const double ms = chrono::duration<double, milli>(end - start).count();
+	const uint32_t frames = AnimationFrameCount(keyframes, options.FrameRate);
+	cout << J.OutPath << " : " << frames << " frames of " << J.Request.Width << "x" << J.Request.Height << " in " << ms << "ms (" << ms / frames << "ms per frame)" << endl;
+	ReportProfile(Render);
+	return true;
+}
+
+// Colors saved counts, the view they came from doesn't matter, only the size and the iterations
+static bool RecolorJob(Renderer& Render, const string& ItersPath, const string& OutPath)
+{
+	RenderRequest request;
+	vector<uint32_t> iters;
+	if (!ReadIterations(ItersPath, iters, request.Width, request.Height, request.Iterations, request.Smooth))
+	{
+		cerr << "Can't read " << ItersPath << endl;
+		return false;
+	}
+
+	auto start = chrono::high_resolution_clock::now();
+	auto buffer = Render.Colorize(request, iters.data());
+	auto end = chrono::high_resolution_clock::now();
+
+	if (!WriteImage(OutPath, buffer.data(), request.Width, request.Height))
+	{
+		cerr << "Failed to write " << OutPath << endl;
+		return false;
+	}
+
+	cout << OutPath << " : " << request.Width << "x" << request.Height << " recolored in " << chrono::duration<double, milli>(end - start).count() << "ms" << endl;
+	ReportProfile(Render);
+	return true;
+}
+
+int main(int argc, char ** argv)
+{
+	Job job;
+	job.OutPath = "mandelbrot.ppm";
+	uint32_t threads = 0; // 0 until --threads, then the default for the pinning
+	WorkerPinning pinning = WorkerPinning::None;
+	string batch_path;
+	string isa_name;
+	string recolor_path;
+	string animate_path;
+	AnimationOptions animation;
+	string cache_dir;
+	size_t cache_mb = 0; // 0 until --cache-size
+	bool verify = false;
+	bool streamed = false;
+	uint32_t budget_ms = 0; // 0 without --budget
+	LargeImageOptions large;
+	Palette palette = HuePalette();
+
+	for (int i = 1; i < argc; i++)
+	{
+		auto has_args = [&](int Count)
+		{
+			if (i + Count >= argc)
+			{
+				cerr << "Missing value for " << argv[i] << endl;
+				exit(1);
+			}
+			return true;
+		};
+
+		if (!strcmp(argv[i], "--center") && has_args(2))
+		{
+			job.Request.PreciseCenterX = argv[++i];
+			job.Request.PreciseCenterY = argv[++i];
+			job.Request.CenterX = atof(job.Request.PreciseCenterX.c_str());
+			job.Request.CenterY = atof(job.Request.PreciseCenterY.c_str());
+		}
+		else if (!strcmp(argv[i], "--zoom") && has_args(1))
+			job.Request.Zoom = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--iterations") && has_args(1))
+			job.Request.Iterations = strtoul(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "--fractal") && has_args(1))
+		{
+			string name = argv[++i];
+			bool found = false;
+			for (Fractal formula : { Fractal::Mandelbrot, Fractal::BurningShip, Fractal::Tricorn, Fractal::Multibrot3, Fractal::Multibrot4 })
+			{
+				if (name == FractalName(formula))
+				{
+					job.Request.Formula = formula;
+					found = true;
+				}
+			}
+			if (!found)
+			{
+				cerr << "Unknown fractal " << name << endl;
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "--julia") && has_args(2))
+		{
+			job.Request.Julia = true;
+			job.Request.JuliaX = atof(argv[++i]);
+			job.Request.JuliaY = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--size") && has_args(2))
+		{
+			job.Request.Width = strtoul(argv[++i], nullptr, 10);
+			job.Request.Height = strtoul(argv[++i], nullptr, 10);
+		}
+		else if (!strcmp(argv[i], "--threads") && has_args(1))
+			threads = max(strtoul(argv[++i], nullptr, 10), 1ul);
+		else if (!strcmp(argv[i], "--pin") && has_args(1))
+		{
+			string pin = argv[++i];
+			if (pin == "none")
+				pinning = WorkerPinning::None;
+			else if (pin == "cores")
+				pinning = WorkerPinning::Cores;
+			else if (pin == "smt")
+				pinning = WorkerPinning::CoresThenSMT;
+			else
+			{
+				cerr << "Unknown pinning " << pin << endl;
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "--isa") && has_args(1))
+			isa_name = argv[++i];
+		else if (!strcmp(argv[i], "--precision") && has_args(1))
+		{
+			string precision = argv[++i];
+			if (precision == "auto")
+				job.Request.Precision = KernelPrecision::Auto;
+			else if (precision == "single")
+				job.Request.Precision = KernelPrecision::Single;
+			else if (precision == "double")
+				job.Request.Precision = KernelPrecision::Double;
+			else if (precision == "perturbation")
+				job.Request.Precision = KernelPrecision::Perturbation;
+			else
+			{
+				cerr << "Unknown precision " << precision << endl;
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "--mode") && has_args(1))
+		{
+			string mode = argv[++i];
+			if (mode == "direct")
+				job.Request.Mode = RenderMode::Direct;
+			else if (mode == "subdivide")
+				job.Request.Mode = RenderMode::Subdivide;
+			else if (mode == "compact")
+				job.Request.Mode = RenderMode::Compact;
+			else
+			{
+				cerr << "Unknown mode " << mode << endl;
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "--verify"))
+			verify = true;
+		else if (!strcmp(argv[i], "--smooth"))
+			job.Request.Smooth = true;
+		else if (!strcmp(argv[i], "--aa") && has_args(1))
+		{
+			const uint32_t rate = strtoul(argv[++i], nullptr, 10);
+			if (rate != 2 && rate != 4 && rate != 8)
+			{
+				cerr << "Adaptive AA has to be 2, 4 or 8" << endl;
+				return 1;
+			}
+			job.Request.AdaptiveAA = rate;
+		}
+		else if (!strcmp(argv[i], "--palette") && has_args(1))
+		{
+			const uint32_t size = strtoul(argv[++i], nullptr, 10);
+			if (size == 0 || (size & (size - 1)))
+			{
+				cerr << "Palette size has to be a power of 2" << endl;
+				return 1;
+			}
+			const uint32_t offset = palette.Offset;
+			palette = HuePalette(size);
+			palette.Offset = offset;
+		}
+		else if (!strcmp(argv[i], "--palette-offset") && has_args(1))
+			palette.Offset = strtoul(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "--out") && has_args(1))
+			job.OutPath = argv[++i];
+		else if (!strcmp(argv[i], "--streamed"))
+			streamed = true;
+		else if (!strcmp(argv[i], "--budget") && has_args(1))
+		{
+			budget_ms = strtoul(argv[++i], nullptr, 10);
+			if (!budget_ms)
+			{
+				cerr << "Invalid frame budget" << endl;
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "--tile-size") && has_args(1))
+		{
+			large.TileSize = strtoul(argv[++i], nullptr, 10);
+			if (large.TileSize < 2 || (large.TileSize & 1))
+			{
+				cerr << "Tile size has to be even" << endl;
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "--resume"))
+			large.Resume = true;
+		else if (!strcmp(argv[i], "--cache") && has_args(1))
+			cache_dir = argv[++i];
+		else if (!strcmp(argv[i], "--cache-size") && has_args(1))
+			cache_mb = max(strtoul(argv[++i], nullptr, 10), 1ul);
+		else if (!strcmp(argv[i], "--profile"))
+			PrintProfile = true;
+		else if (!strcmp(argv[i], "--trace") && has_args(1))
+			TracePath = argv[++i];
+		else if (!strcmp(argv[i], "--save-iters") && has_args(1))
+			job.ItersPath = argv[++i];
+		else if (!strcmp(argv[i], "--recolor") && has_args(1))
+			recolor_path = argv[++i];
+		else if (!strcmp(argv[i], "--batch") && has_args(1))
+			batch_path = argv[++i];
+		else if (!strcmp(argv[i], "--animate") && has_args(1))
+			animate_path = argv[++i];
+		else if (!strcmp(argv[i], "--fps") && has_args(1))
+		{
+			animation.FrameRate = atof(argv[++i]);
+			if (animation.FrameRate <= 0.0)
+			{
+				cerr << "Invalid frame rate" << endl;
+				return 1;
+			}
+		}
+		else
+		{
+			PrintUsage();
+			return strcmp(argv[i], "--help") ? 1 : 0;
+		}
+	}
+
+	if (job.Request.Width == 0 || job.Request.Height == 0)
+	{
+		cerr << "Invalid size" << endl;
+		return 1;
+	}
+
+	// Raw frames go to stdout, so everything else goes to stderr
+	if (!animate_path.empty() && job.OutPath == "-")
+		cout.rdbuf(cerr.rdbuf());
+
+	if (!threads)
+		threads = pinning == WorkerPinning::None ? thread::hardware_concurrency() : DefaultWorkerCount(DetectTopology(), pinning);
+	Renderer renderer(threads, pinning);
+
+	if (isa_name == "avx")
+		renderer.SetISA(KernelISA::AVX);
+	else if (isa_name == "avx2")
+		renderer.SetISA(KernelISA::AVX2);
+	else if (isa_name == "avx512")
+		renderer.SetISA(KernelISA::AVX512);
+	else if (!isa_name.empty())
+	{
+		cerr << "Unknown instruction set " << isa_name << endl;
+		return 1;
+	}
+	cout << "Using " << ISAName(renderer.GetISA()) << " kernel" << endl;
+	renderer.SetVerifySubdivision(verify);
+	renderer.SetPalette(palette);
+	renderer.SetProfiling(PrintProfile || !TracePath.empty(), !TracePath.empty());
+	if (!cache_dir.empty() || cache_mb)
+		renderer.SetIterationCache(make_shared<IterationCache>((cache_mb ? cache_mb : 256) << 20, cache_dir));
+
+	if (!recolor_path.empty())
+		return Finish(RecolorJob(renderer, recolor_path, job.OutPath));
+
+	if (!animate_path.empty())
+	{
+		animation.Resume = large.Resume;
+		return Finish(AnimationJob(renderer, job, animate_path, animation));
+	}
+
+	const bool pyramid = job.OutPath.size() >= 4 && job.OutPath.compare(job.OutPath.size() - 4, 4, ".dzi") == 0;
+	if (batch_path.empty() && (streamed || pyramid))
+		return Finish(LargeJob(renderer, job, large));
+
+	if (batch_path.empty() && budget_ms)
+		return Finish(BudgetJob(renderer, job, budget_ms));
+
+	if (batch_path.empty())
+		return Finish(RenderJob(renderer, job));
+
+	ifstream batch(batch_path);
+	if (!batch)
+	{
+		cerr << "Can't open " << batch_path << endl;
+		return 1;
+	}
+
+	int failed = 0;
+	string line;
+	while (getline(batch, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		Job batch_job;
+		batch_job.Request.Precision = job.Request.Precision;
+		batch_job.Request.Mode = job.Request.Mode;
+		batch_job.Request.Smooth = job.Request.Smooth;
+		batch_job.Request.AdaptiveAA = job.Request.AdaptiveAA;
+		batch_job.Request.Formula = job.Request.Formula;
+		batch_job.Request.Julia = job.Request.Julia;
+		batch_job.Request.JuliaX = job.Request.JuliaX;
+		batch_job.Request.JuliaY = job.Request.JuliaY;
+		istringstream values(line);
+		values >> batch_job.Request.PreciseCenterX >> batch_job.Request.PreciseCenterY >> batch_job.Request.Zoom >> batch_job.Request.Iterations
+			   >> batch_job.Request.Width >> batch_job.Request.Height >> batch_job.OutPath;
+		batch_job.Request.CenterX = atof(batch_job.Request.PreciseCenterX.c_str());
+		batch_job.Request.CenterY = atof(batch_job.Request.PreciseCenterY.c_str());
+
+		if (!values || batch_job.Request.Width == 0 || batch_job.Request.Height == 0)
+		{
+			cerr << "Skipping invalid line : " << line << endl;
+			failed++;
+			continue;
+		}
+
+		if (!RenderJob(renderer, batch_job))
+			failed++;
+	}
+
+	return Finish(failed == 0);
+}
@@ -0,0 +1,193 @@
+#include "Adaptive.h"
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+#include <vector>
+
+namespace
+{
+	// Per thread so the lists keep their memory from one block to the next
+	struct AdaptiveScratch
+	{
+		std::vector<SamplePoint> Points;
+		std::vector<uint32_t> Base; // One count per pixel of the block and its border
+		std::vector<float> Colors; // And its color, 4 floats each
+		std::vector<uint8_t> EdgeFlags; // Per pixel of the block and its border
+		std::vector<uint32_t> Edges; // Block pixels that get the full grid
+		std::vector<uint32_t> EdgeIters; // Rate*Rate - 1 per edge, the first sample is the base one
+	};
+
+	// Color sums are in ShadeTable units, 1/4 of 0-255
+	__m128 LoadColor(const float * Color)
+	{
+		return _mm_loadu_ps(Color);
+	}
+
+	void StorePixel(uint8_t * Dst, __m128 Color)
+	{
+		__m128i rgba = _mm_cvtps_epi32(Color);
+		rgba = _mm_packs_epi32(rgba, rgba);
+		rgba = _mm_packus_epi16(rgba, rgba);
+		rgba = _mm_or_si128(rgba, _mm_set1_epi32(0xFF000000));
+		*(int32_t*)Dst = _mm_cvtsi128_si32(rgba);
+	}
+}
+
+FrameParams AdaptiveSampleFrame(const FrameParams& Frame, uint32_t Rate)
+{
+	// Kernels put sample (x,y) at pixel (x/2, y/2), Rate is a power of 2 so this is exact
+	FrameParams frame = Frame;
+	frame.CoeffA_X = Frame.CoeffA_X * (2.0 / Rate);
+	frame.CoeffA_Y = Frame.CoeffA_Y * (2.0 / Rate);
+	frame.OriginX = Frame.OriginX * (Rate / 2);
+	frame.OriginY = Frame.OriginY * (Rate / 2);
+	return frame;
+}
+
+AdaptiveStats AdaptiveBlock(const FrameParams& Frame, SampleKernel BaseKernel, SampleKernel EdgeKernel, uint32_t Rate, const ShadeTable& Table,
+	uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters, uint8_t * Buffer)
+{
+	static thread_local AdaptiveScratch scratch;
+	// Points go on the whole image, so a region looks past its own border and finds the edges the whole image has there
+	FrameParams sample_frame = AdaptiveSampleFrame(Frame, Rate);
+	sample_frame.OriginX = 0;
+	sample_frame.OriginY = 0;
+	const uint32_t block_x = Frame.OriginX + BlockX;
+	const uint32_t block_y = Frame.OriginY + BlockY;
+
+	// The block plus a pixel all around, clipped to the image
+	const uint32_t x0 = block_x > 0 ? block_x - 1 : 0;
+	const uint32_t y0 = block_y > 0 ? block_y - 1 : 0;
+	const uint32_t x1 = std::min(block_x + SizeX, Frame.ImageWidth - 1);
+	const uint32_t y1 = std::min(block_y + SizeY, Frame.ImageHeight - 1);
+	const uint32_t width = x1 - x0 + 1;
+	const uint32_t height = y1 - y0 + 1;
+
+	scratch.Points.clear();
+	for (uint32_t y = y0; y <= y1; y++)
+	{
+		for (uint32_t x = x0; x <= x1; x++)
+			scratch.Points.push_back({ Rate * x, Rate * y });
+	}
+	scratch.Base.resize(scratch.Points.size());
+	BaseKernel(sample_frame, scratch.Points.data(), uint32_t(scratch.Points.size()), scratch.Base.data());
+
+	scratch.Colors.resize(4 * scratch.Base.size());
+	for (size_t i = 0; i < scratch.Base.size(); i++)
+		ShadeSample(Frame, Table, scratch.Base[i], scratch.Colors.data() + 4 * i);
+
+	// Edges, the threshold goes to table units
+	const float threshold = AdaptiveEdgeThreshold * 0.25f;
+	auto differs = [&](uint32_t A, uint32_t B)
+	{
+		if (scratch.Base[A] == scratch.Base[B])
+			return false;
+
+		const float * a = scratch.Colors.data() + 4 * A;
+		const float * b = scratch.Colors.data() + 4 * B;
+		return std::abs(a[0] - b[0]) + std::abs(a[1] - b[1]) + std::abs(a[2] - b[2]) > threshold;
+	};
+
+	// Each pair of neighbours is only compared once, and marks both
+	scratch.EdgeFlags.assign(scratch.Base.size(), 0);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const uint32_t center = y * width + x;
+			auto mark = [&](uint32_t Neighbour)
+			{
+				if (differs(center, Neighbour))
+				{
+					scratch.EdgeFlags[center] = 1;
+					scratch.EdgeFlags[Neighbour] = 1;
+				}
+			};
+
+			if (x + 1 < width)
+				mark(center + 1);
+			if (y + 1 < height)
+			{
+				mark(center + width);
+				if (x > 0)
+					mark(center + width - 1);
+				if (x + 1 < width)
+					mark(center + width + 1);
+			}
+		}
+	}
+
+	scratch.Edges.clear();
+	for (uint32_t j = 0; j < SizeY; j++)
+	{
+		const uint8_t * flags = scratch.EdgeFlags.data() + (block_y + j - y0) * width + (block_x - x0);
+		for (uint32_t i = 0; i < SizeX; i++)
+		{
+			if (flags[i])
+				scratch.Edges.push_back(j * SizeX + i);
+		}
+	}
+
+	// Every sample of the edges but the first, which is the base one
+	const uint32_t per_edge = Rate * Rate - 1;
+	scratch.Points.clear();
+	for (uint32_t pixel : scratch.Edges)
+	{
+		const uint32_t x = block_x + pixel % SizeX;
+		const uint32_t y = block_y + pixel / SizeX;
+		for (uint32_t sub = 1; sub <= per_edge; sub++)
+			scratch.Points.push_back({ Rate * x + sub % Rate, Rate * y + sub / Rate });
+	}
+	scratch.EdgeIters.resize(scratch.Points.size());
+	if (!scratch.Points.empty())
+		EdgeKernel(sample_frame, scratch.Points.data(), uint32_t(scratch.Points.size()), scratch.EdgeIters.data());
+
+	// Flat pixels first, as if all 4 samples had the base count. Then the edges on top
+	for (uint32_t j = 0; j < SizeY; j++)
+	{
+		const uint32_t row = (block_y + j - y0) * width + (block_x - x0);
+		for (uint32_t i = 0; i < SizeX; i++)
+		{
+			if (Buffer)
+				StorePixel(Buffer + size_t(BlockY + j) * Frame.Stride + 4 * size_t(BlockX + i), _mm_mul_ps(LoadColor(scratch.Colors.data() + 4 * (row + i)), _mm_set1_ps(4.0f)));
+			if (Iters)
+				std::fill(Iters + 4 * (size_t(j) * SizeX + i), Iters + 4 * (size_t(j) * SizeX + i + 1), scratch.Base[row + i]);
+		}
+	}
+
+	const __m128 scale = _mm_set1_ps(4.0f / float(Rate * Rate));
+	const uint32_t half = Rate / 2;
+	for (size_t e = 0; e < scratch.Edges.size(); e++)
+	{
+		const uint32_t i = scratch.Edges[e] % SizeX;
+		const uint32_t j = scratch.Edges[e] / SizeX;
+		const uint32_t base = (block_y + j - y0) * width + (block_x + i - x0);
+		const uint32_t * samples = scratch.EdgeIters.data() + e * per_edge;
+
+		if (Buffer)
+		{
+			__m128 sum = LoadColor(scratch.Colors.data() + 4 * base);
+			alignas(16) float color[4];
+			for (uint32_t sub = 0; sub < per_edge; sub++)
+			{
+				ShadeSample(Frame, Table, samples[sub], color);
+				sum = _mm_add_ps(sum, _mm_load_ps(color));
+			}
+			StorePixel(Buffer + size_t(BlockY + j) * Frame.Stride + 4 * size_t(BlockX + i), _mm_mul_ps(sum, scale));
+		}
+
+		// The SSAA samples are at 0 and half a pixel
+		if (Iters)
+		{
+			uint32_t * pixel_iters = Iters + 4 * size_t(scratch.Edges[e]);
+			pixel_iters[1] = samples[half - 1];
+			pixel_iters[2] = samples[half * Rate - 1];
+			pixel_iters[3] = samples[half * Rate + half - 1];
+		}
+	}
+
+	AdaptiveStats stats;
+	stats.Pixels = uint64_t(SizeX) * SizeY;
+	stats.Supersampled = scratch.Edges.size();
+	return stats;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include "Kernels.h"
+#include "Palette.h"
+
+// What adaptive antialiasing did, counted in pixels
+struct AdaptiveStats
+{
+	uint64_t Pixels = 0;
+	uint64_t Supersampled = 0; // Pixels that were on an edge and got the full grid
+};
+
+// Largest adaptive grid, 8x8 samples per pixel
+const uint32_t MaxAdaptiveRate = 8;
+
+// Pixels whose color differs from a neighbour by more than this (R+G+B, 0-255 each) are edges
+const float AdaptiveEdgeThreshold = 12.0f;
+
+// Adaptive antialiasing : every pixel gets one sample first, and only the ones on an edge (a neighbour, diagonals
+// included, with a different color) get Rate x Rate samples, which are averaged. Flat areas cost a quarter of the
+// fixed 2x2 SSAA, and edges can get more than it. Rate is 2, 4 or 8, with 2 the samples are the same as the SSAA ones
+// BaseKernel iterates the first sample of every pixel and EdgeKernel the rest, as those are closer together they might
+// need more precision. Neighbours outside the block are iterated too, even past the border of a region, so edges
+// don't depend on the tiling or on the image being rendered in pieces
+// Writes the colors to Buffer (the whole frame, can be null) and, if Iters isn't null, 4 counts per pixel in the
+// layout of the block kernels : the 2x2 SSAA samples on edges, the single sample repeated everywhere else
+AdaptiveStats AdaptiveBlock(const FrameParams& Frame, SampleKernel BaseKernel, SampleKernel EdgeKernel, uint32_t Rate, const ShadeTable& Table,
+	uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters, uint8_t * Buffer);
+
+// Frame the kernels get for adaptive samples : sample (x,y) of the SampleKernel is at pixel (x/Rate, y/Rate)
+FrameParams AdaptiveSampleFrame(const FrameParams& Frame, uint32_t Rate);
@@ -0,0 +1,283 @@
+#include "Animation.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include "BigFixed.h"
+#include "ImageWriter.h"
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace
+{
+	// Frames queued on the renderer at once, one rendering while the other is written is enough to overlap them
+	const uint32_t FramesInFlight = 2;
+
+	// Splits a pattern like frame%05d.png around its %d, false if it doesn't have exactly one
+	bool ParsePattern(const std::string& Pattern, std::string& Prefix, std::string& Suffix, uint32_t& Width)
+	{
+		const size_t percent = Pattern.find('%');
+		if (percent == std::string::npos || Pattern.find('%', percent + 1) != std::string::npos)
+			return false;
+
+		size_t pos = percent + 1;
+		Width = 0;
+		while (pos < Pattern.size() && isdigit((unsigned char)Pattern[pos]))
+			Width = std::min(Width * 10 + uint32_t(Pattern[pos++] - '0'), 32u);
+		if (pos >= Pattern.size() || Pattern[pos] != 'd')
+			return false;
+
+		Prefix = Pattern.substr(0, percent);
+		Suffix = Pattern.substr(pos + 1);
+		return true;
+	}
+
+	bool FileExists(const std::string& Path)
+	{
+		FILE * file = fopen(Path.c_str(), "rb");
+		if (!file)
+			return false;
+		fclose(file);
+		return true;
+	}
+
+	bool SameView(const RenderRequest& A, const RenderRequest& B)
+	{
+		return A.CenterX == B.CenterX && A.CenterY == B.CenterY && A.PreciseCenterX == B.PreciseCenterX && A.PreciseCenterY == B.PreciseCenterY &&
+			A.Zoom == B.Zoom && A.Iterations == B.Iterations;
+	}
+
+	// Drops alpha, in place
+	size_t PackRGB(std::vector<uint8_t>& Pixels)
+	{
+		const size_t count = Pixels.size() / 4;
+		for (size_t i = 0; i < count; i++)
+		{
+			Pixels[3 * i + 0] = Pixels[4 * i + 0];
+			Pixels[3 * i + 1] = Pixels[4 * i + 1];
+			Pixels[3 * i + 2] = Pixels[4 * i + 2];
+		}
+		return 3 * count;
+	}
+}
+
+bool ReadKeyframes(const std::string& Path, std::vector<Keyframe>& Keyframes)
+{
+	std::ifstream file(Path);
+	if (!file)
+		return false;
+
+	Keyframes.clear();
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#' || line.find_first_not_of(" \t\r") == std::string::npos)
+			continue;
+
+		Keyframe key;
+		std::istringstream values(line);
+		values >> key.Time >> key.CenterX >> key.CenterY >> key.Zoom >> key.Iterations;
+
+		BigFixed check;
+		if (!values || key.Zoom <= 0.0 || key.Iterations == 0 || !BigFixed::FromString(key.CenterX, 2, check) || !BigFixed::FromString(key.CenterY, 2, check))
+			return false;
+		if (!Keyframes.empty() && key.Time <= Keyframes.back().Time)
+			return false;
+		Keyframes.push_back(key);
+	}
+	return !Keyframes.empty();
+}
+
+RenderRequest InterpolateKeyframes(const std::vector<Keyframe>& Keyframes, double Time, const RenderRequest& Base)
+{
+	size_t next = 1;
+	while (next + 1 < Keyframes.size() && Keyframes[next].Time < Time)
+		next++;
+	const Keyframe& from = Keyframes[next < Keyframes.size() ? next - 1 : 0];
+	const Keyframe& to = Keyframes[std::min(next, Keyframes.size() - 1)];
+
+	const double span = to.Time - from.Time;
+	const double s = span > 0.0 ? std::min(std::max((Time - from.Time) / span, 0.0), 1.0) : 0.0;
+
+	RenderRequest request = Base;
+	const double ratio = std::log(to.Zoom / from.Zoom);
+	request.Zoom = from.Zoom * std::exp(s * ratio);
+	request.Iterations = uint32_t(std::lround(from.Iterations + s * (double(to.Iterations) - double(from.Iterations))));
+
+	// Scaling around a fixed screen point p, center = p + (from - p) * zoom / from zoom, with p picked so it ends on to
+	// That puts the center at from + (to - from) * w, w = expm1(s ratio) / expm1(ratio), and the same zoom is a plain pan
+	// The offset is only a double, so it goes from whichever end is closer, the far side would lose the deep end's digits
+	double w = s, rest = 1.0 - s;
+	if (ratio != 0.0)
+	{
+		w = std::expm1(s * ratio) / std::expm1(ratio);
+		rest = std::exp(s * ratio) * std::expm1((1.0 - s) * ratio) / std::expm1(ratio);
+	}
+
+	const double pixel_size = 4.0 * std::min(from.Zoom, to.Zoom) / double(std::max(std::min(Base.Width, Base.Height), 1u));
+	const uint32_t limbs = BigFixed::LimbsFor(0.25 * pixel_size);
+	BigFixed from_x, from_y, to_x, to_y;
+	BigFixed::FromString(from.CenterX, limbs, from_x);
+	BigFixed::FromString(from.CenterY, limbs, from_y);
+	BigFixed::FromString(to.CenterX, limbs, to_x);
+	BigFixed::FromString(to.CenterY, limbs, to_y);
+
+	const double dx = (to_x - from_x).ToDouble();
+	const double dy = (to_y - from_y).ToDouble();
+	const BigFixed x = w <= 0.5 ? from_x + BigFixed::FromDouble(dx * w, limbs) : to_x - BigFixed::FromDouble(dx * rest, limbs);
+	const BigFixed y = w <= 0.5 ? from_y + BigFixed::FromDouble(dy * w, limbs) : to_y - BigFixed::FromDouble(dy * rest, limbs);
+
+	request.CenterX = x.ToDouble();
+	request.CenterY = y.ToDouble();
+	request.PreciseCenterX = x.ToString();
+	request.PreciseCenterY = y.ToString();
+	return request;
+}
+
+uint32_t AnimationFrameCount(const std::vector<Keyframe>& Keyframes, double FrameRate)
+{
+	if (Keyframes.empty() || FrameRate <= 0.0)
+		return 0;
+	return uint32_t(std::floor((Keyframes.back().Time - Keyframes.front().Time) * FrameRate + 1e-9)) + 1;
+}
+
+bool RenderAnimation(Renderer& Render, const std::vector<Keyframe>& Keyframes, const RenderRequest& Base, const std::string& Output, const AnimationOptions& Options)
+{
+	const uint32_t frame_count = AnimationFrameCount(Keyframes, Options.FrameRate);
+	if (frame_count == 0 || Base.Width == 0 || Base.Height == 0)
+		return false;
+
+	const bool raw = Output == "-";
+	std::string prefix, suffix;
+	uint32_t digits = 0;
+	if (!raw && !ParsePattern(Output, prefix, suffix, digits))
+		return false;
+
+	auto frame_path = [&](uint32_t Index)
+	{
+		std::string number = std::to_string(Index);
+		if (number.size() < digits)
+			number.insert(0, digits - number.size(), '0');
+		return prefix + number + suffix;
+	};
+
+#if defined(_WIN32)
+	if (raw)
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+	const float headroom = Render.GetReferenceHeadroom();
+	Render.SetReferenceHeadroom(Options.ReferenceHeadroom);
+
+	RenderRequest base = Base;
+	base.Stride = 0;
+	base.RegionX = base.RegionY = base.RegionWidth = base.RegionHeight = 0;
+
+	// Before the pool, jobs still running when it drains write to it
+	std::atomic<bool> failed{ false };
+	WorkerPool writers(std::max(Options.WriterThreads, 1u));
+	std::deque<std::future<void>> writes;
+
+	// A frame with the same view as the one before shares its pixels
+	struct Frame
+	{
+		uint32_t Index;
+		RenderRequest Request;
+		std::shared_ptr<std::vector<uint8_t>> Pixels;
+		std::shared_future<void> Done;
+	};
+	std::deque<Frame> frames;
+
+	auto finish_frame = [&](Frame& F)
+	{
+		F.Done.get();
+		if (raw)
+		{
+			// Packed in a copy, a held frame still needs its pixels
+			std::vector<uint8_t> rgb = *F.Pixels;
+			const size_t size = PackRGB(rgb);
+			if (fwrite(rgb.data(), 1, size, stdout) != size)
+				failed = true;
+			return;
+		}
+
+		// Writes go to the pool, and the backlog is kept short so memory stays bounded
+		while (writes.size() >= 2 * std::max(Options.WriterThreads, 1u))
+		{
+			writes.front().get();
+			writes.pop_front();
+		}
+		const std::string path = frame_path(F.Index);
+		auto pixels = F.Pixels;
+		const uint32_t width = base.Width, height = base.Height;
+		writes.push_back(writers.Dispatch(1, [&failed, path, pixels, width, height](int, int)
+		{
+			if (!WriteImage(path, pixels->data(), width, height))
+				failed = true;
+		}));
+	};
+
+	uint32_t done = 0;
+	for (uint32_t index = 0; index < frame_count && !failed; index++)
+	{
+		if (!raw && Options.Resume && FileExists(frame_path(index)))
+		{
+			if (Options.Progress)
+				Options.Progress(++done, frame_count);
+			continue;
+		}
+
+		// Queueing the next frame waits for the one before it to be scheduled, then it renders while that one is written
+		if (frames.size() >= FramesInFlight)
+		{
+			finish_frame(frames.front());
+			frames.pop_front();
+			if (Options.Progress)
+				Options.Progress(++done, frame_count);
+		}
+
+		Frame frame;
+		frame.Index = index;
+		frame.Request = InterpolateKeyframes(Keyframes, Keyframes.front().Time + index / Options.FrameRate, base);
+		if (!frames.empty() && SameView(frames.back().Request, frame.Request))
+		{
+			frame.Pixels = frames.back().Pixels;
+			frame.Done = frames.back().Done;
+		}
+		else
+		{
+			frame.Pixels = std::make_shared<std::vector<uint8_t>>(size_t(base.Width) * base.Height * 4);
+			frame.Done = Render.RenderAsync(frame.Request, frame.Pixels->data()).share();
+		}
+		frames.push_back(std::move(frame));
+	}
+
+	while (!frames.empty())
+	{
+		if (!failed)
+		{
+			finish_frame(frames.front());
+			if (Options.Progress)
+				Options.Progress(++done, frame_count);
+		}
+		else
+		{
+			frames.front().Done.wait();
+		}
+		frames.pop_front();
+	}
+	for (std::future<void>& write : writes)
+		write.wait();
+
+	if (raw && fflush(stdout) != 0)
+		failed = true;
+	Render.SetReferenceHeadroom(headroom);
+	return !failed;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Renderer.h"
+
+// Zoom videos : a path of keyframes rendered to a numbered image sequence or a raw video stream
+// Frames go through RenderAsync back to back, so the next one is on the workers while the last one is written
+
+// Where the view is at Time, in seconds
+struct Keyframe
+{
+	double Time = 0.0;
+	std::string CenterX; // Decimal, with as many digits as the zoom needs
+	std::string CenterY;
+	double Zoom = 1.0;
+	uint32_t Iterations = 100;
+};
+
+// One keyframe per line : TIME X Y ZOOM ITERATIONS. Empty lines and lines starting with # are skipped
+// Times have to go up from one line to the next. Returns false if the file can't be read or a line is wrong
+bool ReadKeyframes(const std::string& Path, std::vector<Keyframe>& Keyframes);
+
+// View at Time, between the keyframes around it (clamped to the first and last). Everything but the view comes from Base
+// The zoom is exponential in time, and the view scales around the one point of the screen that lands on the next
+// keyframe's center, like zooming with the mouse wheel. Two keyframes with the same zoom pan in a straight line
+// Iterations go linearly from one keyframe to the other
+RenderRequest InterpolateKeyframes(const std::vector<Keyframe>& Keyframes, double Time, const RenderRequest& Base);
+
+struct AnimationOptions
+{
+	double FrameRate = 30.0;
+	bool Resume = false; // Image sequences only, frames whose file is already there are skipped
+	uint32_t WriterThreads = 2; // Image files are compressed and written on these, the renderer's workers keep going
+
+	// Perturbation frames use their reference orbits for this many more iterations so the next frames can take them over
+	// (see Renderer::SetReferenceHeadroom), the renderer goes back to its own setting afterwards
+	float ReferenceHeadroom = 0.25f;
+
+	// Called on the calling thread as frames are done, skipped ones included
+	std::function<void(uint32_t Done, uint32_t Total)> Progress;
+};
+
+// Frames the path takes, from the first keyframe to the last one
+uint32_t AnimationFrameCount(const std::vector<Keyframe>& Keyframes, double FrameRate);
+
+// Renders every frame of the path. Output is either a file name with one %d in it for the frame number (it can have
+// a width, like frame%05d.png), or "-" for raw RGB24 frames on stdout, one after the other with nothing in between
+// Frames that show the same view as the one before aren't rendered again
+bool RenderAnimation(Renderer& Render, const std::vector<Keyframe>& Keyframes, const RenderRequest& Base, const std::string& Output, const AnimationOptions& Options);
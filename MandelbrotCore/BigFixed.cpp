@@ -0,0 +1,269 @@
+#include "BigFixed.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+
+BigFixed::BigFixed(uint32_t FractionLimbs) : Limbs(FractionLimbs + 1, 0)
+{
+}
+
+uint32_t BigFixed::LimbsFor(double Resolution)
+{
+	// 64 bits below the resolution covers the error the orbit builds up over a long run
+	const double bits = std::max(0.0, -std::log2(std::abs(Resolution))) + 64.0;
+	return uint32_t(std::ceil(bits / 32.0));
+}
+
+BigFixed BigFixed::FromDouble(double Value, uint32_t FractionLimbs)
+{
+	BigFixed result(FractionLimbs);
+	result.Negative = Value < 0.0;
+
+	// Peel 32 bits at a time, every step is exact on doubles
+	double rest = std::abs(Value);
+	for (size_t i = 0; i < result.Limbs.size() && rest != 0.0; i++)
+	{
+		const double limb = std::floor(rest);
+		result.Limbs[i] = uint32_t(limb);
+		rest = (rest - limb) * 4294967296.0;
+	}
+	result.FixZeroSign();
+	return result;
+}
+
+bool BigFixed::FromString(const std::string& Text, uint32_t FractionLimbs, BigFixed& Result)
+{
+	size_t pos = 0;
+	bool negative = false;
+	if (pos < Text.size() && (Text[pos] == '-' || Text[pos] == '+'))
+		negative = Text[pos++] == '-';
+
+	// Digits with the position of the point, the exponent only moves the point
+	std::string digits;
+	int64_t point = -1;
+	for (; pos < Text.size(); pos++)
+	{
+		if (isdigit((unsigned char)Text[pos]))
+			digits += Text[pos];
+		else if (Text[pos] == '.' && point < 0)
+			point = int64_t(digits.size());
+		else
+			break;
+	}
+	if (digits.empty())
+		return false;
+	if (point < 0)
+		point = int64_t(digits.size());
+
+	if (pos < Text.size() && (Text[pos] == 'e' || Text[pos] == 'E'))
+	{
+		char * end;
+		const long exponent = strtol(Text.c_str() + pos + 1, &end, 10);
+		if (end == Text.c_str() + pos + 1)
+			return false;
+		point += exponent;
+		pos = end - Text.c_str();
+	}
+	if (pos != Text.size())
+		return false;
+
+	// Pad so the point lands inside the digits
+	if (point < 0)
+	{
+		digits.insert(0, size_t(-point), '0');
+		point = 0;
+	}
+	if (point > int64_t(digits.size()))
+		digits.append(size_t(point - int64_t(digits.size())), '0');
+
+	BigFixed result(FractionLimbs);
+
+	// The integer part has to fit on one limb, anything that big is far outside the set anyway
+	uint64_t integer = 0;
+	for (int64_t i = 0; i < point; i++)
+	{
+		integer = integer * 10 + uint64_t(digits[size_t(i)] - '0');
+		if (integer > UINT32_MAX)
+			return false;
+	}
+	result.Limbs[0] = uint32_t(integer);
+
+	// Fraction digits times 2^32 a limb at a time, what carries out of the top is the next limb
+	std::vector<uint8_t> fraction;
+	for (size_t i = size_t(point); i < digits.size(); i++)
+		fraction.push_back(uint8_t(digits[i] - '0'));
+
+	for (size_t limb = 1; limb < result.Limbs.size() && !fraction.empty(); limb++)
+	{
+		uint64_t carry = 0;
+		for (size_t i = fraction.size(); i-- > 0;)
+		{
+			const uint64_t value = uint64_t(fraction[i]) * 4294967296ull + carry;
+			fraction[i] = uint8_t(value % 10);
+			carry = value / 10;
+		}
+		result.Limbs[limb] = uint32_t(carry);
+
+		while (!fraction.empty() && fraction.back() == 0)
+			fraction.pop_back();
+	}
+
+	result.Negative = negative;
+	result.FixZeroSign();
+	Result = result;
+	return true;
+}
+
+double BigFixed::ToDouble() const
+{
+	// Three limbs from the first non zero one are more than the 53 bits of a double
+	size_t first = 0;
+	while (first < Limbs.size() && Limbs[first] == 0)
+		first++;
+
+	double value = 0.0;
+	for (size_t i = first; i < Limbs.size() && i < first + 3; i++)
+		value += std::ldexp(double(Limbs[i]), -32 * int(i));
+	return Negative ? -value : value;
+}
+
+std::string BigFixed::ToString() const
+{
+	std::string text = Negative ? "-" : "";
+	text += std::to_string(Limbs[0]);
+	text += '.';
+
+	// Each digit is what carries out of the fraction times 10, 32 bits are a bit less than 10 digits
+	std::vector<uint32_t> fraction(Limbs.begin() + 1, Limbs.end());
+	const size_t digits = std::max<size_t>(1, 10 * fraction.size());
+	for (size_t d = 0; d < digits; d++)
+	{
+		uint64_t carry = 0;
+		for (size_t i = fraction.size(); i-- > 0;)
+		{
+			const uint64_t value = uint64_t(fraction[i]) * 10 + carry;
+			fraction[i] = uint32_t(value);
+			carry = value >> 32;
+		}
+		text += char('0' + carry);
+	}
+
+	// Trailing zeros say nothing
+	while (text.back() == '0' && text[text.size() - 2] != '.')
+		text.pop_back();
+	return text;
+}
+
+int BigFixed::CompareMagnitude(const std::vector<uint32_t>& A, const std::vector<uint32_t>& B)
+{
+	for (size_t i = 0; i < A.size(); i++)
+	{
+		if (A[i] != B[i])
+			return A[i] < B[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+void BigFixed::AddMagnitude(std::vector<uint32_t>& A, const std::vector<uint32_t>& B)
+{
+	uint64_t carry = 0;
+	for (size_t i = A.size(); i-- > 0;)
+	{
+		const uint64_t sum = uint64_t(A[i]) + B[i] + carry;
+		A[i] = uint32_t(sum);
+		carry = sum >> 32;
+	}
+}
+
+void BigFixed::SubMagnitude(std::vector<uint32_t>& A, const std::vector<uint32_t>& B)
+{
+	int64_t borrow = 0;
+	for (size_t i = A.size(); i-- > 0;)
+	{
+		int64_t diff = int64_t(A[i]) - int64_t(B[i]) - borrow;
+		borrow = diff < 0;
+		A[i] = uint32_t(diff + (borrow << 32));
+	}
+}
+
+BigFixed BigFixed::Resized(uint32_t FractionLimbs) const
+{
+	BigFixed result(FractionLimbs);
+	std::copy(Limbs.begin(), Limbs.begin() + std::min(Limbs.size(), result.Limbs.size()), result.Limbs.begin());
+	result.Negative = Negative;
+	result.FixZeroSign();
+	return result;
+}
+
+void BigFixed::FixZeroSign()
+{
+	if (Negative && std::all_of(Limbs.begin(), Limbs.end(), [](uint32_t Limb) { return Limb == 0; }))
+		Negative = false;
+}
+
+BigFixed BigFixed::operator+(const BigFixed& Other) const
+{
+	BigFixed result = *this;
+	const BigFixed other = Other.GetFractionLimbs() == GetFractionLimbs() ? Other : Other.Resized(GetFractionLimbs());
+
+	if (Negative == other.Negative)
+	{
+		AddMagnitude(result.Limbs, other.Limbs);
+	}
+	else if (CompareMagnitude(Limbs, other.Limbs) >= 0)
+	{
+		SubMagnitude(result.Limbs, other.Limbs);
+	}
+	else
+	{
+		result.Limbs = other.Limbs;
+		result.Negative = other.Negative;
+		SubMagnitude(result.Limbs, Limbs);
+	}
+	result.FixZeroSign();
+	return result;
+}
+
+BigFixed BigFixed::operator-(const BigFixed& Other) const
+{
+	BigFixed negated = Other;
+	negated.Negative = !Other.Negative;
+	negated.FixZeroSign();
+	return *this + negated;
+}
+
+BigFixed BigFixed::operator*(const BigFixed& Other) const
+{
+	const size_t count = Limbs.size();
+	const BigFixed other = Other.GetFractionLimbs() == GetFractionLimbs() ? Other : Other.Resized(GetFractionLimbs());
+
+	// Column i+j gets A[i]*B[j], the high half goes one column up. Columns past the precision are dropped
+	// except for the carry they send into the last kept one
+	std::vector<uint64_t> columns(count + 1, 0);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!Limbs[i])
+			continue;
+		for (size_t j = 0; j + i <= count && j < count; j++)
+		{
+			const uint64_t product = uint64_t(Limbs[i]) * other.Limbs[j];
+			columns[i + j] += product & 0xFFFFFFFF;
+			if (i + j > 0)
+				columns[i + j - 1] += product >> 32;
+		}
+	}
+
+	BigFixed result(GetFractionLimbs());
+	uint64_t carry = columns[count] >> 32;
+	for (size_t i = count; i-- > 0;)
+	{
+		const uint64_t value = columns[i] + carry;
+		result.Limbs[i] = uint32_t(value);
+		carry = value >> 32;
+	}
+
+	result.Negative = Negative != other.Negative;
+	result.FixZeroSign();
+	return result;
+}
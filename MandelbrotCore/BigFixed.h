@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Signed fixed point number with as many 32 bit limbs as asked for, for the reference orbit of deep zooms
+// Limb 0 is the integer part, every limb after it is 32 more bits of fraction. Magnitude and sign are kept apart
+// Products are truncated to the precision of the left operand, so it loses about one ulp per operation
+class BigFixed
+{
+public:
+	// FractionLimbs is the precision, 32 bits each
+	explicit BigFixed(uint32_t FractionLimbs = 2);
+
+	// Exact as long as the precision can hold it
+	static BigFixed FromDouble(double Value, uint32_t FractionLimbs);
+
+	// Decimal, with an optional sign, point and exponent (like "-1.25e-3"). Returns false if it isn't a number
+	static bool FromString(const std::string& Text, uint32_t FractionLimbs, BigFixed& Result);
+
+	// Rounds toward zero
+	double ToDouble() const;
+
+	// Decimal, with as many digits as the precision resolves (so FromString gets it back to about the last bit)
+	std::string ToString() const;
+
+	BigFixed operator+(const BigFixed& Other) const;
+	BigFixed operator-(const BigFixed& Other) const;
+	BigFixed operator*(const BigFixed& Other) const;
+
+	uint32_t GetFractionLimbs() const { return uint32_t(Limbs.size()) - 1; }
+
+	// Precision that resolves steps of Resolution with some bits to spare for the iteration
+	static uint32_t LimbsFor(double Resolution);
+private:
+	std::vector<uint32_t> Limbs; // Most significant first
+	bool Negative = false;
+
+	// Magnitude helpers, both operands with the same number of limbs
+	static int CompareMagnitude(const std::vector<uint32_t>& A, const std::vector<uint32_t>& B);
+	static void AddMagnitude(std::vector<uint32_t>& A, const std::vector<uint32_t>& B);
+	static void SubMagnitude(std::vector<uint32_t>& A, const std::vector<uint32_t>& B); // A >= B
+
+	BigFixed Resized(uint32_t FractionLimbs) const;
+	void FixZeroSign();
+};
@@ -0,0 +1,70 @@
+#include "Budgeted.h"
+#include <algorithm>
+#include <utility>
+
+size_t BudgetedFrame::Unresolved() const
+{
+	if (!Kernel)
+		return 0;
+
+	size_t count = 0;
+	for (const BudgetedTile& tile : Tiles)
+		count += tile.Started ? tile.Orbits.Size() : 4 * size_t(tile.Block.SizeX) * tile.Block.SizeY;
+	return count;
+}
+
+uint32_t BudgetedFrame::Steps() const
+{
+	if (!Kernel)
+		return 0;
+
+	// Tiles with nothing left are as far as they'll go
+	uint32_t steps = Frame.Iterations;
+	for (const BudgetedTile& tile : Tiles)
+	{
+		if (IsBudgetedTilePending(tile))
+			steps = std::min(steps, tile.Started ? tile.Orbits.Steps : 0u);
+	}
+	return steps;
+}
+
+bool MatchesBudgetedFrame(const FrameParams& Frame, OrbitKernel Kernel, const BudgetedFrame& State)
+{
+	const FrameParams& last = State.Frame;
+	return State.Kernel && Kernel == State.Kernel && Frame.CoeffA_X == last.CoeffA_X && Frame.CoeffA_Y == last.CoeffA_Y &&
+		Frame.CoeffB_X == last.CoeffB_X && Frame.CoeffB_Y == last.CoeffB_Y && Frame.OriginX == last.OriginX && Frame.OriginY == last.OriginY &&
+		Frame.Iterations == last.Iterations && Frame.Smooth == last.Smooth &&
+		Frame.Width == last.Width && Frame.Height == last.Height && Frame.Formula == last.Formula && Frame.Julia == last.Julia &&
+		Frame.JuliaX == last.JuliaX && Frame.JuliaY == last.JuliaY;
+}
+
+void BeginBudgetedFrame(const FrameParams& Frame, OrbitKernel Kernel, std::vector<Tile> Tiles, std::vector<uint32_t> NodeJobs, BudgetedFrame& State)
+{
+	// Tiles keep their memory when the new frame has as many
+	State.Tiles.resize(Tiles.size());
+	for (size_t i = 0; i < Tiles.size(); i++)
+	{
+		State.Tiles[i].Block = Tiles[i];
+		State.Tiles[i].Started = false;
+	}
+	State.NodeJobs = std::move(NodeJobs);
+	State.Frame = Frame;
+	State.Kernel = Kernel;
+}
+
+bool IsBudgetedTilePending(const BudgetedTile& Block)
+{
+	return !Block.Started || Block.Orbits.Size() > 0;
+}
+
+void AdvanceBudgetedTile(const BudgetedFrame& State, BudgetedTile& Block)
+{
+	if (!Block.Started)
+	{
+		Block.Iters.resize(4 * size_t(Block.Block.SizeX) * Block.Block.SizeY);
+		StartOrbits(State.Frame, Block.Block.X, Block.Block.Y, Block.Block.SizeX, Block.Block.SizeY, Block.Orbits, Block.Iters.data());
+		Block.Started = true;
+	}
+	if (Block.Orbits.Size())
+		State.Kernel(State.Frame, Block.Orbits, BudgetChunk, Block.Iters.data());
+}
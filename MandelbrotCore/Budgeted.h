@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Kernels.h"
+#include "TileScheduler.h"
+#include "WorkerPool.h"
+
+// Time budgeted frames, for views deep enough that a frame can't be iterated in one go (see Renderer::RenderBudgetedAsync)
+// Samples are iterated BudgetChunk steps at a time, and the ones still going keep their z from one call to the next
+// Every tile keeps its counts laid out like the kernels write them, the samples still going show as the set
+struct BudgetedTile
+{
+	Tile Block;
+	bool Started = false; // Orbits are started by the first pass that gets to the tile
+	std::vector<uint32_t> Iters;
+	OrbitList Orbits;
+};
+
+// Every call that uses a state has to finish before the next one starts
+struct BudgetedFrame
+{
+	FrameParams Frame = {}; // Frame the tiles belong to
+	OrbitKernel Kernel = nullptr; // Different kernels round differently, so changing it starts over. Null means empty
+	std::vector<BudgetedTile> Tiles;
+	std::vector<uint32_t> NodeJobs; // Tiles of each NUMA node, see GroupTilesByNode
+
+	void Reset() { Kernel = nullptr; }
+
+	// Samples still going, 0 once every count is final
+	size_t Unresolved() const;
+
+	// Iterations done by the samples furthest behind
+	uint32_t Steps() const;
+};
+
+// Steps every pass gives the samples still going, the cap goes up by this much per pass
+// Big enough that idle lanes at the end of a batch don't matter, small enough that a pass fits in a frame
+const uint32_t BudgetChunk = 256;
+
+// The state carries on if nothing but the stride changed, anything else starts over
+bool MatchesBudgetedFrame(const FrameParams& Frame, OrbitKernel Kernel, const BudgetedFrame& State);
+
+// Starts over on Tiles, laid out by GroupTilesByNode. Orbits are started by the first pass on each tile
+void BeginBudgetedFrame(const FrameParams& Frame, OrbitKernel Kernel, std::vector<Tile> Tiles, std::vector<uint32_t> NodeJobs, BudgetedFrame& State);
+
+// True if a pass still has something to do on the tile
+bool IsBudgetedTilePending(const BudgetedTile& Block);
+
+// One pass on a tile : starts it if it wasn't, then BudgetChunk more steps of what's still going
+void AdvanceBudgetedTile(const BudgetedFrame& State, BudgetedTile& Block);
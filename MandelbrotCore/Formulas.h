@@ -0,0 +1,119 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include "Kernels.h"
+
+// Formula policies, the part of the iteration that changes from one fractal to another
+// Step takes z to f(z) + c on whatever V holds (a register of lanes, or ScalarDouble for a single sample), with Y2 = z_y^2
+// left by the previous length check. Kernels are templates on the policy, so each formula gets its own inner loop
+// with nothing picked at run time. V needs Add, Sub, Mul, FMA(a,b,c) = a*b + c, Abs and Set, and Fused saying whether
+// FMA rounds once. Power is the degree of f, smooth counts need it
+// Anonymous like KernelCommon.h, each kernel builds its own copy with its own instruction set
+namespace
+{
+// A single double, for scalar probes outside the kernels
+struct ScalarDouble
+{
+	typedef double Scalar;
+	typedef double Vec;
+	static const bool Fused = false;
+
+	static Vec Set(Scalar V) { return V; }
+	static Vec Add(Vec A, Vec B) { return A + B; }
+	static Vec Sub(Vec A, Vec B) { return A - B; }
+	static Vec Mul(Vec A, Vec B) { return A * B; }
+	static Vec FMA(Vec A, Vec B, Vec C) { return A * B + C; }
+	static Vec Abs(Vec A) { return std::abs(A); }
+};
+
+struct MandelbrotFormula
+{
+	static const uint32_t Power = 2;
+
+	// y = 2xy + cy
+	// x = x*x + (cx - y^2)
+	// Without a fused multiply add, (x*x - y^2) + cx is what the AVX kernel always did, so its counts don't change
+	template<typename V>
+	static void Step(typename V::Vec& X, typename V::Vec& Y, typename V::Vec Y2, typename V::Vec CX, typename V::Vec CY)
+	{
+		const typename V::Vec two_x = V::Add(X, X);
+		Y = V::FMA(two_x, Y, CY);
+		X = V::Fused ? V::FMA(X, X, V::Sub(CX, Y2)) : V::Add(V::Sub(V::Mul(X, X), Y2), CX);
+	}
+};
+
+// Same as Mandelbrot with the absolute values of x and y, which only changes the sign of 2xy
+struct BurningShipFormula
+{
+	static const uint32_t Power = 2;
+
+	template<typename V>
+	static void Step(typename V::Vec& X, typename V::Vec& Y, typename V::Vec Y2, typename V::Vec CX, typename V::Vec CY)
+	{
+		Y = V::Add(V::Abs(V::Mul(V::Add(X, X), Y)), CY);
+		X = V::FMA(X, X, V::Sub(CX, Y2));
+	}
+};
+
+// Conjugate first, so 2xy changes sign
+struct TricornFormula
+{
+	static const uint32_t Power = 2;
+
+	template<typename V>
+	static void Step(typename V::Vec& X, typename V::Vec& Y, typename V::Vec Y2, typename V::Vec CX, typename V::Vec CY)
+	{
+		Y = V::Sub(CY, V::Mul(V::Add(X, X), Y));
+		X = V::FMA(X, X, V::Sub(CX, Y2));
+	}
+};
+
+template<uint32_t N>
+struct MultibrotFormula;
+
+// z^3 = x(x^2 - 3y^2) + i y(3x^2 - y^2)
+template<>
+struct MultibrotFormula<3>
+{
+	static const uint32_t Power = 3;
+
+	template<typename V>
+	static void Step(typename V::Vec& X, typename V::Vec& Y, typename V::Vec Y2, typename V::Vec CX, typename V::Vec CY)
+	{
+		const typename V::Vec three = V::Set(typename V::Scalar(3));
+		const typename V::Vec x2 = V::Mul(X, X);
+		Y = V::FMA(Y, V::Sub(V::Mul(three, x2), Y2), CY);
+		X = V::FMA(X, V::Sub(x2, V::Mul(three, Y2)), CX);
+	}
+};
+
+// z^4 = (z^2)^2
+template<>
+struct MultibrotFormula<4>
+{
+	static const uint32_t Power = 4;
+
+	template<typename V>
+	static void Step(typename V::Vec& X, typename V::Vec& Y, typename V::Vec Y2, typename V::Vec CX, typename V::Vec CY)
+	{
+		const typename V::Vec a = V::Sub(V::Mul(X, X), Y2);
+		const typename V::Vec b = V::Mul(V::Add(X, X), Y);
+		Y = V::FMA(V::Add(a, a), b, CY);
+		X = V::FMA(a, a, V::Sub(CX, V::Mul(b, b)));
+	}
+};
+
+// Calls Body(Policy()) with the policy of Formula, the only place a formula is picked at run time
+template<typename Body>
+void WithFormula(Fractal Formula, Body&& F)
+{
+	switch (Formula)
+	{
+	case Fractal::BurningShip: F(BurningShipFormula()); break;
+	case Fractal::Tricorn: F(TricornFormula()); break;
+	case Fractal::Multibrot3: F(MultibrotFormula<3>()); break;
+	case Fractal::Multibrot4: F(MultibrotFormula<4>()); break;
+	default: F(MandelbrotFormula()); break;
+	}
+}
+}
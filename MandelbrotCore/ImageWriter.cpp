@@ -0,0 +1,405 @@
+#include "ImageWriter.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if MANDELBROT_HAS_PNG
+#include <png.h>
+#endif
+
+bool WritePPM(const std::string& Path, const uint8_t * RGBA, uint32_t Width, uint32_t Height)
+{
+	FILE * file = fopen(Path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	fprintf(file, "P6\n%u %u\n255\n", Width, Height);
+
+	std::vector<uint8_t> row(size_t(Width) * 3);
+	bool ok = true;
+	for (uint32_t y = 0; y < Height && ok; y++)
+	{
+		const uint8_t * src = RGBA + size_t(y) * Width * 4;
+		for (uint32_t x = 0; x < Width; x++)
+		{
+			row[3 * x    ] = src[4 * x    ];
+			row[3 * x + 1] = src[4 * x + 1];
+			row[3 * x + 2] = src[4 * x + 2];
+		}
+		ok = fwrite(row.data(), 1, row.size(), file) == row.size();
+	}
+
+	return fclose(file) == 0 && ok;
+}
+
+bool WritePNG(const std::string& Path, const uint8_t * RGBA, uint32_t Width, uint32_t Height)
+{
+#if MANDELBROT_HAS_PNG
+	FILE * file = fopen(Path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	png_infop info = png ? png_create_info_struct(png) : nullptr;
+	if (!info || setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_write_struct(&png, &info);
+		fclose(file);
+		return false;
+	}
+
+	png_init_io(png, file);
+	png_set_IHDR(png, info, Width, Height, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png, info);
+
+	for (uint32_t y = 0; y < Height; y++)
+		png_write_row(png, RGBA + size_t(y) * Width * 4);
+
+	png_write_end(png, nullptr);
+	png_destroy_write_struct(&png, &info);
+
+	return fclose(file) == 0;
+#else
+	// Built without libpng
+	return false;
+#endif
+}
+
+bool EncodePPM(const uint8_t * RGBA, uint32_t Width, uint32_t Height, std::vector<uint8_t>& Out)
+{
+	char header[64];
+	const int header_size = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", Width, Height);
+	Out.assign(header, header + header_size);
+	Out.resize(size_t(header_size) + size_t(Width) * Height * 3);
+
+	uint8_t * dst = Out.data() + header_size;
+	for (size_t i = 0; i < size_t(Width) * Height; i++)
+	{
+		dst[3 * i    ] = RGBA[4 * i    ];
+		dst[3 * i + 1] = RGBA[4 * i + 1];
+		dst[3 * i + 2] = RGBA[4 * i + 2];
+	}
+	return true;
+}
+
+#if MANDELBROT_HAS_PNG
+static void AppendPNGData(png_structp PNG, png_bytep Data, png_size_t Size)
+{
+	auto out = (std::vector<uint8_t>*)png_get_io_ptr(PNG);
+	out->insert(out->end(), Data, Data + Size);
+}
+#endif
+
+bool EncodePNG(const uint8_t * RGBA, uint32_t Width, uint32_t Height, std::vector<uint8_t>& Out)
+{
+#if MANDELBROT_HAS_PNG
+	Out.clear();
+	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	png_infop info = png ? png_create_info_struct(png) : nullptr;
+	if (!info || setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_write_struct(&png, &info);
+		return false;
+	}
+
+	png_set_write_fn(png, &Out, AppendPNGData, nullptr);
+	png_set_IHDR(png, info, Width, Height, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png, info);
+
+	for (uint32_t y = 0; y < Height; y++)
+		png_write_row(png, RGBA + size_t(y) * Width * 4);
+
+	png_write_end(png, nullptr);
+	png_destroy_write_struct(&png, &info);
+	return true;
+#else
+	// Built without libpng
+	return false;
+#endif
+}
+
+bool WriteImage(const std::string& Path, const uint8_t * RGBA, uint32_t Width, uint32_t Height)
+{
+	auto ends_with = [&](const char * Ext)
+	{
+		std::string ext(Ext);
+		return Path.size() >= ext.size() && Path.compare(Path.size() - ext.size(), ext.size(), ext) == 0;
+	};
+
+	if (ends_with(".png"))
+		return WritePNG(Path, RGBA, Width, Height);
+	return WritePPM(Path, RGBA, Width, Height);
+}
+
+bool ReadImage(const std::string& Path, std::vector<uint8_t>& RGBA, uint32_t& Width, uint32_t& Height)
+{
+	FILE * file = fopen(Path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	uint8_t signature[8] = {};
+	const size_t signature_size = fread(signature, 1, 8, file);
+	rewind(file);
+
+	bool ok = false;
+	if (signature_size >= 2 && signature[0] == 'P' && signature[1] == '6')
+	{
+		unsigned width, height, max_value;
+		if (fscanf(file, "P6 %u %u %u", &width, &height, &max_value) == 3 && max_value == 255 && fgetc(file) != EOF)
+		{
+			Width = width;
+			Height = height;
+			RGBA.resize(size_t(Width) * Height * 4);
+
+			std::vector<uint8_t> row(size_t(Width) * 3);
+			ok = true;
+			for (uint32_t y = 0; y < Height && ok; y++)
+			{
+				ok = fread(row.data(), 1, row.size(), file) == row.size();
+				uint8_t * dst = RGBA.data() + size_t(y) * Width * 4;
+				for (uint32_t x = 0; x < Width; x++)
+				{
+					dst[4 * x    ] = row[3 * x    ];
+					dst[4 * x + 1] = row[3 * x + 1];
+					dst[4 * x + 2] = row[3 * x + 2];
+					dst[4 * x + 3] = 255;
+				}
+			}
+		}
+	}
+#if MANDELBROT_HAS_PNG
+	else if (signature_size == 8 && !png_sig_cmp(signature, 0, 8))
+	{
+		png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+		png_infop info = png ? png_create_info_struct(png) : nullptr;
+		if (info && !setjmp(png_jmpbuf(png)))
+		{
+			png_init_io(png, file);
+			png_read_info(png, info);
+			if (png_get_bit_depth(png, info) == 8 && (png_get_color_type(png, info) == PNG_COLOR_TYPE_RGBA || png_get_color_type(png, info) == PNG_COLOR_TYPE_RGB))
+			{
+				png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+				Width = png_get_image_width(png, info);
+				Height = png_get_image_height(png, info);
+				RGBA.resize(size_t(Width) * Height * 4);
+				for (uint32_t y = 0; y < Height; y++)
+					png_read_row(png, RGBA.data() + size_t(y) * Width * 4, nullptr);
+				ok = true;
+			}
+		}
+		png_destroy_read_struct(&png, &info, nullptr);
+	}
+#endif
+
+	fclose(file);
+	return ok;
+}
+
+// 64 bit offsets, streamed images can go well past 2GB
+static bool Seek(FILE * File, int64_t Offset, int Origin)
+{
+#if defined(_MSC_VER)
+	return _fseeki64(File, Offset, Origin) == 0;
+#else
+	return fseeko(File, off_t(Offset), Origin) == 0;
+#endif
+}
+
+static int64_t Tell(FILE * File)
+{
+#if defined(_MSC_VER)
+	return _ftelli64(File);
+#else
+	return int64_t(ftello(File));
+#endif
+}
+
+struct ImageStream::State
+{
+	FILE * File = nullptr;
+	bool PNG = false;
+	bool Failed = false;
+	uint32_t Width = 0;
+	uint32_t HeaderSize = 0; // PPM
+	std::vector<uint8_t> Row;
+#if MANDELBROT_HAS_PNG
+	png_structp Png = nullptr;
+	png_infop Info = nullptr;
+#endif
+};
+
+ImageStream::ImageStream() : Impl(new State)
+{
+}
+
+ImageStream::~ImageStream()
+{
+	Close();
+}
+
+bool ImageStream::Open(const std::string& Path, uint32_t Width, uint32_t Height, bool Resume)
+{
+	Close();
+	Impl->Failed = false;
+	Impl->Width = Width;
+	Impl->PNG = Path.size() >= 4 && Path.compare(Path.size() - 4, 4, ".png") == 0;
+	RowsDone = 0;
+
+	if (Impl->PNG)
+	{
+#if MANDELBROT_HAS_PNG
+		Impl->File = fopen(Path.c_str(), "wb");
+		if (!Impl->File)
+			return false;
+
+		Impl->Png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+		Impl->Info = Impl->Png ? png_create_info_struct(Impl->Png) : nullptr;
+		if (!Impl->Info || setjmp(png_jmpbuf(Impl->Png)))
+		{
+			Impl->Failed = true;
+			Close();
+			return false;
+		}
+
+		png_init_io(Impl->Png, Impl->File);
+		png_set_IHDR(Impl->Png, Impl->Info, Width, Height, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+		png_write_info(Impl->Png, Impl->Info);
+		return true;
+#else
+		// Built without libpng
+		return false;
+#endif
+	}
+
+	char header[64];
+	const int header_size = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", Width, Height);
+	const uint64_t row_size = uint64_t(Width) * 3;
+
+	// Whole rows after a matching header are kept, a partial one is written again
+	if (Resume && (Impl->File = fopen(Path.c_str(), "r+b")) != nullptr)
+	{
+		char existing[64] = {};
+		const bool same = fread(existing, 1, header_size, Impl->File) == size_t(header_size) && memcmp(existing, header, header_size) == 0;
+		if (same && Seek(Impl->File, 0, SEEK_END))
+		{
+			const uint64_t rows = (uint64_t(Tell(Impl->File)) - header_size) / row_size;
+			Impl->HeaderSize = header_size;
+			RowsDone = uint32_t(std::min<uint64_t>(rows, Height));
+			return Rewind(RowsDone);
+		}
+		fclose(Impl->File);
+	}
+
+	Impl->File = fopen(Path.c_str(), "wb");
+	if (!Impl->File)
+		return false;
+	Impl->HeaderSize = header_size;
+	return fwrite(header, 1, header_size, Impl->File) == size_t(header_size);
+}
+
+bool ImageStream::Rewind(uint32_t Row)
+{
+	if (!Impl->File || Impl->PNG || Row > RowsDone)
+		return false;
+
+	RowsDone = Row;
+	return Seek(Impl->File, int64_t(Impl->HeaderSize + uint64_t(Row) * Impl->Width * 3), SEEK_SET);
+}
+
+bool ImageStream::WriteRows(const uint8_t * RGBA, uint32_t Count, uint32_t Stride)
+{
+	if (!Impl->File || Impl->Failed)
+		return false;
+
+#if MANDELBROT_HAS_PNG
+	if (Impl->PNG)
+	{
+		if (setjmp(png_jmpbuf(Impl->Png)))
+		{
+			Impl->Failed = true;
+			return false;
+		}
+		for (uint32_t y = 0; y < Count; y++)
+			png_write_row(Impl->Png, RGBA + size_t(y) * Stride);
+		RowsDone += Count;
+		return true;
+	}
+#endif
+
+	Impl->Row.resize(size_t(Impl->Width) * 3);
+	for (uint32_t y = 0; y < Count && !Impl->Failed; y++)
+	{
+		const uint8_t * src = RGBA + size_t(y) * Stride;
+		for (uint32_t x = 0; x < Impl->Width; x++)
+		{
+			Impl->Row[3 * x    ] = src[4 * x    ];
+			Impl->Row[3 * x + 1] = src[4 * x + 1];
+			Impl->Row[3 * x + 2] = src[4 * x + 2];
+		}
+		Impl->Failed = fwrite(Impl->Row.data(), 1, Impl->Row.size(), Impl->File) != Impl->Row.size();
+	}
+	RowsDone += Impl->Failed ? 0 : Count;
+	return !Impl->Failed;
+}
+
+bool ImageStream::Close()
+{
+	if (!Impl->File)
+		return !Impl->Failed;
+
+#if MANDELBROT_HAS_PNG
+	if (Impl->Png)
+	{
+		if (!Impl->Failed && !setjmp(png_jmpbuf(Impl->Png)))
+			png_write_end(Impl->Png, nullptr);
+		else
+			Impl->Failed = true;
+		png_destroy_write_struct(&Impl->Png, &Impl->Info);
+		Impl->Png = nullptr;
+		Impl->Info = nullptr;
+	}
+#endif
+
+	Impl->Failed |= fclose(Impl->File) != 0;
+	Impl->File = nullptr;
+	return !Impl->Failed;
+}
+
+static const char IterationsMagic[4] = { 'M', 'I', 'T', 'R' };
+
+bool WriteIterations(const std::string& Path, const uint32_t * Iters, uint32_t Width, uint32_t Height, uint32_t Iterations, bool Smooth)
+{
+	FILE * file = fopen(Path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	const uint32_t header[4] = { Width, Height, Iterations, Smooth ? 1u : 0u };
+	const size_t count = size_t(Width) * Height * 4;
+	bool ok = fwrite(IterationsMagic, 1, 4, file) == 4 && fwrite(header, 4, 4, file) == 4 && fwrite(Iters, 4, count, file) == count;
+
+	return fclose(file) == 0 && ok;
+}
+
+bool ReadIterations(const std::string& Path, std::vector<uint32_t>& Iters, uint32_t& Width, uint32_t& Height, uint32_t& Iterations, bool& Smooth)
+{
+	FILE * file = fopen(Path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	char magic[4];
+	uint32_t header[4];
+	bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, IterationsMagic, 4) == 0 && fread(header, 4, 4, file) == 4;
+	if (ok)
+	{
+		Width = header[0];
+		Height = header[1];
+		Iterations = header[2];
+		Smooth = header[3] != 0;
+		Iters.resize(size_t(Width) * Height * 4);
+		ok = fread(Iters.data(), 4, Iters.size(), file) == Iters.size();
+	}
+
+	fclose(file);
+	return ok;
+}
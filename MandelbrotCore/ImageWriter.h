@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Writers for RGBA8 buffers (PPM drops the alpha)
+// All of them return false if the file couldn't be written
+bool WritePPM(const std::string& Path, const uint8_t * RGBA, uint32_t Width, uint32_t Height);
+bool WritePNG(const std::string& Path, const uint8_t * RGBA, uint32_t Width, uint32_t Height);
+
+// Picks the format from the extension (.png or .ppm)
+bool WriteImage(const std::string& Path, const uint8_t * RGBA, uint32_t Width, uint32_t Height);
+
+// Same formats into memory, for sending them somewhere instead of to a file
+bool EncodePPM(const uint8_t * RGBA, uint32_t Width, uint32_t Height, std::vector<uint8_t>& Out);
+bool EncodePNG(const uint8_t * RGBA, uint32_t Width, uint32_t Height, std::vector<uint8_t>& Out);
+
+// Reads back what WriteImage wrote, only 8 bit RGB or RGBA PNGs and binary PPMs
+bool ReadImage(const std::string& Path, std::vector<uint8_t>& RGBA, uint32_t& Width, uint32_t& Height);
+
+// Writes an image a band of rows at a time, for images that don't fit in memory. Same formats as WriteImage
+// With Resume, a PPM of the same size that was cut short keeps its rows and GetRowsDone says how many
+// PNG can't be appended to, it always starts over
+class ImageStream
+{
+public:
+	ImageStream();
+	~ImageStream();
+
+	bool Open(const std::string& Path, uint32_t Width, uint32_t Height, bool Resume = false);
+	uint32_t GetRowsDone() const { return RowsDone; }
+
+	// Goes back to Row, before GetRowsDone, so the rows after it are written again. Only PPM
+	bool Rewind(uint32_t Row);
+
+	// Count rows of Stride bytes, RGBA8
+	bool WriteRows(const uint8_t * RGBA, uint32_t Count, uint32_t Stride);
+
+	// Also called on destruction, false if anything failed
+	bool Close();
+private:
+	struct State;
+	std::unique_ptr<State> Impl;
+	uint32_t RowsDone = 0;
+};
+
+// Raw iteration counts (see Renderer::RenderIterationsAsync), so a frame can be colored again later without iterating
+// A small header (magic, width, height, iterations, smooth) and then the counts, 4 per pixel, little endian
+// Smooth says the counts are fixed point (see SmoothFractionBits)
+bool WriteIterations(const std::string& Path, const uint32_t * Iters, uint32_t Width, uint32_t Height, uint32_t Iterations, bool Smooth);
+bool ReadIterations(const std::string& Path, std::vector<uint32_t>& Iters, uint32_t& Width, uint32_t& Height, uint32_t& Iterations, bool& Smooth);
@@ -0,0 +1,175 @@
+#include "Interactive.h"
+#include <utility>
+
+void ViewChannel::Publish(const ViewParams& NewView)
+{
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		View = NewView;
+		Version.fetch_add(1, std::memory_order_release);
+	}
+	Changed.notify_all();
+}
+
+ViewParams ViewChannel::Snapshot(uint64_t * SeenVersion) const
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	if (SeenVersion)
+		*SeenVersion = Version.load(std::memory_order_relaxed);
+	return View;
+}
+
+bool ViewChannel::WaitForChange(uint64_t Seen) const
+{
+	std::unique_lock<std::mutex> lock(Lock);
+	Changed.wait(lock, [&]() { return Closed || Version.load(std::memory_order_relaxed) != Seen; });
+	return !Closed;
+}
+
+void ViewChannel::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		Closed = true;
+	}
+	Changed.notify_all();
+}
+
+bool ViewChannel::IsClosed() const
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	return Closed;
+}
+
+void FrameMailbox::Publish()
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	std::swap(BackIndex, ReadyIndex);
+	Fresh = true;
+}
+
+bool FrameMailbox::Acquire()
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	if (!Fresh)
+		return false;
+	std::swap(FrontIndex, ReadyIndex);
+	Fresh = false;
+	return true;
+}
+
+const std::chrono::milliseconds RenderLoop::CancelAfter{ 50 };
+
+RenderLoop::RenderLoop(Renderer& Render, ViewChannel& View, FrameMailbox& Frames, std::function<void()> OnFrame)
+	: Render(Render), View(View), Frames(Frames), OnFrame(std::move(OnFrame))
+{
+	Thread = std::thread([this]() { Run(); });
+}
+
+RenderLoop::~RenderLoop()
+{
+	View.Close();
+	Thread.join();
+}
+
+void RenderLoop::Run()
+{
+	typedef std::chrono::steady_clock Clock;
+
+	uint64_t seen = 0;
+	bool idle = false;
+	Path last_path = Path::None;
+	while (!View.IsClosed())
+	{
+		// Nothing left to do for the view we have, sleep until there's a new one
+		if (idle && !View.WaitForChange(seen))
+			break;
+		idle = false;
+
+		const ViewParams view = View.Snapshot(&seen);
+		RenderRequest request = view.Request;
+		request.Stride = 0;
+		request.Priority = JobPriority::Interactive;
+		request.Cancel = MakeCancelFlag();
+		if (request.Width == 0 || request.Height == 0)
+		{
+			idle = true;
+			continue;
+		}
+
+		// Frames already in flight keep the colors they started with
+		bool refresh = Render.GetPalette().Offset != view.ColorOffset;
+		if (refresh)
+		{
+			Palette colors = Render.GetPalette();
+			colors.Offset = view.ColorOffset;
+			Render.SetPalette(colors);
+		}
+
+		// Perturbation has nothing to carry over from one frame to the next, so those go as whole frames too
+		// Coming back to a path, what's on screen came from another one, so even a complete view is shown again
+		const Path path = Render.IsPerturbation(request) ? Path::Whole
+			: view.Budgeted ? Path::Budgeted
+			: request.Mode == RenderMode::Direct ? Path::Progressive : Path::Whole;
+		refresh = refresh || path != last_path;
+
+		ViewerFrame& frame = Frames.Back();
+		frame.Pixels.resize(size_t(request.Width) * request.Height * 4);
+
+		const Clock::time_point start = Clock::now();
+		std::future<void> pending;
+		switch (path)
+		{
+		case Path::Budgeted:
+			if (refresh || !Render.IsBudgetedComplete(request, Budgeted))
+				pending = Render.RenderBudgetedAsync(request, Budgeted, view.Budget, frame.Pixels.data());
+			break;
+		case Path::Progressive:
+			if (!Render.IsProgressiveComplete(request, History))
+				pending = Render.RenderProgressiveAsync(request, History, frame.Pixels.data());
+			else if (refresh)
+				pending = Render.ColorizeAsync(request, History.Iters.data(), frame.Pixels.data());
+			break;
+		default:
+			if (refresh || WholeVersion != seen)
+				pending = Render.RenderAsync(request, frame.Pixels.data());
+			WholeVersion = seen;
+			break;
+		}
+
+		if (!pending.valid())
+		{
+			idle = true;
+			continue;
+		}
+
+		// The view moving on doesn't cancel right away, most frames are done soon after and still worth showing
+		while (pending.wait_for(std::chrono::milliseconds(2)) != std::future_status::ready)
+		{
+			if (IsCancelled(request.Cancel))
+				continue;
+			if (View.IsClosed() || (View.GetVersion() != seen && Clock::now() - start > CancelAfter))
+				request.Cancel->store(true);
+		}
+		pending.get();
+
+		// A cancelled frame has holes and never gets to the screen, so the next one can't take the screen for granted
+		if (IsCancelled(request.Cancel))
+		{
+			last_path = Path::None;
+			continue;
+		}
+
+		frame.Request = request;
+		frame.Frame = path == Path::Progressive ? History.Frame : MakeFrameParams(request);
+		frame.Version = seen;
+		frame.RenderMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		frame.Unresolved = path == Path::Budgeted ? Budgeted.Unresolved() : 0;
+		frame.Complete = path == Path::Budgeted ? Render.IsBudgetedComplete(request, Budgeted)
+			: path == Path::Progressive ? Render.IsProgressiveComplete(request, History) : true;
+		last_path = path;
+		Frames.Publish();
+		if (OnFrame)
+			OnFrame();
+	}
+}
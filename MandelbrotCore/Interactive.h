@@ -0,0 +1,136 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Renderer.h"
+
+// Plumbing for interactive front ends, whatever draws the window (see MandelbrotViewer)
+// Input, rendering and presentation each run on their own thread and only meet here : input publishes the view to a
+// ViewChannel, a RenderLoop renders the newest view over and over into a FrameMailbox, and the window takes the newest
+// frame out of it whenever it wants. Nobody waits on anybody else's frame, input keeps going at its own rate while
+// a slow frame renders and the window can redraw (or move the last frame around) at any time
+
+// What the user is looking at
+struct ViewParams
+{
+	RenderRequest Request; // Stride, Priority and Cancel are set by the render loop
+	uint32_t ColorOffset = 0; // Palette offset, changing only this colors the counts again when it can
+
+	// Renders through RenderBudgetedAsync, Budget at a time, instead of progressive or whole frames
+	bool Budgeted = false;
+	std::chrono::milliseconds Budget{ 33 };
+};
+
+// The view, written by input and read by the render loop. Every Publish is a new version, readers always get a
+// whole view, never half of one and half of the next
+class ViewChannel
+{
+public:
+	void Publish(const ViewParams& View);
+
+	// Copy of the newest view, and its version if Version isn't null
+	ViewParams Snapshot(uint64_t * Version = nullptr) const;
+
+	uint64_t GetVersion() const { return Version.load(std::memory_order_acquire); }
+
+	// Blocks until there's a version past Seen and returns true, or false once Close was called
+	bool WaitForChange(uint64_t Seen) const;
+
+	// Wakes every waiter for good
+	void Close();
+	bool IsClosed() const;
+private:
+	mutable std::mutex Lock;
+	mutable std::condition_variable Changed;
+	ViewParams View;
+	std::atomic<uint64_t> Version{ 0 };
+	bool Closed = false;
+};
+
+// A frame done by the render loop
+struct ViewerFrame
+{
+	std::vector<uint8_t> Pixels; // RGBA8 rows, tightly packed
+	RenderRequest Request; // What it was rendered for
+	FrameParams Frame = {}; // Where its pixels are on the plane, progressive frames snap to their history's pixel grid
+	uint64_t Version = 0; // Of the view it was rendered for
+	double RenderMs = 0.0; // From queueing it until it was done
+	uint64_t Unresolved = 0; // Budgeted frames only, samples still going (see BudgetedFrame)
+	bool Complete = false; // Rendering the same view again wouldn't change it
+};
+
+// Triple buffer : the frame on screen, the newest one done, and the one being rendered
+// The renderer never waits for the window and the window always gets the newest frame, one that was done but
+// never taken just gets rendered over. Back belongs to the producer and Front to the consumer, the middle one
+// changes hands under the lock, which only covers swapping indices
+class FrameMailbox
+{
+public:
+	// Producer only. The frame to render into, whatever it has from before is stale
+	ViewerFrame& Back() { return Frames[BackIndex]; }
+
+	// Producer only. Back is the newest frame now, and the producer gets another one to render into
+	void Publish();
+
+	// Consumer only. Takes the newest frame and returns true if there's one Front didn't have already
+	bool Acquire();
+
+	// Consumer only. The frame taken by the last Acquire, empty Pixels until the first one
+	const ViewerFrame& Front() const { return Frames[FrontIndex]; }
+private:
+	ViewerFrame Frames[3];
+	uint32_t BackIndex = 0;
+	uint32_t FrontIndex = 1;
+
+	std::mutex Lock;
+	uint32_t ReadyIndex = 2;
+	bool Fresh = false; // Ready has a frame Front hasn't seen
+};
+
+// Renders whatever the channel has into the mailbox on a thread of its own until destroyed, only that thread touches
+// the renderer. A still view is refined (progressive or budgeted) until it's complete, and then nothing runs until
+// the view changes again
+// When the view changes under a frame that has been going for more than CancelAfter, the frame is cancelled and the
+// next one starts from the new view, so a heavy frame never holds the screen back by more than that
+class RenderLoop
+{
+public:
+	// OnFrame runs on the render thread after every Publish, to wake the window up. It must not block
+	RenderLoop(Renderer& Render, ViewChannel& View, FrameMailbox& Frames, std::function<void()> OnFrame);
+
+	// Closes the channel, cancels the frame in flight and waits for the thread
+	~RenderLoop();
+
+	RenderLoop(const RenderLoop&) = delete;
+	RenderLoop& operator=(const RenderLoop&) = delete;
+
+	static const std::chrono::milliseconds CancelAfter;
+private:
+	// Where frames come from, see Run
+	enum class Path
+	{
+		None,
+		Progressive,
+		Budgeted,
+		Whole
+	};
+
+	void Run();
+
+	Renderer& Render;
+	ViewChannel& View;
+	FrameMailbox& Frames;
+	std::function<void()> OnFrame;
+
+	// State the frames build on, kept from one to the next
+	FrameHistory History;
+	BudgetedFrame Budgeted;
+	uint64_t WholeVersion = 0; // Version of the last whole (Subdivide or Compact) frame, a still view is rendered once
+
+	std::thread Thread;
+};
@@ -0,0 +1,384 @@
+#include "IterationCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const uint64_t FileMagic = 0x3354494F52424D4Dull; // "MMBROIT3"
+
+	// Header of a tile file, then the compressed counts
+	enum HeaderWord
+	{
+		Magic, KeyX, KeyY, KeyCoeffB_X, KeyCoeffB_Y, KeySpacing, KeyIterations, KeyKernel, KeySize, KeyFormula, KeyJuliaX, KeyJuliaY, DataSize, HeaderWords
+	};
+
+	uint64_t DoubleBits(double Value)
+	{
+		uint64_t bits;
+		memcpy(&bits, &Value, sizeof(bits));
+		return bits;
+	}
+
+	void MakeHeader(const TileKey& Key, uint64_t Size, uint64_t * Header)
+	{
+		Header[Magic] = FileMagic;
+		Header[KeyX] = Key.X;
+		Header[KeyY] = Key.Y;
+		Header[KeyCoeffB_X] = DoubleBits(Key.CoeffB_X);
+		Header[KeyCoeffB_Y] = DoubleBits(Key.CoeffB_Y);
+		Header[KeySpacing] = DoubleBits(Key.Spacing);
+		Header[KeyIterations] = Key.Iterations;
+		Header[KeyKernel] = Key.Kernel;
+		Header[KeySize] = uint64_t(Key.Size) | (uint64_t(Key.Smooth) << 32);
+		Header[KeyFormula] = uint64_t(Key.Formula) | (uint64_t(Key.Julia) << 32);
+		Header[KeyJuliaX] = DoubleBits(Key.JuliaX);
+		Header[KeyJuliaY] = DoubleBits(Key.JuliaY);
+		Header[DataSize] = Size;
+	}
+
+	void PutVarint(uint64_t Value, std::vector<uint8_t>& Out)
+	{
+		while (Value >= 0x80)
+		{
+			Out.push_back(uint8_t(Value | 0x80));
+			Value >>= 7;
+		}
+		Out.push_back(uint8_t(Value));
+	}
+
+	bool GetVarint(const uint8_t *& Pos, const uint8_t * End, uint64_t& Value)
+	{
+		Value = 0;
+		for (uint32_t shift = 0; Pos < End && shift < 64; shift += 7)
+		{
+			const uint8_t byte = *Pos++;
+			Value |= uint64_t(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	// Read only view of a whole file, unmapped when it goes out of scope
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(const std::string& Path)
+		{
+#if defined(_WIN32)
+			File = CreateFileA(Path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (File == INVALID_HANDLE_VALUE)
+				return;
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(File, &size) || size.QuadPart == 0)
+				return;
+			Mapping = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!Mapping)
+				return;
+			Data = (const uint8_t*)MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+			if (Data)
+				Size = size_t(size.QuadPart);
+#else
+			const int file = open(Path.c_str(), O_RDONLY);
+			if (file < 0)
+				return;
+			struct stat info;
+			if (fstat(file, &info) == 0 && info.st_size > 0)
+			{
+				void * view = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+				if (view != MAP_FAILED)
+				{
+					Data = (const uint8_t*)view;
+					Size = size_t(info.st_size);
+				}
+			}
+			close(file);
+#endif
+		}
+
+		~MappedFile()
+		{
+#if defined(_WIN32)
+			if (Data)
+				UnmapViewOfFile(Data);
+			if (Mapping)
+				CloseHandle(Mapping);
+			if (File != INVALID_HANDLE_VALUE)
+				CloseHandle(File);
+#else
+			if (Data)
+				munmap((void*)Data, Size);
+#endif
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const uint8_t * Data = nullptr;
+		size_t Size = 0;
+	private:
+#if defined(_WIN32)
+		HANDLE File = INVALID_HANDLE_VALUE;
+		HANDLE Mapping = nullptr;
+#endif
+	};
+}
+
+bool TileKey::operator==(const TileKey& Other) const
+{
+	return X == Other.X && Y == Other.Y && DoubleBits(CoeffB_X) == DoubleBits(Other.CoeffB_X) && DoubleBits(CoeffB_Y) == DoubleBits(Other.CoeffB_Y) &&
+		DoubleBits(Spacing) == DoubleBits(Other.Spacing) &&
+		Iterations == Other.Iterations && Kernel == Other.Kernel && Size == Other.Size && Smooth == Other.Smooth &&
+		Formula == Other.Formula && Julia == Other.Julia && DoubleBits(JuliaX) == DoubleBits(Other.JuliaX) && DoubleBits(JuliaY) == DoubleBits(Other.JuliaY);
+}
+
+uint64_t TileKey::Hash() const
+{
+	// FNV-1a over the same words the files start with
+	uint64_t header[HeaderWords];
+	MakeHeader(*this, 0, header);
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (uint32_t word = KeyX; word < DataSize; word++)
+	{
+		for (uint32_t byte = 0; byte < 8; byte++)
+		{
+			hash ^= (header[word] >> (8 * byte)) & 0xFF;
+			hash *= 0x100000001B3ull;
+		}
+	}
+	return hash;
+}
+
+FrameParams CacheTileFrame(const TileKey& Key, const FrameParams& Frame)
+{
+	FrameParams tile = Frame;
+	tile.CoeffA_X = Key.Spacing;
+	tile.CoeffA_Y = Key.Spacing;
+	tile.CoeffB_X = Key.CoeffB_X;
+	tile.CoeffB_Y = Key.CoeffB_Y;
+	tile.OriginX = Key.X;
+	tile.OriginY = Key.Y;
+	tile.Width = Key.Size;
+	tile.Height = Key.Size;
+
+	// Tiles on the right and bottom edges go past the image, they're computed whole
+	tile.ImageWidth = std::max(Frame.ImageWidth, Key.X + Key.Size);
+	tile.ImageHeight = std::max(Frame.ImageHeight, Key.Y + Key.Size);
+	tile.Stride = Key.Size * 4;
+	return tile;
+}
+
+void CompressIterations(const uint32_t * Iters, size_t Count, std::vector<uint8_t>& Out)
+{
+	Out.clear();
+	uint32_t last = 0;
+	for (size_t i = 0; i < Count;)
+	{
+		const int64_t step = int64_t(Iters[i]) - int64_t(last);
+		size_t run = 1;
+		while (i + run < Count && int64_t(Iters[i + run]) - int64_t(Iters[i + run - 1]) == step)
+			run++;
+
+		PutVarint(run, Out);
+		PutVarint((uint64_t(step) << 1) ^ uint64_t(step >> 63), Out);
+		last = Iters[i + run - 1];
+		i += run;
+	}
+}
+
+bool DecompressIterations(const uint8_t * Data, size_t Size, uint32_t * Iters, size_t Count)
+{
+	const uint8_t * pos = Data;
+	const uint8_t * end = Data + Size;
+	uint32_t last = 0;
+	for (size_t i = 0; i < Count;)
+	{
+		uint64_t run, zigzag;
+		if (!GetVarint(pos, end, run) || !GetVarint(pos, end, zigzag) || run == 0 || run > Count - i)
+			return false;
+
+		const int64_t step = int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1);
+		for (uint64_t k = 0; k < run; k++)
+		{
+			last = uint32_t(int64_t(last) + step);
+			Iters[i++] = last;
+		}
+	}
+	return pos == end;
+}
+
+IterationCache::IterationCache(size_t MemoryBytes, const std::string& Directory) : MemoryBytes(MemoryBytes), Directory(Directory)
+{
+	// Fine if it's already there, and if it can't be made every tile write just fails
+	if (!Directory.empty())
+	{
+#if defined(_WIN32)
+		_mkdir(Directory.c_str());
+#else
+		mkdir(Directory.c_str(), 0755);
+#endif
+	}
+}
+
+bool IterationCache::Find(const TileKey& Key, uint32_t * Iters)
+{
+	const size_t count = 4 * size_t(Key.Size) * Key.Size;
+	std::shared_ptr<const std::vector<uint8_t>> data;
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		auto found = Index.find(Key);
+		if (found != Index.end())
+		{
+			Recent.splice(Recent.begin(), Recent, found->second);
+			data = found->second->Data;
+		}
+	}
+
+	// Decoded outside the lock, entries are never changed once added
+	if (data && DecompressIterations(data->data(), data->size(), Iters, count))
+	{
+		MemoryHits++;
+		return true;
+	}
+
+	auto read = std::make_shared<std::vector<uint8_t>>();
+	if (!Directory.empty() && ReadTile(Key, *read) && DecompressIterations(read->data(), read->size(), Iters, count))
+	{
+		DiskHits++;
+		Remember(Key, std::move(read));
+		return true;
+	}
+
+	Misses++;
+	return false;
+}
+
+void IterationCache::Insert(const TileKey& Key, const uint32_t * Iters)
+{
+	auto data = std::make_shared<std::vector<uint8_t>>();
+	CompressIterations(Iters, 4 * size_t(Key.Size) * Key.Size, *data);
+	if (!Directory.empty() && WriteTile(Key, *data))
+		DiskWrites++;
+	Remember(Key, std::move(data));
+}
+
+void IterationCache::Remember(const TileKey& Key, std::shared_ptr<const std::vector<uint8_t>> Data)
+{
+	const size_t raw = 16 * size_t(Key.Size) * Key.Size;
+	std::lock_guard<std::mutex> lock(Lock);
+
+	// Two workers can compute the same tile at once, the first one stays
+	if (Index.count(Key) || Data->size() > MemoryBytes)
+		return;
+
+	Bytes += Data->size();
+	RawBytes += raw;
+	Recent.push_front({ Key, std::move(Data) });
+	Index[Key] = Recent.begin();
+
+	while (Bytes > MemoryBytes)
+	{
+		const Entry& oldest = Recent.back();
+		Bytes -= oldest.Data->size();
+		RawBytes -= 16 * size_t(oldest.Key.Size) * oldest.Key.Size;
+		Index.erase(oldest.Key);
+		Recent.pop_back();
+		Evictions++;
+	}
+}
+
+void IterationCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	Recent.clear();
+	Index.clear();
+	Bytes = 0;
+	RawBytes = 0;
+}
+
+IterationCacheStats IterationCache::GetStats() const
+{
+	IterationCacheStats stats;
+	stats.MemoryHits = MemoryHits;
+	stats.DiskHits = DiskHits;
+	stats.Misses = Misses;
+	stats.Evictions = Evictions;
+	stats.DiskWrites = DiskWrites;
+
+	std::lock_guard<std::mutex> lock(Lock);
+	stats.Tiles = Index.size();
+	stats.Bytes = Bytes;
+	stats.RawBytes = RawBytes;
+	return stats;
+}
+
+void IterationCache::ResetStats()
+{
+	MemoryHits = 0;
+	DiskHits = 0;
+	Misses = 0;
+	Evictions = 0;
+	DiskWrites = 0;
+}
+
+std::string IterationCache::TilePath(const TileKey& Key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.tile", (unsigned long long)Key.Hash());
+	return Directory + "/" + name;
+}
+
+bool IterationCache::ReadTile(const TileKey& Key, std::vector<uint8_t>& Data) const
+{
+	MappedFile file(TilePath(Key));
+	if (file.Size < sizeof(uint64_t) * HeaderWords)
+		return false;
+
+	// Another key with the same hash, or a file from an older format, is just a miss
+	uint64_t expected[HeaderWords], header[HeaderWords];
+	memcpy(header, file.Data, sizeof(header));
+	MakeHeader(Key, header[DataSize], expected);
+	if (memcmp(header, expected, sizeof(header)) || header[DataSize] != file.Size - sizeof(header))
+		return false;
+
+	Data.assign(file.Data + sizeof(header), file.Data + file.Size);
+	return true;
+}
+
+bool IterationCache::WriteTile(const TileKey& Key, const std::vector<uint8_t>& Data)
+{
+	// Written under another name and renamed, so a tile file that exists is always complete
+	const std::string path = TilePath(Key);
+	const std::string temp = path + "." + std::to_string(PartCount++) + ".part";
+	FILE * file = fopen(temp.c_str(), "wb");
+	if (!file)
+		return false;
+
+	uint64_t header[HeaderWords];
+	MakeHeader(Key, Data.size(), header);
+	bool ok = fwrite(header, sizeof(header), 1, file) == 1 && fwrite(Data.data(), 1, Data.size(), file) == Data.size();
+	ok = fclose(file) == 0 && ok;
+
+#if defined(_WIN32)
+	ok = ok && MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+	ok = ok && rename(temp.c_str(), path.c_str()) == 0;
+#endif
+	if (!ok)
+		remove(temp.c_str());
+	return ok;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Kernels.h"
+
+// Iteration counts of square tiles of an image, kept across frames (see Renderer::SetIterationCache)
+// A tile is addressed by everything that decides its counts, down to the bits of the image's CoeffB, so the counts that
+// come back are the ones the kernel would give, never the ones of a view that's merely close. Frames that get tiles
+// back are the ones with the same CoeffB : views seen before, and regions of a bigger image (bands, Deep Zoom tiles)
+// Tiles are kept compressed in a memory LRU and, optionally, as one file per tile in a directory, read back mapped
+
+struct TileKey
+{
+	uint32_t X; // Top left pixel of the tile on the image
+	uint32_t Y;
+	double CoeffB_X; // Of the image, see FrameParams
+	double CoeffB_Y;
+	double Spacing; // Pixel size, same on both axes
+	uint32_t Iterations;
+	uint32_t Kernel; // Kernels don't all give the same counts, see CacheKernelID
+	uint32_t Size;
+	bool Smooth;
+	Fractal Formula;
+	bool Julia;
+	double JuliaX; // Only set with Julia, 0 otherwise
+	double JuliaY;
+
+	bool operator==(const TileKey& Other) const;
+	uint64_t Hash() const;
+};
+
+// Instruction set and precision of the kernel that computed a tile
+inline uint32_t CacheKernelID(KernelISA ISA, bool SinglePrecision)
+{
+	return 2 * uint32_t(ISA) + (SinglePrecision ? 1 : 0);
+}
+
+// Frame params of just the tile, a region of the image at the key's top left pixel
+FrameParams CacheTileFrame(const TileKey& Key, const FrameParams& Frame);
+
+// Delta and run length coding of counts : every run of equal steps from one count to the next is a varint with its
+// length and a zigzag varint with the step. The inside of the set and bands of escape counts end up a few bytes
+void CompressIterations(const uint32_t * Iters, size_t Count, std::vector<uint8_t>& Out);
+bool DecompressIterations(const uint8_t * Data, size_t Size, uint32_t * Iters, size_t Count);
+
+struct IterationCacheStats
+{
+	uint64_t MemoryHits = 0;
+	uint64_t DiskHits = 0;
+	uint64_t Misses = 0;
+	uint64_t Evictions = 0; // Out of memory only, files stay
+	uint64_t DiskWrites = 0;
+	uint64_t Tiles = 0; // In memory now
+	uint64_t Bytes = 0; // Compressed size of those
+	uint64_t RawBytes = 0; // And what they'd take uncompressed
+};
+
+class IterationCache
+{
+public:
+	// Keeps up to MemoryBytes of compressed tiles. With a Directory, every tile is also written there and tiles that
+	// aren't in memory are looked up there before giving up. The directory is made if it isn't there, not its parents
+	IterationCache(size_t MemoryBytes = size_t(256) << 20, const std::string& Directory = "");
+
+	// Fills Iters with the Size*Size*4 counts of Key and returns true if the tile is known. Thread safe
+	bool Find(const TileKey& Key, uint32_t * Iters);
+
+	// Adds a tile that was just computed, counts laid out like the kernels write them. Thread safe
+	void Insert(const TileKey& Key, const uint32_t * Iters);
+
+	// Empties memory, files are left alone
+	void Clear();
+
+	IterationCacheStats GetStats() const;
+	void ResetStats();
+
+	size_t GetMemoryBytes() const { return MemoryBytes; }
+	const std::string& GetDirectory() const { return Directory; }
+private:
+	struct Entry
+	{
+		TileKey Key;
+		std::shared_ptr<const std::vector<uint8_t>> Data;
+	};
+	struct KeyHash
+	{
+		size_t operator()(const TileKey& Key) const { return size_t(Key.Hash()); }
+	};
+
+	void Remember(const TileKey& Key, std::shared_ptr<const std::vector<uint8_t>> Data);
+	std::string TilePath(const TileKey& Key) const;
+	bool ReadTile(const TileKey& Key, std::vector<uint8_t>& Data) const;
+	bool WriteTile(const TileKey& Key, const std::vector<uint8_t>& Data);
+
+	const size_t MemoryBytes;
+	const std::string Directory;
+
+	mutable std::mutex Lock;
+	std::list<Entry> Recent; // Most recently used first
+	std::unordered_map<TileKey, std::list<Entry>::iterator, KeyHash> Index;
+	size_t Bytes = 0;
+	size_t RawBytes = 0;
+
+	std::atomic<uint64_t> MemoryHits{ 0 };
+	std::atomic<uint64_t> DiskHits{ 0 };
+	std::atomic<uint64_t> Misses{ 0 };
+	std::atomic<uint64_t> Evictions{ 0 };
+	std::atomic<uint64_t> DiskWrites{ 0 };
+	std::atomic<uint64_t> PartCount{ 0 }; // Names of files being written
+};
@@ -0,0 +1,276 @@
+#include "KernelCommon.h"
+#include <algorithm>
+#include <immintrin.h>
+#include <limits>
+
+// What the formula policies need (see Formulas.h), there's no fused multiply add here
+// The rest is for OrbitIterate
+struct AVXDouble
+{
+	typedef double Scalar;
+	typedef __m256d Vec;
+	static const int Width = 4;
+	static const bool Fused = false;
+
+	static Vec Zero() { return _mm256_setzero_pd(); }
+	static Vec Set(Scalar V) { return _mm256_set1_pd(V); }
+	static Vec Add(Vec A, Vec B) { return _mm256_add_pd(A, B); }
+	static Vec Sub(Vec A, Vec B) { return _mm256_sub_pd(A, B); }
+	static Vec Mul(Vec A, Vec B) { return _mm256_mul_pd(A, B); }
+	static Vec FMA(Vec A, Vec B, Vec C) { return _mm256_add_pd(_mm256_mul_pd(A, B), C); }
+	static Vec Abs(Vec A) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), A); }
+	static Vec Min(Vec A, Vec B) { return _mm256_min_pd(A, B); }
+	static Vec Max(Vec A, Vec B) { return _mm256_max_pd(A, B); }
+	static Vec Load(const Scalar * Src) { return _mm256_load_pd(Src); }
+	static void Store(Scalar * Dst, Vec V) { _mm256_store_pd(Dst, V); }
+
+	// Same as AVX2Double, but without 256 bit integer ops the bits go through two SSE halves
+	static void Split(Vec X, Vec& Exponent, Vec& T)
+	{
+		const __m128i magic = _mm_set1_epi64x(0x4330000000000000);
+		const __m128i mantissa = _mm_set1_epi64x(0x000FFFFFFFFFFFFF);
+		const __m128i one = _mm_set1_epi64x(0x3FF0000000000000);
+		const __m128i halves[2] = { _mm_castpd_si128(_mm256_castpd256_pd128(X)), _mm_castpd_si128(_mm256_extractf128_pd(X, 1)) };
+
+		__m128d e[2], t[2];
+		for (int h = 0; h < 2; h++)
+		{
+			e[h] = _mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(halves[h], 52), magic));
+			t[h] = _mm_castsi128_pd(_mm_or_si128(_mm_and_si128(halves[h], mantissa), one));
+		}
+		Exponent = _mm256_sub_pd(_mm256_insertf128_pd(_mm256_castpd128_pd256(e[0]), e[1], 1), _mm256_set1_pd(4503599627370496.0 + 1023.0));
+		T = _mm256_sub_pd(_mm256_insertf128_pd(_mm256_castpd128_pd256(t[0]), t[1], 1), _mm256_set1_pd(1.0));
+	}
+
+	static uint32_t Escaped(Vec R2, Vec Limit)
+	{
+		return uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(R2, Limit, _CMP_NLE_UQ)));
+	}
+
+	static uint32_t Less(Vec A, Vec B)
+	{
+		return uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(A, B, _CMP_LT_OQ)));
+	}
+};
+
+namespace
+{
+// The block kernel takes the log2 in floats, so the orbit kernel does too
+template<uint32_t Power>
+struct OrbitFraction<AVXDouble, Power>
+{
+	static __m256d Get(__m256d R2) { return _mm256_cvtps_pd(SmoothFraction<SSEFloat, Power>(_mm256_cvtpd_ps(R2))); }
+};
+}
+
+// Iterates 4 samples at once, returns the iteration count of each one as doubles
+// Smooth counts come back already in fixed point
+// P is the position of the samples, their c or on Julia frames their starting z
+template<typename Formula, bool Julia, bool Smooth>
+static inline __m256d IterateSamples(const FrameParams& Frame, __m256d p_x, __m256d p_y)
+{
+	const uint64_t bit_mask = 0x3FF0000000000000; // Used to convert the cmp value to 1.0
+	const double bailout = BailoutRadius2(Frame);
+	const double tolerance2 = PeriodTolerance<double>() * PeriodTolerance<double>();
+	const double iterations_d = InSetCount(Frame);
+
+	__m256d bit_mask_vec = _mm256_broadcast_sd((double*)&bit_mask);
+	__m256d bailout_vec = _mm256_broadcast_sd(&bailout);
+	__m256d tolerance2_vec = _mm256_broadcast_sd(&tolerance2);
+	__m256d iterations_vec = _mm256_broadcast_sd(&iterations_d);
+
+	// Do the iteration
+	const __m256d c_x = Julia ? _mm256_set1_pd(Frame.JuliaX) : p_x;
+	const __m256d c_y = Julia ? _mm256_set1_pd(Frame.JuliaY) : p_y;
+	__m256d z_x = Julia ? p_x : _mm256_setzero_pd();
+	__m256d z_y = Julia ? p_y : _mm256_setzero_pd();
+	__m256d y2 = _mm256_mul_pd(z_y, z_y);
+	__m256d iters = _mm256_setzero_pd();
+
+	// Sub pixels known to be on the set (the cardioid and the period 2 bulb), and found periodic
+	bool all_inside = false;
+	if (std::is_same<Formula, MandelbrotFormula>::value && !Julia)
+	{
+		alignas(32) double c_x_array[4], c_y_array[4];
+		_mm256_store_pd(c_x_array, c_x);
+		_mm256_store_pd(c_y_array, c_y);
+		all_inside = true;
+		for (int s = 0; s < 4; s++)
+			all_inside &= InCardioidOrBulb(c_x_array[s], c_y_array[s]);
+	}
+
+	__m256d periodic = _mm256_setzero_pd();
+	__m256d saved_x = _mm256_setzero_pd();
+	__m256d saved_y = _mm256_setzero_pd();
+	uint32_t next_save = PeriodCheckInterval;
+	uint32_t save_window = PeriodCheckInterval;
+
+	// Lanes keep iterating after they escape, so smooth counts keep |z|^2 from the step where they did
+	// Past the bailout |z| only grows, so that's the smallest |z|^2 seen out there. Lanes still inside are made NaN,
+	// which min skips, instead of blending with another mask. AVX only has 16 registers and the loop needs most of them
+	__m256d escape_r2 = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+
+	for (uint32_t n = 0; n < Frame.Iterations && !all_inside; n++)
+	{
+		// z = f(z) + c, keeping y^2 from the previous length check
+		Formula::template Step<AVXDouble>(z_x, z_y, y2, c_x, c_y);
+
+		// Compute length
+		__m256d x2_r = _mm256_mul_pd(z_x, z_x);
+		y2 = _mm256_mul_pd(z_y, z_y);
+		__m256d r2 = _mm256_add_pd(x2_r, y2);
+
+		// Check if length <= 4 (or the smooth bailout)
+		__m256d r2_value = r2;
+		r2 = _mm256_cmp_pd(r2, bailout_vec, _CMP_LE_OQ);
+		if (Smooth)
+			escape_r2 = _mm256_min_pd(_mm256_or_pd(r2_value, r2), escape_r2);
+
+		// If all are 0 after removing the periodic ones, that means they are all r^2 > 4, so end
+		if (_mm256_testc_pd(periodic, r2))
+			break;
+
+		// Cycle detection every few steps, lanes that come back to their saved point are on the set
+		uint32_t step = n + 1;
+		if (step % PeriodCheckInterval == 0)
+		{
+			__m256d d_x = _mm256_sub_pd(z_x, saved_x);
+			__m256d d_y = _mm256_sub_pd(z_y, saved_y);
+			__m256d d2 = _mm256_add_pd(_mm256_mul_pd(d_x, d_x), _mm256_mul_pd(d_y, d_y));
+			periodic = _mm256_or_pd(periodic, _mm256_and_pd(r2, _mm256_cmp_pd(d2, tolerance2_vec, _CMP_LT_OQ)));
+
+			// All 4 started together, so they share the save schedule
+			if (step == next_save)
+			{
+				saved_x = z_x;
+				saved_y = z_y;
+				save_window *= 2;
+				next_save += save_window;
+			}
+		}
+
+		// Now convert the cmp mask to a 1.0 or 0.0
+		r2 = _mm256_and_pd(r2, bit_mask_vec);
+
+		// Finally, increase iterations count
+		// By using the mask and not just + 1, you only increase the values that are still bounded
+		iters = _mm256_add_pd(iters, r2);
+	}
+
+	if (Smooth)
+	{
+		const double scale = 1 << SmoothFractionBits;
+		const double iterations_whole = Frame.Iterations;
+		const __m256d bounded = _mm256_cmp_pd(iters, _mm256_broadcast_sd(&iterations_whole), _CMP_EQ_OQ);
+		iters = _mm256_add_pd(_mm256_mul_pd(iters, _mm256_broadcast_sd(&scale)), _mm256_round_pd(_mm256_cvtps_pd(SmoothFraction<SSEFloat, Formula::Power>(_mm256_cvtpd_ps(escape_r2))), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+		iters = _mm256_blendv_pd(iters, iterations_vec, bounded);
+	}
+
+	// Periodic ones would have run all the iterations
+	iters = _mm256_blendv_pd(iters, iterations_vec, periodic);
+	if (all_inside)
+		iters = iterations_vec;
+
+	return iters;
+}
+
+template<typename Formula, bool Julia, bool Smooth>
+static void IterateBlock(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters)
+{
+	alignas(32) const double mask_x_array[4] = { 0.0, 0.5, 0.0, 0.5 };
+	alignas(32) const double mask_y_array[4] = { 0.0, 0.0, 0.5, 0.5 };
+
+	__m256d mask_x_vec = _mm256_load_pd(mask_x_array);
+	__m256d mask_y_vec = _mm256_load_pd(mask_y_array);
+	__m256d coeff_a_x_vec = _mm256_broadcast_sd(&Frame.CoeffA_X);
+	__m256d coeff_a_y_vec = _mm256_broadcast_sd(&Frame.CoeffA_Y);
+	__m256d coeff_b_x_vec = _mm256_broadcast_sd(&Frame.CoeffB_X);
+	__m256d coeff_b_y_vec = _mm256_broadcast_sd(&Frame.CoeffB_Y);
+
+	for (uint32_t j = 0; j < SizeY; j++)
+	{
+		for (uint32_t i = 0; i < SizeX; i++, Iters += 4)
+		{
+			uint32_t pX = Frame.OriginX + BlockX + i;
+			uint32_t pY = Frame.OriginY + BlockY + j;
+
+			double px_d = pX;
+			double py_d = pY;
+
+			// Load the pixel positions
+			__m256d c_x = _mm256_broadcast_sd(&px_d);
+			__m256d c_y = _mm256_broadcast_sd(&py_d);
+
+			// Add the subpixel offsets for SSAA
+			c_x = _mm256_add_pd(c_x, mask_x_vec);
+			c_y = _mm256_add_pd(c_y, mask_y_vec);
+
+			// Normalize pixel pos
+			c_x = _mm256_mul_pd(c_x, coeff_a_x_vec);
+			c_y = _mm256_mul_pd(c_y, coeff_a_y_vec);
+			c_x = _mm256_add_pd(c_x, coeff_b_x_vec);
+			c_y = _mm256_add_pd(c_y, coeff_b_y_vec);
+
+			// The 4 samples of the pixel are already in the order the shading wants them
+			__m128i iters_i = _mm256_cvtpd_epi32(IterateSamples<Formula, Julia, Smooth>(Frame, c_x, c_y));
+			_mm_storeu_si128((__m128i*)Iters, iters_i);
+		}
+	}
+}
+
+template<typename Formula, bool Julia, bool Smooth>
+static void IterateList(const FrameParams& Frame, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters)
+{
+	const double half = 0.5;
+	__m256d half_vec = _mm256_broadcast_sd(&half);
+	__m256d coeff_a_x_vec = _mm256_broadcast_sd(&Frame.CoeffA_X);
+	__m256d coeff_a_y_vec = _mm256_broadcast_sd(&Frame.CoeffA_Y);
+	__m256d coeff_b_x_vec = _mm256_broadcast_sd(&Frame.CoeffB_X);
+	__m256d coeff_b_y_vec = _mm256_broadcast_sd(&Frame.CoeffB_Y);
+
+	for (uint32_t i = 0; i < Count; i += 4)
+	{
+		// The last group repeats its last sample to fill the register
+		alignas(32) double s_x[4], s_y[4];
+		for (uint32_t s = 0; s < 4; s++)
+		{
+			const SamplePoint& sample = Samples[std::min(i + s, Count - 1)];
+			s_x[s] = 2.0 * Frame.OriginX + sample.X;
+			s_y[s] = 2.0 * Frame.OriginY + sample.Y;
+		}
+
+		// Same c as the block kernel, the sample position is exact before scaling
+		__m256d c_x = _mm256_mul_pd(_mm256_load_pd(s_x), half_vec);
+		__m256d c_y = _mm256_mul_pd(_mm256_load_pd(s_y), half_vec);
+		c_x = _mm256_add_pd(_mm256_mul_pd(c_x, coeff_a_x_vec), coeff_b_x_vec);
+		c_y = _mm256_add_pd(_mm256_mul_pd(c_y, coeff_a_y_vec), coeff_b_y_vec);
+
+		alignas(32) double iters[4];
+		_mm256_store_pd(iters, IterateSamples<Formula, Julia, Smooth>(Frame, c_x, c_y));
+		for (uint32_t s = 0; s < 4 && i + s < Count; s++)
+			Iters[i + s] = uint32_t(iters[s]);
+	}
+}
+
+void MandelbrotBlock_AVX(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters)
+{
+	WithFrameKernel(Frame, [&](auto Formula, auto Julia, auto Smooth)
+	{
+		IterateBlock<decltype(Formula), decltype(Julia)::value, decltype(Smooth)::value>(Frame, BlockX, BlockY, SizeX, SizeY, Iters);
+	});
+}
+
+void MandelbrotSamples_AVX(const FrameParams& Frame, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters)
+{
+	WithFrameKernel(Frame, [&](auto Formula, auto Julia, auto Smooth)
+	{
+		IterateList<decltype(Formula), decltype(Julia)::value, decltype(Smooth)::value>(Frame, Samples, Count, Iters);
+	});
+}
+
+// 16 registers, two groups of five leave room for the constants
+void MandelbrotOrbits_AVX(const FrameParams& Frame, OrbitList& List, uint32_t Steps, uint32_t * Iters)
+{
+	// IterateSamples saves on the 1st check and compares against the origin before that
+	OrbitRun<AVXDouble, 2, SaveSchedule<1, UINT32_MAX, true>>(Frame, List, Steps, Iters);
+}
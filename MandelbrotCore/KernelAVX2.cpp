@@ -0,0 +1,184 @@
+#include "KernelCommon.h"
+#include <immintrin.h>
+
+// AVX2 has no expand load, so it's done with a permute from a table indexed by the lanes mask
+// The k-th lane on the mask takes the k-th element from memory. Indices are for 32 bit elements
+static const struct ExpandTables
+{
+	alignas(32) int32_t Double[16][8];
+	alignas(32) int32_t Float[256][8];
+
+	ExpandTables()
+	{
+		for (int mask = 0; mask < 256; mask++)
+		{
+			int k = 0;
+			for (int lane = 0; lane < 8; lane++)
+				Float[mask][lane] = (mask & (1 << lane)) ? k++ : 0;
+		}
+
+		for (int mask = 0; mask < 16; mask++)
+		{
+			int k = 0;
+			for (int lane = 0; lane < 4; lane++)
+			{
+				int src = (mask & (1 << lane)) ? k++ : 0;
+				Double[mask][2 * lane] = 2 * src;
+				Double[mask][2 * lane + 1] = 2 * src + 1;
+			}
+		}
+	}
+} ExpandPermute;
+
+struct AVX2Double
+{
+	typedef double Scalar;
+	typedef __m256d Vec;
+	static const int Width = 4;
+	static const bool Fused = true;
+
+	static Vec Zero() { return _mm256_setzero_pd(); }
+	static Vec Set(Scalar V) { return _mm256_set1_pd(V); }
+	static Vec Add(Vec A, Vec B) { return _mm256_add_pd(A, B); }
+	static Vec Sub(Vec A, Vec B) { return _mm256_sub_pd(A, B); }
+	static Vec Mul(Vec A, Vec B) { return _mm256_mul_pd(A, B); }
+	static Vec FMA(Vec A, Vec B, Vec C) { return _mm256_fmadd_pd(A, B, C); }
+	static Vec Abs(Vec A) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), A); }
+	static Vec Min(Vec A, Vec B) { return _mm256_min_pd(A, B); }
+	static Vec Max(Vec A, Vec B) { return _mm256_max_pd(A, B); }
+	static Vec Load(const Scalar * Src) { return _mm256_load_pd(Src); }
+	static void Store(Scalar * Dst, Vec V) { _mm256_store_pd(Dst, V); }
+
+	// No 64 bit int to double before AVX-512, the exponent goes in the mantissa of 2^52 instead
+	static void Split(Vec X, Vec& Exponent, Vec& T)
+	{
+		const __m256i bits = _mm256_castpd_si256(X);
+		const __m256i magic = _mm256_set1_epi64x(0x4330000000000000);
+		Exponent = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), magic)), _mm256_set1_pd(4503599627370496.0 + 1023.0));
+		T = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFF)), _mm256_set1_epi64x(0x3FF0000000000000))), _mm256_set1_pd(1.0));
+	}
+
+	static uint32_t Escaped(Vec R2, Vec Limit)
+	{
+		return uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(R2, Limit, _CMP_NLE_UQ)));
+	}
+
+	static uint32_t Less(Vec A, Vec B)
+	{
+		return uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(A, B, _CMP_LT_OQ)));
+	}
+
+	// All ones on the lanes of Mask
+	static Vec LaneMask(uint32_t Mask)
+	{
+		const __m256i bits = _mm256_setr_epi64x(1, 2, 4, 8);
+		return _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(Mask), bits), bits));
+	}
+
+	static Vec Expand(Vec Old, uint32_t Mask, const Scalar * Src)
+	{
+		__m256 src = _mm256_castpd_ps(_mm256_loadu_pd(Src));
+		__m256i perm = _mm256_load_si256((const __m256i*)ExpandPermute.Double[Mask]);
+		return _mm256_blendv_pd(Old, _mm256_castps_pd(_mm256_permutevar8x32_ps(src, perm)), LaneMask(Mask));
+	}
+
+	static Vec Clear(Vec V, uint32_t Mask)
+	{
+		return _mm256_andnot_pd(LaneMask(Mask), V);
+	}
+
+	static Vec Select(Vec A, uint32_t Mask, Vec B)
+	{
+		return _mm256_blendv_pd(A, B, LaneMask(Mask));
+	}
+};
+
+struct AVX2Float
+{
+	typedef float Scalar;
+	typedef __m256 Vec;
+	static const int Width = 8;
+	static const bool Fused = true;
+
+	static Vec Zero() { return _mm256_setzero_ps(); }
+	static Vec Set(Scalar V) { return _mm256_set1_ps(V); }
+	static Vec Add(Vec A, Vec B) { return _mm256_add_ps(A, B); }
+	static Vec Sub(Vec A, Vec B) { return _mm256_sub_ps(A, B); }
+	static Vec Mul(Vec A, Vec B) { return _mm256_mul_ps(A, B); }
+	static Vec FMA(Vec A, Vec B, Vec C) { return _mm256_fmadd_ps(A, B, C); }
+	static Vec Abs(Vec A) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), A); }
+	static Vec Min(Vec A, Vec B) { return _mm256_min_ps(A, B); }
+	static Vec Max(Vec A, Vec B) { return _mm256_max_ps(A, B); }
+	static Vec Load(const Scalar * Src) { return _mm256_load_ps(Src); }
+	static void Store(Scalar * Dst, Vec V) { _mm256_store_ps(Dst, V); }
+
+	static void Split(Vec X, Vec& Exponent, Vec& T)
+	{
+		const __m256i bits = _mm256_castps_si256(X);
+		Exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+		T = _mm256_sub_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000))), _mm256_set1_ps(1.0f));
+	}
+
+	static uint32_t Escaped(Vec R2, Vec Limit)
+	{
+		return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(R2, Limit, _CMP_NLE_UQ)));
+	}
+
+	static uint32_t Less(Vec A, Vec B)
+	{
+		return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(A, B, _CMP_LT_OQ)));
+	}
+
+	static Vec LaneMask(uint32_t Mask)
+	{
+		const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+		return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(int(Mask)), bits), bits));
+	}
+
+	static Vec Expand(Vec Old, uint32_t Mask, const Scalar * Src)
+	{
+		__m256i perm = _mm256_load_si256((const __m256i*)ExpandPermute.Float[Mask]);
+		return _mm256_blendv_ps(Old, _mm256_permutevar8x32_ps(_mm256_loadu_ps(Src), perm), LaneMask(Mask));
+	}
+
+	static Vec Clear(Vec V, uint32_t Mask)
+	{
+		return _mm256_andnot_ps(LaneMask(Mask), V);
+	}
+
+	static Vec Select(Vec A, uint32_t Mask, Vec B)
+	{
+		return _mm256_blendv_ps(A, B, LaneMask(Mask));
+	}
+};
+
+// Each group takes 5 registers, 3 groups is all AVX2 can hold without spilling
+void MandelbrotBlock_AVX2(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters)
+{
+	PixelParallelBlock<AVX2Double, 3>(Frame, BlockX, BlockY, SizeX, SizeY, Iters);
+}
+
+void MandelbrotBlock_AVX2_Float(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters)
+{
+	PixelParallelBlock<AVX2Float, 3>(Frame, BlockX, BlockY, SizeX, SizeY, Iters);
+}
+
+void MandelbrotSamples_AVX2(const FrameParams& Frame, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters)
+{
+	PixelParallelSamples<AVX2Double, 3>(Frame, Samples, Count, Iters);
+}
+
+void MandelbrotSamples_AVX2_Float(const FrameParams& Frame, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters)
+{
+	PixelParallelSamples<AVX2Float, 3>(Frame, Samples, Count, Iters);
+}
+
+void MandelbrotOrbits_AVX2(const FrameParams& Frame, OrbitList& List, uint32_t Steps, uint32_t * Iters)
+{
+	OrbitRun<AVX2Double, 3>(Frame, List, Steps, Iters);
+}
+
+void MandelbrotOrbits_AVX2_Float(const FrameParams& Frame, OrbitList& List, uint32_t Steps, uint32_t * Iters)
+{
+	OrbitRun<AVX2Float, 3>(Frame, List, Steps, Iters);
+}
@@ -0,0 +1,137 @@
+#include "KernelCommon.h"
+#include <immintrin.h>
+
+// Mask registers for the compares and a native expand load, getexp/getmant for the log2 of smooth counts
+
+struct AVX512Double
+{
+	typedef double Scalar;
+	typedef __m512d Vec;
+	static const int Width = 8;
+	static const bool Fused = true;
+
+	static Vec Zero() { return _mm512_setzero_pd(); }
+	static Vec Set(Scalar V) { return _mm512_set1_pd(V); }
+	static Vec Add(Vec A, Vec B) { return _mm512_add_pd(A, B); }
+	static Vec Sub(Vec A, Vec B) { return _mm512_sub_pd(A, B); }
+	static Vec Mul(Vec A, Vec B) { return _mm512_mul_pd(A, B); }
+	static Vec FMA(Vec A, Vec B, Vec C) { return _mm512_fmadd_pd(A, B, C); }
+	static Vec Abs(Vec A) { return _mm512_abs_pd(A); }
+	static Vec Min(Vec A, Vec B) { return _mm512_min_pd(A, B); }
+	static Vec Max(Vec A, Vec B) { return _mm512_max_pd(A, B); }
+	static Vec Load(const Scalar * Src) { return _mm512_load_pd(Src); }
+	static void Store(Scalar * Dst, Vec V) { _mm512_store_pd(Dst, V); }
+
+	static void Split(Vec X, Vec& Exponent, Vec& T)
+	{
+		Exponent = _mm512_getexp_pd(X);
+		T = _mm512_sub_pd(_mm512_getmant_pd(X, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_zero), Set(1));
+	}
+
+	static uint32_t Escaped(Vec R2, Vec Limit)
+	{
+		return uint32_t(_mm512_cmp_pd_mask(R2, Limit, _CMP_NLE_UQ));
+	}
+
+	static uint32_t Less(Vec A, Vec B)
+	{
+		return uint32_t(_mm512_cmp_pd_mask(A, B, _CMP_LT_OQ));
+	}
+
+	static Vec Expand(Vec Old, uint32_t Mask, const Scalar * Src)
+	{
+		return _mm512_mask_expandloadu_pd(Old, __mmask8(Mask), Src);
+	}
+
+	static Vec Clear(Vec V, uint32_t Mask)
+	{
+		return _mm512_maskz_mov_pd(__mmask8(~Mask), V);
+	}
+
+	static Vec Select(Vec A, uint32_t Mask, Vec B)
+	{
+		return _mm512_mask_mov_pd(A, __mmask8(Mask), B);
+	}
+};
+
+struct AVX512Float
+{
+	typedef float Scalar;
+	typedef __m512 Vec;
+	static const int Width = 16;
+	static const bool Fused = true;
+
+	static Vec Zero() { return _mm512_setzero_ps(); }
+	static Vec Set(Scalar V) { return _mm512_set1_ps(V); }
+	static Vec Add(Vec A, Vec B) { return _mm512_add_ps(A, B); }
+	static Vec Sub(Vec A, Vec B) { return _mm512_sub_ps(A, B); }
+	static Vec Mul(Vec A, Vec B) { return _mm512_mul_ps(A, B); }
+	static Vec FMA(Vec A, Vec B, Vec C) { return _mm512_fmadd_ps(A, B, C); }
+	static Vec Abs(Vec A) { return _mm512_abs_ps(A); }
+	static Vec Min(Vec A, Vec B) { return _mm512_min_ps(A, B); }
+	static Vec Max(Vec A, Vec B) { return _mm512_max_ps(A, B); }
+	static Vec Load(const Scalar * Src) { return _mm512_load_ps(Src); }
+	static void Store(Scalar * Dst, Vec V) { _mm512_store_ps(Dst, V); }
+
+	static void Split(Vec X, Vec& Exponent, Vec& T)
+	{
+		Exponent = _mm512_getexp_ps(X);
+		T = _mm512_sub_ps(_mm512_getmant_ps(X, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_zero), Set(1));
+	}
+
+	static uint32_t Escaped(Vec R2, Vec Limit)
+	{
+		return uint32_t(_mm512_cmp_ps_mask(R2, Limit, _CMP_NLE_UQ));
+	}
+
+	static uint32_t Less(Vec A, Vec B)
+	{
+		return uint32_t(_mm512_cmp_ps_mask(A, B, _CMP_LT_OQ));
+	}
+
+	static Vec Expand(Vec Old, uint32_t Mask, const Scalar * Src)
+	{
+		return _mm512_mask_expandloadu_ps(Old, __mmask16(Mask), Src);
+	}
+
+	static Vec Clear(Vec V, uint32_t Mask)
+	{
+		return _mm512_maskz_mov_ps(__mmask16(~Mask), V);
+	}
+
+	static Vec Select(Vec A, uint32_t Mask, Vec B)
+	{
+		return _mm512_mask_mov_ps(A, __mmask16(Mask), B);
+	}
+};
+
+// There are 32 registers here so more groups fit, but lane masks are 32 bits so float stops at 2
+void MandelbrotBlock_AVX512(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters)
+{
+	PixelParallelBlock<AVX512Double, 4>(Frame, BlockX, BlockY, SizeX, SizeY, Iters);
+}
+
+void MandelbrotBlock_AVX512_Float(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters)
+{
+	PixelParallelBlock<AVX512Float, 2>(Frame, BlockX, BlockY, SizeX, SizeY, Iters);
+}
+
+void MandelbrotSamples_AVX512(const FrameParams& Frame, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters)
+{
+	PixelParallelSamples<AVX512Double, 4>(Frame, Samples, Count, Iters);
+}
+
+void MandelbrotSamples_AVX512_Float(const FrameParams& Frame, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters)
+{
+	PixelParallelSamples<AVX512Float, 2>(Frame, Samples, Count, Iters);
+}
+
+void MandelbrotOrbits_AVX512(const FrameParams& Frame, OrbitList& List, uint32_t Steps, uint32_t * Iters)
+{
+	OrbitRun<AVX512Double, 4>(Frame, List, Steps, Iters);
+}
+
+void MandelbrotOrbits_AVX512_Float(const FrameParams& Frame, OrbitList& List, uint32_t Steps, uint32_t * Iters)
+{
+	OrbitRun<AVX512Float, 2>(Frame, List, Steps, Iters);
+}
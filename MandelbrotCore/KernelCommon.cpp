@@ -0,0 +1,66 @@
+#include "KernelCommon.h"
+#include <vector>
+
+uint32_t * SampleScratch(size_t Count)
+{
+	static thread_local std::vector<uint32_t> scratch;
+	if (scratch.size() < Count)
+		scratch.resize(Count);
+	return scratch.data();
+}
+
+void OrbitList::Resize(size_t Count)
+{
+	ZX.resize(Count);
+	ZY.resize(Count);
+	CX.resize(Count);
+	CY.resize(Count);
+	SaveX.resize(Count);
+	SaveY.resize(Count);
+	Index.resize(Count);
+}
+
+void StartOrbits(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, OrbitList& List, uint32_t * Iters)
+{
+	const uint32_t count = 4 * SizeX * SizeY;
+	const bool interior = HasInteriorCheck(Frame);
+	List.Resize(count);
+
+	size_t queued = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		// Same c as SampleQueue
+		const uint32_t sub = i & 3;
+		const uint32_t pixel = i >> 2;
+		const uint32_t sample_x = 2 * (BlockX + pixel % SizeX) + (sub & 1);
+		const uint32_t sample_y = 2 * (BlockY + pixel / SizeX) + (sub >> 1);
+		const double p_x = (0.5 * (2.0 * Frame.OriginX + sample_x)) * Frame.CoeffA_X + Frame.CoeffB_X;
+		const double p_y = (0.5 * (2.0 * Frame.OriginY + sample_y)) * Frame.CoeffA_Y + Frame.CoeffB_Y;
+
+		Iters[i] = InSetCount(Frame);
+		if (interior && InCardioidOrBulb(p_x, p_y))
+			continue;
+
+		List.ZX[queued] = Frame.Julia ? p_x : 0.0;
+		List.ZY[queued] = Frame.Julia ? p_y : 0.0;
+		List.CX[queued] = Frame.Julia ? Frame.JuliaX : p_x;
+		List.CY[queued] = Frame.Julia ? Frame.JuliaY : p_y;
+		List.SaveX[queued] = 0.0;
+		List.SaveY[queued] = 0.0;
+		List.Index[queued] = i;
+		queued++;
+	}
+	List.Resize(queued);
+
+	// The orbit kernel sets the cycle detection schedule up on its first call, the saved points start at the origin
+	List.Steps = 0;
+}
+
+void CompactBlock(const FrameParams& Frame, OrbitKernel Kernel, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters)
+{
+	// Per thread so the arrays keep their memory from one block to the next
+	static thread_local OrbitList orbits;
+	StartOrbits(Frame, BlockX, BlockY, SizeX, SizeY, orbits, Iters);
+	while (orbits.Size())
+		Kernel(Frame, orbits, CompactBatch, Iters);
+}
@@ -0,0 +1,742 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include "Formulas.h"
+#include "Kernels.h"
+
+// Helpers shared by the pixel parallel kernels, not part of the public interface
+
+// Per thread scratch big enough for the iteration count of every sample of a block
+uint32_t * SampleScratch(size_t Count);
+
+// The anonymous namespace gives each kernel its own copy, built with its own instruction set
+// Sharing a single inline copy across kernels could end up running AVX-512 code on an AVX2 CPU
+namespace
+{
+inline int LowestBit(uint32_t Mask)
+{
+#if defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanForward(&idx, Mask);
+	return int(idx);
+#else
+	return __builtin_ctz(Mask);
+#endif
+}
+
+inline int PopCount(uint32_t Mask)
+{
+#if defined(_MSC_VER)
+	return int(__popcnt(Mask));
+#else
+	return __builtin_popcount(Mask);
+#endif
+}
+
+// log2(1 + t) ~= t*(c0 + t*(c1 + t*(c2 + t*c3))) on [0,1), within 1e-4, plenty for 8 fraction bits
+const double Log2Poly[4] = { 1.439016597384802, -0.6799618145605086, 0.3256360378084793, -0.0847943897295745 };
+
+// log2 of positive normal numbers, the exponent plus the polynomial on the mantissa
+// V needs Split(X, Exponent, T) with X = 2^Exponent * (1 + T), on top of what PixelParallelIterate uses
+template<typename V>
+typename V::Vec FastLog2(typename V::Vec X)
+{
+	typedef typename V::Scalar Scalar;
+	typename V::Vec e, t;
+	V::Split(X, e, t);
+
+	typename V::Vec p = V::Set(Scalar(Log2Poly[3]));
+	for (int k = 2; k >= 0; k--)
+		p = V::FMA(p, t, V::Set(Scalar(Log2Poly[k])));
+	return V::FMA(p, t, e);
+}
+
+// Fraction of a smooth count from |z|^2 on the step that escaped, scaled to [0,256) so it truncates to the fixed point bits
+// Lanes that didn't escape can have anything, even denormals that take a microcode assist per operation, so everything
+// goes up to the bailout first. Overflowed and NaN lanes clamp to 0, Max returns its second operand on NaN
+// Formulas of a higher Power grow faster, the logs are then in base Power instead of 2
+template<typename V, uint32_t Power = 2>
+typename V::Vec SmoothFraction(typename V::Vec R2)
+{
+	typedef typename V::Scalar Scalar;
+	R2 = V::Max(V::Set(Scalar(SmoothBailout2)), R2);
+	typename V::Vec f;
+	if (Power == 2)
+	{
+		f = V::Sub(V::Set(Scalar(SmoothFractionBase)), FastLog2<V>(FastLog2<V>(R2)));
+	}
+	else
+	{
+		const double inv_log2_power = 1.0 / std::log2(double(Power));
+		const double base = 1.0 + (SmoothFractionBase - 1.0) * inv_log2_power;
+		f = V::Sub(V::Set(Scalar(base)), V::Mul(FastLog2<V>(FastLog2<V>(R2)), V::Set(Scalar(inv_log2_power))));
+	}
+	const typename V::Vec scaled = V::Mul(f, V::Set(Scalar(1 << SmoothFractionBits)));
+	return V::Min(V::Max(scaled, V::Zero()), V::Set(Scalar((1 << SmoothFractionBits) - 1)));
+}
+
+// 4 floats, what the AVX kernels convert their doubles to for SmoothFraction. AVX has no 256 bit integer ops
+struct SSEFloat
+{
+	typedef float Scalar;
+	typedef __m128 Vec;
+
+	static Vec Zero() { return _mm_setzero_ps(); }
+	static Vec Set(Scalar V) { return _mm_set1_ps(V); }
+	static Vec Sub(Vec A, Vec B) { return _mm_sub_ps(A, B); }
+	static Vec Mul(Vec A, Vec B) { return _mm_mul_ps(A, B); }
+	static Vec FMA(Vec A, Vec B, Vec C) { return _mm_add_ps(_mm_mul_ps(A, B), C); }
+	static Vec Min(Vec A, Vec B) { return _mm_min_ps(A, B); }
+	static Vec Max(Vec A, Vec B) { return _mm_max_ps(A, B); }
+
+	static void Split(Vec X, Vec& Exponent, Vec& T)
+	{
+		const __m128i bits = _mm_castps_si128(X);
+		Exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+		T = _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000))), _mm_set1_ps(1.0f));
+	}
+};
+
+// Fractions of the orbit kernels, which have to be the ones the block kernel of the same ISA gives
+// That's SmoothFraction on V itself for all of them but AVX, which specializes this (see KernelAVX.cpp)
+template<typename V, uint32_t Power>
+struct OrbitFraction
+{
+	static typename V::Vec Get(typename V::Vec R2) { return SmoothFraction<V, Power>(R2); }
+};
+
+// Samples of a block are numbered pixel by pixel in row order, 4 SSAA samples per pixel on a 2x2 grid
+// The queue keeps the next few of them ready in contiguous arrays, so the kernels can refill lanes with
+// a vector load instead of going through memory lane by lane
+// Samples on the main cardioid or the period 2 bulb are resolved right away and never queued (Mandelbrot only)
+// Can also walk a list of samples instead of a block, numbered in list order
+// T is the precision of the kernel, positions are always computed in double and then rounded
+// CX and CY are the position of the sample on the plane, which is c or, on Julia frames, the starting z
+template<typename T>
+struct SampleQueue
+{
+	static const uint32_t Chunk = 256;
+	static const uint32_t Capacity = 2 * Chunk;
+
+	alignas(64) T CX[Capacity] = {};
+	alignas(64) T CY[Capacity] = {};
+	uint32_t Index[Capacity];
+	uint32_t Head = 0;
+	uint32_t Tail = 0;
+
+	const FrameParams& Frame;
+	uint32_t * SampleIters;
+	const SamplePoint * Points = nullptr;
+	uint32_t BlockX = 0;
+	uint32_t SizeX = 0;
+	uint32_t Count;
+	uint32_t Next = 0;
+	uint32_t X = 0;
+	uint32_t Y = 0;
+	bool Interior;
+
+	SampleQueue(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * SampleIters)
+		: Frame(Frame), SampleIters(SampleIters), BlockX(BlockX), SizeX(SizeX), Count(4 * SizeX * SizeY), Y(BlockY), Interior(HasInteriorCheck(Frame))
+	{
+	}
+
+	SampleQueue(const FrameParams& Frame, const SamplePoint * Points, uint32_t Count, uint32_t * SampleIters)
+		: Frame(Frame), SampleIters(SampleIters), Points(Points), Count(Count), Interior(HasInteriorCheck(Frame))
+	{
+	}
+
+	uint32_t Available() const
+	{
+		return Tail - Head;
+	}
+
+	// Makes sure there are at least Min samples after Head, unless the block runs out
+	// Everything up to Head + Chunk stays readable, past Tail it's just stale values
+	void Reserve(uint32_t Min)
+	{
+		if (Available() >= Min || Next == Count)
+			return;
+
+		// Move what's left to the front and append a new chunk
+		uint32_t left = Available();
+		for (uint32_t i = 0; i < left; i++)
+		{
+			CX[i] = CX[Head + i];
+			CY[i] = CY[Head + i];
+			Index[i] = Index[Head + i];
+		}
+		Head = 0;
+		Tail = left;
+
+		for (; Tail < Chunk + left && Next < Count; Next++)
+		{
+			// Both ways end up on the same sample grid position, so they give the same c
+			const uint32_t sub = Next & 3;
+			const SamplePoint sample = Points ? Points[Next] : SamplePoint{ 2 * (BlockX + X) + (sub & 1), 2 * Y + (sub >> 1) };
+			const double c_x = (0.5 * (2.0 * Frame.OriginX + sample.X)) * Frame.CoeffA_X + Frame.CoeffB_X;
+			const double c_y = (0.5 * (2.0 * Frame.OriginY + sample.Y)) * Frame.CoeffA_Y + Frame.CoeffB_Y;
+
+			if (Interior && InCardioidOrBulb(c_x, c_y))
+			{
+				SampleIters[Next] = InSetCount(Frame);
+			}
+			else
+			{
+				CX[Tail] = T(c_x);
+				CY[Tail] = T(c_y);
+				Index[Tail] = Next;
+				Tail++;
+			}
+
+			if (!Points && sub == 3 && ++X == SizeX)
+			{
+				X = 0;
+				Y++;
+			}
+		}
+	}
+};
+
+// Iteration bookkeeping for the lanes of a pixel parallel kernel
+// Instead of a counter per lane it keeps one step count and the step each lane started on,
+// so the vector loop only has to report which lanes escaped or turned out periodic
+// Also decides when each lane replaces the saved point of the cycle detection
+template<int Lanes>
+struct LaneTracker
+{
+	static_assert(Lanes <= 32, "Lane masks are 32 bits");
+
+	uint32_t Active = 0;
+	uint64_t StepCount = 0;
+	uint64_t Deadline = UINT64_MAX; // First step where some active lane reaches the max iterations
+	uint64_t LaneStart[Lanes];
+	uint32_t LaneSample[Lanes];
+
+	// Pending saves as a calendar, one lane mask per check. Windows stop doubling at MaxSaveWindow checks
+	// so the ring never wraps onto a pending save, that still finds periods up to MaxSaveWindow*PeriodCheckInterval
+	static const uint32_t FirstSave = 2;
+	static const uint32_t MaxSaveWindow = 64;
+	static const uint32_t SaveRingSize = 2 * MaxSaveWindow;
+	uint32_t SaveRing[SaveRingSize] = {};
+	uint32_t Saved = 0; // Lanes that have a saved point, the rest still see the one from the previous sample
+	uint32_t SaveSlot[Lanes] = {};
+	uint32_t SaveWindow[Lanes];
+	uint32_t MaxIterations;
+	uint32_t InSet; // Count stored for lanes on the set
+	uint32_t CountShift; // Smooth counts get the whole part here, the kernel adds the fraction
+	uint32_t * SampleIters;
+
+	LaneTracker(const FrameParams& Frame, uint32_t * SampleIters)
+		: MaxIterations(Frame.Iterations), InSet(InSetCount(Frame)), CountShift(Frame.Smooth ? SmoothFractionBits : 0), SampleIters(SampleIters)
+	{
+	}
+
+	// Gives the next samples of the queue to the lanes on Mask, in lane order like an expand load
+	// Lanes that don't get one are retired
+	template<typename T>
+	void Start(uint32_t Mask, SampleQueue<T>& Queue)
+	{
+		for (uint32_t m = Mask; m; m &= m - 1)
+		{
+			const int lane = LowestBit(m);
+			if (Queue.Available())
+			{
+				LaneSample[lane] = Queue.Index[Queue.Head++];
+				LaneStart[lane] = StepCount;
+				Active |= 1u << lane;
+				Deadline = std::min(Deadline, StepCount + MaxIterations);
+
+				// The first save lands FirstSave checks later so lanes that escape quickly never pay for it
+				// Whatever the previous sample of the lane had pending goes away
+				Saved &= ~(1u << lane);
+				SaveRing[SaveSlot[lane]] &= ~(1u << lane);
+				SaveSlot[lane] = uint32_t(StepCount / PeriodCheckInterval + FirstSave) % SaveRingSize;
+				SaveRing[SaveSlot[lane]] |= 1u << lane;
+				SaveWindow[lane] = FirstSave;
+			}
+			else
+			{
+				Active &= ~(1u << lane);
+			}
+		}
+	}
+
+	// True if the step about to be taken has to compare against the saved points
+	bool CheckDue() const
+	{
+		return (StepCount + 1) % PeriodCheckInterval == 0;
+	}
+
+	// Call once per iteration with the lanes that escaped on it, and on check steps the ones back to their saved point
+	// Stores the result of every lane that finished and returns them
+	uint32_t Step(uint32_t EscapedMask, uint32_t PeriodicMask = 0)
+	{
+		StepCount++;
+
+		// The step where a lane escapes doesn't count
+		uint32_t done = EscapedMask & Active;
+		for (uint32_t m = done; m; m &= m - 1)
+		{
+			const int lane = LowestBit(m);
+			SampleIters[LaneSample[lane]] = uint32_t(StepCount - LaneStart[lane] - 1) << CountShift;
+		}
+
+		// Periodic lanes are on the set, same as running out of iterations
+		const uint32_t periodic = PeriodicMask & Saved & Active & ~done;
+		for (uint32_t m = periodic; m; m &= m - 1)
+			SampleIters[LaneSample[LowestBit(m)]] = InSet;
+		done |= periodic;
+
+		// Lanes on the set
+		if (StepCount >= Deadline)
+		{
+			Deadline = UINT64_MAX;
+			for (uint32_t m = Active & ~done; m; m &= m - 1)
+			{
+				const int lane = LowestBit(m);
+				if (StepCount - LaneStart[lane] >= MaxIterations)
+				{
+					SampleIters[LaneSample[lane]] = InSet;
+					done |= 1u << lane;
+				}
+				else
+				{
+					Deadline = std::min(Deadline, LaneStart[lane] + MaxIterations);
+				}
+			}
+		}
+
+		return done;
+	}
+
+	// Call on check steps after the refill, returns the lanes that have to save their current z
+	uint32_t SavesDue()
+	{
+		const uint32_t slot = uint32_t(StepCount / PeriodCheckInterval) % SaveRingSize;
+		const uint32_t saves = SaveRing[slot] & Active;
+		SaveRing[slot] = 0;
+		Saved |= saves;
+
+		for (uint32_t m = saves; m; m &= m - 1)
+		{
+			const int lane = LowestBit(m);
+			SaveWindow[lane] = std::min(2 * SaveWindow[lane], MaxSaveWindow);
+			SaveSlot[lane] = (slot + SaveWindow[lane]) % SaveRingSize;
+			SaveRing[SaveSlot[lane]] |= 1u << lane;
+		}
+		return saves;
+	}
+};
+
+// Body of the pixel parallel kernels, V wraps the vector type and instructions of one ISA and precision
+// It needs : Scalar, Vec, Width, Fused, Zero(), Set(), Add(), Sub(), Mul(), FMA(a,b,c) = a*b + c, Abs(), Min(), Max(), Split() (see FastLog2),
+// Escaped(r2, limit) and Less(a, b) returning lane masks, Expand(old, mask, src) doing an expand load,
+// Clear(v, mask), Select(a, mask, b) taking b on the lanes of mask, and aligned Load(src) / Store(dst, v)
+// Groups registers are iterated together so the FMA latency of one hides behind the others
+// Runs every sample of Queue, writing the iteration counts to its SampleIters
+// Formula is the step (see Formulas.h). Julia lanes start at their sample instead of 0 and all share the frame's c
+// Smooth only adds work on the steps where some lane escapes, plus the longer bailout
+template<typename V, int Groups, typename Formula, bool Julia, bool Smooth>
+void PixelParallelIterate(SampleQueue<typename V::Scalar>& Queue)
+{
+	typedef typename V::Vec Vec;
+	const int Lanes = V::Width * Groups;
+	const uint32_t group_bits = (1u << V::Width) - 1;
+
+	LaneTracker<Lanes> lanes(Queue.Frame, Queue.SampleIters);
+
+	const Vec bailout_vec = V::Set(typename V::Scalar(BailoutRadius2(Queue.Frame)));
+	const Vec tolerance2_vec = V::Set(PeriodTolerance<typename V::Scalar>() * PeriodTolerance<typename V::Scalar>());
+
+	Vec z_x[Groups], z_y[Groups], y2[Groups], c_x[Groups], c_y[Groups];
+	for (int g = 0; g < Groups; g++)
+	{
+		z_x[g] = z_y[g] = y2[g] = V::Zero();
+		c_x[g] = Julia ? V::Set(typename V::Scalar(Queue.Frame.JuliaX)) : V::Zero();
+		c_y[g] = Julia ? V::Set(typename V::Scalar(Queue.Frame.JuliaY)) : V::Zero();
+	}
+
+	// Saved points of the cycle detection. Only used every few steps, so they stay in memory
+	// Lanes ignore theirs until the tracker says they saved one, so refills don't have to clear them
+	alignas(64) typename V::Scalar s_x[Lanes] = {};
+	alignas(64) typename V::Scalar s_y[Lanes] = {};
+
+	// Smooth fractions of the lanes that escaped on a step
+	alignas(64) typename V::Scalar fractions[Lanes];
+
+	// Restarts the lanes on Mask with the next samples of the queue
+	// Groups is a constant, loops over them have to unroll fully or z ends up living in memory,
+	// so the scalar bookkeeping is kept out of them
+	auto refill = [&](uint32_t Mask)
+	{
+		Queue.Reserve(Lanes);
+
+		uint32_t head = Queue.Head;
+		for (int g = 0; g < Groups; g++)
+		{
+			uint32_t group_mask = (Mask >> (V::Width * g)) & group_bits;
+			if (!group_mask)
+				continue;
+
+			if (Julia)
+			{
+				// y^2 is z_y^2 on every lane, the old ones just get it again
+				z_x[g] = V::Expand(z_x[g], group_mask, Queue.CX + head);
+				z_y[g] = V::Expand(z_y[g], group_mask, Queue.CY + head);
+				y2[g] = V::Mul(z_y[g], z_y[g]);
+			}
+			else
+			{
+				c_x[g] = V::Expand(c_x[g], group_mask, Queue.CX + head);
+				c_y[g] = V::Expand(c_y[g], group_mask, Queue.CY + head);
+				z_x[g] = V::Clear(z_x[g], group_mask);
+				z_y[g] = V::Clear(z_y[g], group_mask);
+				y2[g] = V::Clear(y2[g], group_mask);
+			}
+			head += PopCount(group_mask);
+		}
+
+		// Takes the same samples, lanes in order
+		lanes.Start(Mask, Queue);
+	};
+
+	// One step of every lane, with the cycle detection on check steps
+	// Check is a compile time constant so the steps in between don't carry any of that code
+	auto step = [&](auto Check)
+	{
+		uint32_t escaped_mask = 0;
+		uint32_t periodic_mask = 0;
+		Vec r2[Groups];
+
+		for (int g = 0; g < Groups; g++)
+		{
+			// z = f(z) + c, keeping y^2 from the previous length check
+			Formula::template Step<V>(z_x[g], z_y[g], y2[g], c_x[g], c_y[g]);
+
+			// Length, y^2 is reused on the next iteration
+			y2[g] = V::Mul(z_y[g], z_y[g]);
+			r2[g] = V::FMA(z_x[g], z_x[g], y2[g]);
+
+			// NaN counts as escaped
+			escaped_mask |= V::Escaped(r2[g], bailout_vec) << (V::Width * g);
+
+			if (decltype(Check)::value)
+			{
+				Vec s_xg = V::Load(s_x + V::Width * g);
+				Vec s_yg = V::Load(s_y + V::Width * g);
+				Vec d_x = V::Sub(z_x[g], s_xg);
+				Vec d_y = V::Sub(z_y[g], s_yg);
+				Vec d2 = V::FMA(d_x, d_x, V::Mul(d_y, d_y));
+				periodic_mask |= V::Less(d2, tolerance2_vec) << (V::Width * g);
+			}
+		}
+
+		// Step writes the whole part of the counts, so the fractions go after it
+		// The log2 runs on the whole register of every group where some lane escaped
+		const uint32_t escaped_lanes = escaped_mask & lanes.Active;
+		uint32_t done_mask = lanes.Step(escaped_mask, periodic_mask);
+		if (Smooth && escaped_lanes)
+		{
+			for (int g = 0; g < Groups; g++)
+			{
+				if ((escaped_lanes >> (V::Width * g)) & group_bits)
+					V::Store(fractions + V::Width * g, SmoothFraction<V, Formula::Power>(r2[g]));
+			}
+			for (uint32_t m = escaped_lanes; m; m &= m - 1)
+			{
+				const int lane = LowestBit(m);
+				Queue.SampleIters[lanes.LaneSample[lane]] += uint32_t(fractions[lane]);
+			}
+		}
+
+		if (done_mask)
+			refill(done_mask);
+
+		if (decltype(Check)::value)
+		{
+			uint32_t save_mask = lanes.SavesDue();
+			for (int g = 0; g < Groups; g++)
+			{
+				uint32_t group_mask = (save_mask >> (V::Width * g)) & group_bits;
+				if (!group_mask)
+					continue;
+
+				V::Store(s_x + V::Width * g, V::Select(V::Load(s_x + V::Width * g), group_mask, z_x[g]));
+				V::Store(s_y + V::Width * g, V::Select(V::Load(s_y + V::Width * g), group_mask, z_y[g]));
+			}
+		}
+	};
+
+	refill(uint32_t(~0ull >> (64 - Lanes)));
+
+	// Plain steps get their own loop so the check doesn't push the orbit out of registers
+	while (lanes.Active)
+	{
+		while (lanes.Active && !lanes.CheckDue())
+			step(std::false_type());
+		if (lanes.Active)
+			step(std::true_type());
+	}
+}
+
+// Calls Body(Formula(), Julia, Smooth) with the formula policy and flags of Frame as types, so every combination gets
+// its own loop and nothing is picked while iterating
+template<typename Body>
+void WithFrameKernel(const FrameParams& Frame, Body&& F)
+{
+	WithFormula(Frame.Formula, [&](auto Formula)
+	{
+		if (Frame.Julia)
+		{
+			if (Frame.Smooth)
+				F(Formula, std::true_type(), std::true_type());
+			else
+				F(Formula, std::true_type(), std::false_type());
+		}
+		else
+		{
+			if (Frame.Smooth)
+				F(Formula, std::false_type(), std::true_type());
+			else
+				F(Formula, std::false_type(), std::false_type());
+		}
+	});
+}
+
+template<typename V, int Groups>
+void PixelParallelRun(SampleQueue<typename V::Scalar>& Queue)
+{
+	WithFrameKernel(Queue.Frame, [&](auto Formula, auto Julia, auto Smooth)
+	{
+		PixelParallelIterate<V, Groups, decltype(Formula), decltype(Julia)::value, decltype(Smooth)::value>(Queue);
+	});
+}
+
+template<typename V, int Groups>
+void PixelParallelBlock(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters)
+{
+	SampleQueue<typename V::Scalar> queue(Frame, BlockX, BlockY, SizeX, SizeY, Iters);
+	PixelParallelRun<V, Groups>(queue);
+}
+
+template<typename V, int Groups>
+void PixelParallelSamples(const FrameParams& Frame, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters)
+{
+	SampleQueue<typename V::Scalar> queue(Frame, Samples, Count, Iters);
+	PixelParallelRun<V, Groups>(queue);
+}
+
+// Save schedule of the cycle detection, in checks : the first save on check First, then windows of 2*First, 4*First...
+// up to MaxWindow checks. FromStart compares against the origin until the first save, as if it had been saved there
+// Orbit kernels take the one of the block kernel of their ISA, so they compare against the same points
+template<uint32_t First, uint32_t MaxWindow, bool FromStart>
+struct SaveSchedule
+{
+	static const uint32_t FirstSave = First;
+	static const uint32_t MaxSaveWindow = MaxWindow;
+	static const bool SavedFromStart = FromStart;
+};
+
+// LaneTracker's, for the pixel parallel kernels
+typedef SaveSchedule<LaneTracker<1>::FirstSave, LaneTracker<1>::MaxSaveWindow, false> LaneSaves;
+
+// Body of the orbit kernels, same V as PixelParallelIterate without Expand, Clear and Select
+// Orbits go through in batches of Lanes, each batch iterated together until it has done the steps asked or none of
+// its orbits is still going, then the ones still going are stored back packed to the front of the list
+// Lanes that finish early sit idle until the end of their batch, with a few hundred steps per call that's a small part
+template<typename V, int Groups, typename Formula, bool Smooth, typename Schedule>
+void OrbitIterate(const FrameParams& Frame, OrbitList& List, uint32_t Steps, uint32_t * Iters)
+{
+	typedef typename V::Vec Vec;
+	typedef typename V::Scalar Scalar;
+	const int Lanes = V::Width * Groups;
+	const uint32_t all_lanes = uint32_t(~0ull >> (64 - Lanes));
+	const uint32_t group_bits = (1u << V::Width) - 1;
+
+	const uint32_t begin = std::min(List.Steps, Frame.Iterations);
+	const uint32_t end = begin + std::min(Steps, Frame.Iterations - begin);
+	const uint32_t in_set = InSetCount(Frame);
+	const uint32_t count_shift = Frame.Smooth ? SmoothFractionBits : 0;
+
+	const Vec bailout_vec = V::Set(Scalar(BailoutRadius2(Frame)));
+	const Vec tolerance2_vec = V::Set(PeriodTolerance<Scalar>() * PeriodTolerance<Scalar>());
+	const uint64_t max_window = uint64_t(Schedule::MaxSaveWindow) * PeriodCheckInterval;
+
+	// Fresh lists get the schedule here, StartOrbits doesn't know which kernel iterates them
+	if (List.Steps == 0)
+	{
+		List.Saved = Schedule::SavedFromStart;
+		List.NextSave = uint64_t(Schedule::FirstSave) * PeriodCheckInterval;
+		List.SaveWindow = List.NextSave;
+	}
+
+	alignas(64) Scalar in_x[Lanes], in_y[Lanes], in_cx[Lanes], in_cy[Lanes];
+	alignas(64) Scalar s_x[Lanes], s_y[Lanes];
+	alignas(64) Scalar fractions[Lanes];
+
+	const size_t count = List.Size();
+	size_t kept = 0;
+	for (size_t first = 0; first < count; first += Lanes)
+	{
+		// The last batch repeats its last orbit to fill the registers
+		const uint32_t live_count = uint32_t(std::min<size_t>(Lanes, count - first));
+		const uint32_t live = all_lanes >> (Lanes - live_count);
+		for (int lane = 0; lane < Lanes; lane++)
+		{
+			const size_t src = first + std::min<uint32_t>(lane, live_count - 1);
+			in_x[lane] = Scalar(List.ZX[src]);
+			in_y[lane] = Scalar(List.ZY[src]);
+			in_cx[lane] = Scalar(List.CX[src]);
+			in_cy[lane] = Scalar(List.CY[src]);
+			s_x[lane] = Scalar(List.SaveX[src]);
+			s_y[lane] = Scalar(List.SaveY[src]);
+		}
+
+		Vec z_x[Groups], z_y[Groups], y2[Groups], c_x[Groups], c_y[Groups];
+		for (int g = 0; g < Groups; g++)
+		{
+			z_x[g] = V::Load(in_x + V::Width * g);
+			z_y[g] = V::Load(in_y + V::Width * g);
+			c_x[g] = V::Load(in_cx + V::Width * g);
+			c_y[g] = V::Load(in_cy + V::Width * g);
+			y2[g] = V::Mul(z_y[g], z_y[g]);
+		}
+
+		bool saved = List.Saved;
+		uint64_t next_save = List.NextSave;
+		uint64_t save_window = List.SaveWindow;
+		uint32_t done = 0;
+		uint32_t n = begin;
+
+		// Same step as PixelParallelIterate, Check being a compile time constant keeps the compares out of plain steps
+		auto step = [&](auto Check)
+		{
+			uint32_t escaped_mask = 0;
+			uint32_t periodic_mask = 0;
+			Vec r2[Groups];
+
+			for (int g = 0; g < Groups; g++)
+			{
+				Formula::template Step<V>(z_x[g], z_y[g], y2[g], c_x[g], c_y[g]);
+				y2[g] = V::Mul(z_y[g], z_y[g]);
+				r2[g] = V::FMA(z_x[g], z_x[g], y2[g]);
+				escaped_mask |= V::Escaped(r2[g], bailout_vec) << (V::Width * g);
+
+				if (decltype(Check)::value && saved)
+				{
+					Vec d_x = V::Sub(z_x[g], V::Load(s_x + V::Width * g));
+					Vec d_y = V::Sub(z_y[g], V::Load(s_y + V::Width * g));
+					Vec d2 = V::FMA(d_x, d_x, V::Mul(d_y, d_y));
+					periodic_mask |= V::Less(d2, tolerance2_vec) << (V::Width * g);
+				}
+			}
+			n++;
+
+			// The step where an orbit escapes doesn't count
+			const uint32_t escaped = escaped_mask & live & ~done;
+			if (escaped)
+			{
+				for (uint32_t m = escaped; m; m &= m - 1)
+					Iters[List.Index[first + LowestBit(m)]] = (n - 1) << count_shift;
+
+				if (Smooth)
+				{
+					for (int g = 0; g < Groups; g++)
+					{
+						if ((escaped >> (V::Width * g)) & group_bits)
+							V::Store(fractions + V::Width * g, OrbitFraction<V, Formula::Power>::Get(r2[g]));
+					}
+					for (uint32_t m = escaped; m; m &= m - 1)
+					{
+						const int lane = LowestBit(m);
+						Iters[List.Index[first + lane]] += uint32_t(fractions[lane]);
+					}
+				}
+				done |= escaped;
+			}
+
+			if (decltype(Check)::value)
+			{
+				const uint32_t periodic = periodic_mask & live & ~done;
+				for (uint32_t m = periodic; m; m &= m - 1)
+					Iters[List.Index[first + LowestBit(m)]] = in_set;
+				done |= periodic;
+
+				if (n == next_save)
+				{
+					for (int g = 0; g < Groups; g++)
+					{
+						V::Store(s_x + V::Width * g, z_x[g]);
+						V::Store(s_y + V::Width * g, z_y[g]);
+					}
+					saved = true;
+					save_window = std::min(2 * save_window, max_window);
+					next_save += save_window;
+				}
+			}
+		};
+
+		while (n < end && done != live)
+		{
+			const uint32_t plain_end = std::min(end, n + (PeriodCheckInterval - 1 - n % PeriodCheckInterval));
+			while (n < plain_end && done != live)
+				step(std::false_type());
+			if (n < end && done != live)
+				step(std::true_type());
+		}
+
+		// Out of iterations, StartOrbits already wrote them as on the set
+		const uint32_t going = live & ~done;
+		if (!going || end == Frame.Iterations)
+			continue;
+
+		for (int g = 0; g < Groups; g++)
+		{
+			V::Store(in_x + V::Width * g, z_x[g]);
+			V::Store(in_y + V::Width * g, z_y[g]);
+		}
+		for (uint32_t m = going; m; m &= m - 1)
+		{
+			// Never past the batch being read, so packing in place is safe
+			const int lane = LowestBit(m);
+			List.ZX[kept] = double(in_x[lane]);
+			List.ZY[kept] = double(in_y[lane]);
+			List.CX[kept] = List.CX[first + lane];
+			List.CY[kept] = List.CY[first + lane];
+			List.SaveX[kept] = double(s_x[lane]);
+			List.SaveY[kept] = double(s_y[lane]);
+			List.Index[kept] = List.Index[first + lane];
+			kept++;
+		}
+	}
+	List.Resize(kept);
+
+	// Batches that ended early skipped some saves, the list goes on as if every orbit had done all the steps
+	List.Steps = end;
+	while (List.NextSave <= end)
+	{
+		List.Saved = true;
+		List.SaveWindow = std::min(2 * List.SaveWindow, max_window);
+		List.NextSave += List.SaveWindow;
+	}
+}
+
+template<typename V, int Groups, typename Schedule = LaneSaves>
+void OrbitRun(const FrameParams& Frame, OrbitList& List, uint32_t Steps, uint32_t * Iters)
+{
+	WithFormula(Frame.Formula, [&](auto Formula)
+	{
+		if (Frame.Smooth)
+			OrbitIterate<V, Groups, decltype(Formula), true, Schedule>(Frame, List, Steps, Iters);
+		else
+			OrbitIterate<V, Groups, decltype(Formula), false, Schedule>(Frame, List, Steps, Iters);
+	});
+}
+}
@@ -0,0 +1,164 @@
+#include "Kernels.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void CPUID(uint32_t Leaf, uint32_t SubLeaf, uint32_t Regs[4])
+{
+#if defined(_MSC_VER)
+	int regs[4];
+	__cpuidex(regs, int(Leaf), int(SubLeaf));
+	for (int i = 0; i < 4; i++)
+		Regs[i] = uint32_t(regs[i]);
+#else
+	__cpuid_count(Leaf, SubLeaf, Regs[0], Regs[1], Regs[2], Regs[3]);
+#endif
+}
+
+// Register state the OS saves on context switches (XCR0)
+static uint64_t XGETBV()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (uint64_t(edx) << 32) | eax;
+#endif
+}
+
+KernelISA DetectISA()
+{
+	static const KernelISA detected = []()
+	{
+		uint32_t regs[4];
+		CPUID(0, 0, regs);
+		const uint32_t max_leaf = regs[0];
+
+		CPUID(1, 0, regs);
+		const bool has_osxsave = regs[2] & (1u << 27);
+		const bool has_fma = regs[2] & (1u << 12);
+
+		// AVX is the baseline, the original kernel already needed it
+		if (!has_osxsave || max_leaf < 7)
+			return KernelISA::AVX;
+
+		const uint64_t xcr0 = XGETBV();
+		const bool os_ymm = (xcr0 & 0x6) == 0x6; // SSE and AVX state
+		const bool os_zmm = (xcr0 & 0xE6) == 0xE6; // Plus opmask and the upper ZMM registers
+
+		CPUID(7, 0, regs);
+		const bool has_avx2 = regs[1] & (1u << 5);
+		const bool has_avx512f = regs[1] & (1u << 16);
+
+		// The AVX-512 kernels are built with AVX2 and FMA too, and the compiler is free to use them anywhere in there
+		if (os_zmm && has_avx512f && has_avx2 && has_fma)
+			return KernelISA::AVX512;
+		if (os_ymm && has_avx2 && has_fma)
+			return KernelISA::AVX2;
+		return KernelISA::AVX;
+	}();
+
+	return detected;
+}
+
+const char * ISAName(KernelISA ISA)
+{
+	switch (ISA)
+	{
+	case KernelISA::AVX512: return "AVX-512";
+	case KernelISA::AVX2: return "AVX2";
+	default: return "AVX";
+	}
+}
+
+const char * FractalName(Fractal Formula)
+{
+	switch (Formula)
+	{
+	case Fractal::BurningShip: return "burningship";
+	case Fractal::Tricorn: return "tricorn";
+	case Fractal::Multibrot3: return "multibrot3";
+	case Fractal::Multibrot4: return "multibrot4";
+	default: return "mandelbrot";
+	}
+}
+
+bool FitsSinglePrecision(const FrameParams& Frame)
+{
+	// Float spacing is relative to the magnitude, and z goes up to 2 before escaping
+	// Largest coordinate on the frame, both corners checked as the view might not contain the origin
+	const double left = Frame.CoeffB_X + Frame.CoeffA_X * Frame.OriginX, top = Frame.CoeffB_Y + Frame.CoeffA_Y * Frame.OriginY;
+	const double far_x = std::max(std::abs(left), std::abs(left + Frame.CoeffA_X * Frame.Width));
+	const double far_y = std::max(std::abs(top), std::abs(top + Frame.CoeffA_Y * Frame.Height));
+	const double magnitude = std::max(2.0, std::max(far_x, far_y));
+
+	// SSAA samples are half a pixel apart, and they need a good margin over one float ulp
+	// or the rounding error that builds up while iterating shows up as noise and then blocks
+	// Noise starts around 2 ulps, so 64 keeps it well out of sight
+	const double sample_spacing = 0.5 * std::min(Frame.CoeffA_X, Frame.CoeffA_Y);
+	return sample_spacing > 64.0 * FLT_EPSILON * magnitude;
+}
+
+bool FitsDoublePrecision(const FrameParams& Frame)
+{
+	// Same margin as single precision
+	const double left = Frame.CoeffB_X + Frame.CoeffA_X * Frame.OriginX, top = Frame.CoeffB_Y + Frame.CoeffA_Y * Frame.OriginY;
+	const double far_x = std::max(std::abs(left), std::abs(left + Frame.CoeffA_X * Frame.Width));
+	const double far_y = std::max(std::abs(top), std::abs(top + Frame.CoeffA_Y * Frame.Height));
+	const double magnitude = std::max(2.0, std::max(far_x, far_y));
+
+	const double sample_spacing = 0.5 * std::min(Frame.CoeffA_X, Frame.CoeffA_Y);
+	return sample_spacing > 64.0 * DBL_EPSILON * magnitude;
+}
+
+bool UseSinglePrecision(const FrameParams& Frame, KernelISA ISA, KernelPrecision Precision)
+{
+	if (ISA == KernelISA::AVX || Precision == KernelPrecision::Double || Precision == KernelPrecision::Perturbation)
+		return false;
+	return Precision == KernelPrecision::Single || FitsSinglePrecision(Frame);
+}
+
+bool UsePerturbation(const FrameParams& Frame, KernelPrecision Precision)
+{
+	// Reference orbits and series are only worked out for the Mandelbrot set, anything else stays on double
+	if (Frame.Formula != Fractal::Mandelbrot || Frame.Julia)
+		return false;
+	return Precision == KernelPrecision::Perturbation || (Precision == KernelPrecision::Auto && !FitsDoublePrecision(Frame));
+}
+
+BlockKernel GetBlockKernel(KernelISA ISA, bool SinglePrecision)
+{
+	switch (ISA)
+	{
+	case KernelISA::AVX512: return SinglePrecision ? MandelbrotBlock_AVX512_Float : MandelbrotBlock_AVX512;
+	case KernelISA::AVX2: return SinglePrecision ? MandelbrotBlock_AVX2_Float : MandelbrotBlock_AVX2;
+	default: return MandelbrotBlock_AVX;
+	}
+}
+
+SampleKernel GetSampleKernel(KernelISA ISA, bool SinglePrecision)
+{
+	switch (ISA)
+	{
+	case KernelISA::AVX512: return SinglePrecision ? MandelbrotSamples_AVX512_Float : MandelbrotSamples_AVX512;
+	case KernelISA::AVX2: return SinglePrecision ? MandelbrotSamples_AVX2_Float : MandelbrotSamples_AVX2;
+	default: return MandelbrotSamples_AVX;
+	}
+}
+
+OrbitKernel GetOrbitKernel(KernelISA ISA, bool SinglePrecision)
+{
+	switch (ISA)
+	{
+	case KernelISA::AVX512: return SinglePrecision ? MandelbrotOrbits_AVX512_Float : MandelbrotOrbits_AVX512;
+	case KernelISA::AVX2: return SinglePrecision ? MandelbrotOrbits_AVX2_Float : MandelbrotOrbits_AVX2;
+	default: return MandelbrotOrbits_AVX;
+	}
+}
@@ -0,0 +1,133 @@
+#include "Perturbation.h"
+#include <algorithm>
+#include <immintrin.h>
+#include "KernelCommon.h"
+
+// Below this |z|^2 / |Z|^2 the offset has cancelled out the reference and lost all its precision
+static const double GlitchTolerance = 1e-6;
+
+void PerturbationSamples_AVX(const FrameParams& Frame, const ReferenceOrbit& Orbit, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters)
+{
+	const uint64_t bit_mask = 0x3FF0000000000000; // Used to convert the cmp value to 1.0
+	const double half = 0.5;
+	const double two = 2.0;
+	const double bailout = BailoutRadius2(Frame);
+	const double scale = 1 << SmoothFractionBits;
+	const double inv_radius = 1.0 / Orbit.Radius;
+	const double a_x = Orbit.A.real(), a_y = Orbit.A.imag();
+	const double b_x = Orbit.B.real(), b_y = Orbit.B.imag();
+	const double c_x = Orbit.C.real(), c_y = Orbit.C.imag();
+
+	__m256d half_vec = _mm256_broadcast_sd(&half);
+	__m256d two_vec = _mm256_broadcast_sd(&two);
+	__m256d bailout_vec = _mm256_broadcast_sd(&bailout);
+	__m256d tolerance_vec = _mm256_broadcast_sd(&GlitchTolerance);
+	__m256d bit_mask_vec = _mm256_castsi256_pd(_mm256_set1_epi64x(bit_mask));
+	__m256d coeff_a_x_vec = _mm256_broadcast_sd(&Frame.CoeffA_X);
+	__m256d coeff_a_y_vec = _mm256_broadcast_sd(&Frame.CoeffA_Y);
+	__m256d coeff_b_x_vec = _mm256_broadcast_sd(&Frame.CoeffB_X);
+	__m256d coeff_b_y_vec = _mm256_broadcast_sd(&Frame.CoeffB_Y);
+
+	const double * ref_x = Orbit.X.data();
+	const double * ref_y = Orbit.Y.data();
+
+	for (uint32_t i = 0; i < Count; i += 4)
+	{
+		// The last group repeats its last sample to fill the register
+		alignas(32) double s_x[4], s_y[4];
+		for (uint32_t s = 0; s < 4; s++)
+		{
+			const SamplePoint& sample = Samples[std::min(i + s, Count - 1)];
+			s_x[s] = sample.X;
+			s_y[s] = sample.Y;
+		}
+
+		__m256d dc_x = _mm256_mul_pd(_mm256_load_pd(s_x), half_vec);
+		__m256d dc_y = _mm256_mul_pd(_mm256_load_pd(s_y), half_vec);
+		dc_x = _mm256_add_pd(_mm256_mul_pd(dc_x, coeff_a_x_vec), coeff_b_x_vec);
+		dc_y = _mm256_add_pd(_mm256_mul_pd(dc_y, coeff_a_y_vec), coeff_b_y_vec);
+
+		// Starting offset from the series, d = ((C u + B) u + A) u
+		uint32_t n = Orbit.Skip;
+		__m256d d_x = _mm256_setzero_pd();
+		__m256d d_y = _mm256_setzero_pd();
+		if (n)
+		{
+			const __m256d inv_radius_vec = _mm256_broadcast_sd(&inv_radius);
+			const __m256d u_x = _mm256_mul_pd(dc_x, inv_radius_vec);
+			const __m256d u_y = _mm256_mul_pd(dc_y, inv_radius_vec);
+
+			__m256d t_x = _mm256_broadcast_sd(&c_x);
+			__m256d t_y = _mm256_broadcast_sd(&c_y);
+			const double * coeffs[2][2] = { { &b_x, &b_y }, { &a_x, &a_y } };
+			for (int k = 0; k < 2; k++)
+			{
+				const __m256d m_x = _mm256_sub_pd(_mm256_mul_pd(t_x, u_x), _mm256_mul_pd(t_y, u_y));
+				const __m256d m_y = _mm256_add_pd(_mm256_mul_pd(t_x, u_y), _mm256_mul_pd(t_y, u_x));
+				t_x = _mm256_add_pd(m_x, _mm256_broadcast_sd(coeffs[k][0]));
+				t_y = _mm256_add_pd(m_y, _mm256_broadcast_sd(coeffs[k][1]));
+			}
+			d_x = _mm256_sub_pd(_mm256_mul_pd(t_x, u_x), _mm256_mul_pd(t_y, u_y));
+			d_y = _mm256_add_pd(_mm256_mul_pd(t_x, u_y), _mm256_mul_pd(t_y, u_x));
+		}
+
+		__m256d active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+		__m256d glitched = _mm256_setzero_pd();
+		__m256d iters = _mm256_set1_pd(double(n));
+		__m256d escape_r2 = _mm256_setzero_pd(); // |z|^2 of the step each lane escaped on, for smooth counts
+
+		for (; n < Frame.Iterations; n++)
+		{
+			// Every lane still running needs Z(n+1), past the end of the reference they can't go on
+			if (n + 1 > Orbit.Length)
+			{
+				glitched = _mm256_or_pd(glitched, active);
+				break;
+			}
+
+			// d = (2Z + d) d + dc
+			const __m256d z_x = _mm256_broadcast_sd(ref_x + n);
+			const __m256d z_y = _mm256_broadcast_sd(ref_y + n);
+			const __m256d sum_x = _mm256_add_pd(_mm256_mul_pd(z_x, two_vec), d_x);
+			const __m256d sum_y = _mm256_add_pd(_mm256_mul_pd(z_y, two_vec), d_y);
+			const __m256d next_x = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(sum_x, d_x), _mm256_mul_pd(sum_y, d_y)), dc_x);
+			const __m256d next_y = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(sum_x, d_y), _mm256_mul_pd(sum_y, d_x)), dc_y);
+			d_x = next_x;
+			d_y = next_y;
+
+			// Full z = Z + d, for the escape and the glitch checks
+			const __m256d ref_next_x = _mm256_broadcast_sd(ref_x + n + 1);
+			const __m256d ref_next_y = _mm256_broadcast_sd(ref_y + n + 1);
+			const __m256d full_x = _mm256_add_pd(ref_next_x, d_x);
+			const __m256d full_y = _mm256_add_pd(ref_next_y, d_y);
+			const __m256d r2 = _mm256_add_pd(_mm256_mul_pd(full_x, full_x), _mm256_mul_pd(full_y, full_y));
+			const __m256d ref_r2 = _mm256_add_pd(_mm256_mul_pd(ref_next_x, ref_next_x), _mm256_mul_pd(ref_next_y, ref_next_y));
+
+			const __m256d escaped = _mm256_cmp_pd(r2, bailout_vec, _CMP_GT_OQ);
+			if (Frame.Smooth)
+				escape_r2 = _mm256_blendv_pd(escape_r2, r2, active);
+			const __m256d lost = _mm256_andnot_pd(escaped, _mm256_cmp_pd(r2, _mm256_mul_pd(ref_r2, tolerance_vec), _CMP_LT_OQ));
+			glitched = _mm256_or_pd(glitched, _mm256_and_pd(active, lost));
+			active = _mm256_andnot_pd(_mm256_or_pd(escaped, lost), active);
+
+			// Same count as the plain kernels, the step that escapes doesn't count
+			iters = _mm256_add_pd(iters, _mm256_and_pd(active, bit_mask_vec));
+			if (!_mm256_movemask_pd(active))
+				break;
+		}
+
+		// Lanes still active ran out of iterations, they are on the set
+		if (Frame.Smooth)
+		{
+			iters = _mm256_add_pd(_mm256_mul_pd(iters, _mm256_broadcast_sd(&scale)), _mm256_round_pd(_mm256_cvtps_pd(SmoothFraction<SSEFloat>(_mm256_cvtpd_ps(escape_r2))), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+			const double in_set = InSetCount(Frame);
+			iters = _mm256_blendv_pd(iters, _mm256_broadcast_sd(&in_set), active);
+		}
+
+		alignas(32) double counts[4];
+		_mm256_store_pd(counts, iters);
+		const int glitched_lanes = _mm256_movemask_pd(glitched);
+		for (uint32_t s = 0; s < 4 && i + s < Count; s++)
+			Iters[i + s] = (glitched_lanes >> s) & 1 ? GlitchedSample : uint32_t(counts[s]);
+	}
+}
@@ -0,0 +1,214 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Escape time formulas the kernels can iterate, z -> f(z) + c (see Formulas.h)
+enum class Fractal
+{
+	Mandelbrot, // z^2
+	BurningShip, // (|x| + i|y|)^2
+	Tricorn, // conj(z)^2
+	Multibrot3, // z^3
+	Multibrot4 // z^4
+};
+
+const char * FractalName(Fractal Formula);
+
+// Per frame constants shared by all the kernels
+// Pixel (x,y) maps to c = CoeffA * (x,y) + CoeffB, same as the cbuffer on the shader
+// Julia frames map pixels to the starting z instead, and every sample uses the same c
+// A region of a bigger image keeps the CoeffB of the whole image and starts at pixel Origin of it, so its pixel (x,y)
+// is at CoeffA * (Origin + (x,y)) + CoeffB and gets the same c, to the last bit, as the whole image would give it
+struct FrameParams
+{
+	double CoeffA_X;
+	double CoeffA_Y;
+	double CoeffB_X;
+	double CoeffB_Y;
+	uint32_t OriginX; // 0 unless it's a region
+	uint32_t OriginY;
+
+	uint32_t Iterations;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t ImageWidth; // Of the whole image, same as Width and Height unless it's a region
+	uint32_t ImageHeight;
+	uint32_t Stride; // Bytes per row of the output
+	bool Smooth; // Counts are fixed point smooth counts instead of whole steps, see SmoothFractionBits
+
+	Fractal Formula;
+	bool Julia;
+	double JuliaX; // c of the Julia set
+	double JuliaY;
+};
+
+// Smooth (normalized) counts : n + 1 - log2(log2|z|) with z from the step that escaped, which is continuous across
+// the bands of whole counts. Stored as fixed point so they still fit the same uint32 buffers, up to 2^24 iterations
+// They escape at |z| = 16 instead of 2, about 2 more steps per sample. The formula ignores c, which at 16 moves the
+// fraction by less than one fixed point step, while at 2 the error is a good part of a band
+const uint32_t SmoothFractionBits = 8;
+const double SmoothBailout2 = 16.0 * 16.0;
+const double SmoothFractionBase = 4.0; // 1 + log2(log2(SmoothBailout2)), puts the fraction in [0,1)
+
+// |z|^2 past which a sample escaped
+inline double BailoutRadius2(const FrameParams& Frame)
+{
+	return Frame.Smooth ? SmoothBailout2 : 4.0;
+}
+
+// Count written for samples on the set
+inline uint32_t InSetCount(const FrameParams& Frame)
+{
+	return Frame.Smooth ? Frame.Iterations << SmoothFractionBits : Frame.Iterations;
+}
+
+// Interior checks, shared by every kernel and mirrored on the shader
+// Points on the main cardioid or the period 2 bulb are on the set, so they are never iterated
+inline bool InCardioidOrBulb(double CX, double CY)
+{
+	const double q = (CX - 0.25)*(CX - 0.25) + CY*CY;
+	return q*(q + (CX - 0.25)) <= 0.25*CY*CY || (CX + 1.0)*(CX + 1.0) + CY*CY <= 0.0625;
+}
+
+// The cardioid and bulb only exist on the Mandelbrot set itself
+inline bool HasInteriorCheck(const FrameParams& Frame)
+{
+	return Frame.Formula == Fractal::Mandelbrot && !Frame.Julia;
+}
+
+// Brent style cycle detection : every PeriodCheckInterval steps z is compared against a saved point, which is
+// replaced on the 1st, 2nd, 4th, 8th... check. Saving only on checks keeps any period detectable
+// Coming back within PeriodTolerance of the saved point means the orbit is periodic, so it's on the set
+const uint32_t PeriodCheckInterval = 32;
+
+template<typename T>
+constexpr T PeriodTolerance()
+{
+	return T(16) * std::numeric_limits<T>::epsilon();
+}
+
+// Position of a sample on the SSAA grid, which has twice the resolution of the frame
+// Sample (x,y) is at pixel (x/2, y/2) of the frame, so c = CoeffA * (Origin + (x,y)/2) + CoeffB
+struct SamplePoint
+{
+	uint32_t X;
+	uint32_t Y;
+};
+
+// Computes a block of the image using AVX for x2 SSAA, writing the iteration count of every sample to Iters
+// The block must be inside the frame. Iters gets 4*SizeX*SizeY counts, pixel by pixel in row order with the 2x2 samples
+// of each one, which is what ShadeSamples colors (see Palette.h). InSetCount(Frame) means on the set
+void MandelbrotBlock_AVX(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters);
+
+// Pixel parallel kernels : every lane is an independent SSAA sample, and as soon as a lane escapes it
+// picks up the next sample of the block, so no lane waits on a slow neighbour. Use FMA for the iteration
+void MandelbrotBlock_AVX2(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters);
+void MandelbrotBlock_AVX512(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters);
+
+// Single precision versions, twice the lanes per register. Only good while pixels are far apart compared to float epsilon
+void MandelbrotBlock_AVX2_Float(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters);
+void MandelbrotBlock_AVX512_Float(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters);
+
+// Same iteration as the block kernels but on a list of samples, in list order
+// Gives the counts the block kernels get for the same samples, up to the cycle detection (see the orbit kernels)
+void MandelbrotSamples_AVX(const FrameParams& Frame, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters);
+void MandelbrotSamples_AVX2(const FrameParams& Frame, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters);
+void MandelbrotSamples_AVX512(const FrameParams& Frame, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters);
+void MandelbrotSamples_AVX2_Float(const FrameParams& Frame, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters);
+void MandelbrotSamples_AVX512_Float(const FrameParams& Frame, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters);
+
+// Samples part way through their orbit, so iterating them can stop and pick up later where it left
+// Dense arrays, the orbit kernels load a batch of them straight into registers
+// Every orbit of a list has done the same Steps iterations, they only ever advance together
+struct OrbitList
+{
+	std::vector<double> ZX; // z after Steps iterations, float kernels keep their floats here exactly
+	std::vector<double> ZY;
+	std::vector<double> CX; // c, on Julia frames the frame's for every orbit
+	std::vector<double> CY;
+	std::vector<double> SaveX; // Saved point of the cycle detection, only meaningful once Saved
+	std::vector<double> SaveY;
+	std::vector<uint32_t> Index; // Where the count goes once the orbit is over
+
+	uint32_t Steps = 0;
+
+	// Cycle detection schedule in steps, shared by the whole list since it goes together (see PeriodCheckInterval)
+	bool Saved = false;
+	uint64_t NextSave = 0;
+	uint64_t SaveWindow = 0;
+
+	size_t Size() const { return Index.size(); }
+	void Resize(size_t Count);
+};
+
+// Starts a list with every sample of a block, laid out in Iters like the block kernels do
+// Samples on the cardioid or the bulb get their count right away, the rest are queued and get InSetCount(Frame) until
+// they're done, so Iters can be shaded at any point with whatever hasn't escaped yet showing as the set
+void StartOrbits(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, OrbitList& List, uint32_t * Iters);
+
+// Up to Steps more iterations of every orbit in List, never past Frame.Iterations. Orbits that escape, turn out
+// periodic or run out of iterations get their count written to Iters[Index] and leave the list, the ones still going
+// are packed to the front in the same order. Counts are the ones the block kernel of the same ISA and precision gives :
+// same c, same operations in the same order, no multiply add fused behind their back (the core is built without fp
+// contraction) and the same save schedule for the cycle detection (see SaveSchedule)
+// The one thing that can differ is where the checks fall. Orbits check every PeriodCheckInterval of their own steps,
+// and so does the AVX block kernel, but pixel parallel lanes check on their kernel's steps, and pick samples up in
+// between. An orbit that comes back within PeriodTolerance of its saved point on one schedule and not the other gets
+// a different count. That takes an orbit lingering right at the tolerance, so it's rare
+void MandelbrotOrbits_AVX(const FrameParams& Frame, OrbitList& List, uint32_t Steps, uint32_t * Iters);
+void MandelbrotOrbits_AVX2(const FrameParams& Frame, OrbitList& List, uint32_t Steps, uint32_t * Iters);
+void MandelbrotOrbits_AVX512(const FrameParams& Frame, OrbitList& List, uint32_t Steps, uint32_t * Iters);
+void MandelbrotOrbits_AVX2_Float(const FrameParams& Frame, OrbitList& List, uint32_t Steps, uint32_t * Iters);
+void MandelbrotOrbits_AVX512_Float(const FrameParams& Frame, OrbitList& List, uint32_t Steps, uint32_t * Iters);
+
+// Instruction sets with a kernel, in order of preference
+enum class KernelISA
+{
+	AVX,
+	AVX2,
+	AVX512
+};
+
+enum class KernelPrecision
+{
+	Auto, // Single while the frame allows it, then double, then perturbation past what double can resolve
+	Single,
+	Double,
+	Perturbation // Double offsets from a high precision reference orbit (see Perturbation.h). Mandelbrot only, double for the rest
+};
+
+using BlockKernel = void(*)(const FrameParams&, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t *);
+
+// Widest instruction set supported by both the CPU and the OS, checked with CPUID
+KernelISA DetectISA();
+const char * ISAName(KernelISA ISA);
+
+// True if neighbouring samples are still far enough apart in float to not blend into blocks
+bool FitsSinglePrecision(const FrameParams& Frame);
+
+// Same for double, deeper than this needs perturbation
+bool FitsDoublePrecision(const FrameParams& Frame);
+
+// Resolves Auto, and falls back to double on instruction sets without a float kernel (AVX)
+bool UseSinglePrecision(const FrameParams& Frame, KernelISA ISA, KernelPrecision Precision);
+bool UsePerturbation(const FrameParams& Frame, KernelPrecision Precision);
+
+using SampleKernel = void(*)(const FrameParams&, const SamplePoint *, uint32_t, uint32_t *);
+
+BlockKernel GetBlockKernel(KernelISA ISA, bool SinglePrecision = false);
+SampleKernel GetSampleKernel(KernelISA ISA, bool SinglePrecision = false);
+
+using OrbitKernel = void(*)(const FrameParams&, OrbitList&, uint32_t, uint32_t *);
+
+OrbitKernel GetOrbitKernel(KernelISA ISA, bool SinglePrecision = false);
+
+// Steps per batch of CompactBlock
+const uint32_t CompactBatch = 256;
+
+// Block kernel on top of the orbit kernels : every sample of the block goes in a list that's iterated CompactBatch steps
+// at a time, with the samples still going packed together after every batch. Lanes only idle until the end of a batch,
+// so the vectors stay full on views where a few samples take far more iterations than the rest of the block
+// Same layout and the same counts as the block kernel of the same ISA and precision (see the orbit kernels)
+void CompactBlock(const FrameParams& Frame, OrbitKernel Kernel, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters);
@@ -0,0 +1,532 @@
+#include "LargeImage.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include "ImageWriter.h"
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	// Bands are kept under this many bytes, a few rows of a very wide image or up to MaxBandRows of a normal one
+	const size_t MaxBandBytes = size_t(32) << 20;
+	const uint32_t MaxBandRows = 256;
+
+	// Pieces queued on the renderer at once, one rendering while the other is written is enough to overlap them
+	const uint32_t PiecesInFlight = 2;
+
+	// Pyramid blocks are 2^BlockShift tiles across
+	const uint32_t BlockShift = 3;
+
+	uint32_t CeilDiv(uint64_t A, uint64_t B)
+	{
+		return uint32_t((A + B - 1) / B);
+	}
+
+	// Auto resolved on the whole frame, a piece on its own could pick something else
+	RenderRequest FixPrecision(const Renderer& Render, const RenderRequest& Request)
+	{
+		RenderRequest request = Request;
+		if (Request.Precision == KernelPrecision::Auto)
+		{
+			if (Render.IsPerturbation(Request))
+				request.Precision = KernelPrecision::Perturbation;
+			else
+				request.Precision = Render.IsSinglePrecision(Request) ? KernelPrecision::Single : KernelPrecision::Double;
+		}
+		request.Stride = 0;
+		return request;
+	}
+
+	RenderRequest Region(const RenderRequest& Request, uint32_t X, uint32_t Y, uint32_t Width, uint32_t Height)
+	{
+		RenderRequest request = Request;
+		request.RegionX = X;
+		request.RegionY = Y;
+		request.RegionWidth = Width;
+		request.RegionHeight = Height;
+		return request;
+	}
+
+	// Everything the pixels depend on, Request with its precision fixed. Written next to the output, so resuming can
+	// tell it's still the same image
+	std::string ViewSignature(const Renderer& Render, const RenderRequest& Request)
+	{
+		// FNV-1a over the colors, they change the pixels as much as the view does
+		const Palette& colors = Render.GetPalette();
+		uint64_t palette_hash = 14695981039346656037ull;
+		auto hash = [&](const void * Data, size_t Size)
+		{
+			for (size_t i = 0; i < Size; i++)
+				palette_hash = (palette_hash ^ static_cast<const uint8_t *>(Data)[i]) * 1099511628211ull;
+		};
+		for (const PaletteColor& color : colors.Colors)
+			hash(&color, sizeof(color));
+		hash(&colors.InSet, sizeof(colors.InSet));
+		hash(&colors.Offset, sizeof(colors.Offset));
+
+		std::ostringstream view;
+		view.precision(17);
+		view << "center " << Request.CenterX << " " << Request.CenterY << " " << Request.PreciseCenterX << " " << Request.PreciseCenterY << "\n"
+			 << "zoom " << Request.Zoom << "\n"
+			 << "size " << Request.Width << " " << Request.Height << "\n"
+			 << "iterations " << Request.Iterations << (Request.Smooth ? " smooth" : "") << "\n"
+			 << "fractal " << FractalName(Request.Formula) << "\n"
+			 << "julia " << Request.Julia << " " << Request.JuliaX << " " << Request.JuliaY << "\n"
+			 << "mode " << int(Request.Mode) << " aa " << Request.AdaptiveAA << "\n"
+			 << "kernel " << ISAName(Render.GetISA()) << " " << int(Request.Precision) << "\n"
+			 << "palette " << colors.Colors.size() << " " << std::hex << palette_hash << "\n";
+		return view.str();
+	}
+
+	// Checks the view an interrupted run left at Path against View, then writes View there for this run
+	// A different view fails, nothing is ever spliced into another image. Without one there's no telling what the
+	// output has, so Resume is turned off and the run starts over
+	bool ClaimView(const std::string& Path, const std::string& View, bool& Resume)
+	{
+		if (Resume)
+		{
+			std::string old;
+			FILE * file = fopen(Path.c_str(), "rb");
+			if (file)
+			{
+				char chunk[256];
+				size_t got;
+				while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+					old.append(chunk, got);
+				fclose(file);
+				if (old != View)
+					return false;
+			}
+			else
+			{
+				Resume = false;
+			}
+		}
+
+		FILE * file = fopen(Path.c_str(), "wb");
+		if (!file)
+			return false;
+		const bool written = fwrite(View.data(), 1, View.size(), file) == View.size();
+		return fclose(file) == 0 && written;
+	}
+
+	// Fine if it's already there
+	bool MakeDirectory(const std::string& Path)
+	{
+#if defined(_WIN32)
+		return _mkdir(Path.c_str()) == 0 || errno == EEXIST;
+#else
+		return mkdir(Path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+	}
+
+	// Replaces To if it's there, which rename doesn't do on Windows
+	bool ReplaceFile(const std::string& From, const std::string& To)
+	{
+#if defined(_WIN32)
+		remove(To.c_str());
+#endif
+		return rename(From.c_str(), To.c_str()) == 0;
+	}
+
+	// Half size box filter, odd sizes average whatever is left on the last row and column
+	void Downsample(const uint8_t * Src, uint32_t Width, uint32_t Height, uint32_t SrcStride, uint8_t * Dst, uint32_t DstStride)
+	{
+		for (uint32_t y = 0; y < (Height + 1) / 2; y++)
+		{
+			const uint8_t * row0 = Src + size_t(2 * y) * SrcStride;
+			const uint8_t * row1 = 2 * y + 1 < Height ? row0 + SrcStride : row0;
+			uint8_t * out = Dst + size_t(y) * DstStride;
+			for (uint32_t x = 0; x < (Width + 1) / 2; x++)
+			{
+				const uint32_t x0 = 8 * x;
+				const uint32_t x1 = 2 * x + 1 < Width ? x0 + 4 : x0;
+				for (uint32_t c = 0; c < 4; c++)
+					out[4 * x + c] = uint8_t((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+			}
+		}
+	}
+
+	struct PyramidLayout
+	{
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t TileSize;
+		uint32_t MaxLevel; // Full frame, level 0 is 1x1
+		std::string Directory;
+
+		uint32_t LevelWidth(uint32_t Level) const { return CeilDiv(Width, uint64_t(1) << (MaxLevel - Level)); }
+		uint32_t LevelHeight(uint32_t Level) const { return CeilDiv(Height, uint64_t(1) << (MaxLevel - Level)); }
+		uint32_t Columns(uint32_t Level) const { return CeilDiv(LevelWidth(Level), TileSize); }
+		uint32_t Rows(uint32_t Level) const { return CeilDiv(LevelHeight(Level), TileSize); }
+		uint32_t TileWidth(uint32_t Level, uint32_t Column) const { return std::min(TileSize, LevelWidth(Level) - Column * TileSize); }
+		uint32_t TileHeight(uint32_t Level, uint32_t Row) const { return std::min(TileSize, LevelHeight(Level) - Row * TileSize); }
+
+		std::string TilePath(uint32_t Level, uint32_t Column, uint32_t Row) const
+		{
+			return Directory + "/" + std::to_string(Level) + "/" + std::to_string(Column) + "_" + std::to_string(Row) + ".png";
+		}
+	};
+
+	// Tile sized image, what moves up the pyramid
+	struct TileImage
+	{
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+		std::vector<uint8_t> Pixels;
+	};
+
+	// Written under another name and renamed, so a tile that exists is always complete
+	bool WriteTile(const PyramidLayout& Layout, uint32_t Level, uint32_t Column, uint32_t Row, const uint8_t * RGBA, uint32_t Width, uint32_t Height, uint32_t Stride)
+	{
+		std::vector<uint8_t> packed;
+		if (Stride != Width * 4)
+		{
+			packed.resize(size_t(Width) * Height * 4);
+			for (uint32_t y = 0; y < Height; y++)
+				std::copy(RGBA + size_t(y) * Stride, RGBA + size_t(y) * Stride + 4 * size_t(Width), packed.begin() + 4 * size_t(y) * Width);
+			RGBA = packed.data();
+		}
+
+		const std::string path = Layout.TilePath(Level, Column, Row);
+		const std::string temp = path + ".part";
+		return WritePNG(temp, RGBA, Width, Height) && ReplaceFile(temp, path);
+	}
+
+	// Every level of a block, from the full frame one down to the block's own tile
+	struct BlockLevels
+	{
+		uint32_t Column; // Of the block tile
+		uint32_t Row;
+		std::vector<TileImage> Levels;
+	};
+
+	// Tiles above the blocks, each one filled a quadrant at a time as its children come in
+	class PyramidTop
+	{
+	public:
+		PyramidTop(const PyramidLayout& Layout, std::function<void(uint32_t, uint32_t, uint32_t, std::shared_ptr<TileImage>)> Write)
+			: Layout(Layout), Write(Write) {}
+
+		void AddChild(uint32_t Level, uint32_t Column, uint32_t Row, const TileImage& Child)
+		{
+			if (Level == 0)
+				return;
+
+			const uint32_t parent_level = Level - 1;
+			const uint32_t parent_column = Column / 2;
+			const uint32_t parent_row = Row / 2;
+			const uint64_t key = (uint64_t(parent_level) << 58) | (uint64_t(parent_column) << 29) | parent_row;
+
+			auto found = Partial.find(key);
+			if (found == Partial.end())
+			{
+				Pending pending;
+				pending.Tile = std::make_shared<TileImage>();
+				pending.Tile->Width = Layout.TileWidth(parent_level, parent_column);
+				pending.Tile->Height = Layout.TileHeight(parent_level, parent_row);
+				pending.Tile->Pixels.resize(size_t(pending.Tile->Width) * pending.Tile->Height * 4);
+				pending.Remaining = (2 * parent_column + 1 < Layout.Columns(Level) ? 2 : 1) * (2 * parent_row + 1 < Layout.Rows(Level) ? 2 : 1);
+				found = Partial.emplace(key, pending).first;
+			}
+
+			TileImage& parent = *found->second.Tile;
+			const uint32_t half = Layout.TileSize / 2;
+			Downsample(Child.Pixels.data(), Child.Width, Child.Height, Child.Width * 4,
+				parent.Pixels.data() + 4 * (size_t((Row & 1) * half) * parent.Width + (Column & 1) * half), parent.Width * 4);
+
+			if (--found->second.Remaining == 0)
+			{
+				std::shared_ptr<TileImage> done = found->second.Tile;
+				Partial.erase(found);
+				Write(parent_level, parent_column, parent_row, done);
+				AddChild(parent_level, parent_column, parent_row, *done);
+			}
+		}
+	private:
+		struct Pending
+		{
+			std::shared_ptr<TileImage> Tile;
+			uint32_t Remaining;
+		};
+
+		const PyramidLayout& Layout;
+		std::function<void(uint32_t, uint32_t, uint32_t, std::shared_ptr<TileImage>)> Write;
+		std::map<uint64_t, Pending> Partial;
+	};
+
+	// Z order over a grid, so the 4 children of a tile are always done one after the other
+	void MortonDecode(uint64_t Code, uint32_t& X, uint32_t& Y)
+	{
+		X = 0;
+		Y = 0;
+		for (uint32_t bit = 0; bit < 32; bit++)
+		{
+			X |= uint32_t((Code >> (2 * bit)) & 1) << bit;
+			Y |= uint32_t((Code >> (2 * bit + 1)) & 1) << bit;
+		}
+	}
+}
+
+bool RenderStreamedImage(Renderer& Render, const RenderRequest& Request, const std::string& Path, const LargeImageOptions& Options)
+{
+	if (Request.Width == 0 || Request.Height == 0)
+		return false;
+
+	const RenderRequest request = FixPrecision(Render, Request);
+	bool resume = Options.Resume;
+	if (!ClaimView(Path + ".view", ViewSignature(Render, request), resume))
+		return false;
+
+	ImageStream stream;
+	if (!stream.Open(Path, Request.Width, Request.Height, resume))
+		return false;
+
+	const uint32_t band_rows = uint32_t(std::max<size_t>(1, std::min<size_t>(MaxBandRows, MaxBandBytes / (size_t(Request.Width) * 4))));
+	const uint64_t total = uint64_t(Request.Width) * Request.Height;
+
+	struct Band
+	{
+		uint32_t Rows;
+		std::vector<uint8_t> Pixels;
+		std::future<void> Done;
+	};
+	std::deque<Band> bands;
+
+	// Bands always start at the same rows, so a resumed image has the same pieces as one rendered in one go. Counts
+	// don't depend on where a piece starts, but perturbation picks its references for every piece on its own
+	bool ok = stream.GetRowsDone() % band_rows == 0 || stream.Rewind(stream.GetRowsDone() / band_rows * band_rows);
+	uint32_t next_row = stream.GetRowsDone();
+	while (ok && (next_row < Request.Height || !bands.empty()))
+	{
+		// Queueing the next band waits for the one before it to be scheduled, then it renders while that one is written
+		while (bands.size() < PiecesInFlight && next_row < Request.Height)
+		{
+			Band band;
+			band.Rows = std::min(band_rows, Request.Height - next_row);
+			band.Pixels.resize(size_t(Request.Width) * band.Rows * 4);
+			band.Done = Render.RenderAsync(Region(request, 0, next_row, Request.Width, band.Rows), band.Pixels.data());
+			next_row += band.Rows;
+			bands.push_back(std::move(band));
+		}
+
+		Band& band = bands.front();
+		band.Done.get();
+		ok = stream.WriteRows(band.Pixels.data(), band.Rows, Request.Width * 4);
+		bands.pop_front();
+
+		if (Options.Progress)
+			Options.Progress(uint64_t(stream.GetRowsDone()) * Request.Width, total);
+	}
+
+	// Whatever is still queued has to finish before its buffer goes away
+	for (Band& band : bands)
+		band.Done.wait();
+	return stream.Close() && ok;
+}
+
+bool RenderTilePyramid(Renderer& Render, const RenderRequest& Request, const std::string& Path, const LargeImageOptions& Options)
+{
+	if (Request.Width == 0 || Request.Height == 0 || Options.TileSize < 2 || (Options.TileSize & 1))
+		return false;
+
+	PyramidLayout layout;
+	layout.Width = Request.Width;
+	layout.Height = Request.Height;
+	layout.TileSize = Options.TileSize;
+	layout.MaxLevel = 0;
+	while ((uint64_t(1) << layout.MaxLevel) < std::max(Request.Width, Request.Height))
+		layout.MaxLevel++;
+
+	const std::string extension = ".dzi";
+	const std::string base = Path.size() > extension.size() && Path.compare(Path.size() - extension.size(), extension.size(), extension) == 0 ? Path.substr(0, Path.size() - extension.size()) : Path;
+	layout.Directory = base + "_files";
+
+	if (!MakeDirectory(layout.Directory))
+		return false;
+	for (uint32_t level = 0; level <= layout.MaxLevel; level++)
+	{
+		if (!MakeDirectory(layout.Directory + "/" + std::to_string(level)))
+			return false;
+	}
+
+	const RenderRequest request = FixPrecision(Render, Request);
+	bool resume = Options.Resume;
+	if (!ClaimView(layout.Directory + "/view", ViewSignature(Render, request) + "tile size " + std::to_string(layout.TileSize) + "\n", resume))
+		return false;
+
+	const uint32_t shift = std::min(BlockShift, layout.MaxLevel);
+	const uint32_t block_level = layout.MaxLevel - shift;
+	const uint32_t block_pixels = layout.TileSize << shift;
+	const uint32_t block_columns = layout.Columns(block_level);
+	const uint32_t block_rows = layout.Rows(block_level);
+	const uint64_t total = uint64_t(Request.Width) * Request.Height;
+	uint64_t done = 0;
+
+	// Before the pool, jobs still running when it drains write to it
+	std::atomic<bool> failed{ false };
+	WorkerPool writers(std::max(Options.WriterThreads, 1u));
+	std::deque<std::future<void>> writes;
+
+	// Writes go to the pool, and the backlog is kept short so memory stays bounded
+	auto queue_write = [&](std::function<bool()> Job)
+	{
+		while (writes.size() >= 2 * std::max(Options.WriterThreads, 1u))
+		{
+			writes.front().get();
+			writes.pop_front();
+		}
+		writes.push_back(writers.Dispatch(1, [&failed, Job](int, int)
+		{
+			if (!Job())
+				failed = true;
+		}));
+	};
+
+	PyramidTop top(layout, [&](uint32_t Level, uint32_t Column, uint32_t Row, std::shared_ptr<TileImage> Tile)
+	{
+		queue_write([&layout, Level, Column, Row, Tile]()
+		{
+			return WriteTile(layout, Level, Column, Row, Tile->Pixels.data(), Tile->Width, Tile->Height, Tile->Width * 4);
+		});
+	});
+
+	struct Block
+	{
+		uint32_t Column;
+		uint32_t Row;
+		uint32_t Width;
+		uint32_t Height;
+		std::vector<uint8_t> Pixels;
+		std::future<void> Done;
+	};
+	std::deque<Block> blocks;
+
+	// Splits a rendered block into the tiles of every level it covers, the block tile goes last so it marks the block done
+	auto finish_block = [&](Block& B)
+	{
+		auto levels = std::make_shared<BlockLevels>();
+		levels->Column = B.Column;
+		levels->Row = B.Row;
+		levels->Levels.resize(shift + 1);
+		levels->Levels[0].Width = B.Width;
+		levels->Levels[0].Height = B.Height;
+		levels->Levels[0].Pixels = std::move(B.Pixels);
+		for (uint32_t k = 1; k <= shift; k++)
+		{
+			const TileImage& above = levels->Levels[k - 1];
+			TileImage& level = levels->Levels[k];
+			level.Width = (above.Width + 1) / 2;
+			level.Height = (above.Height + 1) / 2;
+			level.Pixels.resize(size_t(level.Width) * level.Height * 4);
+			Downsample(above.Pixels.data(), above.Width, above.Height, above.Width * 4, level.Pixels.data(), level.Width * 4);
+		}
+
+		queue_write([&layout, levels, shift]()
+		{
+			for (uint32_t k = 0; k <= shift; k++)
+			{
+				const TileImage& image = levels->Levels[k];
+				const uint32_t level = layout.MaxLevel - k;
+				const uint32_t first_column = levels->Column << (shift - k);
+				const uint32_t first_row = levels->Row << (shift - k);
+				for (uint32_t row = 0; row < CeilDiv(image.Height, layout.TileSize); row++)
+				{
+					for (uint32_t column = 0; column < CeilDiv(image.Width, layout.TileSize); column++)
+					{
+						const uint8_t * corner = image.Pixels.data() + 4 * (size_t(row) * layout.TileSize * image.Width + size_t(column) * layout.TileSize);
+						if (!WriteTile(layout, level, first_column + column, first_row + row, corner, layout.TileWidth(level, first_column + column), layout.TileHeight(level, first_row + row), image.Width * 4))
+							return false;
+					}
+				}
+			}
+			return true;
+		});
+
+		top.AddChild(block_level, B.Column, B.Row, levels->Levels[shift]);
+		done += uint64_t(B.Width) * B.Height;
+		if (Options.Progress)
+			Options.Progress(done, total);
+	};
+
+	uint32_t grid = 1;
+	while (grid < std::max(block_columns, block_rows))
+		grid *= 2;
+
+	for (uint64_t code = 0; code < uint64_t(grid) * grid && !failed; code++)
+	{
+		uint32_t column, row;
+		MortonDecode(code, column, row);
+		if (column >= block_columns || row >= block_rows)
+			continue;
+
+		const uint32_t x = column * block_pixels;
+		const uint32_t y = row * block_pixels;
+		const uint32_t width = std::min(block_pixels, Request.Width - x);
+		const uint32_t height = std::min(block_pixels, Request.Height - y);
+
+		// A block whose tile is there was finished, only its tile is needed for the levels above
+		TileImage existing;
+		if (resume && ReadImage(layout.TilePath(block_level, column, row), existing.Pixels, existing.Width, existing.Height))
+		{
+			if (existing.Width == layout.TileWidth(block_level, column) && existing.Height == layout.TileHeight(block_level, row))
+			{
+				top.AddChild(block_level, column, row, existing);
+				done += uint64_t(width) * height;
+				if (Options.Progress)
+					Options.Progress(done, total);
+				continue;
+			}
+		}
+
+		if (blocks.size() >= PiecesInFlight)
+		{
+			blocks.front().Done.get();
+			finish_block(blocks.front());
+			blocks.pop_front();
+		}
+
+		Block block;
+		block.Column = column;
+		block.Row = row;
+		block.Width = width;
+		block.Height = height;
+		block.Pixels.resize(size_t(width) * height * 4);
+		block.Done = Render.RenderAsync(Region(request, x, y, width, height), block.Pixels.data());
+		blocks.push_back(std::move(block));
+	}
+
+	while (!blocks.empty())
+	{
+		blocks.front().Done.get();
+		if (!failed)
+			finish_block(blocks.front());
+		blocks.pop_front();
+	}
+
+	for (auto& write : writes)
+		write.get();
+	if (failed)
+		return false;
+
+	// Last, a pyramid with its .dzi is complete
+	FILE * file = fopen((base + extension).c_str(), "wb");
+	if (!file)
+		return false;
+	fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	fprintf(file, "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"png\" Overlap=\"0\" TileSize=\"%u\">\n", layout.TileSize);
+	fprintf(file, "  <Size Width=\"%u\" Height=\"%u\"/>\n", Request.Width, Request.Height);
+	fprintf(file, "</Image>\n");
+	return fclose(file) == 0;
+}
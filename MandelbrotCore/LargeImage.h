@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "Renderer.h"
+
+// Frames far bigger than memory, rendered a piece at a time through Request regions and written as soon as each
+// piece is done. Only a few pieces are alive at once, and the next one is already on the workers while the last
+// one is written. Precision is picked once for the whole frame, so pieces don't switch kernels at their borders
+// Perturbation frames work too, but every piece looks for its own references
+
+struct LargeImageOptions
+{
+	// Keep what an interrupted run already wrote, see each function for what survives. Every run writes what it renders
+	// (view, size, iterations, kernel, palette...) next to its output, and resuming another image fails instead of
+	// splicing the two. Without that file the run starts over
+	bool Resume = false;
+	uint32_t TileSize = 256; // Pyramid tiles
+	uint32_t WriterThreads = 2; // Pyramid tiles are compressed and written on these, the renderer's workers keep going
+
+	// Called on the calling thread as pieces are done, with the pixels done so far (resumed ones included)
+	std::function<void(uint64_t Done, uint64_t Total)> Progress;
+};
+
+// Bands of whole rows, top to bottom, streamed to a PNG or PPM (see ImageStream)
+// Resume only works with PPM : rows already in the file are kept and rendering starts after them
+// What was rendered goes to Path.view
+bool RenderStreamedImage(Renderer& Render, const RenderRequest& Request, const std::string& Path, const LargeImageOptions& Options);
+
+// Deep Zoom tile pyramid. Path is the .dzi, tiles go to <name>_files/<level>/<column>_<row>.png
+// The last level is the full frame and every level before it is half the size, down to a single pixel
+// Rendered in blocks of 8x8 tiles, each block writing its tiles on all the levels it covers. Levels above that are
+// built from the block tiles in Z order, so only a few partial tiles per level are kept. The .dzi goes last
+// Resume skips blocks whose top tile is there, tiles are renamed into place once written so none is ever half done
+// What was rendered goes to <name>_files/view
+bool RenderTilePyramid(Renderer& Render, const RenderRequest& Request, const std::string& Path, const LargeImageOptions& Options);
@@ -0,0 +1,160 @@
+#include "Palette.h"
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+
+Palette HuePalette(uint32_t Size)
+{
+	Palette palette;
+	palette.Colors.resize(std::max(Size, 1u));
+	for (uint32_t i = 0; i < palette.Colors.size(); i++)
+	{
+		// Same operations as the original kernel so both round the same way
+		float h = (float(i) * (1.0f / float(palette.Colors.size()))) * 6.0f;
+
+		palette.Colors[i].R = std::min(std::max(std::abs(h - 3.0f) - 1.0f, 0.0f), 1.0f);
+		palette.Colors[i].G = std::min(std::max(2.0f - std::abs(h - 2.0f), 0.0f), 1.0f);
+		palette.Colors[i].B = std::min(std::max(2.0f - std::abs(h - 4.0f), 0.0f), 1.0f);
+	}
+	return palette;
+}
+
+ShadeTable::ShadeTable(const Palette& Colors)
+{
+	const Palette fallback = Colors.Colors.empty() ? HuePalette() : Palette();
+	const Palette& palette = Colors.Colors.empty() ? fallback : Colors;
+
+	uint32_t size = 1;
+	while (size * 2 <= palette.Colors.size())
+		size *= 2;
+	Mask = size - 1;
+	Offset = Colors.Offset;
+
+	Entries.resize(4 * size_t(size + 1));
+	auto put = [&](uint32_t Index, const PaletteColor& Color)
+	{
+		Entries[4 * Index    ] = Color.R * (255.0f * 0.25f);
+		Entries[4 * Index + 1] = Color.G * (255.0f * 0.25f);
+		Entries[4 * Index + 2] = Color.B * (255.0f * 0.25f);
+		Entries[4 * Index + 3] = 0.0f;
+	};
+	for (uint32_t i = 0; i < size; i++)
+		put(i, palette.Colors[i]);
+	put(size, Colors.InSet);
+}
+
+void ShadeSample(const FrameParams& Frame, const ShadeTable& Table, uint32_t Iters, float * Color)
+{
+	const float * entries = Table.Entries.data();
+	if (Iters == InSetCount(Frame))
+	{
+		std::copy(entries + 4 * (Table.Mask + 1), entries + 4 * (Table.Mask + 2), Color);
+		return;
+	}
+
+	if (!Frame.Smooth)
+	{
+		const float * entry = entries + 4 * ((Iters + Table.Offset) & Table.Mask);
+		std::copy(entry, entry + 4, Color);
+		return;
+	}
+
+	const uint32_t low = ((Iters >> SmoothFractionBits) + Table.Offset) & Table.Mask;
+	const uint32_t high = (low + 1) & Table.Mask;
+	const float weight = float(Iters & ((1 << SmoothFractionBits) - 1)) * (1.0f / float(1 << SmoothFractionBits));
+	for (int c = 0; c < 4; c++)
+		Color[c] = entries[4 * low + c] + weight * (entries[4 * high + c] - entries[4 * low + c]);
+}
+
+// Smooth counts blend the two palette entries around them by the fraction, so the bands become gradients
+static void ShadeSmoothSamples(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, const uint32_t * SampleIters, const ShadeTable& Table, uint8_t * Buffer)
+{
+	const float * entries = Table.Entries.data();
+	const __m128i offset_vec = _mm_set1_epi32(int(Table.Offset));
+	const __m128i mask_vec = _mm_set1_epi32(int(Table.Mask));
+	const __m128i one_vec = _mm_set1_epi32(1);
+	const __m128i fraction_mask_vec = _mm_set1_epi32((1 << SmoothFractionBits) - 1);
+	const __m128i in_set_vec = _mm_set1_epi32(int(Table.Mask + 1));
+	const __m128i iterations_vec = _mm_set1_epi32(int(InSetCount(Frame)));
+	const __m128i alpha_vec = _mm_set1_epi32(0xFF000000);
+	const __m128 fraction_scale_vec = _mm_set1_ps(1.0f / float(1 << SmoothFractionBits));
+
+	for (uint32_t j = 0; j < SizeY; j++)
+	{
+		uint8_t * out_row = Buffer + size_t(BlockY + j) * Frame.Stride + 4 * size_t(BlockX);
+		const uint32_t * iters = SampleIters + 4 * size_t(j) * SizeX;
+
+		for (uint32_t i = 0; i < SizeX; i++, iters += 4)
+		{
+			// Entries below and above each sample, both go to the set entry on the set. Its fraction is 0 anyway
+			const __m128i n = _mm_loadu_si128((const __m128i*)iters);
+			const __m128i in_set = _mm_cmpeq_epi32(n, iterations_vec);
+			const __m128i low = _mm_and_si128(_mm_add_epi32(_mm_srli_epi32(n, SmoothFractionBits), offset_vec), mask_vec);
+			const __m128i high = _mm_and_si128(_mm_add_epi32(low, one_vec), mask_vec);
+			const __m128 weight = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(n, fraction_mask_vec)), fraction_scale_vec);
+
+			alignas(16) uint32_t idx_low[4], idx_high[4];
+			_mm_store_si128((__m128i*)idx_low, _mm_or_si128(_mm_andnot_si128(in_set, low), _mm_and_si128(in_set, in_set_vec)));
+			_mm_store_si128((__m128i*)idx_high, _mm_or_si128(_mm_andnot_si128(in_set, high), _mm_and_si128(in_set, in_set_vec)));
+
+			auto blend = [&](int S, __m128 W)
+			{
+				const __m128 a = _mm_loadu_ps(entries + 4 * idx_low[S]);
+				return _mm_add_ps(a, _mm_mul_ps(W, _mm_sub_ps(_mm_loadu_ps(entries + 4 * idx_high[S]), a)));
+			};
+			const __m128 sum = _mm_add_ps(_mm_add_ps(blend(0, _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(0, 0, 0, 0))), blend(1, _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(1, 1, 1, 1)))),
+				_mm_add_ps(blend(2, _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(2, 2, 2, 2))), blend(3, _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(3, 3, 3, 3)))));
+
+			__m128i rgba = _mm_cvtps_epi32(sum);
+			rgba = _mm_packs_epi32(rgba, rgba);
+			rgba = _mm_packus_epi16(rgba, rgba);
+			rgba = _mm_or_si128(rgba, alpha_vec);
+			*(int32_t*)(out_row + 4 * i) = _mm_cvtsi128_si32(rgba);
+		}
+	}
+}
+
+void ShadeSamples(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, const uint32_t * SampleIters, const ShadeTable& Table, uint8_t * Buffer)
+{
+	if (Frame.Smooth)
+	{
+		ShadeSmoothSamples(Frame, BlockX, BlockY, SizeX, SizeY, SampleIters, Table, Buffer);
+		return;
+	}
+
+	const float * entries = Table.Entries.data();
+	const __m128i offset_vec = _mm_set1_epi32(int(Table.Offset));
+	const __m128i mask_vec = _mm_set1_epi32(int(Table.Mask));
+	const __m128i in_set_vec = _mm_set1_epi32(int(Table.Mask + 1));
+	const __m128i iterations_vec = _mm_set1_epi32(int(Frame.Iterations));
+	const __m128i alpha_vec = _mm_set1_epi32(0xFF000000);
+
+	for (uint32_t j = 0; j < SizeY; j++)
+	{
+		uint8_t * out_row = Buffer + size_t(BlockY + j) * Frame.Stride + 4 * size_t(BlockX);
+		const uint32_t * iters = SampleIters + 4 * size_t(j) * SizeX;
+
+		for (uint32_t i = 0; i < SizeX; i++, iters += 4)
+		{
+			// Table index of the 4 samples, the ones on the set go to the last entry
+			const __m128i n = _mm_loadu_si128((const __m128i*)iters);
+			const __m128i in_set = _mm_cmpeq_epi32(n, iterations_vec);
+			__m128i index = _mm_and_si128(_mm_add_epi32(n, offset_vec), mask_vec);
+			index = _mm_or_si128(_mm_andnot_si128(in_set, index), _mm_and_si128(in_set, in_set_vec));
+
+			alignas(16) uint32_t idx[4];
+			_mm_store_si128((__m128i*)idx, index);
+
+			// Same reduction order as the hadd of the original kernel, and the same round to nearest even
+			const __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(entries + 4 * idx[0]), _mm_loadu_ps(entries + 4 * idx[1])),
+				_mm_add_ps(_mm_loadu_ps(entries + 4 * idx[2]), _mm_loadu_ps(entries + 4 * idx[3])));
+
+			// RGBA in the low bytes of each lane, packed down to one pixel
+			__m128i rgba = _mm_cvtps_epi32(sum);
+			rgba = _mm_packs_epi32(rgba, rgba);
+			rgba = _mm_packus_epi16(rgba, rgba);
+			rgba = _mm_or_si128(rgba, alpha_vec);
+			*(int32_t*)(out_row + 4 * i) = _mm_cvtsi128_si32(rgba);
+		}
+	}
+}
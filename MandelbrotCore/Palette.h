@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Kernels.h"
+
+// Coloring is its own pass over the iteration counts, so changing colors never needs another iteration
+
+struct PaletteColor
+{
+	float R; // [0,1]
+	float G;
+	float B;
+};
+
+// Colors for the iteration counts, the CPU side of the ColorTable texture of the shader
+// Count n gets Colors[(n + Offset) mod size], samples on the set get InSet
+// The size has to be a power of 2 so it wraps with a mask, like the texture does. Anything else is cut down to one
+struct Palette
+{
+	std::vector<PaletteColor> Colors;
+	uint32_t Offset = 0; // Cycles the colors
+	PaletteColor InSet = { 0.0f, 0.0f, 0.0f };
+};
+
+// Hue ramp with Size colors, the default is the 32 hues of the original kernel
+Palette HuePalette(uint32_t Size = 32);
+
+// Palette ready for shading, built once when it changes
+// Every entry is 4 floats already scaled by 255/4, so the 4 samples of a pixel only have to be added up
+// The entry for the set goes after the palette
+struct ShadeTable
+{
+	explicit ShadeTable(const Palette& Colors);
+
+	std::vector<float> Entries;
+	uint32_t Mask;
+	uint32_t Offset;
+};
+
+// Colors every sample, averages the 4 samples of each pixel and writes RGBA8
+// SampleIters has the block pixel by pixel in row order, 4 samples each on a 2x2 grid. Buffer points to the first row of the frame
+// With the default palette it gives exactly the colors of the original AVX kernel. Smooth counts blend between entries
+void ShadeSamples(const FrameParams& Frame, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, const uint32_t * SampleIters, const ShadeTable& Table, uint8_t * Buffer);
+
+// Table entry for a single count, the 4 floats of ShadeTable (so 1/4 of the color). Smooth counts get the same blend
+void ShadeSample(const FrameParams& Frame, const ShadeTable& Table, uint32_t Iters, float * Color);
@@ -0,0 +1,81 @@
+#include "Perturbation.h"
+#include <algorithm>
+#include <cmath>
+
+ReferenceOrbit ComputeReferenceOrbit(const BigFixed& CX, const BigFixed& CY, uint32_t Iterations, double Bailout2)
+{
+	ReferenceOrbit orbit;
+	orbit.X.reserve(size_t(Iterations) + 1);
+	orbit.Y.reserve(size_t(Iterations) + 1);
+
+	BigFixed x(CX.GetFractionLimbs());
+	BigFixed y(CX.GetFractionLimbs());
+	orbit.X.push_back(0.0);
+	orbit.Y.push_back(0.0);
+
+	for (uint32_t n = 0; n < Iterations; n++)
+	{
+		const BigFixed x2 = x * x;
+		const BigFixed y2 = y * y;
+		const BigFixed xy = x * y;
+		x = x2 - y2 + CX;
+		y = xy + xy + CY;
+
+		const double dx = x.ToDouble();
+		const double dy = y.ToDouble();
+		orbit.X.push_back(dx);
+		orbit.Y.push_back(dy);
+		if (dx*dx + dy*dy > Bailout2)
+			break;
+	}
+
+	orbit.Length = uint32_t(orbit.X.size()) - 1;
+	return orbit;
+}
+
+void ComputeSeriesApproximation(ReferenceOrbit& Orbit, double Radius, const std::complex<double> * Probes, int ProbeCount)
+{
+	// Relative error allowed on the offsets where the series hands over, it grows along with them afterwards
+	// so it has to stay close to what double rounding gets
+	const double tolerance = 1e-12;
+	const int MaxProbes = 16;
+	ProbeCount = std::min(ProbeCount, MaxProbes);
+
+	std::complex<double> a, b, c;
+	std::complex<double> probe_d[MaxProbes] = {};
+
+	Orbit.Radius = Radius;
+	Orbit.Skip = 0;
+	Orbit.A = Orbit.B = Orbit.C = 0.0;
+
+	// The step reaching Length would leave nothing for the kernel to check the escape on
+	for (uint32_t n = 0; n + 1 < Orbit.Length; n++)
+	{
+		const std::complex<double> z(Orbit.X[n], Orbit.Y[n]);
+
+		// A(n+1) = 2Z A + 1, B(n+1) = 2Z B + A^2, C(n+1) = 2Z C + 2AB, scaled by Radius, Radius^2 and Radius^3
+		const std::complex<double> next_a = 2.0*z*a + Radius;
+		const std::complex<double> next_b = 2.0*z*b + a*a;
+		const std::complex<double> next_c = 2.0*z*c + 2.0*a*b;
+
+		bool valid = true;
+		for (int p = 0; p < ProbeCount && valid; p++)
+		{
+			probe_d[p] = (2.0*z + probe_d[p])*probe_d[p] + Probes[p];
+
+			const std::complex<double> u = Probes[p] / Radius;
+			const std::complex<double> series = ((next_c*u + next_b)*u + next_a)*u;
+			valid = std::abs(series - probe_d[p]) <= tolerance * std::abs(probe_d[p]) && std::isfinite(std::abs(series));
+		}
+		if (!valid)
+			break;
+
+		a = next_a;
+		b = next_b;
+		c = next_c;
+		Orbit.Skip = n + 1;
+		Orbit.A = a;
+		Orbit.B = b;
+		Orbit.C = c;
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <complex>
+#include <cstdint>
+#include <vector>
+#include "BigFixed.h"
+#include "Kernels.h"
+
+// Deep zooms : once pixels are closer than a few double ulps the plain kernels turn into blocks
+// Instead one reference point is iterated in BigFixed and every sample only iterates its offset from it,
+// d(n+1) = (2Z(n) + d(n)) d(n) + dc, which stays small enough for doubles down to around 1e-290
+
+// Orbit of the reference point, rounded to double
+struct ReferenceOrbit
+{
+	std::vector<double> X; // Z(n), n = 0 .. Length
+	std::vector<double> Y;
+	uint32_t Length = 0; // Last n on the orbit, less than the iterations if the reference escaped
+
+	// Series approximation, d(Skip) = A u + B u^2 + C u^3 with u = dc / Radius, so the first Skip steps are free
+	// Coefficients are scaled by powers of Radius, the plain ones go out of range on deep zooms
+	uint32_t Skip = 0;
+	double Radius = 1.0;
+	std::complex<double> A;
+	std::complex<double> B;
+	std::complex<double> C;
+};
+
+// Iterates c = (CX, CY) for up to Iterations steps, stopping after the step that escapes past Bailout2 (|z|^2)
+// It has to go as far out as the samples do, or the ones that escape after it end up glitched
+ReferenceOrbit ComputeReferenceOrbit(const BigFixed& CX, const BigFixed& CY, uint32_t Iterations, double Bailout2 = 4.0);
+
+// Finds how many steps the series can skip for offsets up to Radius from the reference
+// It stops as soon as the series drifts from what the probes get iterating their offsets, so the probes should be
+// the farthest points of the frame (the corners)
+void ComputeSeriesApproximation(ReferenceOrbit& Orbit, double Radius, const std::complex<double> * Probes, int ProbeCount);
+
+// What the last perturbation frame took
+struct PerturbationStats
+{
+	uint32_t References = 0; // Reference orbits computed, the first one plus one per glitch fixing pass
+	uint32_t Skipped = 0; // Steps the series approximation skipped on the first reference
+	uint64_t Glitched = 0; // Samples the first reference couldn't resolve
+	uint64_t Unresolved = 0; // Still glitched when the passes ran out, they're shown as on the set
+	bool Reused = false; // The first reference came from an earlier frame instead of being computed
+};
+
+// Result of samples the reference can't resolve, they need another reference
+const uint32_t GlitchedSample = UINT32_MAX;
+
+// Perturbation kernel, iterates the 4 lanes of an AVX register in lockstep against the reference
+// Frame maps samples to dc, so CoeffB is the offset of pixel (0,0) from the reference, not its position
+// Writes GlitchedSample for samples that get too close to zero compared to Z (Pauldelbrot's criterion),
+// and for the ones still running when the reference escaped
+void PerturbationSamples_AVX(const FrameParams& Frame, const ReferenceOrbit& Orbit, const SamplePoint * Samples, uint32_t Count, uint32_t * Iters);
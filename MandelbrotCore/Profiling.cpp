@@ -0,0 +1,127 @@
+#include "Profiling.h"
+#include <algorithm>
+#include <cstdio>
+
+FrameProfile::FrameProfile(std::shared_ptr<FrameStatsLog> Log, uint64_t Frame, const char * Kind, uint32_t Width, uint32_t Height, uint32_t Workers, bool Trace)
+	: Log(Log), Trace(Trace), Start(Clock::now()), Slots(Workers)
+{
+	Stats.Frame = Frame;
+	Stats.Kind = Kind;
+	Stats.Width = Width;
+	Stats.Height = Height;
+	Stats.Start = Micros(Start);
+}
+
+double FrameProfile::Micros(Clock::time_point Time) const
+{
+	return std::chrono::duration<double, std::micro>(Time - Log->Origin).count();
+}
+
+void FrameProfile::SetFinalJobs(uint32_t Jobs)
+{
+	Remaining = Jobs;
+	if (Jobs == 0)
+		Finish();
+}
+
+void FrameProfile::CountSamples(uint32_t Worker, const FrameParams& Frame, const uint32_t * Iters, size_t Count)
+{
+	Slot& slot = Slots[Worker];
+	const uint32_t in_set = InSetCount(Frame);
+	const uint32_t shift = Frame.Smooth ? SmoothFractionBits : 0;
+	uint64_t iterations = 0, escaped = 0;
+	for (size_t i = 0; i < Count; i++)
+	{
+		iterations += Iters[i] >> shift;
+		escaped += Iters[i] != in_set;
+	}
+	slot.Iterations += iterations;
+	slot.Escaped += escaped;
+	slot.InSet += Count - escaped;
+}
+
+FrameProfile::Job::Job(FrameProfile * Profile, uint32_t Worker, uint32_t Index, bool Final)
+	: Profile(Profile), Worker(Worker), Index(Index), Final(Final)
+{
+	if (Profile)
+		Start = Clock::now();
+}
+
+FrameProfile::Job::~Job()
+{
+	if (!Profile)
+		return;
+
+	const Clock::time_point end = Clock::now();
+	Slot& slot = Profile->Slots[Worker];
+	slot.Busy += std::chrono::duration<double, std::milli>(end - Start).count();
+	slot.Jobs++;
+	slot.FirstStart = std::min(slot.FirstStart, Start);
+	if (Profile->Trace)
+		slot.Events.push_back({ Worker, Index, Profile->Micros(Start), std::chrono::duration<double, std::micro>(end - Start).count() });
+
+	// The other workers are done with their slots once the count gets to 0
+	if (Final && Profile->Remaining.fetch_sub(1) == 1)
+		Profile->Finish();
+}
+
+void FrameProfile::Finish()
+{
+	const Clock::time_point end = Clock::now();
+	Stats.WallMs = std::chrono::duration<double, std::milli>(end - Start).count();
+
+	Clock::time_point first = Clock::time_point::max();
+	for (Slot& slot : Slots)
+	{
+		WorkerFrameStats worker;
+		worker.BusyMs = slot.Busy;
+		worker.IdleMs = std::max(Stats.WallMs - slot.Busy, 0.0);
+		worker.Jobs = slot.Jobs;
+		Stats.Workers.push_back(worker);
+
+		Stats.Iterations += slot.Iterations;
+		Stats.Escaped += slot.Escaped;
+		Stats.InSet += slot.InSet;
+		first = std::min(first, slot.FirstStart);
+		Stats.Events.insert(Stats.Events.end(), slot.Events.begin(), slot.Events.end());
+	}
+	if (first != Clock::time_point::max())
+		Stats.FirstJobMs = std::chrono::duration<double, std::milli>(first - Start).count();
+
+	std::lock_guard<std::mutex> lock(Log->Lock);
+	if (Log->Done.size() >= FrameStatsLog::MaxFrames)
+		Log->Done.pop_front();
+	Log->Done.push_back(std::move(Stats));
+}
+
+bool WriteChromeTrace(const std::string& Path, const std::vector<FrameStats>& Frames)
+{
+	FILE * file = fopen(Path.c_str(), "w");
+	if (!file)
+		return false;
+
+	// Workers are threads 0 to N-1, frames go on a track of their own after them
+	uint32_t workers = 0;
+	for (const FrameStats& frame : Frames)
+		workers = std::max(workers, uint32_t(frame.Workers.size()));
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (uint32_t w = 0; w < workers; w++)
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"Worker %u\"}},\n", w, w);
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"Frames\"}}", workers);
+
+	for (const FrameStats& frame : Frames)
+	{
+		fprintf(file, ",\n{\"name\":\"%s %ux%u\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu,\"iterations\":%llu,\"escaped\":%llu,\"in_set\":%llu,\"first_job_ms\":%.3f}}",
+			frame.Kind, frame.Width, frame.Height, workers, frame.Start, frame.WallMs * 1000.0, (unsigned long long)frame.Frame,
+			(unsigned long long)frame.Iterations, (unsigned long long)frame.Escaped, (unsigned long long)frame.InSet, frame.FirstJobMs);
+
+		for (const TraceEvent& event : frame.Events)
+		{
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu,\"job\":%u}}",
+				frame.Kind, event.Worker, event.Start, event.Duration, (unsigned long long)frame.Frame, event.Job);
+		}
+	}
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+}
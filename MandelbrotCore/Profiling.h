@@ -0,0 +1,117 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Kernels.h"
+
+// Per frame instrumentation, see Renderer::SetProfiling
+// Times are in microseconds since the renderer was created, durations in milliseconds
+
+// One job on one worker, only kept when tracing
+struct TraceEvent
+{
+	uint32_t Worker;
+	uint32_t Job;
+	double Start;
+	double Duration; // Microseconds, like Start
+};
+
+struct WorkerFrameStats
+{
+	double BusyMs = 0.0; // Running jobs of this frame
+	double IdleMs = 0.0; // The rest of the frame's wall time, waiting or on other frames' jobs
+	uint32_t Jobs = 0; // Tiles, or chunks of samples for perturbation glitch passes
+};
+
+struct FrameStats
+{
+	uint64_t Frame = 0; // Counts every frame queued with profiling on
+	const char * Kind = ""; // tiles, progressive, budgeted, perturbation or colorize
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	double Start = 0.0; // When the render call came in
+	double WallMs = 0.0; // From the call until the last job was done, pre-passes included
+	double FirstJobMs = 0.0; // From the call until a worker started on the first job
+	std::vector<WorkerFrameStats> Workers;
+
+	// Kernel samples, 4 per pixel (1 with adaptive AA). Iterations is the sum of their counts with the ones on the set at
+	// the full cap, so it's an upper bound : the interior checks and cycle detection stop those early
+	// Progressive and budgeted frames don't count them, most of their samples come from the frame before
+	uint64_t Iterations = 0;
+	uint64_t Escaped = 0;
+	uint64_t InSet = 0;
+
+	std::vector<TraceEvent> Events; // Every job, only when tracing
+};
+
+// Chrome trace (chrome://tracing or ui.perfetto.dev) : one track per worker with its jobs, and one with the frames
+bool WriteChromeTrace(const std::string& Path, const std::vector<FrameStats>& Frames);
+
+// Frames done and not taken yet, shared with the jobs so it can outlive the renderer's part in them
+struct FrameStatsLog
+{
+	std::mutex Lock;
+	std::deque<FrameStats> Done;
+	std::chrono::steady_clock::time_point Origin = std::chrono::steady_clock::now();
+
+	// Oldest frames go first once there are this many
+	static const size_t MaxFrames = 4096;
+};
+
+// What a frame collects while it runs. Workers only touch their own slot, the last job of the final dispatch
+// adds the totals to the log
+class FrameProfile
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	FrameProfile(std::shared_ptr<FrameStatsLog> Log, uint64_t Frame, const char * Kind, uint32_t Width, uint32_t Height, uint32_t Workers, bool Trace);
+
+	// Before the dispatch whose end is the frame's end, with its job count
+	void SetFinalJobs(uint32_t Jobs);
+
+	// Counts of Count samples, Iters laid out like the kernels write them
+	void CountSamples(uint32_t Worker, const FrameParams& Frame, const uint32_t * Iters, size_t Count);
+
+	// Times a job for as long as it lives, a null profile does nothing
+	class Job
+	{
+	public:
+		Job(FrameProfile * Profile, uint32_t Worker, uint32_t Index, bool Final = true);
+		~Job();
+	private:
+		FrameProfile * Profile;
+		uint32_t Worker;
+		uint32_t Index;
+		bool Final;
+		Clock::time_point Start;
+	};
+private:
+	// Padded so workers don't share cache lines, vectors of over aligned types aren't a thing before C++17
+	struct Slot
+	{
+		double Busy = 0.0;
+		uint32_t Jobs = 0;
+		uint64_t Iterations = 0;
+		uint64_t Escaped = 0;
+		uint64_t InSet = 0;
+		Clock::time_point FirstStart = Clock::time_point::max();
+		std::vector<TraceEvent> Events;
+		char Padding[64];
+	};
+
+	void Finish();
+	double Micros(Clock::time_point Time) const;
+
+	std::shared_ptr<FrameStatsLog> Log;
+	FrameStats Stats;
+	bool Trace;
+	Clock::time_point Start;
+	std::vector<Slot> Slots;
+	std::atomic<uint32_t> Remaining{ 0 };
+};
@@ -0,0 +1,201 @@
+#include "Progressive.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+ProgressivePlan PlanProgressiveFrame(const FrameParams& Requested, SampleKernel Kernel, const FrameHistory& History)
+{
+	ProgressivePlan plan;
+	plan.Frame = Requested;
+	plan.Reuse = false;
+	plan.ShiftX = 0;
+	plan.ShiftY = 0;
+	plan.Step = ProgressiveCoarseStep;
+
+	const FrameParams& last = History.Frame;
+	if (History.Step == 0 || Kernel != History.Kernel || Requested.CoeffA_X != last.CoeffA_X || Requested.CoeffA_Y != last.CoeffA_Y ||
+		Requested.OriginX != last.OriginX || Requested.OriginY != last.OriginY ||
+		Requested.Iterations != last.Iterations || Requested.Smooth != last.Smooth || Requested.Width != last.Width || Requested.Height != last.Height ||
+		Requested.Formula != last.Formula || Requested.Julia != last.Julia || Requested.JuliaX != last.JuliaX || Requested.JuliaY != last.JuliaY)
+		return plan;
+
+	// Whole pixels, so rows of the history move with a plain copy
+	const double shift_x = std::round((Requested.CoeffB_X - last.CoeffB_X) / last.CoeffA_X);
+	const double shift_y = std::round((Requested.CoeffB_Y - last.CoeffB_Y) / last.CoeffA_Y);
+
+	// Nothing left on screen, also catches NaN
+	if (!(std::abs(shift_x) < last.Width && std::abs(shift_y) < last.Height))
+		return plan;
+
+	plan.Reuse = true;
+	plan.ShiftX = int64_t(shift_x);
+	plan.ShiftY = int64_t(shift_y);
+	plan.Frame.CoeffB_X = last.CoeffB_X + shift_x * last.CoeffA_X;
+	plan.Frame.CoeffB_Y = last.CoeffB_Y + shift_y * last.CoeffA_Y;
+	plan.Step = std::max(History.Step / 2, 1u);
+	return plan;
+}
+
+bool IsProgressiveComplete(const FrameParams& Requested, SampleKernel Kernel, const FrameHistory& History)
+{
+	const ProgressivePlan plan = PlanProgressiveFrame(Requested, Kernel, History);
+	return plan.Reuse && plan.ShiftX == 0 && plan.ShiftY == 0 && History.Step == 1;
+}
+
+void BeginProgressiveFrame(const ProgressivePlan& Plan, SampleKernel Kernel, FrameHistory& History)
+{
+	// The tiles copy from the previous frame, only needed when the samples move
+	if (Plan.Reuse && (Plan.ShiftX || Plan.ShiftY))
+	{
+		std::swap(History.Iters, History.PrevIters);
+		std::swap(History.Exact, History.PrevExact);
+	}
+
+	if (Plan.Reuse)
+	{
+		History.OriginX += 2 * Plan.ShiftX;
+		History.OriginY += 2 * Plan.ShiftY;
+	}
+	else
+	{
+		History.OriginX = 0;
+		History.OriginY = 0;
+	}
+
+	const size_t count = 4 * size_t(Plan.Frame.Width) * Plan.Frame.Height;
+	History.Iters.resize(count);
+	History.Exact.resize(count);
+	History.Frame = Plan.Frame;
+	History.Kernel = Kernel;
+	History.Step = Plan.Step;
+}
+
+namespace
+{
+	// Per thread so the lists keep their memory from one tile to the next
+	struct ProgressiveScratch
+	{
+		std::vector<SamplePoint> Points;
+		std::vector<size_t> Slots;
+		std::vector<uint32_t> Results;
+	};
+
+	// Start of the cell that contains Local, cells are aligned to the sample grid of the first frame of the history
+	int64_t CellStart(int64_t Local, int64_t Origin, int64_t Step)
+	{
+		const int64_t global = Local + Origin;
+		return global - (((global % Step) + Step) % Step) - Origin;
+	}
+}
+
+void RenderProgressiveTile(const ProgressivePlan& Plan, FrameHistory& History, const Tile& Block, const ShadeTable& Table, uint8_t * Buffer)
+{
+	static thread_local ProgressiveScratch scratch;
+
+	const FrameParams& frame = Plan.Frame;
+	const uint32_t width = frame.Width;
+	uint32_t * iters = History.Iters.data();
+	uint8_t * exact = History.Exact.data();
+
+	auto slot = [&](uint32_t X, uint32_t Y)
+	{
+		return 4 * (size_t(Y >> 1) * width + (X >> 1)) + 2 * (Y & 1) + (X & 1);
+	};
+
+	// Tile bounds on the sample grid
+	const uint32_t x0 = 2 * Block.X;
+	const uint32_t y0 = 2 * Block.Y;
+	const uint32_t x1 = x0 + 2 * Block.SizeX;
+	const uint32_t y1 = y0 + 2 * Block.SizeY;
+
+	if (!Plan.Reuse)
+	{
+		for (uint32_t y = Block.Y; y < Block.Y + Block.SizeY; y++)
+			memset(exact + 4 * (size_t(y) * width + Block.X), 0, 4 * size_t(Block.SizeX));
+	}
+	else if (Plan.ShiftX || Plan.ShiftY)
+	{
+		// Pixel x of this frame was pixel x + shift of the last one, whatever was off screen is left to iterate
+		const int64_t begin_x = std::max<int64_t>(Block.X, -Plan.ShiftX);
+		const int64_t end_x = std::min<int64_t>(Block.X + Block.SizeX, int64_t(width) - Plan.ShiftX);
+		for (uint32_t y = Block.Y; y < Block.Y + Block.SizeY; y++)
+		{
+			const size_t row = 4 * (size_t(y) * width + Block.X);
+			memset(exact + row, 0, 4 * size_t(Block.SizeX));
+
+			const int64_t src_y = int64_t(y) + Plan.ShiftY;
+			if (src_y < 0 || src_y >= int64_t(frame.Height) || begin_x >= end_x)
+				continue;
+
+			const size_t dst = 4 * (size_t(y) * width + size_t(begin_x));
+			const size_t src = 4 * (size_t(src_y) * width + size_t(begin_x + Plan.ShiftX));
+			const size_t count = 4 * size_t(end_x - begin_x);
+			memcpy(iters + dst, History.PrevIters.data() + src, count * sizeof(uint32_t));
+			memcpy(exact + dst, History.PrevExact.data() + src, count);
+		}
+	}
+
+	// Cells are cut at the tile edges, each part uses its own top left sample so tiles don't depend on each other
+	const int64_t step = Plan.Step;
+	auto for_each_cell = [&](auto Function)
+	{
+		for (int64_t cell_y = CellStart(y0, History.OriginY, step); cell_y < y1; cell_y += step)
+		{
+			const uint32_t top = uint32_t(std::max<int64_t>(cell_y, y0));
+			const uint32_t bottom = uint32_t(std::min<int64_t>(cell_y + step, y1));
+			for (int64_t cell_x = CellStart(x0, History.OriginX, step); cell_x < x1; cell_x += step)
+			{
+				const uint32_t left = uint32_t(std::max<int64_t>(cell_x, x0));
+				const uint32_t right = uint32_t(std::min<int64_t>(cell_x + step, x1));
+				Function(left, top, right, bottom);
+			}
+		}
+	};
+
+	// Iterate the corners that aren't exact yet
+	scratch.Points.clear();
+	scratch.Slots.clear();
+	for_each_cell([&](uint32_t Left, uint32_t Top, uint32_t, uint32_t)
+	{
+		const size_t corner = slot(Left, Top);
+		if (!exact[corner])
+		{
+			scratch.Points.push_back({ Left, Top });
+			scratch.Slots.push_back(corner);
+		}
+	});
+
+	if (!scratch.Points.empty())
+	{
+		scratch.Results.resize(scratch.Points.size());
+		History.Kernel(frame, scratch.Points.data(), uint32_t(scratch.Points.size()), scratch.Results.data());
+		for (size_t i = 0; i < scratch.Slots.size(); i++)
+		{
+			iters[scratch.Slots[i]] = scratch.Results[i];
+			exact[scratch.Slots[i]] = 1;
+		}
+	}
+
+	// Everything else in the cell copies the corner until a finer step gets to it. On step 1 every sample is a corner
+	if (step > 1)
+	{
+		for_each_cell([&](uint32_t Left, uint32_t Top, uint32_t Right, uint32_t Bottom)
+		{
+			const uint32_t value = iters[slot(Left, Top)];
+			for (uint32_t y = Top; y < Bottom; y++)
+			{
+				for (uint32_t x = Left; x < Right; x++)
+				{
+					const size_t s = slot(x, y);
+					if (!exact[s])
+						iters[s] = value;
+				}
+			}
+		});
+	}
+
+	// Rows of the history are a whole frame wide, so shade them one at a time
+	for (uint32_t y = Block.Y; y < Block.Y + Block.SizeY; y++)
+		ShadeSamples(frame, Block.X, y, Block.SizeX, 1, iters + 4 * (size_t(y) * width + Block.X), Table, Buffer);
+}
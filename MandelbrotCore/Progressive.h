@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Kernels.h"
+#include "Palette.h"
+#include "TileScheduler.h"
+
+// Iteration counts of the last progressive frame, kept so the next one only iterates what it can't reuse
+// Samples are stored pixel by pixel, 4 per pixel, same as ShadeSamples wants them
+// Every frame that uses a history has to finish before the next one starts
+struct FrameHistory
+{
+	FrameParams Frame = {}; // Frame the samples belong to
+	SampleKernel Kernel = nullptr; // Different kernels round differently, so changing it starts over
+	uint32_t Step = 0; // Samples are exact on cells of Step x Step samples, 1 is full resolution and 0 means empty
+
+	// Sample grid offset from the frame that started the history, so the coarse cells don't move while panning
+	int64_t OriginX = 0;
+	int64_t OriginY = 0;
+
+	std::vector<uint32_t> Iters;
+	std::vector<uint8_t> Exact; // 0 for samples copied from the corner of their cell, still to be iterated
+
+	// Previous frame while a new one is being built
+	std::vector<uint32_t> PrevIters;
+	std::vector<uint8_t> PrevExact;
+
+	// Of the last frame, a cancelled one leaves holes so the next one starts over
+	CancelFlag Cancel;
+
+	void Reset() { Step = 0; }
+};
+
+// First frame after a reset has one exact sample every CoarseStep samples each way, 1/8 of the resolution
+// Each frame after that halves the step, so a still view gets to full resolution in 4 more frames
+const uint32_t ProgressiveCoarseStep = 16;
+
+// What the next frame takes from the history
+struct ProgressivePlan
+{
+	FrameParams Frame; // Frame to render, its center snaps to the pixel grid of the history when reusing it
+	bool Reuse; // If false everything starts over at ProgressiveCoarseStep
+	int64_t ShiftX; // Pixels the view moved since the last frame
+	int64_t ShiftY;
+	uint32_t Step;
+};
+
+// A frame can reuse the history if only the center changed, and by less than the frame size
+// Snapping keeps the center within half a pixel of the requested one
+ProgressivePlan PlanProgressiveFrame(const FrameParams& Requested, SampleKernel Kernel, const FrameHistory& History);
+
+// True if the history already has Requested at full resolution, so there's nothing left to render
+bool IsProgressiveComplete(const FrameParams& Requested, SampleKernel Kernel, const FrameHistory& History);
+
+// Moves the history to Plan, the tiles then fill it in. Has to run before any tile of the frame
+void BeginProgressiveFrame(const ProgressivePlan& Plan, SampleKernel Kernel, FrameHistory& History);
+
+// Copies what the previous frame had for the tile, iterates the corner of every cell that isn't exact yet,
+// fills the rest of the cell with it and writes RGBA8 to Buffer
+void RenderProgressiveTile(const ProgressivePlan& Plan, FrameHistory& History, const Tile& Block, const ShadeTable& Table, uint8_t * Buffer);
@@ -0,0 +1,223 @@
+#include "RenderService.h"
+#include <algorithm>
+#include <sstream>
+
+RenderService::RenderService(Renderer& Render) : Render(Render)
+{
+}
+
+RenderService::~RenderService()
+{
+	std::list<std::shared_ptr<Job>> running;
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		for (auto& job : Running)
+			job->Request.Cancel->store(true);
+		InFlight.clear();
+		running = Running;
+	}
+
+	// Tiles that had started still write to the pixels
+	for (auto& job : running)
+	{
+		{
+			std::unique_lock<std::mutex> lock(Lock);
+			Queued.wait(lock, [&]() { return job->Queued; });
+		}
+		job->Done.wait();
+	}
+}
+
+std::string RenderService::RequestKey(const RenderRequest& Request)
+{
+	std::ostringstream key;
+	key << std::hexfloat << Request.CenterX << ' ' << Request.CenterY << ' ' << Request.Zoom << ' ' << Request.JuliaX << ' ' << Request.JuliaY << ' '
+		<< Request.Iterations << ' ' << Request.Width << ' ' << Request.Height << ' ' << int(Request.Precision) << ' ' << int(Request.Mode) << ' '
+		<< Request.Smooth << ' ' << int(Request.Formula) << ' ' << Request.Julia << ' ' << Request.AdaptiveAA << ' '
+		<< Request.RegionX << ' ' << Request.RegionY << ' ' << Request.RegionWidth << ' ' << Request.RegionHeight << ' '
+		<< Request.PreciseCenterX << ' ' << Request.PreciseCenterY;
+	return key.str();
+}
+
+std::shared_ptr<RenderService::Ticket> RenderService::Submit(const RenderRequest& Request, const std::string& Client)
+{
+	RenderRequest request = Request;
+	request.Stride = 0;
+	request.Cancel = nullptr;
+	const std::string key = RequestKey(request);
+
+	std::shared_ptr<Job> job;
+	std::shared_ptr<Ticket> ticket;
+	bool fresh = false;
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		Reap();
+		Stats.Submitted++;
+
+		auto found = InFlight.find(key);
+		if (found != InFlight.end())
+		{
+			job = found->second;
+			Stats.Coalesced++;
+		}
+		else
+		{
+			job = std::make_shared<Job>();
+			job->Key = key;
+			job->Request = request;
+			job->Request.Cancel = MakeCancelFlag();
+			InFlight[key] = job;
+			Running.push_back(job);
+			fresh = true;
+		}
+
+		job->Waiters++;
+		ticket.reset(new Ticket(*this, job));
+		if (!Client.empty())
+		{
+			auto& tickets = Clients[Client];
+			tickets.erase(std::remove_if(tickets.begin(), tickets.end(), [](const std::weak_ptr<Ticket>& T) { return T.expired(); }), tickets.end());
+			tickets.push_back(ticket);
+		}
+	}
+
+	if (fresh)
+	{
+		// Outside Lock, the cost pre-pass or perturbation's references can take a while and cancels shouldn't wait on
+		// them. Nothing else to hold either, frames from other submits start alongside this one
+		// Nobody reads the pixels before Queued, so they're made out here too
+		std::shared_future<void> done;
+		try
+		{
+			const FrameParams frame = MakeFrameParams(request);
+			job->Pixels = std::make_shared<std::vector<uint8_t>>(size_t(frame.Width) * frame.Height * 4);
+			done = Render.RenderAsync(job->Request, job->Pixels->data()).share();
+		}
+		catch (...)
+		{
+			std::promise<void> failed;
+			failed.set_exception(std::current_exception());
+			done = failed.get_future().share();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			job->Done = done;
+			job->Queued = true;
+		}
+		Queued.notify_all();
+	}
+	return ticket;
+}
+
+void RenderService::CancelClient(const std::string& Client)
+{
+	std::vector<std::shared_ptr<Ticket>> tickets;
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		auto found = Clients.find(Client);
+		if (found == Clients.end())
+			return;
+		for (auto& weak : found->second)
+		{
+			if (auto ticket = weak.lock())
+				tickets.push_back(ticket);
+		}
+		Clients.erase(found);
+	}
+
+	for (auto& ticket : tickets)
+		ticket->Cancel();
+}
+
+ServiceStats RenderService::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	ServiceStats stats = Stats;
+	stats.InFlight = InFlight.size();
+	return stats;
+}
+
+void RenderService::Release(Ticket& Waiter, bool Finished)
+{
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		if (Waiter.Done)
+			return;
+		Waiter.Done = true;
+		Waiter.Cancelled = !Finished;
+
+		Job& job = *Waiter.Image;
+		job.Waiters--;
+		if (job.Finished || (!Finished && job.Waiters > 0))
+			return;
+
+		if (Finished)
+		{
+			job.Finished = true;
+			Stats.Rendered++;
+		}
+		else
+		{
+			job.Request.Cancel->store(true);
+			Stats.Cancelled++;
+		}
+
+		// Later requests start a render of their own
+		auto found = InFlight.find(job.Key);
+		if (found != InFlight.end() && found->second.get() == &job)
+			InFlight.erase(found);
+		Reap();
+	}
+	Queued.notify_all();
+}
+
+void RenderService::Reap()
+{
+	for (auto job = Running.begin(); job != Running.end();)
+	{
+		if ((*job)->Queued && (*job)->Done.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			job = Running.erase(job);
+		else
+			++job;
+	}
+}
+
+RenderService::Ticket::~Ticket()
+{
+	Owner.Release(*this, false);
+}
+
+bool RenderService::Ticket::Wait(std::chrono::milliseconds Timeout)
+{
+	const auto deadline = std::chrono::steady_clock::now() + Timeout;
+	{
+		std::unique_lock<std::mutex> lock(Owner.Lock);
+		if (!Owner.Queued.wait_until(lock, deadline, [&]() { return Image->Queued || Done; }))
+			return false;
+		if (Done)
+			return true;
+	}
+
+	if (Image->Done.wait_until(deadline) != std::future_status::ready)
+		return false;
+	Owner.Release(*this, true);
+	Image->Done.get();
+	return true;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> RenderService::Ticket::GetPixels() const
+{
+	std::lock_guard<std::mutex> lock(Owner.Lock);
+	return Done && !Cancelled ? Image->Pixels : nullptr;
+}
+
+void RenderService::Ticket::Cancel()
+{
+	Owner.Release(*this, false);
+}
+
+const RenderRequest& RenderService::Ticket::GetRequest() const
+{
+	return Image->Request;
+}
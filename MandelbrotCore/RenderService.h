@@ -0,0 +1,104 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Renderer.h"
+
+// Front for one Renderer shared by many callers at once, what the tile server (MandelbrotServer) sits on
+// A request for an image that is already being rendered waits on that render instead of starting its own, Interactive
+// requests get ahead of Batch ones a tile at a time (see JobPriority), and an image nobody waits for anymore is
+// cancelled mid-frame, so a client that pans away stops costing anything past the tiles already running
+// Only identical requests share a render. Ones that merely overlap, like a frame and a tile of the same image, render
+// on their own, and what they share is the renderer's iteration cache once the first one's tiles are done
+
+struct ServiceStats
+{
+	uint64_t Submitted = 0;
+	uint64_t Coalesced = 0; // Of those, how many joined a render already in flight
+	uint64_t Rendered = 0; // Renders that finished
+	uint64_t Cancelled = 0; // Renders cancelled before finishing, every request on them had given up
+	uint64_t InFlight = 0;
+};
+
+class RenderService
+{
+	struct Job;
+public:
+	// One caller waiting on an image. Dropping it without waiting until the end is the same as Cancel
+	class Ticket
+	{
+	public:
+		~Ticket();
+
+		// True once the image is done, false if Timeout went by first. Also true after Cancel
+		// Rethrows what the render threw
+		bool Wait(std::chrono::milliseconds Timeout);
+
+		// RGBA8 rows of the image, tightly packed. Null until Wait returned true, and null if cancelled
+		std::shared_ptr<const std::vector<uint8_t>> GetPixels() const;
+
+		// Gives up on the image, the render is cancelled once every ticket on it has
+		void Cancel();
+
+		const RenderRequest& GetRequest() const;
+	private:
+		friend class RenderService;
+		Ticket(RenderService& Owner, std::shared_ptr<Job> Image) : Owner(Owner), Image(std::move(Image)) {}
+
+		RenderService& Owner;
+		std::shared_ptr<Job> Image;
+		bool Done = false; // Waited until the end or cancelled, both under Owner.Lock
+		bool Cancelled = false;
+	};
+
+	explicit RenderService(Renderer& Render);
+
+	// Cancels whatever is still in flight and waits for the running tiles. Tickets must not outlive the service
+	~RenderService();
+
+	// Queues Request (Stride and Cancel are ignored, the service sets them) or joins an identical one in flight
+	// A render joined by an Interactive request keeps the priority it was queued with
+	// Client names who asked, for CancelClient. Thread safe
+	std::shared_ptr<Ticket> Submit(const RenderRequest& Request, const std::string& Client = "");
+
+	// Cancel on every ticket of Client still waiting
+	void CancelClient(const std::string& Client);
+
+	ServiceStats GetStats() const;
+private:
+	struct Job
+	{
+		std::string Key;
+		RenderRequest Request;
+		std::shared_ptr<std::vector<uint8_t>> Pixels; // Set by the submit that queues it, before Queued
+		std::shared_future<void> Done; // Valid once Queued
+		bool Queued = false; // Under Owner.Lock, Done is set right after the request reaches the renderer
+		bool Finished = false;
+		uint32_t Waiters = 0;
+	};
+
+	// Everything that decides the pixels of a request, identical keys give identical images
+	static std::string RequestKey(const RenderRequest& Request);
+
+	void Release(Ticket& Waiter, bool Finished);
+
+	// Drops the renders that are over from Running, with Lock held
+	void Reap();
+
+	Renderer& Render; // Only ever starts frames, which it lets several threads do at once
+
+	mutable std::mutex Lock;
+	std::condition_variable Queued;
+	std::unordered_map<std::string, std::shared_ptr<Job>> InFlight; // Renders new requests can still join
+	std::list<std::shared_ptr<Job>> Running; // Every render until its future is ready, cancelled ones too, their tiles still write to the pixels
+	std::map<std::string, std::vector<std::weak_ptr<Ticket>>> Clients;
+	ServiceStats Stats;
+};
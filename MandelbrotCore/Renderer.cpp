@@ -0,0 +1,799 @@
+#include "Renderer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include "KernelCommon.h"
+
+static uint32_t CeilDiv(uint32_t A, uint32_t B)
+{
+	return (A + B - 1) / B;
+}
+
+FrameParams MakeFrameParams(const RenderRequest& Request)
+{
+	const double pixel_size = (4.0*Request.Zoom) / double(std::min(Request.Width, Request.Height));
+
+	FrameParams frame;
+	frame.CoeffA_X = pixel_size;
+	frame.CoeffA_Y = pixel_size;
+	frame.CoeffB_X = Request.CenterX - pixel_size*(0.5*Request.Width);
+	frame.CoeffB_Y = Request.CenterY - pixel_size*(0.5*Request.Height);
+	frame.OriginX = Request.RegionX;
+	frame.OriginY = Request.RegionY;
+	frame.Iterations = Request.Iterations;
+	frame.Width = Request.RegionWidth ? Request.RegionWidth : Request.Width;
+	frame.Height = Request.RegionHeight ? Request.RegionHeight : Request.Height;
+	frame.ImageWidth = Request.Width;
+	frame.ImageHeight = Request.Height;
+	frame.Stride = Request.Stride ? Request.Stride : frame.Width * 4;
+
+	// Smooth counts keep 8 bits for the fraction, more iterations than that go back to whole counts
+	frame.Smooth = Request.Smooth && Request.Iterations < (1u << (32 - SmoothFractionBits));
+
+	frame.Formula = Request.Formula;
+	frame.Julia = Request.Julia;
+	frame.JuliaX = Request.JuliaX;
+	frame.JuliaY = Request.JuliaY;
+	return frame;
+}
+
+// Grid size of adaptive AA, 0 when it's off
+static uint32_t AdaptiveRate(const RenderRequest& Request)
+{
+	if (Request.AdaptiveAA < 2 || Request.Mode != RenderMode::Direct)
+		return 0;
+
+	uint32_t rate = 2;
+	while (rate * 2 <= std::min(Request.AdaptiveAA, MaxAdaptiveRate))
+		rate *= 2;
+	return rate;
+}
+
+// Key of the cache tile whose top left pixel is the frame's. False when it can't be cached : pixels that aren't square
+static bool CacheGrid(const FrameParams& Frame, TileKey& Grid)
+{
+	if (Frame.CoeffA_X != Frame.CoeffA_Y)
+		return false;
+
+	Grid.X = Frame.OriginX;
+	Grid.Y = Frame.OriginY;
+	Grid.CoeffB_X = Frame.CoeffB_X;
+	Grid.CoeffB_Y = Frame.CoeffB_Y;
+	Grid.Spacing = Frame.CoeffA_X;
+	Grid.Iterations = Frame.Iterations;
+	Grid.Smooth = Frame.Smooth;
+	Grid.Formula = Frame.Formula;
+	Grid.Julia = Frame.Julia;
+	Grid.JuliaX = Frame.Julia ? Frame.JuliaX : 0.0;
+	Grid.JuliaY = Frame.Julia ? Frame.JuliaY : 0.0;
+	return true;
+}
+
+uint32_t Renderer::PickBlockSize(const FrameParams& Frame) const
+{
+	// Aim for a few blocks per worker so the last ones to finish don't leave the rest idle
+	uint32_t block_size = MaxBlockSize;
+	while (block_size > MinBlockSize && CeilDiv(Frame.Width, block_size)*CeilDiv(Frame.Height, block_size) < 4 * WorkersCount)
+		block_size /= 2;
+	return block_size;
+}
+
+// Nothing to detect without pinning, every worker is on node 0
+static std::vector<WorkerPlacement> PlaceRendererWorkers(uint32_t NumWorkers, WorkerPinning Pinning)
+{
+	if (Pinning == WorkerPinning::None)
+		return {};
+	return PlaceWorkers(DetectTopology(), NumWorkers, Pinning);
+}
+
+Renderer::Renderer(uint32_t NumWorkers, WorkerPinning Pinning)
+	: Workers(std::max(NumWorkers, 1u), PlaceRendererWorkers(std::max(NumWorkers, 1u), Pinning)), WorkersCount(std::max(NumWorkers, 1u)), StatsLog(std::make_shared<FrameStatsLog>())
+{
+	SetISA(DetectISA());
+	SetPalette(HuePalette());
+}
+
+void Renderer::SetISA(KernelISA NewISA)
+{
+	ISA = std::min(NewISA, DetectISA());
+}
+
+void Renderer::SetProfiling(bool Enable, bool Trace)
+{
+	Profiling = Enable;
+	Tracing = Enable && Trace;
+}
+
+std::vector<FrameStats> Renderer::TakeFrameStats()
+{
+	std::lock_guard<std::mutex> lock(StatsLog->Lock);
+	std::vector<FrameStats> frames(std::make_move_iterator(StatsLog->Done.begin()), std::make_move_iterator(StatsLog->Done.end()));
+	StatsLog->Done.clear();
+	return frames;
+}
+
+std::shared_ptr<FrameProfile> Renderer::BeginProfile(const char * Kind, const FrameParams& Frame)
+{
+	if (!Profiling)
+		return nullptr;
+	return std::make_shared<FrameProfile>(StatsLog, ProfiledFrames++, Kind, Frame.Width, Frame.Height, WorkersCount, Tracing);
+}
+
+bool Renderer::IsSinglePrecision(const RenderRequest& Request) const
+{
+	return !IsPerturbation(Request) && UseSinglePrecision(MakeFrameParams(Request), ISA, Request.Precision);
+}
+
+bool Renderer::IsPerturbation(const RenderRequest& Request) const
+{
+	return UsePerturbation(MakeFrameParams(Request), Request.Precision);
+}
+
+void Renderer::Render(const RenderRequest& Request, uint8_t * Buffer)
+{
+	RenderAsync(Request, Buffer).get();
+}
+
+std::future<void> Renderer::RenderAsync(const RenderRequest& Request, uint8_t * Buffer)
+{
+	return RenderTilesAsync(Request, Buffer, nullptr);
+}
+
+std::future<void> Renderer::RenderIterationsAsync(const RenderRequest& Request, uint32_t * Iters, uint8_t * Buffer)
+{
+	return RenderTilesAsync(Request, Buffer, Iters);
+}
+
+std::future<void> Renderer::RenderTilesAsync(const RenderRequest& Request, uint8_t * Buffer, uint32_t * Iters)
+{
+	if (Request.Width == 0 || Request.Height == 0)
+		return Workers.Dispatch(0, nullptr);
+
+	const FrameParams frame = MakeFrameParams(Request);
+	if (UsePerturbation(frame, Request.Precision))
+		return RenderPerturbationAsync(Request, Buffer, Iters);
+
+	const bool single = UseSinglePrecision(frame, ISA, Request.Precision);
+	TileKey grid;
+	if (Cache && Request.Mode == RenderMode::Direct && !AdaptiveRate(Request) && CacheGrid(frame, grid))
+	{
+		grid.Kernel = CacheKernelID(ISA, single);
+		grid.Size = CacheTileSize;
+		return RenderCachedAsync(Request, grid, Buffer, Iters);
+	}
+
+	// Before the cost pre-pass, so it's part of the wall time
+	auto profile = BeginProfile("tiles", frame);
+	const BlockKernel kernel = GetBlockKernel(ISA, single);
+	const SampleKernel sample_kernel = GetSampleKernel(ISA, single);
+	const OrbitKernel orbit_kernel = GetOrbitKernel(ISA, single);
+	const uint32_t block_size = PickBlockSize(frame);
+
+	// Adaptive scheduling fills it in once the cost pre-pass is done, before any tile job runs
+	auto tiles = std::make_shared<std::vector<Tile>>();
+
+	// Edge samples are closer together than pixels, they get their own precision
+	const uint32_t adaptive_rate = AdaptiveRate(Request);
+	const SampleKernel edge_kernel = adaptive_rate ? GetSampleKernel(ISA, UseSinglePrecision(AdaptiveSampleFrame(frame, adaptive_rate), ISA, Request.Precision)) : nullptr;
+
+	// Everything is captured by value, the jobs can outlive this call
+	// Sets that aren't connected go direct, filling would paint over their pieces
+	const bool subdivide = Request.Mode == RenderMode::Subdivide && SubdivisionFits(frame);
+	const bool compact = Request.Mode == RenderMode::Compact;
+	const bool verify = VerifySubdivision;
+	auto totals = &SubdivisionTotals;
+	auto adaptive_totals = &AdaptiveTotals;
+	auto shading = Shading;
+	WorkerPool::JobFunction tile_job = [=](int JobIDX, int WorkerIDX)
+	{
+		FrameProfile::Job timer(profile.get(), WorkerIDX, JobIDX);
+		const Tile& tile = (*tiles)[JobIDX];
+		uint32_t * tile_iters = SampleScratch(4 * size_t(tile.SizeX) * tile.SizeY);
+
+		if (adaptive_rate)
+		{
+			// Colors straight from the samples, there's no 2x2 grid to shade
+			AdaptiveStats stats = AdaptiveBlock(frame, sample_kernel, edge_kernel, adaptive_rate, *shading, tile.X, tile.Y, tile.SizeX, tile.SizeY, Iters || profile ? tile_iters : nullptr, Buffer);
+			adaptive_totals->Pixels += stats.Pixels;
+			adaptive_totals->Supersampled += stats.Supersampled;
+		}
+		else if (subdivide)
+		{
+			SubdivisionStats stats = SubdivideBlock(frame, sample_kernel, verify, tile.X, tile.Y, tile.SizeX, tile.SizeY, tile_iters);
+			totals->Iterated += stats.Iterated;
+			totals->Filled += stats.Filled;
+			totals->Mismatched += stats.Mismatched;
+		}
+		else if (compact)
+		{
+			CompactBlock(frame, orbit_kernel, tile.X, tile.Y, tile.SizeX, tile.SizeY, tile_iters);
+		}
+		else
+		{
+			kernel(frame, tile.X, tile.Y, tile.SizeX, tile.SizeY, tile_iters);
+		}
+
+		if (Iters)
+		{
+			for (uint32_t y = 0; y < tile.SizeY; y++)
+				memcpy(Iters + 4 * (size_t(tile.Y + y) * frame.Width + tile.X), tile_iters + 4 * size_t(y) * tile.SizeX, 16 * size_t(tile.SizeX));
+		}
+		if (Buffer && !adaptive_rate)
+			ShadeSamples(frame, tile.X, tile.Y, tile.SizeX, tile.SizeY, tile_iters, *shading, Buffer);
+
+		// Adaptive AA only has the 2x2 samples on edges, its first sample is the one that was iterated everywhere
+		if (profile && adaptive_rate)
+		{
+			for (size_t pixel = 0; pixel < size_t(tile.SizeX) * tile.SizeY; pixel++)
+				profile->CountSamples(WorkerIDX, frame, tile_iters + 4 * pixel, 1);
+		}
+		else if (profile)
+		{
+			profile->CountSamples(WorkerIDX, frame, tile_iters, 4 * size_t(tile.SizeX) * tile.SizeY);
+		}
+	};
+
+	if (!AdaptiveScheduling)
+	{
+		*tiles = RasterTiles(frame, block_size);
+		if (profile)
+			profile->SetFinalJobs(uint32_t(tiles->size()));
+		return Workers.Dispatch(GroupTilesByNode(*tiles, frame.Height, Workers), tile_job, Request.Priority, Request.Cancel);
+	}
+
+	// The pre-pass is queued like the tiles, and the worker that finishes it deals them. Nothing waits on it here,
+	// so frames already in flight don't hold up the caller
+	auto costs = std::make_shared<TileCosts>(frame, MinBlockSize);
+	WorkerPool * workers = &Workers;
+	const uint32_t workers_count = WorkersCount;
+	return Workers.DispatchThen(costs->Rows(), [costs](int JobIDX, int)
+	{
+		costs->ProbeRow(uint32_t(JobIDX));
+	}, [=](std::vector<uint32_t>& NodeJobs, WorkerPool::JobFunction& Function)
+	{
+		*tiles = ScheduleTiles(*costs, block_size, workers_count);
+		NodeJobs = GroupTilesByNode(*tiles, frame.Height, *workers);
+		Function = tile_job;
+		if (profile)
+			profile->SetFinalJobs(uint32_t(tiles->size()));
+	}, Request.Priority, Request.Cancel);
+}
+
+std::future<void> Renderer::RenderCachedAsync(const RenderRequest& Request, const TileKey& Grid, uint8_t * Buffer, uint32_t * Iters)
+{
+	const FrameParams frame = MakeFrameParams(Request);
+	auto profile = BeginProfile("tiles", frame);
+	const BlockKernel kernel = GetBlockKernel(ISA, UseSinglePrecision(frame, ISA, Request.Precision));
+
+	// Tiles of the image clipped to the frame, in frame pixels. No cost pre-pass, most tiles are expected to be there already
+	const uint32_t size = CacheTileSize;
+	auto tiles = std::make_shared<std::vector<Tile>>();
+	for (uint32_t y = Grid.Y / size * size; y < Grid.Y + frame.Height; y += size)
+	{
+		for (uint32_t x = Grid.X / size * size; x < Grid.X + frame.Width; x += size)
+		{
+			const uint32_t left = std::max(x, Grid.X), top = std::max(y, Grid.Y);
+			const uint32_t right = std::min(x + size, Grid.X + frame.Width), bottom = std::min(y + size, Grid.Y + frame.Height);
+			tiles->push_back({ left - Grid.X, top - Grid.Y, right - left, bottom - top, 0 });
+		}
+	}
+	const std::vector<uint32_t> node_jobs = GroupTilesByNode(*tiles, frame.Height, Workers);
+
+	auto cache = Cache;
+	auto shading = Shading;
+	if (profile)
+		profile->SetFinalJobs(uint32_t(tiles->size()));
+	return Workers.Dispatch(node_jobs, [=](int JobIDX, int WorkerIDX)
+	{
+		FrameProfile::Job timer(profile.get(), WorkerIDX, JobIDX);
+		const Tile& tile = (*tiles)[JobIDX];
+
+		TileKey key = Grid;
+		key.X = (Grid.X + tile.X) / size * size;
+		key.Y = (Grid.Y + tile.Y) / size * size;
+		uint32_t * tile_iters = SampleScratch(4 * size_t(size) * size);
+		if (!cache->Find(key, tile_iters))
+		{
+			// Always the whole tile, so any region of the image can use it
+			kernel(CacheTileFrame(key, frame), 0, 0, size, size, tile_iters);
+			cache->Insert(key, tile_iters);
+		}
+
+		// Only part of the tile can be on the frame, a row at a time
+		const size_t offset_x = size_t(Grid.X + tile.X - key.X), offset_y = size_t(Grid.Y + tile.Y - key.Y);
+		for (uint32_t y = 0; y < tile.SizeY; y++)
+		{
+			const uint32_t * row = tile_iters + 4 * ((offset_y + y) * size_t(size) + offset_x);
+			if (Iters)
+				memcpy(Iters + 4 * (size_t(tile.Y + y) * frame.Width + tile.X), row, 16 * size_t(tile.SizeX));
+			if (Buffer)
+				ShadeSamples(frame, tile.X, tile.Y + y, tile.SizeX, 1, row, *shading, Buffer);
+			if (profile)
+				profile->CountSamples(WorkerIDX, frame, row, 4 * size_t(tile.SizeX));
+		}
+	}, Request.Priority, Request.Cancel);
+}
+
+std::future<void> Renderer::ColorizeAsync(const RenderRequest& Request, const uint32_t * Iters, uint8_t * Buffer)
+{
+	if (Request.Width == 0 || Request.Height == 0)
+		return Workers.Dispatch(0, nullptr);
+
+	// Only reads and writes memory, so wide bands of rows are enough
+	const FrameParams frame = MakeFrameParams(Request);
+	auto profile = BeginProfile("colorize", frame);
+	auto tiles = std::make_shared<std::vector<Tile>>(RasterTiles(frame, PickBlockSize(frame)));
+	const std::vector<uint32_t> node_jobs = GroupTilesByNode(*tiles, frame.Height, Workers);
+	auto shading = Shading;
+	if (profile)
+		profile->SetFinalJobs(uint32_t(tiles->size()));
+	return Workers.Dispatch(node_jobs, [=](int JobIDX, int WorkerIDX)
+	{
+		FrameProfile::Job timer(profile.get(), WorkerIDX, JobIDX);
+		const Tile& tile = (*tiles)[JobIDX];
+		for (uint32_t y = tile.Y; y < tile.Y + tile.SizeY; y++)
+			ShadeSamples(frame, tile.X, y, tile.SizeX, 1, Iters + 4 * (size_t(y) * frame.Width + tile.X), *shading, Buffer);
+	}, Request.Priority, Request.Cancel);
+}
+
+void Renderer::SetPalette(const Palette& NewColors)
+{
+	Colors = NewColors;
+	Shading = std::make_shared<const ShadeTable>(Colors);
+}
+
+std::future<void> Renderer::RenderProgressiveAsync(const RenderRequest& Request, FrameHistory& History, uint8_t * Buffer)
+{
+	if (Request.Width == 0 || Request.Height == 0)
+		return Workers.Dispatch(0, nullptr);
+
+	const FrameParams requested = MakeFrameParams(Request);
+	if (UsePerturbation(requested, Request.Precision))
+	{
+		History.Reset();
+		return RenderPerturbationAsync(Request, Buffer, nullptr);
+	}
+	const SampleKernel kernel = GetSampleKernel(ISA, UseSinglePrecision(requested, ISA, Request.Precision));
+	if (IsCancelled(History.Cancel))
+		History.Reset();
+	History.Cancel = Request.Cancel;
+
+	auto profile = BeginProfile("progressive", requested);
+	auto plan = std::make_shared<ProgressivePlan>(PlanProgressiveFrame(requested, kernel, History));
+	BeginProgressiveFrame(*plan, kernel, History);
+
+	// Most tiles only copy and shade when panning, no point in a cost pre-pass
+	auto tiles = std::make_shared<std::vector<Tile>>(RasterTiles(plan->Frame, MaxBlockSize));
+	const std::vector<uint32_t> node_jobs = GroupTilesByNode(*tiles, plan->Frame.Height, Workers);
+
+	FrameHistory * history = &History;
+	auto shading = Shading;
+	if (profile)
+		profile->SetFinalJobs(uint32_t(tiles->size()));
+	return Workers.Dispatch(node_jobs, [=](int JobIDX, int WorkerIDX)
+	{
+		FrameProfile::Job timer(profile.get(), WorkerIDX, JobIDX);
+		RenderProgressiveTile(*plan, *history, (*tiles)[JobIDX], *shading, Buffer);
+	}, Request.Priority, Request.Cancel);
+}
+
+bool Renderer::IsProgressiveComplete(const RenderRequest& Request, const FrameHistory& History) const
+{
+	const FrameParams requested = MakeFrameParams(Request);
+	if (UsePerturbation(requested, Request.Precision))
+		return false;
+	return ::IsProgressiveComplete(requested, GetSampleKernel(ISA, UseSinglePrecision(requested, ISA, Request.Precision)), History);
+}
+
+std::future<void> Renderer::RenderBudgetedAsync(const RenderRequest& Request, BudgetedFrame& State, std::chrono::milliseconds Budget, uint8_t * Buffer)
+{
+	if (Request.Width == 0 || Request.Height == 0)
+		return Workers.Dispatch(0, nullptr);
+
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point deadline = Clock::now() + Budget;
+	const FrameParams frame = MakeFrameParams(Request);
+	if (UsePerturbation(frame, Request.Precision))
+	{
+		State.Reset();
+		return RenderPerturbationAsync(Request, Buffer, nullptr);
+	}
+
+	auto profile = BeginProfile("budgeted", frame);
+	const OrbitKernel kernel = GetOrbitKernel(ISA, UseSinglePrecision(frame, ISA, Request.Precision));
+	if (!MatchesBudgetedFrame(frame, kernel, State))
+	{
+		std::vector<Tile> tiles = RasterTiles(frame, PickBlockSize(frame));
+		std::vector<uint32_t> node_jobs = GroupTilesByNode(tiles, frame.Height, Workers);
+		BeginBudgetedFrame(frame, kernel, std::move(tiles), std::move(node_jobs), State);
+	}
+
+	// Passes only get shorter as samples escape, so the last one says whether the next fits
+	// Tiles aren't handed out past the deadline either, a pass can take far longer than the budget. The ones furthest
+	// behind go first, so tiles left behind by a pass cut short (or cancelled) catch up on the next ones
+	// The first tile of the first pass always runs, so every call gets somewhere
+	std::vector<uint32_t> pending;
+	Clock::duration last_pass = Clock::duration::zero();
+	for (bool first = true; !IsCancelled(Request.Cancel); first = false)
+	{
+		pending.clear();
+		for (uint32_t i = 0; i < uint32_t(State.Tiles.size()); i++)
+		{
+			if (IsBudgetedTilePending(State.Tiles[i]))
+				pending.push_back(i);
+		}
+		auto steps = [&](uint32_t Index) { return State.Tiles[Index].Started ? State.Tiles[Index].Orbits.Steps : 0u; };
+		std::stable_sort(pending.begin(), pending.end(), [&](uint32_t A, uint32_t B) { return steps(A) < steps(B); });
+
+		const Clock::time_point pass_start = Clock::now();
+		if (pending.empty() || (!first && pass_start + last_pass > deadline))
+			break;
+
+		Workers.Dispatch(uint32_t(pending.size()), [&](int JobIDX, int WorkerIDX)
+		{
+			if ((!first || JobIDX != 0) && Clock::now() > deadline)
+				return;
+			FrameProfile::Job timer(profile.get(), WorkerIDX, JobIDX, false);
+			AdvanceBudgetedTile(State, State.Tiles[pending[JobIDX]]);
+		}, Request.Priority, Request.Cancel).get();
+		last_pass = Clock::now() - pass_start;
+	}
+
+	BudgetedFrame * state = &State;
+	auto shading = Shading;
+	if (profile)
+		profile->SetFinalJobs(uint32_t(State.Tiles.size()));
+	return Workers.Dispatch(State.NodeJobs, [=](int JobIDX, int WorkerIDX)
+	{
+		FrameProfile::Job timer(profile.get(), WorkerIDX, JobIDX);
+		const BudgetedTile& tile = state->Tiles[JobIDX];
+		if (tile.Started)
+			ShadeSamples(frame, tile.Block.X, tile.Block.Y, tile.Block.SizeX, tile.Block.SizeY, tile.Iters.data(), *shading, Buffer);
+	}, Request.Priority, Request.Cancel);
+}
+
+bool Renderer::IsBudgetedComplete(const RenderRequest& Request, const BudgetedFrame& State) const
+{
+	const FrameParams frame = MakeFrameParams(Request);
+	if (UsePerturbation(frame, Request.Precision))
+		return false;
+	return MatchesBudgetedFrame(frame, GetOrbitKernel(ISA, UseSinglePrecision(frame, ISA, Request.Precision)), State) && State.Unresolved() == 0;
+}
+
+// Sample index on a frame wide buffer laid out like ShadeSamples wants it, 4 samples per pixel
+static SamplePoint SampleAt(const FrameParams& Frame, size_t Index)
+{
+	const size_t pixel = Index / 4;
+	const uint32_t sub = uint32_t(Index % 4);
+	return { 2 * uint32_t(pixel % Frame.Width) + (sub & 1), 2 * uint32_t(pixel / Frame.Width) + (sub >> 1) };
+}
+
+// Next reference out of the glitched samples : the one closest to the middle of them
+static const SamplePoint& PickReference(const std::vector<SamplePoint>& Glitched)
+{
+	double mean_x = 0.0, mean_y = 0.0;
+	for (const SamplePoint& sample : Glitched)
+	{
+		mean_x += sample.X;
+		mean_y += sample.Y;
+	}
+	mean_x /= double(Glitched.size());
+	mean_y /= double(Glitched.size());
+
+	size_t best = 0;
+	double best_distance = INFINITY;
+	for (size_t i = 0; i < Glitched.size(); i++)
+	{
+		const double distance = (Glitched[i].X - mean_x)*(Glitched[i].X - mean_x) + (Glitched[i].Y - mean_y)*(Glitched[i].Y - mean_y);
+		if (distance < best_distance)
+		{
+			best = i;
+			best_distance = distance;
+		}
+	}
+	return Glitched[best];
+}
+
+// Moves the reference to Sample, Frame stays relative to it
+static void MoveReference(const SamplePoint& Sample, FrameParams& Frame, BigFixed& RefX, BigFixed& RefY)
+{
+	// Computed like the kernel does, so the reference lands exactly on the sample
+	const double offset_x = (0.5*Sample.X)*Frame.CoeffA_X + Frame.CoeffB_X;
+	const double offset_y = (0.5*Sample.Y)*Frame.CoeffA_Y + Frame.CoeffB_Y;
+	RefX = RefX + BigFixed::FromDouble(offset_x, RefX.GetFractionLimbs());
+	RefY = RefY + BigFixed::FromDouble(offset_y, RefY.GetFractionLimbs());
+	Frame.CoeffB_X -= offset_x;
+	Frame.CoeffB_Y -= offset_y;
+}
+
+// Orbit as if it had been computed for just Iterations
+static ReferenceOrbit TruncatedOrbit(const ReferenceOrbit& Orbit, uint32_t Iterations)
+{
+	ReferenceOrbit orbit = Orbit;
+	if (orbit.Length > Iterations)
+	{
+		orbit.Length = Iterations;
+		orbit.X.resize(size_t(Iterations) + 1);
+		orbit.Y.resize(size_t(Iterations) + 1);
+	}
+	return orbit;
+}
+
+std::future<void> Renderer::RenderPerturbationAsync(const RenderRequest& Request, uint8_t * Buffer, uint32_t * Iters)
+{
+	// Frame relative to the reference, the first one is the center
+	FrameParams frame = MakeFrameParams(Request);
+	auto profile = BeginProfile("perturbation", frame);
+	// Every region gets references of its own anyway, so the region just goes in CoeffB
+	frame.CoeffB_X = frame.CoeffA_X*(double(Request.RegionX) - 0.5*Request.Width);
+	frame.CoeffB_Y = frame.CoeffA_Y*(double(Request.RegionY) - 0.5*Request.Height);
+	frame.OriginX = 0;
+	frame.OriginY = 0;
+
+	const uint32_t limbs = BigFixed::LimbsFor(0.5 * std::min(frame.CoeffA_X, frame.CoeffA_Y));
+	BigFixed ref_x = BigFixed::FromDouble(Request.CenterX, limbs);
+	BigFixed ref_y = BigFixed::FromDouble(Request.CenterY, limbs);
+	if (!Request.PreciseCenterX.empty() || !Request.PreciseCenterY.empty())
+	{
+		BigFixed precise_x, precise_y;
+		if (BigFixed::FromString(Request.PreciseCenterX, limbs, precise_x) && BigFixed::FromString(Request.PreciseCenterY, limbs, precise_y))
+		{
+			ref_x = precise_x;
+			ref_y = precise_y;
+		}
+	}
+
+	PerturbationStats stats;
+	std::vector<SamplePoint> samples;
+	std::vector<uint32_t> results;
+
+	// The center often escapes long before the interesting parts of the view, and then every sample that outlives it
+	// has to go again. So the reference first moves around on a sparse grid until it outlives all of it
+	const uint32_t SearchGrid = 16;
+	const uint32_t SearchPasses = 4;
+	// Unless the last frame's first reference still works here : in view, same precision, and it went as far as this
+	// frame needs or escaped before running out
+	const double bailout2 = BailoutRadius2(frame);
+	ReferenceOrbit orbit;
+	std::shared_ptr<const KeptReference> last;
+	{
+		std::lock_guard<std::mutex> lock(ReferenceLock);
+		last = LastReference;
+	}
+	const bool complete = last && (last->Orbit.Length >= frame.Iterations || last->Orbit.Length < last->Iterations);
+	if (complete && last->X.GetFractionLimbs() == limbs && last->Bailout2 == bailout2)
+	{
+		const double offset_x = (last->X - ref_x).ToDouble();
+		const double offset_y = (last->Y - ref_y).ToDouble();
+		if (offset_x >= frame.CoeffB_X && offset_x <= frame.CoeffB_X + frame.CoeffA_X*frame.Width &&
+			offset_y >= frame.CoeffB_Y && offset_y <= frame.CoeffB_Y + frame.CoeffA_Y*frame.Height)
+		{
+			ref_x = last->X;
+			ref_y = last->Y;
+			frame.CoeffB_X -= offset_x;
+			frame.CoeffB_Y -= offset_y;
+			orbit = TruncatedOrbit(last->Orbit, frame.Iterations);
+			stats.Reused = true;
+		}
+	}
+
+	// Headroom only goes on the first reference, glitch fixing ones aren't kept
+	const uint32_t first_iterations = uint32_t(std::min(frame.Iterations * (1.0 + ReferenceHeadroom), double(UINT32_MAX - 1)));
+	for (uint32_t pass = 0;; pass++)
+	{
+		if (pass > 0 || !stats.Reused)
+		{
+			auto kept = std::make_shared<KeptReference>();
+			kept->Orbit = ComputeReferenceOrbit(ref_x, ref_y, first_iterations, bailout2);
+			kept->X = ref_x;
+			kept->Y = ref_y;
+			kept->Bailout2 = bailout2;
+			kept->Iterations = first_iterations;
+			orbit = TruncatedOrbit(kept->Orbit, frame.Iterations);
+			stats.References++;
+
+			std::lock_guard<std::mutex> lock(ReferenceLock);
+			LastReference = std::move(kept);
+		}
+		if (orbit.Length == frame.Iterations || pass == SearchPasses || IsCancelled(Request.Cancel))
+			break;
+
+		samples.clear();
+		for (uint32_t y = 0; y < SearchGrid; y++)
+		{
+			for (uint32_t x = 0; x < SearchGrid; x++)
+				samples.push_back({ (2 * x + 1) * frame.Width / SearchGrid, (2 * y + 1) * frame.Height / SearchGrid });
+		}
+		results.resize(samples.size());
+		PerturbationSamples_AVX(frame, orbit, samples.data(), uint32_t(samples.size()), results.data());
+
+		size_t glitched = 0;
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			if (results[i] == GlitchedSample)
+				samples[glitched++] = samples[i];
+		}
+		if (!glitched)
+			break;
+		samples.resize(glitched);
+		MoveReference(PickReference(samples), frame, ref_x, ref_y);
+	}
+
+	// The corners are the farthest samples from the reference, if the series holds for them it holds everywhere
+	const double left = frame.CoeffB_X, right = frame.CoeffB_X + frame.CoeffA_X*frame.Width;
+	const double top = frame.CoeffB_Y, bottom = frame.CoeffB_Y + frame.CoeffA_Y*frame.Height;
+	const std::complex<double> probes[] = { { left, top }, { right, top }, { left, bottom }, { right, bottom } };
+	double radius = 0.0;
+	for (const std::complex<double>& probe : probes)
+		radius = std::max(radius, std::abs(probe));
+	ComputeSeriesApproximation(orbit, radius, probes, 4);
+	stats.Skipped = orbit.Skip;
+
+	// Frame wide counts, in Iters if there is one
+	// Left uninitialized, every sample is written by the first pass on the node that shades it later
+	const size_t sample_count = size_t(frame.Width) * frame.Height * 4;
+	std::shared_ptr<uint32_t> storage(Iters ? nullptr : new uint32_t[sample_count], std::default_delete<uint32_t[]>());
+	uint32_t * iters = Iters ? Iters : storage.get();
+	auto tiles = std::make_shared<std::vector<Tile>>(RasterTiles(frame, PickBlockSize(frame)));
+	const std::vector<uint32_t> node_jobs = GroupTilesByNode(*tiles, frame.Height, Workers);
+
+	// Everything against that reference first, a row of the tile at a time
+	Workers.Dispatch(node_jobs, [&](int JobIDX, int WorkerIDX)
+	{
+		FrameProfile::Job timer(profile.get(), WorkerIDX, JobIDX, false);
+		const Tile& tile = (*tiles)[JobIDX];
+		std::vector<SamplePoint> row(size_t(tile.SizeX) * 4);
+		for (uint32_t y = tile.Y; y < tile.Y + tile.SizeY; y++)
+		{
+			for (uint32_t x = 0; x < tile.SizeX; x++)
+			{
+				for (uint32_t sub = 0; sub < 4; sub++)
+					row[4 * x + sub] = { 2 * (tile.X + x) + (sub & 1), 2 * y + (sub >> 1) };
+			}
+			PerturbationSamples_AVX(frame, orbit, row.data(), uint32_t(row.size()), iters + 4 * (size_t(y) * frame.Width + tile.X));
+		}
+	}, Request.Priority, Request.Cancel).get();
+
+	// Skipped tiles left the counts uninitialized, nothing after this can use them
+	if (IsCancelled(Request.Cancel))
+		return Workers.Dispatch(0, nullptr);
+
+	// Glitch fixing, only the glitched samples go again against a reference picked among them
+	// The new reference resolves at least itself, so every pass gets somewhere
+	std::vector<size_t> glitched;
+	for (size_t i = 0; i < sample_count; i++)
+	{
+		if (iters[i] == GlitchedSample)
+			glitched.push_back(i);
+	}
+	stats.Glitched = glitched.size();
+
+	const uint32_t chunk_size = 4096;
+	for (uint32_t pass = 0; !glitched.empty() && pass < MaxReferences && !IsCancelled(Request.Cancel); pass++)
+	{
+		samples.resize(glitched.size());
+		for (size_t i = 0; i < glitched.size(); i++)
+			samples[i] = SampleAt(frame, glitched[i]);
+
+		// No series here, the glitched samples can be anywhere on the frame
+		MoveReference(PickReference(samples), frame, ref_x, ref_y);
+		orbit = ComputeReferenceOrbit(ref_x, ref_y, frame.Iterations, bailout2);
+		stats.References++;
+
+		results.resize(samples.size());
+		Workers.Dispatch(CeilDiv(uint32_t(samples.size()), chunk_size), [&](int JobIDX, int WorkerIDX)
+		{
+			FrameProfile::Job timer(profile.get(), WorkerIDX, JobIDX, false);
+			const uint32_t first = uint32_t(JobIDX) * chunk_size;
+			const uint32_t count = std::min(chunk_size, uint32_t(samples.size()) - first);
+			PerturbationSamples_AVX(frame, orbit, samples.data() + first, count, results.data() + first);
+		}, Request.Priority, Request.Cancel).get();
+
+		size_t remaining = 0;
+		for (size_t i = 0; i < glitched.size(); i++)
+		{
+			iters[glitched[i]] = results[i];
+			if (results[i] == GlitchedSample)
+				glitched[remaining++] = glitched[i];
+		}
+		glitched.resize(remaining);
+	}
+
+	stats.Unresolved = glitched.size();
+	for (size_t index : glitched)
+		iters[index] = InSetCount(frame);
+	{
+		std::lock_guard<std::mutex> lock(ReferenceLock);
+		LastPerturbation = stats;
+	}
+
+	// The counts are final now, shading jobs add them up along the way
+	if (!Buffer && profile)
+	{
+		for (uint32_t y = 0; y < frame.Height; y++)
+			profile->CountSamples(0, frame, iters + 4 * size_t(y) * frame.Width, 4 * size_t(frame.Width));
+	}
+	if (!Buffer)
+	{
+		if (profile)
+			profile->SetFinalJobs(0);
+		return Workers.Dispatch(0, nullptr);
+	}
+
+	// Storage has to live until the last tile is shaded
+	auto shading = Shading;
+	if (profile)
+		profile->SetFinalJobs(uint32_t(tiles->size()));
+	return Workers.Dispatch(node_jobs, [=, storage = storage](int JobIDX, int WorkerIDX)
+	{
+		FrameProfile::Job timer(profile.get(), WorkerIDX, JobIDX);
+		const Tile& tile = (*tiles)[JobIDX];
+		for (uint32_t y = tile.Y; y < tile.Y + tile.SizeY; y++)
+		{
+			ShadeSamples(frame, tile.X, y, tile.SizeX, 1, iters + 4 * (size_t(y) * frame.Width + tile.X), *shading, Buffer);
+			if (profile)
+				profile->CountSamples(WorkerIDX, frame, iters + 4 * (size_t(y) * frame.Width + tile.X), 4 * size_t(tile.SizeX));
+		}
+	}, Request.Priority, Request.Cancel);
+}
+
+SubdivisionStats Renderer::GetSubdivisionStats() const
+{
+	SubdivisionStats stats;
+	stats.Iterated = SubdivisionTotals.Iterated;
+	stats.Filled = SubdivisionTotals.Filled;
+	stats.Mismatched = SubdivisionTotals.Mismatched;
+	return stats;
+}
+
+void Renderer::ResetSubdivisionStats()
+{
+	SubdivisionTotals.Iterated = 0;
+	SubdivisionTotals.Filled = 0;
+	SubdivisionTotals.Mismatched = 0;
+}
+
+AdaptiveStats Renderer::GetAdaptiveStats() const
+{
+	AdaptiveStats stats;
+	stats.Pixels = AdaptiveTotals.Pixels;
+	stats.Supersampled = AdaptiveTotals.Supersampled;
+	return stats;
+}
+
+void Renderer::ResetAdaptiveStats()
+{
+	AdaptiveTotals.Pixels = 0;
+	AdaptiveTotals.Supersampled = 0;
+}
+
+FrameBuffer<uint8_t> Renderer::Render(const RenderRequest& Request)
+{
+	RenderRequest packed = Request;
+	packed.Stride = 0;
+
+	const FrameParams frame = MakeFrameParams(Request);
+	FrameBuffer<uint8_t> buffer(size_t(frame.Width) * frame.Height * 4);
+	Render(packed, buffer.data());
+	return buffer;
+}
+
+FrameBuffer<uint32_t> Renderer::RenderIterations(const RenderRequest& Request)
+{
+	const FrameParams frame = MakeFrameParams(Request);
+	FrameBuffer<uint32_t> iters(size_t(frame.Width) * frame.Height * 4);
+	RenderIterationsAsync(Request, iters.data()).get();
+	return iters;
+}
+
+FrameBuffer<uint8_t> Renderer::Colorize(const RenderRequest& Request, const uint32_t * Iters)
+{
+	RenderRequest packed = Request;
+	packed.Stride = 0;
+
+	const FrameParams frame = MakeFrameParams(Request);
+	FrameBuffer<uint8_t> buffer(size_t(frame.Width) * frame.Height * 4);
+	ColorizeAsync(packed, Iters, buffer.data()).get();
+	return buffer;
+}
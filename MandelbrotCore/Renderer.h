@@ -0,0 +1,284 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Adaptive.h"
+#include "Budgeted.h"
+#include "IterationCache.h"
+#include "Kernels.h"
+#include "Palette.h"
+#include "Perturbation.h"
+#include "Profiling.h"
+#include "Progressive.h"
+#include "Subdivision.h"
+#include "TileScheduler.h"
+#include "WorkerPool.h"
+
+enum class RenderMode
+{
+	Direct, // Every sample goes through the kernel
+	Subdivide, // Mariani-Silver, uniform rectangles are filled from their border (see SubdivideBlock). Direct on sets that aren't connected
+	Compact // Every sample too, in batches of steps with the samples still going packed together in between (see CompactBlock)
+};
+
+// Everything needed to render one frame, independent of any window or device
+// Same conventions as the interactive app : the smaller side of the frame covers [-2,2] * Zoom around the center
+struct RenderRequest
+{
+	double CenterX = 0.0;
+	double CenterY = 0.0;
+	double Zoom = 1.0;
+	uint32_t Iterations = 100;
+	uint32_t Width = 1024;
+	uint32_t Height = 1024;
+	uint32_t Stride = 0; // Bytes per row of the output buffer, 0 means tightly packed (Width*4)
+	KernelPrecision Precision = KernelPrecision::Auto;
+	RenderMode Mode = RenderMode::Direct;
+	bool Smooth = false; // Smooth counts for gradients instead of color bands, see SmoothFractionBits
+
+	// What gets iterated. Julia frames put the pixels at the starting z and iterate them all with c = (JuliaX, JuliaY)
+	// Perturbation and the GPU only do the plain Mandelbrot set, deeper zooms of anything else stay on double
+	Fractal Formula = Fractal::Mandelbrot;
+	bool Julia = false;
+	double JuliaX = 0.0;
+	double JuliaY = 0.0;
+
+	// 0 is the fixed 2x2 SSAA on every pixel. 2, 4 or 8 gives one sample per pixel and that many squared only on edges
+	// (see AdaptiveBlock), anything in between goes down to the power of 2 below. Direct mode only
+	uint32_t AdaptiveAA = 0;
+
+	// Renders only this rectangle of the frame, the buffers then hold just the rectangle (Stride is of its rows)
+	// A 0 size means the whole frame. Lets frames far bigger than memory be done a piece at a time, see LargeImage.h
+	uint32_t RegionX = 0;
+	uint32_t RegionY = 0;
+	uint32_t RegionWidth = 0;
+	uint32_t RegionHeight = 0;
+
+	// Optional decimal center, for zooms where a double can't place the view anymore
+	// Only perturbation uses them, everything else (and the precision choice) goes by CenterX and CenterY
+	std::string PreciseCenterX;
+	std::string PreciseCenterY;
+
+	// Interactive frames have their tiles taken before any Batch ones already queued (see JobPriority)
+	JobPriority Priority = JobPriority::Batch;
+
+	// Optional. Once set, tiles of the frame that haven't started are skipped and the future is ready as soon as the
+	// running ones are done. What the buffers hold then is undefined, cancelled tiles don't go to the iteration cache,
+	// and cancelled frames don't show up in the profiling stats
+	CancelFlag Cancel;
+};
+
+// Maps the request to the pixel -> c transform used by the kernels (and the shader)
+// Pixels are square, so non square frames show more of the plane on the long side instead of stretching
+// With a region, the frame is the region : Width and Height are its size and pixel (0,0) is its corner
+FrameParams MakeFrameParams(const RenderRequest& Request);
+
+// Allocator that leaves what it makes uninitialized, so the pages of a frame buffer are first touched by the workers
+// that render into them (see GroupTilesByNode) and not all by the thread that allocated it
+template<typename T>
+struct UninitializedAllocator : std::allocator<T>
+{
+	template<typename U>
+	struct rebind { typedef UninitializedAllocator<U> other; };
+
+	UninitializedAllocator() = default;
+	template<typename U>
+	UninitializedAllocator(const UninitializedAllocator<U>&) {}
+
+	template<typename U>
+	void construct(U * Pointer) { ::new((void*)Pointer) U; }
+	template<typename U, typename... Args>
+	void construct(U * Pointer, Args&&... Arguments) { ::new((void*)Pointer) U(std::forward<Args>(Arguments)...); }
+};
+
+template<typename T>
+using FrameBuffer = std::vector<T, UninitializedAllocator<T>>;
+
+// CPU renderer, owns the worker threads
+class Renderer
+{
+public:
+	// With pinning, workers are pinned to cores (see PlaceWorkers) and frames on machines with several NUMA nodes are
+	// split in bands of rows, one per node, so each node computes and shades its own part of the buffers
+	Renderer(uint32_t NumWorkers = std::thread::hardware_concurrency(), WorkerPinning Pinning = WorkerPinning::None);
+
+	// Renders to an RGBA8 buffer of at least Height rows of Stride bytes
+	void Render(const RenderRequest& Request, uint8_t * Buffer);
+	FrameBuffer<uint8_t> Render(const RenderRequest& Request);
+
+	// Same as Render but returns as soon as the work is queued, Buffer has to stay alive until the future is ready
+	// The cost pre-pass of adaptive scheduling is queued too, its last job deals the tiles
+	// Frames queued back to back share the workers, so the caller can present one while the next is computed
+	// Several threads can start frames at once (RenderAsync and RenderIterationsAsync), as long as none of the Set
+	// functions runs meanwhile. Only the little state frames share is locked, so a slow start doesn't hold up the others
+	std::future<void> RenderAsync(const RenderRequest& Request, uint8_t * Buffer);
+
+	// Iteration counts of every sample instead of colors, 4 per pixel (see MandelbrotBlock_AVX), Width*Height*4 of them
+	// Also writes the colors to Buffer if it isn't null, same as RenderAsync
+	// Keep the counts around and ColorizeAsync can change the colors without iterating again
+	std::future<void> RenderIterationsAsync(const RenderRequest& Request, uint32_t * Iters, uint8_t * Buffer = nullptr);
+	FrameBuffer<uint32_t> RenderIterations(const RenderRequest& Request);
+
+	// Colors counts from RenderIterationsAsync with the current palette, only touches memory so it's way faster than rendering
+	// Request has to match the one the counts came from, Iters has to stay alive until the future is ready
+	std::future<void> ColorizeAsync(const RenderRequest& Request, const uint32_t * Iters, uint8_t * Buffer);
+	FrameBuffer<uint8_t> Colorize(const RenderRequest& Request, const uint32_t * Iters);
+
+	// For interactive use, takes what it can from the last frame rendered with the same History
+	// Pans only iterate the strips that came into view and a view that didn't change only gets sharper, anything
+	// else starts over at 1/8 of the resolution (see FrameHistory). Always iterates directly, Mode is ignored
+	// The next call with the same History has to wait until this frame is done
+	std::future<void> RenderProgressiveAsync(const RenderRequest& Request, FrameHistory& History, uint8_t * Buffer);
+
+	// True if History already has Request at full resolution, so rendering it again would give the same image
+	bool IsProgressiveComplete(const RenderRequest& Request, const FrameHistory& History) const;
+
+	// For views with more iterations than fit in a frame : iterates the samples still going BudgetChunk more steps at a
+	// time until the next pass wouldn't fit in Budget, then shades what State has. Past Budget a pass stops handing out
+	// tiles, so a call takes about Budget plus one tile (always at least one tile, so every call gets somewhere). Samples that
+	// escaped are final and never iterated again, the rest show as the set and carry on from their z on the next call
+	// with the same view and State, anything else starts over. The passes run before returning, like perturbation's
+	// references, only shading is left on the workers. Mode, AdaptiveAA and the iteration cache are ignored
+	// The next call with the same State has to wait until this frame is done
+	std::future<void> RenderBudgetedAsync(const RenderRequest& Request, BudgetedFrame& State, std::chrono::milliseconds Budget, uint8_t * Buffer);
+
+	// True if State has every count of Request final, rendering it again would only shade
+	bool IsBudgetedComplete(const RenderRequest& Request, const BudgetedFrame& State) const;
+
+	// Kernel selection, defaults to the widest instruction set the CPU has
+	// Asking for something the CPU doesn't support falls back to the best supported one
+	void SetISA(KernelISA ISA);
+	KernelISA GetISA() const { return ISA; }
+
+	// Colors of every frame queued after this, HuePalette() by default. Frames already queued keep the old one
+	void SetPalette(const Palette& Colors);
+	const Palette& GetPalette() const { return Colors; }
+
+	// Whether the kernel used for Request is single precision
+	bool IsSinglePrecision(const RenderRequest& Request) const;
+
+	// Whether Request goes through perturbation, either asked for or because double can't resolve it
+	// Perturbation frames compute their reference orbits and fix glitches on the calling thread before returning,
+	// only shading is left on the workers. Mode is ignored, and progressive rendering starts over every frame
+	bool IsPerturbation(const RenderRequest& Request) const;
+
+	// Stats of the last perturbation frame
+	PerturbationStats GetPerturbationStats() const { std::lock_guard<std::mutex> lock(ReferenceLock); return LastPerturbation; }
+
+	// The first reference orbit of a perturbation frame is kept, and the next frame starts from it instead of computing
+	// its own if it's still in view, at the same precision and went far enough (or escaped). Neighbouring frames of an animation
+	// mostly are, but a zoom also raises the iterations a bit every frame. With headroom, new first references go that
+	// much further (0.25 is 25% more iterations) so the frames after can use them too. 0 by default, it's wasted on stills
+	void SetReferenceHeadroom(float Headroom) { ReferenceHeadroom = std::max(Headroom, 0.0f); }
+	float GetReferenceHeadroom() const { return ReferenceHeadroom; }
+
+	// On by default, tiles are sized and ordered by a cost estimate (see ScheduleTiles)
+	// Off, the frame is cut in equal tiles issued in raster order
+	void SetAdaptiveScheduling(bool Enable) { AdaptiveScheduling = Enable; }
+	bool GetAdaptiveScheduling() const { return AdaptiveScheduling; }
+
+	// Subdivide mode only. When on, filled samples are iterated too and the kernel result is written instead
+	// Slow, meant to check how often filling gets it wrong on a given view
+	void SetVerifySubdivision(bool Enable) { VerifySubdivision = Enable; }
+	bool GetVerifySubdivision() const { return VerifySubdivision; }
+
+	// Totals over every Subdivide frame since the last reset, only exact once those frames are done
+	SubdivisionStats GetSubdivisionStats() const;
+	void ResetSubdivisionStats();
+
+	// Same for frames with AdaptiveAA
+	AdaptiveStats GetAdaptiveStats() const;
+	void ResetAdaptiveStats();
+
+	// Off by default. Frames queued while it's on are timed (wall time, busy time and jobs per worker) and their counts
+	// added up (see FrameStats). Trace also keeps every job, for WriteChromeTrace
+	// Costs two clock reads per job and a pass over the counts of every tile
+	void SetProfiling(bool Enable, bool Trace = false);
+	bool GetProfiling() const { return Profiling; }
+
+	// Stats of the profiled frames done since the last call, oldest first. Frames still running show up on a later call
+	std::vector<FrameStats> TakeFrameStats();
+
+	// How fast parked workers get back to work, over every dispatch since the last reset
+	WorkerPool::WakeStats GetWakeStats() const { return Workers.GetWakeStats(); }
+	void ResetWakeStats() { Workers.ResetWakeStats(); }
+
+	// Counts of Direct frames without adaptive AA come from Cache when it has them, and the tiles computed are added to it
+	// Frames are then cut in CacheTileSize tiles of the whole image, so tiles on the frame's edges are computed whole
+	// Counts are the same with or without the cache. Null (the default) turns it off
+	// The cache can be shared by several renderers
+	void SetIterationCache(std::shared_ptr<IterationCache> NewCache) { Cache = std::move(NewCache); }
+	std::shared_ptr<IterationCache> GetIterationCache() const { return Cache; }
+
+	// Blocks are at most this size, smaller frames use smaller blocks so every worker gets enough of them
+	static const uint32_t MaxBlockSize = 64;
+	static const uint32_t MinBlockSize = 16;
+
+	static const uint32_t CacheTileSize = 64;
+
+	// Perturbation glitch fixing passes, each one with a new reference, before giving up on what's left
+	static const uint32_t MaxReferences = 32;
+private:
+	uint32_t PickBlockSize(const FrameParams& Frame) const;
+
+	// Buffer and Iters can be null, whatever isn't gets written
+	std::future<void> RenderTilesAsync(const RenderRequest& Request, uint8_t * Buffer, uint32_t * Iters);
+	std::future<void> RenderPerturbationAsync(const RenderRequest& Request, uint8_t * Buffer, uint32_t * Iters);
+
+	// Grid is the key of the tile whose top left pixel is the frame's, see CacheGrid
+	std::future<void> RenderCachedAsync(const RenderRequest& Request, const TileKey& Grid, uint8_t * Buffer, uint32_t * Iters);
+
+	// Null when profiling is off
+	std::shared_ptr<FrameProfile> BeginProfile(const char * Kind, const FrameParams& Frame);
+
+	// Before Workers, jobs still running when the pool drains on destruction write to it
+	struct
+	{
+		std::atomic<uint64_t> Iterated{ 0 };
+		std::atomic<uint64_t> Filled{ 0 };
+		std::atomic<uint64_t> Mismatched{ 0 };
+	} SubdivisionTotals;
+
+	struct
+	{
+		std::atomic<uint64_t> Pixels{ 0 };
+		std::atomic<uint64_t> Supersampled{ 0 };
+	} AdaptiveTotals;
+
+	WorkerPool Workers;
+	uint32_t WorkersCount;
+	KernelISA ISA;
+	bool AdaptiveScheduling = true;
+	bool VerifySubdivision = false;
+	float ReferenceHeadroom = 0.0f;
+	std::shared_ptr<IterationCache> Cache;
+	std::atomic<bool> Profiling{ false }; // Can be switched from another thread while frames are queued
+	std::atomic<bool> Tracing{ false };
+	std::atomic<uint64_t> ProfiledFrames{ 0 };
+	std::shared_ptr<FrameStatsLog> StatsLog; // Jobs hold on to it through their frame's profile
+
+	// First reference of the last perturbation frame, the whole orbit it was computed with (before the series)
+	// Never changed once made, a frame keeps the one it started from while others replace it
+	struct KeptReference
+	{
+		BigFixed X;
+		BigFixed Y;
+		double Bailout2 = 0.0;
+		uint32_t Iterations = 0; // Asked for, the orbit is shorter if it escaped
+		ReferenceOrbit Orbit;
+	};
+
+	mutable std::mutex ReferenceLock; // Only around swapping these two, never while computing
+	std::shared_ptr<const KeptReference> LastReference;
+	PerturbationStats LastPerturbation;
+	Palette Colors;
+	std::shared_ptr<const ShadeTable> Shading; // Jobs hold on to the one they started with
+};
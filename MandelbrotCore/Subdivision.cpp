@@ -0,0 +1,200 @@
+#include "Subdivision.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "Formulas.h"
+
+namespace
+{
+	// Rectangle of the block sample grid, bounds included. Its border is always computed before it's looked at
+	struct SampleRect
+	{
+		uint32_t X0;
+		uint32_t Y0;
+		uint32_t X1;
+		uint32_t Y1;
+	};
+
+	// Rectangles this many samples across or less are iterated in full, the cross would save very little
+	const uint32_t MinRectSpan = 4;
+
+	// Samples waiting for the kernel, and where their result goes on the block
+	struct SampleBatch
+	{
+		std::vector<SamplePoint> Points;
+		std::vector<uint32_t> Slots;
+		std::vector<uint32_t> Results;
+
+		void Run(const FrameParams& Frame, SampleKernel Kernel)
+		{
+			Results.resize(Points.size());
+			if (!Points.empty())
+				Kernel(Frame, Points.data(), uint32_t(Points.size()), Results.data());
+		}
+
+		void Clear()
+		{
+			Points.clear();
+			Slots.clear();
+		}
+	};
+
+	// Per thread so the lists keep their memory from one block to the next
+	struct SubdivisionScratch
+	{
+		SampleBatch Batch;
+		SampleBatch Check;
+		std::vector<SampleRect> Current;
+		std::vector<SampleRect> Next;
+	};
+}
+
+SubdivisionStats SubdivideBlock(const FrameParams& Frame, SampleKernel Kernel, bool Verify, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters)
+{
+	static thread_local SubdivisionScratch scratch;
+	SampleBatch& batch = scratch.Batch;
+	SampleBatch& check = scratch.Check;
+
+	SubdivisionStats stats;
+
+	auto slot = [&](uint32_t X, uint32_t Y)
+	{
+		return 4 * ((Y >> 1) * SizeX + (X >> 1)) + 2 * (Y & 1) + (X & 1);
+	};
+
+	auto add = [&](SampleBatch& Batch, uint32_t X, uint32_t Y)
+	{
+		Batch.Points.push_back({ 2 * BlockX + X, 2 * BlockY + Y });
+		Batch.Slots.push_back(slot(X, Y));
+	};
+
+	auto flush = [&]()
+	{
+		batch.Run(Frame, Kernel);
+		for (size_t i = 0; i < batch.Slots.size(); i++)
+			Iters[batch.Slots[i]] = batch.Results[i];
+		stats.Iterated += batch.Slots.size();
+		batch.Clear();
+	};
+
+	// Border of the whole block first
+	const uint32_t width = 2 * SizeX;
+	const uint32_t height = 2 * SizeY;
+	for (uint32_t x = 0; x < width; x++)
+	{
+		add(batch, x, 0);
+		add(batch, x, height - 1);
+	}
+	for (uint32_t y = 1; y < height - 1; y++)
+	{
+		add(batch, 0, y);
+		add(batch, width - 1, y);
+	}
+	flush();
+
+	std::vector<SampleRect>& current = scratch.Current;
+	std::vector<SampleRect>& next = scratch.Next;
+	current.assign(1, { 0, 0, width - 1, height - 1 });
+	check.Clear();
+
+	while (!current.empty())
+	{
+		next.clear();
+		for (const SampleRect& rect : current)
+		{
+			// Nothing inside
+			if (rect.X1 - rect.X0 < 2 || rect.Y1 - rect.Y0 < 2)
+				continue;
+
+			const uint32_t value = Iters[slot(rect.X0, rect.Y0)];
+			bool uniform = true;
+			for (uint32_t x = rect.X0; x <= rect.X1 && uniform; x++)
+				uniform = Iters[slot(x, rect.Y0)] == value && Iters[slot(x, rect.Y1)] == value;
+			for (uint32_t y = rect.Y0 + 1; y < rect.Y1 && uniform; y++)
+				uniform = Iters[slot(rect.X0, y)] == value && Iters[slot(rect.X1, y)] == value;
+
+			if (uniform)
+			{
+				for (uint32_t y = rect.Y0 + 1; y < rect.Y1; y++)
+				{
+					for (uint32_t x = rect.X0 + 1; x < rect.X1; x++)
+					{
+						Iters[slot(x, y)] = value;
+						if (Verify)
+							add(check, x, y);
+					}
+				}
+				stats.Filled += uint64_t(rect.X1 - rect.X0 - 1) * (rect.Y1 - rect.Y0 - 1);
+			}
+			else if (rect.X1 - rect.X0 <= MinRectSpan || rect.Y1 - rect.Y0 <= MinRectSpan)
+			{
+				for (uint32_t y = rect.Y0 + 1; y < rect.Y1; y++)
+				{
+					for (uint32_t x = rect.X0 + 1; x < rect.X1; x++)
+						add(batch, x, y);
+				}
+			}
+			else
+			{
+				// The cross between the 4 quarters is the border they are missing
+				const uint32_t mid_x = (rect.X0 + rect.X1) / 2;
+				const uint32_t mid_y = (rect.Y0 + rect.Y1) / 2;
+				for (uint32_t x = rect.X0 + 1; x < rect.X1; x++)
+					add(batch, x, mid_y);
+				for (uint32_t y = rect.Y0 + 1; y < rect.Y1; y++)
+				{
+					if (y != mid_y)
+						add(batch, mid_x, y);
+				}
+
+				next.push_back({ rect.X0, rect.Y0, mid_x, mid_y });
+				next.push_back({ mid_x, rect.Y0, rect.X1, mid_y });
+				next.push_back({ rect.X0, mid_y, mid_x, rect.Y1 });
+				next.push_back({ mid_x, mid_y, rect.X1, rect.Y1 });
+			}
+		}
+
+		flush();
+		std::swap(current, next);
+	}
+
+	// Brute force on everything that was filled, keeping what the kernel says
+	if (Verify)
+	{
+		check.Run(Frame, Kernel);
+		for (size_t i = 0; i < check.Slots.size(); i++)
+		{
+			uint32_t& filled = Iters[check.Slots[i]];
+			if (filled != check.Results[i])
+			{
+				stats.Mismatched++;
+				filled = check.Results[i];
+			}
+		}
+		check.Clear();
+	}
+
+	return stats;
+}
+
+bool SubdivisionFits(const FrameParams& Frame)
+{
+	if (Frame.Formula == Fractal::BurningShip)
+		return false;
+	if (!Frame.Julia)
+		return true;
+
+	// Orbit of the critical point 0, the same one for every formula left
+	bool bounded = true;
+	WithFormula(Frame.Formula, [&](auto Formula)
+	{
+		double x = 0.0, y = 0.0, y2 = 0.0;
+		for (uint32_t n = 0; n < Frame.Iterations && bounded; n++)
+		{
+			decltype(Formula)::template Step<ScalarDouble>(x, y, y2, Frame.JuliaX, Frame.JuliaY);
+			y2 = y*y;
+			bounded = x*x + y2 <= 4.0;
+		}
+	});
+	return bounded;
+}
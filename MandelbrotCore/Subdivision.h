@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include "Kernels.h"
+
+// What the subdivision renderer did, counted in SSAA samples
+struct SubdivisionStats
+{
+	uint64_t Iterated = 0; // Ran through the kernel
+	uint64_t Filled = 0; // Copied from the border of a uniform rectangle
+	uint64_t Mismatched = 0; // Filled samples the kernel disagrees with, only counted when verifying
+};
+
+// Whether filling from the borders holds on Frame's set, see SubdivideBlock
+// The Mandelbrot set, the Tricorn and the Multibrots are connected, the Burning Ship isn't. A Julia set is connected
+// when its c is in the set of its formula, which is taken as c not escaping within Frame.Iterations
+bool SubdivisionFits(const FrameParams& Frame);
+
+// Mariani-Silver : the set is connected, so a rectangle whose border is all the same iteration count has that count inside too
+// Only true of some sets (see SubdivisionFits), on the others filling can paint over whole pieces of the set
+// Iterates only the border of the block, then splits it in 4 (iterating the cross between them) until every rectangle
+// is either uniform, and gets filled without iterating, or small enough that iterating all of it is cheaper
+// Rectangles are done a level at a time, so Kernel always gets a long list of samples to keep its lanes busy
+// With Verify the filled samples are iterated anyway, the kernel result is the one written and the differences are counted
+// Writes the iteration counts to Iters in the same layout as the block kernels
+SubdivisionStats SubdivideBlock(const FrameParams& Frame, SampleKernel Kernel, bool Verify, uint32_t BlockX, uint32_t BlockY, uint32_t SizeX, uint32_t SizeY, uint32_t * Iters);
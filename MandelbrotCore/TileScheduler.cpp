@@ -0,0 +1,179 @@
+#include "TileScheduler.h"
+#include <algorithm>
+#include "Formulas.h"
+
+static uint32_t CeilDiv(uint32_t A, uint32_t B)
+{
+	return (A + B - 1) / B;
+}
+
+// Steps a kernel spends on a pixel, with the same interior checks
+template<typename Formula>
+static uint32_t ProbeIterations(const FrameParams& Frame, double PX, double PY)
+{
+	if (HasInteriorCheck(Frame) && InCardioidOrBulb(PX, PY))
+		return 0;
+
+	// Julia starts from the pixel with a fixed c, the rest start from 0 with c on the pixel
+	const double c_x = Frame.Julia ? Frame.JuliaX : PX;
+	const double c_y = Frame.Julia ? Frame.JuliaY : PY;
+	const double tolerance2 = PeriodTolerance<double>() * PeriodTolerance<double>();
+	double x = Frame.Julia ? PX : 0.0, y = Frame.Julia ? PY : 0.0;
+	double saved_x = x, saved_y = y;
+	uint32_t next_save = PeriodCheckInterval, save_window = PeriodCheckInterval;
+	for (uint32_t n = 0; n < Frame.Iterations; n++)
+	{
+		const double x2 = x*x;
+		const double y2 = y*y;
+		if (x2 + y2 > 4.0)
+			return n;
+
+		Formula::template Step<ScalarDouble>(x, y, y2, c_x, c_y);
+
+		if ((n + 1) % PeriodCheckInterval == 0)
+		{
+			if ((x - saved_x)*(x - saved_x) + (y - saved_y)*(y - saved_y) < tolerance2)
+				return n;
+
+			if (n + 1 == next_save)
+			{
+				saved_x = x;
+				saved_y = y;
+				save_window *= 2;
+				next_save += save_window;
+			}
+		}
+	}
+	return Frame.Iterations;
+}
+
+std::vector<Tile> RasterTiles(const FrameParams& Frame, uint32_t BlockSize)
+{
+	std::vector<Tile> tiles;
+	for (uint32_t y = 0; y < Frame.Height; y += BlockSize)
+	{
+		for (uint32_t x = 0; x < Frame.Width; x += BlockSize)
+			tiles.push_back({ x, y, std::min(BlockSize, Frame.Width - x), std::min(BlockSize, Frame.Height - y), 0 });
+	}
+	return tiles;
+}
+
+TileCosts::TileCosts(const FrameParams& Frame, uint32_t MinBlockSize)
+	: Frame(Frame), MinBlockSize(MinBlockSize), CellsX(CeilDiv(Frame.Width, MinBlockSize)), CellsY(CeilDiv(Frame.Height, MinBlockSize)),
+	  CellCost(size_t(CellsX) * CellsY, 0)
+{
+}
+
+void TileCosts::ProbeRow(uint32_t Row)
+{
+	uint32_t(*probe)(const FrameParams&, double, double) = nullptr;
+	WithFormula(Frame.Formula, [&](auto Policy) { probe = &ProbeIterations<decltype(Policy)>; });
+
+	const uint32_t y = Row * MinBlockSize;
+	const uint32_t size_y = std::min(MinBlockSize, Frame.Height - y);
+	for (uint32_t cell = 0; cell < CellsX; cell++)
+	{
+		const uint32_t x = cell * MinBlockSize;
+		const uint32_t size_x = std::min(MinBlockSize, Frame.Width - x);
+
+		const double p_x = (double(Frame.OriginX + x) + 0.5*size_x) * Frame.CoeffA_X + Frame.CoeffB_X;
+		const double p_y = (double(Frame.OriginY + y) + 0.5*size_y) * Frame.CoeffA_Y + Frame.CoeffB_Y;
+
+		// +1 so fast escaping pixels still cost something
+		CellCost[size_t(Row) * CellsX + cell] = uint64_t(probe(Frame, p_x, p_y) + 1) * size_x * size_y;
+	}
+}
+
+std::vector<Tile> ScheduleTiles(const TileCosts& Costs, uint32_t BlockSize, uint32_t WorkersCount)
+{
+	const FrameParams& frame = Costs.Frame;
+	const uint32_t min_size = Costs.MinBlockSize;
+	const uint32_t cells_x = Costs.CellsX;
+	const uint32_t cells_y = Costs.CellsY;
+	const std::vector<uint64_t>& cell_cost = Costs.CellCost;
+
+	// Cells are aligned with the tiles, so the cost of any tile is the sum of the cells it covers
+	auto tile_cost = [&](uint32_t X, uint32_t Y, uint32_t Size)
+	{
+		uint64_t cost = 0;
+		const uint32_t end_x = std::min(CeilDiv(X + Size, min_size), cells_x);
+		const uint32_t end_y = std::min(CeilDiv(Y + Size, min_size), cells_y);
+		for (uint32_t cy = Y / min_size; cy < end_y; cy++)
+		{
+			for (uint32_t cx = X / min_size; cx < end_x; cx++)
+				cost += cell_cost[size_t(cy) * cells_x + cx];
+		}
+		return cost;
+	};
+
+	uint64_t total_cost = 0;
+	for (uint64_t cost : cell_cost)
+		total_cost += cost;
+
+	// Anything above this would be a big part of what a worker does in the whole frame
+	const uint64_t split_cost = std::max<uint64_t>(total_cost / (8 * std::max(WorkersCount, 1u)), 1);
+
+	std::vector<Tile> tiles;
+	std::vector<uint32_t> pending; // x, y, size triplets still to check
+	for (uint32_t y = 0; y < frame.Height; y += BlockSize)
+	{
+		for (uint32_t x = 0; x < frame.Width; x += BlockSize)
+		{
+			pending.insert(pending.end(), { x, y, BlockSize });
+			while (!pending.empty())
+			{
+				const uint32_t size = pending.back();
+				const uint32_t tile_y = pending[pending.size() - 2];
+				const uint32_t tile_x = pending[pending.size() - 3];
+				pending.resize(pending.size() - 3);
+
+				const uint64_t cost = tile_cost(tile_x, tile_y, size);
+				if (cost > split_cost && size / 2 >= min_size)
+				{
+					const uint32_t half = size / 2;
+					for (uint32_t k = 0; k < 4; k++)
+					{
+						const uint32_t sub_x = tile_x + (k & 1) * half;
+						const uint32_t sub_y = tile_y + (k >> 1) * half;
+						if (sub_x < frame.Width && sub_y < frame.Height)
+							pending.insert(pending.end(), { sub_x, sub_y, half });
+					}
+				}
+				else
+				{
+					tiles.push_back({ tile_x, tile_y, std::min(size, frame.Width - tile_x), std::min(size, frame.Height - tile_y), cost });
+				}
+			}
+		}
+	}
+
+	// Longest first, the pool starts lower job indices first so the cheap tiles fill the gaps at the end
+	std::stable_sort(tiles.begin(), tiles.end(), [](const Tile& A, const Tile& B) { return A.Cost > B.Cost; });
+	return tiles;
+}
+
+std::vector<uint32_t> GroupTilesByNode(std::vector<Tile>& Tiles, uint32_t Height, const WorkerPool& Workers)
+{
+	const uint32_t nodes = Workers.GetNodeCount();
+	std::vector<uint32_t> counts(nodes, 0);
+	if (nodes == 1)
+	{
+		counts[0] = uint32_t(Tiles.size());
+		return counts;
+	}
+
+	// Last row of every band, tiles go by the row in their middle
+	std::vector<uint32_t> ends(nodes);
+	uint32_t workers = 0;
+	for (uint32_t node = 0; node < nodes; node++)
+	{
+		workers += Workers.GetNodeWorkersCount(node);
+		ends[node] = uint32_t(uint64_t(Height) * workers / Workers.GetWorkersCount());
+	}
+	auto node_of = [&](const Tile& T) { return uint32_t(std::upper_bound(ends.begin(), ends.end(), T.Y + T.SizeY / 2) - ends.begin()); };
+
+	std::stable_sort(Tiles.begin(), Tiles.end(), [&](const Tile& A, const Tile& B) { return node_of(A) < node_of(B); });
+	for (const Tile& tile : Tiles)
+		counts[node_of(tile)]++;
+	return counts;
+}
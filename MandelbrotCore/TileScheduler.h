@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Kernels.h"
+#include "WorkerPool.h"
+
+// Block of the frame given to a kernel, already clipped to the frame
+struct Tile
+{
+	uint32_t X;
+	uint32_t Y;
+	uint32_t SizeX;
+	uint32_t SizeY;
+	uint64_t Cost; // Predicted iterations
+};
+
+// Splits the frame into tiles of BlockSize in raster order, all with the same cost
+std::vector<Tile> RasterTiles(const FrameParams& Frame, uint32_t BlockSize);
+
+// Cost pre-pass of ScheduleTiles : iterates the center of every MinBlockSize cell of the frame
+// Every row of cells is a job of its own, ProbeRow(Row) for Row < Rows(), meant to be dispatched like any other. Rows
+// that never run (a cancelled dispatch) leave their cells at no cost
+struct TileCosts
+{
+	TileCosts(const FrameParams& Frame, uint32_t MinBlockSize);
+
+	uint32_t Rows() const { return CellsY; }
+	void ProbeRow(uint32_t Row);
+
+	FrameParams Frame;
+	uint32_t MinBlockSize;
+	uint32_t CellsX;
+	uint32_t CellsY;
+	std::vector<uint64_t> CellCost; // Predicted iterations of every cell, row by row
+};
+
+// Splits the frame of a finished pre-pass into tiles of BlockSize, ordered from most to least expensive
+// Tiles that would take much longer than the rest are split in 4 (down to the cell size), so the frame
+// isn't left waiting on one worker stuck on a block full of in-set pixels. WorkersCount is what the frame runs on
+std::vector<Tile> ScheduleTiles(const TileCosts& Costs, uint32_t BlockSize, uint32_t WorkersCount);
+
+// Reorders Tiles so each NUMA node of Workers gets a band of rows, as tall as its share of the workers, and returns the
+// tile count of every band for WorkerPool::Dispatch. Tiles keep their order within a band
+// The rows a node computes are then first touched and read back by that node. With one node nothing moves
+std::vector<uint32_t> GroupTilesByNode(std::vector<Tile>& Tiles, uint32_t Height, const WorkerPool& Workers);
@@ -0,0 +1,262 @@
+#include "Topology.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+	// Every thread on its own core, all on one node
+	CPUTopology FlatTopology()
+	{
+		CPUTopology topology;
+		const uint32_t count = std::max(std::thread::hardware_concurrency(), 1u);
+		for (uint32_t i = 0; i < count; i++)
+			topology.CPUs.push_back({ i, i, 0, 0 });
+		topology.Cores = count;
+		return topology;
+	}
+
+	// Sibling numbers from the core of every CPU, and the node numbers packed to 0 .. Nodes - 1
+	void Finish(CPUTopology& Topology)
+	{
+		std::sort(Topology.CPUs.begin(), Topology.CPUs.end(), [](const LogicalCPU& A, const LogicalCPU& B) { return A.ID < B.ID; });
+
+		std::map<uint32_t, uint32_t> threads_per_core, nodes;
+		for (LogicalCPU& cpu : Topology.CPUs)
+		{
+			cpu.Sibling = threads_per_core[cpu.Core]++;
+			nodes.emplace(cpu.Node, 0);
+		}
+
+		uint32_t next = 0;
+		for (auto& node : nodes)
+			node.second = next++;
+		for (LogicalCPU& cpu : Topology.CPUs)
+			cpu.Node = nodes[cpu.Node];
+
+		Topology.Cores = uint32_t(threads_per_core.size());
+		Topology.Nodes = std::max(next, 1u);
+	}
+
+#if defined(__linux__)
+	bool ReadNumber(const std::string& Path, uint32_t& Value)
+	{
+		FILE * file = fopen(Path.c_str(), "r");
+		if (!file)
+			return false;
+		const bool ok = fscanf(file, "%u", &Value) == 1;
+		fclose(file);
+		return ok;
+	}
+
+	// Lists like 0-3,8,10-11
+	std::vector<uint32_t> ReadList(const std::string& Path)
+	{
+		std::vector<uint32_t> values;
+		FILE * file = fopen(Path.c_str(), "r");
+		if (!file)
+			return values;
+
+		char text[4096] = {};
+		if (fgets(text, sizeof(text), file))
+		{
+			const char * pos = text;
+			while (*pos >= '0' && *pos <= '9')
+			{
+				char * end;
+				const uint32_t first = uint32_t(strtoul(pos, &end, 10));
+				uint32_t last = first;
+				if (*end == '-')
+					last = uint32_t(strtoul(end + 1, &end, 10));
+				for (uint32_t value = first; value <= last; value++)
+					values.push_back(value);
+				pos = *end == ',' ? end + 1 : end;
+			}
+		}
+		fclose(file);
+		return values;
+	}
+#endif
+}
+
+CPUTopology DetectTopology()
+{
+	CPUTopology topology;
+
+#if defined(_WIN32)
+	DWORD size = 0;
+	GetLogicalProcessorInformationEx(RelationAll, nullptr, &size);
+	std::vector<uint8_t> buffer(size);
+	if (!size || !GetLogicalProcessorInformationEx(RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)buffer.data(), &size))
+		return FlatTopology();
+
+	// Cores come first, nodes are matched to their CPUs once all of them are known
+	std::vector<std::pair<uint32_t, GROUP_AFFINITY>> node_masks;
+	uint32_t core = 0;
+	for (DWORD offset = 0; offset < size;)
+	{
+		auto info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(buffer.data() + offset);
+		if (info->Relationship == RelationProcessorCore)
+		{
+			for (WORD g = 0; g < info->Processor.GroupCount; g++)
+			{
+				const GROUP_AFFINITY& mask = info->Processor.GroupMask[g];
+				for (uint32_t bit = 0; bit < 64; bit++)
+				{
+					if (mask.Mask & (KAFFINITY(1) << bit))
+						topology.CPUs.push_back({ uint32_t(mask.Group) * 64 + bit, core, 0, 0 });
+				}
+			}
+			core++;
+		}
+		else if (info->Relationship == RelationNumaNode)
+		{
+			node_masks.push_back({ uint32_t(info->NumaNode.NodeNumber), info->NumaNode.GroupMask });
+		}
+		offset += info->Size;
+	}
+
+	for (LogicalCPU& cpu : topology.CPUs)
+	{
+		for (const auto& node : node_masks)
+		{
+			if (node.second.Group == cpu.ID / 64 && (node.second.Mask & (KAFFINITY(1) << (cpu.ID % 64))))
+				cpu.Node = node.first;
+		}
+	}
+#elif defined(__linux__)
+	const std::string root = "/sys/devices/system/";
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t> cores; // (package, core id) -> core
+
+	// Only the CPUs this process may run on, taskset and containers take some away
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	const bool restricted = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+	for (uint32_t id : ReadList(root + "cpu/online"))
+	{
+		if (restricted && (id >= CPU_SETSIZE || !CPU_ISSET(id, &allowed)))
+			continue;
+
+		const std::string dir = root + "cpu/cpu" + std::to_string(id) + "/topology/";
+		uint32_t package = 0, core_id = id;
+		ReadNumber(dir + "physical_package_id", package);
+		ReadNumber(dir + "core_id", core_id);
+		const uint32_t core = cores.emplace(std::make_pair(package, core_id), uint32_t(cores.size())).first->second;
+		topology.CPUs.push_back({ id, core, 0, 0 });
+	}
+
+	if (DIR * nodes = opendir((root + "node").c_str()))
+	{
+		while (dirent * entry = readdir(nodes))
+		{
+			uint32_t node;
+			if (sscanf(entry->d_name, "node%u", &node) != 1)
+				continue;
+			for (uint32_t id : ReadList(root + "node/" + entry->d_name + "/cpulist"))
+			{
+				for (LogicalCPU& cpu : topology.CPUs)
+				{
+					if (cpu.ID == id)
+						cpu.Node = node;
+				}
+			}
+		}
+		closedir(nodes);
+	}
+#endif
+
+	if (topology.CPUs.empty())
+		return FlatTopology();
+	Finish(topology);
+	return topology;
+}
+
+uint32_t DefaultWorkerCount(const CPUTopology& Topology, WorkerPinning Pinning)
+{
+	return std::max(Pinning == WorkerPinning::Cores ? Topology.Cores : uint32_t(Topology.CPUs.size()), 1u);
+}
+
+std::vector<WorkerPlacement> PlaceWorkers(const CPUTopology& Topology, uint32_t Count, WorkerPinning Pinning)
+{
+	std::vector<WorkerPlacement> placement(Count);
+	if (Pinning == WorkerPinning::None)
+		return placement;
+
+	// Per node, the first thread of every core, then the second ones...
+	const uint32_t max_sibling = Pinning == WorkerPinning::CoresThenSMT ? UINT32_MAX : 0;
+	std::vector<std::vector<const LogicalCPU*>> node_cpus(Topology.Nodes);
+	for (uint32_t sibling = 0; sibling <= max_sibling; sibling++)
+	{
+		bool any = false;
+		for (const LogicalCPU& cpu : Topology.CPUs)
+		{
+			if (cpu.Sibling == sibling)
+			{
+				node_cpus[cpu.Node].push_back(&cpu);
+				any = true;
+			}
+		}
+		if (!any)
+			break;
+	}
+
+	// Nodes take turns so every one of them gets workers, then workers sharing a node are put together
+	std::vector<size_t> taken(Topology.Nodes, 0);
+	uint32_t placed = 0;
+	for (bool progress = true; progress && placed < Count;)
+	{
+		progress = false;
+		for (uint32_t node = 0; node < Topology.Nodes && placed < Count; node++)
+		{
+			if (taken[node] < node_cpus[node].size())
+			{
+				placement[placed].CPU = int(node_cpus[node][taken[node]++]->ID);
+				placement[placed].Node = node;
+				placed++;
+				progress = true;
+			}
+		}
+	}
+
+	// Whatever is left isn't pinned, spread over the nodes
+	for (uint32_t i = placed; i < Count; i++)
+		placement[i].Node = i % Topology.Nodes;
+
+	std::stable_sort(placement.begin(), placement.end(), [](const WorkerPlacement& A, const WorkerPlacement& B) { return A.Node < B.Node; });
+	return placement;
+}
+
+bool PinCurrentThread(int CPU)
+{
+	if (CPU < 0)
+		return false;
+
+#if defined(_WIN32)
+	GROUP_AFFINITY affinity = {};
+	affinity.Group = WORD(CPU / 64);
+	affinity.Mask = KAFFINITY(1) << (CPU % 64);
+	return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(CPU, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
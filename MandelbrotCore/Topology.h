@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Where the hardware threads are : which physical core each one belongs to and which NUMA node it's on
+// Only used to place the workers, anything that can't be read falls back to one node with one core per thread
+
+struct LogicalCPU
+{
+	uint32_t ID; // What the OS pins to. On Windows it's group * 64 + the index in the group
+	uint32_t Core; // Physical core, unique across packages
+	uint32_t Node; // NUMA node, 0 to Nodes - 1
+	uint32_t Sibling; // 0 for the first hardware thread of its core, 1 for the second SMT one...
+};
+
+struct CPUTopology
+{
+	std::vector<LogicalCPU> CPUs;
+	uint32_t Cores = 0;
+	uint32_t Nodes = 1;
+};
+
+CPUTopology DetectTopology();
+
+enum class WorkerPinning
+{
+	None, // Threads go wherever the OS puts them
+	Cores, // One worker per physical core, spread over the NUMA nodes. Workers past the core count aren't pinned
+	CoresThenSMT // Physical cores first, then the other hardware threads of each core
+};
+
+// Where one worker runs
+struct WorkerPlacement
+{
+	int CPU = -1; // LogicalCPU::ID, -1 for not pinned
+	uint32_t Node = 0;
+};
+
+// Placement of Count workers. Cores are taken a node at a time in turn, so fewer workers than cores still use
+// every node, and workers are sorted by node so the ones sharing a node are next to each other
+// With None every worker is unpinned on node 0
+std::vector<WorkerPlacement> PlaceWorkers(const CPUTopology& Topology, uint32_t Count, WorkerPinning Pinning);
+
+// Worker count for a pinning : the core count with Cores, every hardware thread otherwise
+uint32_t DefaultWorkerCount(const CPUTopology& Topology, WorkerPinning Pinning);
+
+// Pins the calling thread to a LogicalCPU::ID, false if the OS refused
+bool PinCurrentThread(int CPU);
@@ -0,0 +1,497 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Topology.h"
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Queue a dispatch goes to. Workers take every Interactive job there is, from their own deque or anyone else's, before
+// touching a Batch one, so a frame somebody is waiting on gets ahead of background work at the next job boundary
+enum class JobPriority
+{
+	Interactive,
+	Batch
+};
+const uint32_t JobPriorityCount = 2;
+
+// Set it to true from any thread and the jobs of the dispatches holding it that haven't started yet are skipped
+// Jobs already running finish, and the dispatch's future is ready once they have
+typedef std::shared_ptr<std::atomic<bool>> CancelFlag;
+
+inline CancelFlag MakeCancelFlag()
+{
+	return std::make_shared<std::atomic<bool>>(false);
+}
+
+inline bool IsCancelled(const CancelFlag& Cancel)
+{
+	return Cancel && Cancel->load(std::memory_order_relaxed);
+}
+
+// Work stealing pool
+// Every dispatch is dealt round robin across the workers' deques, worker w gets jobs w, w + N, w + 2N...
+// A worker runs its jobs in increasing order, and when it runs dry it steals the back half of somebody else's
+// So lower job indices start first, callers can put their most expensive jobs there
+// Idle workers spin for a while before parking, so back to back frames don't pay for a wake up
+// Workers can be pinned and assigned to NUMA nodes (see PlaceWorkers). They steal from their own node before the others,
+// and dispatches can give each node its own share of the jobs
+// Each worker has a deque per JobPriority, see there
+class WorkerPool
+{
+public:
+	// First argument is the job index, second is the worker id
+	typedef std::function<void(int, int)> JobFunction;
+
+	// How many times an idle worker polls for new jobs before going to sleep
+	static const uint32_t SpinCount = 4000;
+
+	// Placement has one entry per worker, or is empty for unpinned workers on a single node
+	WorkerPool(uint32_t NumWorkers, const std::vector<WorkerPlacement>& Placement = {}) : Queues(NumWorkers), WorkerNodes(NumWorkers, 0)
+	{
+		IsAlive = true;
+		WorkersCount = NumWorkers;
+
+		for (uint32_t id = 0; id < WorkersCount && id < Placement.size(); id++)
+			WorkerNodes[id] = Placement[id].Node;
+		const uint32_t nodes = WorkersCount ? *std::max_element(WorkerNodes.begin(), WorkerNodes.end()) + 1 : 1;
+		NodeWorkers.resize(nodes);
+		for (uint32_t id = 0; id < WorkersCount; id++)
+			NodeWorkers[WorkerNodes[id]].push_back(id);
+		for (uint32_t id = 0; id < WorkersCount; id++)
+			AllWorkers.push_back(id);
+
+		// Everybody on the same node first, in the same ring order as before, then the other nodes
+		Victims.resize(WorkersCount);
+		for (uint32_t id = 0; id < WorkersCount; id++)
+		{
+			for (int pass = 0; pass < 2; pass++)
+			{
+				for (uint32_t k = 1; k < WorkersCount; k++)
+				{
+					const uint32_t victim = (id + k) % WorkersCount;
+					if ((WorkerNodes[victim] == WorkerNodes[id]) == (pass == 0))
+						Victims[id].push_back(victim);
+				}
+			}
+		}
+
+		for (uint32_t id = 0; id < WorkersCount; id++)
+		{
+			const int cpu = id < Placement.size() ? Placement[id].CPU : -1;
+			wPool.emplace_back([id, cpu, this]()
+			{
+				// Before anything else, so the thread's own allocations land on its node
+				if (cpu >= 0)
+					PinCurrentThread(cpu);
+				WorkerLoop(id);
+			});
+		}
+	}
+
+	// Finishes whatever was dispatched before returning
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(SleepLock);
+			IsAlive = false;
+			WakeEpoch++;
+		}
+		SleepCV.notify_all();
+
+		for (auto& worker : wPool)
+			worker.join();
+	}
+
+	// Queues JobCount jobs and returns right away. The future is ready once all of them are done (or skipped, see
+	// CancelFlag), and rethrows the first exception a job threw
+	// Several dispatches can be in flight at once, each one with its own function
+	std::future<void> Dispatch(uint32_t JobCount, JobFunction Function, JobPriority Priority = JobPriority::Batch, CancelFlag Cancel = nullptr)
+	{
+		auto batch = MakeBatch(JobCount, std::move(Function), Priority, std::move(Cancel));
+		std::future<void> done = batch->Done.get_future();
+
+		if (JobCount == 0)
+		{
+			batch->Done.set_value();
+			return done;
+		}
+
+		QueuedJobs += JobCount;
+		Deal(batch, 0, JobCount, AllWorkers);
+		Wake();
+		return done;
+	}
+
+	// Same, with the jobs split by NUMA node : the first NodeJobs[0] jobs go to the workers of node 0, the next
+	// NodeJobs[1] to node 1 and so on. Each node runs its own share first and only then helps the others
+	// Shares for nodes the pool doesn't have are dealt to every worker
+	std::future<void> Dispatch(const std::vector<uint32_t>& NodeJobs, JobFunction Function, JobPriority Priority = JobPriority::Batch, CancelFlag Cancel = nullptr)
+	{
+		uint32_t job_count = 0;
+		for (uint32_t jobs : NodeJobs)
+			job_count += jobs;
+		if (NodeWorkers.size() == 1 || job_count == 0)
+			return Dispatch(job_count, std::move(Function), Priority, std::move(Cancel));
+
+		auto batch = MakeBatch(job_count, std::move(Function), Priority, std::move(Cancel));
+		std::future<void> done = batch->Done.get_future();
+		DealByNode(batch, NodeJobs);
+		return done;
+	}
+
+	// Fills in the second dispatch of DispatchThen, its jobs by node and their function
+	typedef std::function<void(std::vector<uint32_t>& NodeJobs, JobFunction& Function)> NextFunction;
+
+	// Two dispatches in a row, for work whose jobs depend on what other jobs find. Once the JobCount jobs are done (or
+	// skipped), Next runs on the worker that finished the last one (on the caller without jobs) and the jobs it gives are
+	// dealt like Dispatch(NodeJobs) with the same priority and flag. Returns right away, the future is ready once the
+	// second dispatch is done and rethrows what either of them (or Next) threw
+	std::future<void> DispatchThen(uint32_t JobCount, JobFunction Function, NextFunction Next, JobPriority Priority = JobPriority::Batch, CancelFlag Cancel = nullptr)
+	{
+		auto batch = MakeBatch(JobCount, std::move(Function), Priority, Cancel);
+		std::future<void> done = batch->Done.get_future();
+		batch->Then = [this, Next, Priority, Cancel](std::promise<void>& Done)
+		{
+			std::vector<uint32_t> node_jobs;
+			JobFunction function;
+			Next(node_jobs, function);
+
+			uint32_t job_count = 0;
+			for (uint32_t jobs : node_jobs)
+				job_count += jobs;
+			if (job_count == 0)
+			{
+				Done.set_value();
+				return;
+			}
+
+			auto second = MakeBatch(job_count, std::move(function), Priority, Cancel);
+			second->Done = std::move(Done);
+			DealByNode(second, node_jobs);
+		};
+
+		if (JobCount == 0)
+		{
+			Finish(*batch);
+			return done;
+		}
+
+		QueuedJobs += JobCount;
+		Deal(batch, 0, JobCount, AllWorkers);
+		Wake();
+		return done;
+	}
+
+	uint32_t GetNodeCount() const
+	{
+		return uint32_t(NodeWorkers.size());
+	}
+
+	uint32_t GetNodeWorkersCount(uint32_t Node) const
+	{
+		return uint32_t(NodeWorkers[Node].size());
+	}
+
+	uint32_t GetWorkersCount() const
+	{
+		return WorkersCount;
+	}
+
+
+	// Workers that had parked and were woken up by a dispatch, and how long it took from the dispatch until they
+	// were running again. Workers that were still spinning pick jobs up right away and aren't counted
+	struct WakeStats
+	{
+		uint64_t Wakeups = 0;
+		double TotalLatencyUs = 0.0;
+		double MaxLatencyUs = 0.0;
+	};
+
+	WakeStats GetWakeStats() const
+	{
+		WakeStats stats;
+		stats.Wakeups = Wakeups;
+		stats.TotalLatencyUs = WakeLatencyNs * 1e-3;
+		stats.MaxLatencyUs = MaxWakeLatencyNs * 1e-3;
+		return stats;
+	}
+
+	void ResetWakeStats()
+	{
+		Wakeups = 0;
+		WakeLatencyNs = 0;
+		MaxWakeLatencyNs = 0;
+	}
+
+private:
+	struct Batch
+	{
+		JobFunction Function;
+		uint32_t Priority;
+		CancelFlag Cancel;
+		std::atomic<uint32_t> Remaining;
+		std::promise<void> Done;
+		std::mutex ErrorLock;
+		std::exception_ptr Error;
+		std::function<void(std::promise<void>&)> Then; // DispatchThen's, gets Done to hand over to the second dispatch
+	};
+
+	// Jobs Begin, Begin + Stride, ... Count of them, of a batch
+	struct Range
+	{
+		std::shared_ptr<Batch> Owner;
+		uint32_t Begin;
+		uint32_t Count;
+		uint32_t Stride;
+	};
+
+	// Own cache line so workers don't fight over each other's locks
+	struct alignas(64) WorkerQueue
+	{
+		std::mutex Lock;
+		std::deque<Range> Ranges[JobPriorityCount];
+	};
+
+	static std::shared_ptr<Batch> MakeBatch(uint32_t JobCount, JobFunction Function, JobPriority Priority, CancelFlag Cancel)
+	{
+		auto batch = std::make_shared<Batch>();
+		batch->Function = std::move(Function);
+		batch->Priority = uint32_t(Priority);
+		batch->Cancel = std::move(Cancel);
+		batch->Remaining = JobCount;
+		return batch;
+	}
+
+	// Even split of jobs First .. First + Count - 1 over Workers, stealing takes care of the imbalance
+	void Deal(const std::shared_ptr<Batch>& Owner, uint32_t First, uint32_t Count, const std::vector<uint32_t>& Workers)
+	{
+		const uint32_t stride = uint32_t(Workers.size());
+		for (uint32_t k = 0; k < stride && k < Count; k++)
+		{
+			std::lock_guard<std::mutex> lock(Queues[Workers[k]].Lock);
+			Queues[Workers[k]].Ranges[Owner->Priority].push_back({ Owner, First + k, (Count - k + stride - 1) / stride, stride });
+		}
+	}
+
+	// Jobs split by node, see Dispatch(NodeJobs)
+	void DealByNode(const std::shared_ptr<Batch>& Owner, const std::vector<uint32_t>& NodeJobs)
+	{
+		QueuedJobs += Owner->Remaining.load();
+		uint32_t first = 0;
+		for (size_t node = 0; node < NodeJobs.size(); node++)
+		{
+			const bool has_workers = node < NodeWorkers.size() && !NodeWorkers[node].empty();
+			Deal(Owner, first, NodeJobs[node], has_workers ? NodeWorkers[node] : AllWorkers);
+			first += NodeJobs[node];
+		}
+		Wake();
+	}
+
+	// Last job of the batch done
+	static void Finish(Batch& Owner)
+	{
+		if (Owner.Error)
+		{
+			Owner.Done.set_exception(Owner.Error);
+			return;
+		}
+		if (!Owner.Then)
+		{
+			Owner.Done.set_value();
+			return;
+		}
+
+		try
+		{
+			Owner.Then(Owner.Done);
+		}
+		catch (...)
+		{
+			Owner.Done.set_exception(std::current_exception());
+		}
+	}
+
+	void Wake()
+	{
+		// Bumping the epoch under the lock is what keeps a worker that is about to park from missing this
+		{
+			std::lock_guard<std::mutex> lock(SleepLock);
+			LastDispatch = Now();
+			WakeEpoch++;
+		}
+		if (Sleepers > 0)
+			SleepCV.notify_all();
+	}
+
+	static int64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static void Pause()
+	{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+		_mm_pause();
+#else
+		std::this_thread::yield();
+#endif
+	}
+
+	// Takes the first job of the worker's own deque of that priority, older dispatches go first
+	bool PopLocal(uint32_t ID, uint32_t Priority, Range& Job)
+	{
+		WorkerQueue& queue = Queues[ID];
+		std::lock_guard<std::mutex> lock(queue.Lock);
+		std::deque<Range>& ranges = queue.Ranges[Priority];
+		if (ranges.empty())
+			return false;
+
+		Range& front = ranges.front();
+		Job = { front.Owner, front.Begin, 1, front.Stride };
+		front.Begin += front.Stride;
+		if (--front.Count == 0)
+			ranges.pop_front();
+
+		QueuedJobs--;
+		return true;
+	}
+
+	// Takes the back half of the first range found on another worker, keeps one job and queues the rest locally
+	bool Steal(uint32_t ID, uint32_t Priority, Range& Job)
+	{
+		for (uint32_t victim_id : Victims[ID])
+		{
+			std::deque<Range>& ranges = Queues[victim_id].Ranges[Priority];
+			Range stolen;
+			{
+				std::lock_guard<std::mutex> lock(Queues[victim_id].Lock);
+				if (ranges.empty())
+					continue;
+
+				Range& front = ranges.front();
+				uint32_t take = (front.Count + 1) / 2;
+				front.Count -= take;
+				stolen = { front.Owner, front.Begin + front.Count*front.Stride, take, front.Stride };
+				if (front.Count == 0)
+					ranges.pop_front();
+			}
+
+			Job = { stolen.Owner, stolen.Begin, 1, stolen.Stride };
+			if (stolen.Count > 1)
+			{
+				std::lock_guard<std::mutex> lock(Queues[ID].Lock);
+				Queues[ID].Ranges[Priority].push_back({ stolen.Owner, stolen.Begin + stolen.Stride, stolen.Count - 1, stolen.Stride });
+			}
+
+			QueuedJobs--;
+			return true;
+		}
+
+		return false;
+	}
+
+	void Run(const Range& Job, uint32_t ID)
+	{
+		Batch& batch = *Job.Owner;
+
+		try
+		{
+			if (!IsCancelled(batch.Cancel))
+				batch.Function(int(Job.Begin), int(ID));
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(batch.ErrorLock);
+			if (!batch.Error)
+				batch.Error = std::current_exception();
+		}
+
+		if (batch.Remaining.fetch_sub(1) == 1)
+			Finish(batch);
+	}
+
+	void WorkerLoop(uint32_t ID)
+	{
+		while (true)
+		{
+			// Anything interactive anywhere first
+			Range job;
+			bool found = false;
+			for (uint32_t priority = 0; priority < JobPriorityCount && !found; priority++)
+				found = PopLocal(ID, priority, job) || Steal(ID, priority, job);
+			if (found)
+			{
+				Run(job, ID);
+				continue;
+			}
+
+			// Only leave once everything that was dispatched is done
+			if (!IsAlive && QueuedJobs == 0)
+				return;
+
+			// Spin on the counter, it's cheap compared to checking every deque
+			bool has_work = false;
+			for (uint32_t spin = 0; spin < SpinCount && !has_work; spin++)
+			{
+				has_work = QueuedJobs.load(std::memory_order_relaxed) > 0;
+				if (!has_work)
+					Pause();
+			}
+			if (has_work)
+				continue;
+
+			// Park. The epoch is read before checking for work one last time, so any dispatch after
+			// that check changes it and the wait returns right away
+			uint64_t seen_epoch = WakeEpoch.load();
+			if (QueuedJobs > 0)
+				continue;
+
+			std::unique_lock<std::mutex> lock(SleepLock);
+			Sleepers++;
+			SleepCV.wait(lock, [&]() { return WakeEpoch.load() != seen_epoch || !IsAlive; });
+			Sleepers--;
+
+			if (IsAlive)
+			{
+				const uint64_t latency = uint64_t(std::max<int64_t>(Now() - LastDispatch, 0));
+				Wakeups++;
+				WakeLatencyNs += latency;
+				uint64_t max_latency = MaxWakeLatencyNs;
+				while (latency > max_latency && !MaxWakeLatencyNs.compare_exchange_weak(max_latency, latency))
+					;
+			}
+		}
+	}
+
+	std::vector<std::thread> wPool;
+	std::vector<WorkerQueue> Queues;
+	std::vector<uint32_t> WorkerNodes;
+	std::vector<std::vector<uint32_t>> NodeWorkers;
+	std::vector<uint32_t> AllWorkers;
+	std::vector<std::vector<uint32_t>> Victims; // Steal order of every worker
+
+	uint32_t WorkersCount;
+	std::atomic<int64_t> QueuedJobs{ 0 }; // Dispatched jobs nobody has taken yet
+	std::atomic<uint64_t> WakeEpoch{ 0 };
+	std::atomic<uint32_t> Sleepers{ 0 };
+	std::mutex SleepLock;
+	std::condition_variable SleepCV;
+	std::atomic<bool> IsAlive;
+
+	int64_t LastDispatch = 0; // Under SleepLock, steady clock nanoseconds
+	std::atomic<uint64_t> Wakeups{ 0 };
+	std::atomic<uint64_t> WakeLatencyNs{ 0 };
+	std::atomic<uint64_t> MaxWakeLatencyNs{ 0 };
+};
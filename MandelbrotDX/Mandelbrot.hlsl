@@ -9,8 +9,8 @@ cbuffer CSConstantBuffer_Double : register(b0)
     double2 CoeffB;
 
     uint Iterations;
-    uint padding0;
-    uint padding1;
+    uint ColorOffset;
+    uint Smooth;
     uint padding2;
 };
 #else
@@ -20,14 +20,36 @@ cbuffer CSConstantBuffer : register(b0)
     float2 CoeffB;
 
     uint Iterations;
-    uint padding0;
-    uint padding1;
+    uint ColorOffset;
+    uint Smooth;
     uint padding2;
 };
 #endif
 
-#define SCREEN_RES_X 1024
-#define SCREEN_RES_Y 1024
+// Resolution independent, the dispatch covers the whole output and CoeffA/CoeffB map pixels to the plane
+
+// Interior checks, same as InCardioidOrBulb, PeriodCheckInterval and PeriodTolerance on the CPU
+#define PERIOD_CHECK_INTERVAL 32
+#if USE_DOUBLES
+#define PERIOD_TOLERANCE2 1.2621774483536189e-29
+#else
+#define PERIOD_TOLERANCE2 3.6379788e-12
+#endif
+
+bool InCardioidOrBulb(float2 c)
+{
+    float q = (c.x - 0.25) * (c.x - 0.25) + c.y * c.y;
+    return q * (q + (c.x - 0.25)) <= 0.25 * c.y * c.y || (c.x + 1) * (c.x + 1) + c.y * c.y <= 0.0625;
+}
+
+#if USE_DOUBLES
+// Same in double, a float c lands on the wrong side of the cardioid at zooms only double resolves
+bool InCardioidOrBulb(double2 c)
+{
+    double q = (c.x - 0.25) * (c.x - 0.25) + c.y * c.y;
+    return q * (q + (c.x - 0.25)) <= 0.25 * c.y * c.y || (c.x + 1) * (c.x + 1) + c.y * c.y <= 0.0625;
+}
+#endif
 
 #define GROUP_DIM 16
 groupshared float4 GroupBuffer[GROUP_DIM][GROUP_DIM];
@@ -54,11 +76,21 @@ void main(uint3 DTid : SV_DispatchThreadID, uint3 GTid : SV_GroupThreadID)
 
 #if USE_DOUBLES
     double2 z = 0;
+    double2 saved = 0;
 #else
     float2 z = 0;
+    float2 saved = 0;
 #endif
+    uint next_save = PERIOD_CHECK_INTERVAL;
+    uint save_window = PERIOD_CHECK_INTERVAL;
+
+    // Points on the cardioid or the period 2 bulb skip the loop and stay at -1 (on the set)
+    float max_iters = InCardioidOrBulb(c) ? 0 : Iterations;
+
+    // Smooth uses a bigger bailout so the fraction below is accurate, same as SmoothBailout2 on the CPU
+    float bailout2 = Smooth ? 256 : 4;
 
-    for (float i = 0; i < Iterations; i++)
+    for (float i = 0; i < max_iters; i++)
     {
         // iterate
 #if USE_DOUBLES
@@ -66,19 +98,36 @@ void main(uint3 DTid : SV_DispatchThreadID, uint3 GTid : SV_GroupThreadID)
 #else
         z = float2(z.x * z.x - z.y * z.y, 2 * z.x * z.y) + c;
 #endif
-        if (dot(z, z) > 4)
+        float r2 = float(dot(z, z));
+        if (r2 > bailout2)
         {
             iters = i;
+            if (Smooth)
+                iters += saturate(4 - log2(log2(r2)));
             break;
         }
-           
+
+        // Brent style cycle detection, coming back to the saved point means it's on the set
+        uint step = uint(i) + 1;
+        if (step % PERIOD_CHECK_INTERVAL == 0)
+        {
+            if (dot(z - saved, z - saved) < PERIOD_TOLERANCE2)
+                break;
+
+            if (step == next_save)
+            {
+                saved = z;
+                save_window *= 2;
+                next_save += save_window;
+            }
+        }
     }
 
-    // Write to groupshared
+    // Write to groupshared. Fractional counts land between two entries and the sampler blends them
     if (iters == -1)
         GroupBuffer[GTid.x][GTid.y] = float4(0, 0, 0, 1);
     else
-        GroupBuffer[GTid.x][GTid.y] = ColorTable.SampleLevel(PointSampler, float2(iters * (1.0 / 32.0f), 0.0f), 0.0f);
+        GroupBuffer[GTid.x][GTid.y] = ColorTable.SampleLevel(PointSampler, float2((iters + ColorOffset) * (1.0 / 32.0f), 0.0f), 0.0f);
 
     // Sync
     GroupMemoryBarrierWithGroupSync();
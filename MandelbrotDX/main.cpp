@@ -1,5 +1,5 @@
 #include "stdafx.h"
-#include "WorkerPool.h"
+#include "Renderer.h"
 using namespace std;
 
 // Structure for the cbuffer data
@@ -11,8 +11,8 @@ struct CSConstantBuffer
 	float CoeffB_Y;
 
 	uint32_t Iterations;
-	uint32_t padding0;
-	uint32_t padding1;
+	uint32_t ColorOffset;
+	uint32_t Smooth;
 	uint32_t padding2;
 };
 
@@ -24,8 +24,8 @@ struct CSConstantBuffer_Double
 	double CoeffB_Y;
 
 	uint32_t Iterations;
-	uint32_t padding0;
-	uint32_t padding1;
+	uint32_t ColorOffset;
+	uint32_t Smooth;
 	uint32_t padding2;
 };
 
@@ -46,227 +46,46 @@ double CurrentZoom = 1.0f;
 uint32_t CurrentInterations = 100;
 bool UseDouble = false;
 bool UseCPU = false;
+bool UseSubdivision = false;
+bool UseSmooth = false;
+uint32_t ColorOffset = 0; // Cycles the palette, the CPU recolors the last frame without iterating again
 
-const uint32_t ScreenResX = 1024;
-const uint32_t ScreenResY = 1024;
-const uint32_t CPUBlockSizeX = 64;
-const uint32_t CPUBlockSizeY = 64;
-const uint32_t BlocksCountX = FrameDX::ceil(ScreenResX, CPUBlockSizeX);
-const uint32_t BlocksCountY = FrameDX::ceil(ScreenResY, CPUBlockSizeY);
-const uint32_t TotalBlocksCount = BlocksCountX*BlocksCountY;
-const double InvResX = 1.0 / double(ScreenResX);
-const double InvResY = 1.0 / double(ScreenResY);
-
-// CPU pooled workers
-WorkerPool * Workers = nullptr;
-
-// Computes mandelbrot for the current parameters using multithreading and AVX for x2 SSAA
-void CPUMandelbrot(uint8_t * Buffer)
-{
-	alignas(32) const double mask_x_array[4] = { 0.0, 0.5, 0.0, 0.5 };
-	alignas(32) const double mask_y_array[4] = { 0.0, 0.0, 0.5, 0.5 };
-	const double coeff_a_x = (4.0*CurrentZoom) * InvResX;
-	const double coeff_a_y = (4.0*CurrentZoom) * InvResY;
-	const double coeff_b_x = -2.0*CurrentZoom + CurrentPosX;
-	const double coeff_b_y = -2.0*CurrentZoom + CurrentPosY;
-	const uint64_t bit_mask = 0x3FF0000000000000; // Used to convert the cmp value to 1.0
-	const double two = 2.0;
-	const double four = 4.0;
-
-	const float zero_f = 0.0f;
-	const float one_f = 1.0f;
-	const float two_f = 2.0f;
-	const float four_f = 4.0f;
-	const float six = 6.0f;
-	const float three = 3.0f;
-	const uint32_t hue_div = 31; // 32 colors, can use & 31 to take mod
-	const float hue_mul = 1.0f / 32.0f;
-	const uint32_t abs_bit_mask = 0x7FFFFFFF; // Used to mask out the sign bit
-	const float final_mul_f = 255.0f * 0.25f; // 255 max per pixel, averaging 4 pixels
-
-	__m256d mask_x_vec = _mm256_load_pd(mask_x_array);
-	__m256d mask_y_vec = _mm256_load_pd(mask_y_array);
-	__m256d inv_res_x_vec = _mm256_broadcast_sd(&InvResX);
-	__m256d inv_res_y_vec = _mm256_broadcast_sd(&InvResY);
-	__m256d coeff_a_x_vec = _mm256_broadcast_sd(&coeff_a_x);
-	__m256d coeff_a_y_vec = _mm256_broadcast_sd(&coeff_a_y);
-	__m256d coeff_b_x_vec = _mm256_broadcast_sd(&coeff_b_x);
-	__m256d coeff_b_y_vec = _mm256_broadcast_sd(&coeff_b_y);
-	__m256d bit_mask_vec = _mm256_broadcast_sd((double*)&bit_mask);
-	__m256d two_vec = _mm256_broadcast_sd(&two);	
-	__m256d four_vec = _mm256_broadcast_sd(&four);
-
-	__m128 zero_vec_f = _mm_broadcast_ss(&zero_f);
-	__m128 one_vec_f = _mm_broadcast_ss(&one_f);
-	__m128 two_vec_f = _mm_broadcast_ss(&two_f);
-	__m128 three_vec_f = _mm_broadcast_ss(&three);
-	__m128 four_vec_f = _mm_broadcast_ss(&four_f);
-	__m128 six_vec_f = _mm_broadcast_ss(&six);
-	__m128i hue_div_vec = _mm_set1_epi32(hue_div); // sadly have to use this, no nice broadcast function for ints
-	__m128 hue_mul_vec = _mm_broadcast_ss(&hue_mul);
-	__m128 abs_bit_mask_vec = _mm_broadcast_ss((float*)&abs_bit_mask);
-	__m128i num_iters_vec = _mm_set1_epi32(CurrentInterations);
-	__m128 final_mul_vec_f = _mm_broadcast_ss(&final_mul_f);
-
-	Workers->JobSize = TotalBlocksCount;
-	Workers->WorkerFunction = [&](int JobIDX, int WorkerIDX)
-	{
-		int x = uint32_t(JobIDX) % BlocksCountX;
-		int y = uint32_t(JobIDX) / BlocksCountX;
+// Window size, can be overridden from the command line as "MandelbrotDX.exe width height"
+uint32_t ScreenResX = 1024;
+uint32_t ScreenResY = 1024;
 
-		x *= CPUBlockSizeX;
-		y *= CPUBlockSizeY;
+// CPU renderer, owns the pooled workers
+Renderer * CPURenderer = nullptr;
 
-		for (int s = 0; s < CPUBlockSizeY; s++)
-		{
-			for (int r = 0; r < CPUBlockSizeX; r++)
-			{
-				int pX = x + r;
-				int pY = y + s;
+// Profiling of the CPU frames, only the console thread touches the stats
+bool Tracing = false;
+FrameStats LastFrameStats;
+vector<FrameStats> TracedFrames;
 
-				if (pX < ScreenResX && pY < ScreenResY)
-				{
-					double px_d = pX;
-					double py_d = pY;
-
-					// Load the pixel positions
-					__m256d c_x = _mm256_broadcast_sd(&px_d);
-					__m256d c_y = _mm256_broadcast_sd(&py_d);
-
-					// Add the subpixel offsets for SSAA
-					c_x = _mm256_add_pd(c_x, mask_x_vec);
-					c_y = _mm256_add_pd(c_y, mask_y_vec);
-
-					// Normalize pixel pos
-					c_x = _mm256_mul_pd(c_x, coeff_a_x_vec);
-					c_y = _mm256_mul_pd(c_y, coeff_a_y_vec);
-					c_x = _mm256_add_pd(c_x, coeff_b_x_vec);
-					c_y = _mm256_add_pd(c_y, coeff_b_y_vec);
-
-					// Do the iteration
-					__m256d z_x = _mm256_setzero_pd();
-					__m256d z_y = _mm256_setzero_pd();
-					__m256d iters = _mm256_setzero_pd();
-
-					for (float i = 0; i < CurrentInterations; i++)
-					{
-						// Square
-						__m256d x2 = _mm256_mul_pd(z_x, z_x);
-						__m256d y2 = _mm256_mul_pd(z_y, z_y);
-						
-						// Compute y coordinate first
-						z_y = _mm256_mul_pd(z_x, z_y);
-						z_y = _mm256_mul_pd(z_y, two_vec);
-
-						// Then compute z coordinate
-						z_x = _mm256_sub_pd(x2, y2);
-
-						// Add c
-						z_x = _mm256_add_pd(z_x,c_x);
-						z_y = _mm256_add_pd(z_y,c_y);
-
-						// Compute length
-						__m256d x2_r = _mm256_mul_pd(z_x, z_x);
-						__m256d y2_r = _mm256_mul_pd(z_y, z_y);
-						__m256d r2 = _mm256_add_pd(x2_r, y2_r);
-
-						// Check if length <= 4
-						r2 = _mm256_cmp_pd(r2, four_vec, _CMP_LE_OQ);
-
-						// If all are 0, that means they are all r^2 > 4, so end
-						if (_mm256_testz_pd(r2,r2))
-							break;
-
-						// Now convert the cmp mask to a 1.0 or 0.0
-						r2 = _mm256_and_pd(r2, bit_mask_vec);
-
-						// Finally, increase iterations count
-						// By using the mask and not just + 1, you only increase the values that are still bounded
-						iters = _mm256_add_pd(iters, r2);
-					}
-
-					// Now compute rgb color from that
-					// Using 32 hues
-
-					// Convert to integer for the mod
-					__m128i iters_i = _mm256_cvtpd_epi32(iters);
-
-					// Pixels that are on the set go black
-					// No compare != , but have andnot so no problem here
-					__m128i in_set_mask = _mm_cmpeq_epi32(iters_i, num_iters_vec);
-
-					// Mod by 32 by doing an & 31
-					iters_i = _mm_and_si128(iters_i, hue_div_vec);
-
-					// Convert back to float
-					__m128 iters_f = _mm_cvtepi32_ps(iters_i);
-
-					// Normalize and multiply by 6
-					iters_f = _mm_mul_ps(iters_f, hue_mul_vec);
-					iters_f = _mm_mul_ps(iters_f, six_vec_f);
-
-					// Now start computing each channel
-					__m128 r = _mm_sub_ps(iters_f, three_vec_f);
-					__m128 g = _mm_sub_ps(iters_f, two_vec_f);
-					__m128 b = _mm_sub_ps(iters_f, four_vec_f);
-
-					// mask sign bit because there is no abs inst
-					r = _mm_and_ps(r, abs_bit_mask_vec);
-					g = _mm_and_ps(g, abs_bit_mask_vec);
-					b = _mm_and_ps(b, abs_bit_mask_vec);
-
-					r = _mm_sub_ps(r, one_vec_f);
-					g = _mm_sub_ps(two_vec_f, g);
-					b = _mm_sub_ps(two_vec_f, b);
-
-					// Clamp each value to [0,1]
-					r = _mm_min_ps(_mm_max_ps(r, zero_vec_f), one_vec_f);
-					g = _mm_min_ps(_mm_max_ps(g, zero_vec_f), one_vec_f);
-					b = _mm_min_ps(_mm_max_ps(b, zero_vec_f), one_vec_f);
-
-					// Mask out the elements that are on the set
-					// Using andnot because the comparison is == (don't have !=)
-					// The cast is only for the compiler, it doesn't emit any instruction
-					r = _mm_castsi128_ps(_mm_andnot_si128(in_set_mask, _mm_castps_si128(r)));
-					g = _mm_castsi128_ps(_mm_andnot_si128(in_set_mask, _mm_castps_si128(g)));
-					b = _mm_castsi128_ps(_mm_andnot_si128(in_set_mask, _mm_castps_si128(b)));
-
-					// Now average across sub pixels
-					//		First multiply by 255.0f * 0.25f = 64.0f
-					r = _mm_mul_ps(r, final_mul_vec_f);
-					g = _mm_mul_ps(g, final_mul_vec_f);
-					b = _mm_mul_ps(b, final_mul_vec_f);
-
-					//		Then reduce
-					r = _mm_hadd_ps(r, r);
-					g = _mm_hadd_ps(g, g);
-					b = _mm_hadd_ps(b, b);
-
-					r = _mm_hadd_ps(r, r);
-					g = _mm_hadd_ps(g, g);
-					b = _mm_hadd_ps(b, b);
-
-					// Convert to int
-					__m128i r_i = _mm_cvtps_epi32(r);
-					__m128i g_i = _mm_cvtps_epi32(g);
-					__m128i b_i = _mm_cvtps_epi32(b);
-
-					// Finally extract values and store
-					// Values are [0,255] anyway, so 16 bits is more than enough
-					Buffer[4 * (pX + pY*ScreenResX)    ] = _mm_extract_epi16(r_i, 0);
-					Buffer[4 * (pX + pY*ScreenResX) + 1] = _mm_extract_epi16(g_i, 0);
-					Buffer[4 * (pX + pY*ScreenResX) + 2] = _mm_extract_epi16(b_i, 0);
-					Buffer[4 * (pX + pY*ScreenResX) + 3] = 255;
-				}
-			}
-		}
-	};
-	
-	Workers->Dispatch();
+// Same view for the CPU and the GPU
+RenderRequest CurrentRequest()
+{
+	RenderRequest request;
+	request.CenterX = CurrentPosX;
+	request.CenterY = CurrentPosY;
+	request.Zoom = CurrentZoom;
+	request.Iterations = CurrentInterations;
+	request.Width = ScreenResX;
+	request.Height = ScreenResY;
+	request.Mode = UseSubdivision ? RenderMode::Subdivide : RenderMode::Direct;
+	request.Smooth = UseSmooth;
+	return request;
 }
 
-int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
+int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR CmdLine, int)
 {
+	uint32_t res_x, res_y;
+	if (CmdLine && sscanf(CmdLine, "%u %u", &res_x, &res_y) == 2 && res_x > 0 && res_y > 0)
+	{
+		ScreenResX = res_x;
+		ScreenResY = res_y;
+	}
+
 	AllocConsole();
 	freopen("CONIN$", "r", stdin);
 	freopen("CONOUT$", "w", stdout);
@@ -283,8 +102,12 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 			wcout << L"	Arrows for movement" << endl;
 			wcout << L"	A,D = Less/More iterations" << endl;
 			wcout << L"	Shift + any of the above makes them faster" << endl;
-			wcout << L"	Press T to toggle double precision (CPU always runs at double precision)" << endl;
+			wcout << L"	Press T to toggle double precision on the GPU (the CPU picks it from the zoom)" << endl;
 			wcout << L"	Press R to switch between CPU and GPU" << endl;
+			wcout << L"	Press M to toggle subdivision (Mariani-Silver) on the CPU" << endl;
+			wcout << L"	Press C to cycle the colors" << endl;
+			wcout << L"	Press S to toggle smooth coloring" << endl;
+			wcout << L"	Press P to start/stop a Chrome trace of the CPU frames (written to trace.json)" << endl;
 			wcout << L"-------------------------------" << endl;
 			wcout << L"Zoom : " << CurrentZoom << endl;
 			wcout << L"X : " << CurrentPosX << endl;
@@ -292,10 +115,42 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 			wcout << L"n : " << CurrentInterations << endl;
 
 			if (UseCPU)
-				wcout << L"CPU, Using Double Precision" << endl;
+			{
+				bool single = CPURenderer && CPURenderer->IsSinglePrecision(CurrentRequest());
+				wcout << (single ? L"CPU, Using Single Precision (" : L"CPU, Using Double Precision (") << (CPURenderer ? ISAName(CPURenderer->GetISA()) : "") << L")" << (UseSubdivision ? L", Subdivision" : L"") << endl;
+			}
 			else
 				wcout << ((UseDouble) ? L"GPU, Using Double Precision" : L"GPU, Using Single Precision") << endl;
 
+			// Last CPU frame done since the last print, and the trace if one is going
+			if (CPURenderer)
+			{
+				vector<FrameStats> frames = CPURenderer->TakeFrameStats();
+				if (!frames.empty())
+					LastFrameStats = frames.back();
+				if (Tracing)
+					TracedFrames.insert(TracedFrames.end(), frames.begin(), frames.end());
+				if (!Tracing && !TracedFrames.empty())
+				{
+					WriteChromeTrace("trace.json", TracedFrames);
+					TracedFrames.clear();
+				}
+				CPURenderer->SetProfiling(true, Tracing);
+			}
+			if (UseCPU && !LastFrameStats.Workers.empty())
+			{
+				double min_busy = LastFrameStats.Workers[0].BusyMs, max_busy = min_busy;
+				for (const WorkerFrameStats& worker : LastFrameStats.Workers)
+				{
+					min_busy = min(min_busy, worker.BusyMs);
+					max_busy = max(max_busy, worker.BusyMs);
+				}
+				WorkerPool::WakeStats wake = CPURenderer->GetWakeStats();
+				wcout << L"Last frame (" << LastFrameStats.Kind << L") : " << LastFrameStats.WallMs << L"ms, first job after " << LastFrameStats.FirstJobMs << L"ms" << endl;
+				wcout << L"	workers busy " << min_busy << L" to " << max_busy << L"ms, " << LastFrameStats.Escaped << L" samples escaped, " << LastFrameStats.InSet << L" on the set" << endl;
+				wcout << L"	wake ups take " << (wake.Wakeups ? wake.TotalLatencyUs / wake.Wakeups : 0.0) << L"us on average" << (Tracing ? L", tracing (P to stop)" : L"") << endl;
+			}
+
 			FrameDX::Log.PrintAll(wcout);
 		}, 150ms);
 	});
@@ -326,6 +181,14 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 			UseDouble = !UseDouble;
 		if (key == 'R' && action == FrameDX::KeyAction::Up)
 			UseCPU = !UseCPU;
+		if (key == 'M' && action == FrameDX::KeyAction::Up)
+			UseSubdivision = !UseSubdivision;
+		if (key == 'C' && action == FrameDX::KeyAction::Up)
+			ColorOffset++;
+		if (key == 'S' && action == FrameDX::KeyAction::Up)
+			UseSmooth = !UseSmooth;
+		if (key == 'P' && action == FrameDX::KeyAction::Up)
+			Tracing = !Tracing;
 	};
 
 	// Create device
@@ -337,8 +200,8 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 	desc.SwapChainDescription.BackbufferAccessFlags |= DXGI_USAGE_SHADER_INPUT;
 	LogCheck(dev.Start(desc), FrameDX::LogCategory::CriticalError);
 
-	// Create workers
-	Workers = new WorkerPool(thread::hardware_concurrency());
+	// Create CPU renderer and its workers
+	CPURenderer = new Renderer(thread::hardware_concurrency());
 
 	// Create texture for the cpu side
 	FrameDX::Texture2D cpu_texture;
@@ -351,6 +214,16 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 	tex_desc.AccessFlags = D3D11_CPU_ACCESS_WRITE;
 
 	cpu_texture.CreateFromDescription(&dev, tex_desc);
+
+	// The CPU renders one frame ahead, into one of these while the other one is being presented
+	vector<uint8_t> cpu_frames[2];
+	for (auto& frame : cpu_frames)
+		frame.resize(size_t(tex_desc.SizeX) * tex_desc.SizeY * 4);
+	int cpu_frame_idx = 0;
+	future<void> cpu_pending;
+
+	// Iteration counts of the last CPU frame, pans and still frames build on them
+	FrameHistory cpu_history;
 	
 	// Create color table
 	// 32 colors
@@ -378,7 +251,7 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 	FrameDX::ComputeShader mandelbrot_cs;
 	mandelbrot_cs.CreateFromFile(&dev, L"Mandelbrot.hlsl", "main");
 	FrameDX::ComputeShader mandelbrot_cs_double;
-	mandelbrot_cs_double.CreateFromFile(&dev, L"Mandelbrot.hlsl", "main", false, { {"USE_DOUBLES","1"}, {"SCREEN_RES_X", to_string(ScreenResX).c_str() }, { "SCREEN_RES_Y", to_string(ScreenResY).c_str() } });
+	mandelbrot_cs_double.CreateFromFile(&dev, L"Mandelbrot.hlsl", "main", false, { {"USE_DOUBLES","1"} });
 
 	// Create constant buffer for the cs
 	ID3D11Buffer* cb_buffer;
@@ -432,27 +305,79 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 	{
 		if (UseCPU)
 		{
-			// Compute mandelbrot writing directly to the mapped buffer
-			D3D11_MAPPED_SUBRESOURCE mappedResource;
-			ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
-			dev.GetImmediateContext()->Map(cpu_texture.GetResource(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+			RenderRequest request = CurrentRequest();
+			request.Width = cpu_texture.Desc.SizeX;
+			request.Height = cpu_texture.Desc.SizeY;
 
-				CPUMandelbrot((uint8_t*)mappedResource.pData);
+			// Frames already in flight keep the colors they started with
+			bool recolor = CPURenderer->GetPalette().Offset != ColorOffset;
+			if (recolor)
+			{
+				Palette colors = CPURenderer->GetPalette();
+				colors.Offset = ColorOffset;
+				CPURenderer->SetPalette(colors);
+			}
 
-			dev.GetImmediateContext()->Unmap(cpu_texture.GetResource(), 0);
+			// Subdivision has no progressive version, it renders whole frames
+			// A still view stops queueing frames once it's at full resolution, the texture already has it
+			// unless the colors changed, then the counts it has are colored again
+			auto queue_frame = [&](uint8_t * Buffer)
+			{
+				if (UseSubdivision)
+					cpu_pending = CPURenderer->RenderAsync(request, Buffer);
+				else if (!CPURenderer->IsProgressiveComplete(request, cpu_history))
+					cpu_pending = CPURenderer->RenderProgressiveAsync(request, cpu_history, Buffer);
+				else if (recolor)
+					cpu_pending = CPURenderer->ColorizeAsync(request, cpu_history.Iters.data(), Buffer);
+				recolor = false;
+			};
+
+			// Nothing in flight, either the first frame or the view was done and just changed
+			if (!cpu_pending.valid())
+				queue_frame(cpu_frames[cpu_frame_idx].data());
+
+			if (cpu_pending.valid())
+			{
+				// Wait for the frame that was queued last time, then queue the next one on the other buffer
+				// so the workers keep going while this one is uploaded and presented
+				cpu_pending.get();
+				const uint8_t * ready = cpu_frames[cpu_frame_idx].data();
+				cpu_frame_idx ^= 1;
+				queue_frame(cpu_frames[cpu_frame_idx].data());
+
+				D3D11_MAPPED_SUBRESOURCE mappedResource;
+				ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
+				dev.GetImmediateContext()->Map(cpu_texture.GetResource(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+
+					// Rows of the mapped texture can be padded
+					const size_t row_size = size_t(request.Width) * 4;
+					for (uint32_t y = 0; y < request.Height; y++)
+						memcpy((uint8_t*)mappedResource.pData + y*mappedResource.RowPitch, ready + y*row_size, row_size);
+
+				dev.GetImmediateContext()->Unmap(cpu_texture.GetResource(), 0);
+			}
 
 			// Copy the texture to the backbuffer
 			dev.GetBackbuffer()->CopyFrom(&cpu_texture);
 		}
 		else
 		{
+			// Don't leave a CPU frame running behind the GPU
+			if (cpu_pending.valid())
+				cpu_pending.get();
+
 			// Update cbuffer
 			// TODO : move this to a wrapper function to make it cleaner
 
-			double CoeffA_X = (4.0*CurrentZoom) * InvResX;
-			double CoeffA_Y = (4.0*CurrentZoom) * InvResY;
-			double CoeffB_X = -2.0*CurrentZoom + CurrentPosX;
-			double CoeffB_Y = -2.0*CurrentZoom + CurrentPosY;
+			RenderRequest request = CurrentRequest();
+			request.Width = dev.GetBackbuffer()->Desc.SizeX;
+			request.Height = dev.GetBackbuffer()->Desc.SizeY;
+			FrameParams frame = MakeFrameParams(request);
+
+			double CoeffA_X = frame.CoeffA_X;
+			double CoeffA_Y = frame.CoeffA_Y;
+			double CoeffB_X = frame.CoeffB_X;
+			double CoeffB_Y = frame.CoeffB_Y;
 
 			if (UseDouble)
 			{
@@ -466,6 +391,8 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 				new_data.CoeffB_X = CoeffB_X;
 				new_data.CoeffB_Y = CoeffB_Y;
 				new_data.Iterations = CurrentInterations;
+				new_data.ColorOffset = ColorOffset;
+				new_data.Smooth = UseSmooth;
 
 				memcpy(mappedResource.pData, &new_data, sizeof(CSConstantBuffer_Double));
 				dev.GetImmediateContext()->Unmap(cb_buffer_double, 0);
@@ -482,6 +409,8 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 				new_data.CoeffB_X = CoeffB_X;
 				new_data.CoeffB_Y = CoeffB_Y;
 				new_data.Iterations = CurrentInterations;
+				new_data.ColorOffset = ColorOffset;
+				new_data.Smooth = UseSmooth;
 
 				memcpy(mappedResource.pData, &new_data, sizeof(CSConstantBuffer));
 				dev.GetImmediateContext()->Unmap(cb_buffer, 0);
@@ -500,7 +429,7 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 	});
 
 	// Not releasing any resources here... Should implement that eventually
-	delete Workers;
+	delete CPURenderer;
 
 	return 0;
 }
\ No newline at end of file
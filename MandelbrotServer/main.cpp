@@ -0,0 +1,531 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "Renderer.h"
+#include "RenderService.h"
+#include "ImageWriter.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET Socket;
+static const Socket NoSocket = INVALID_SOCKET;
+static void CloseSocket(Socket S) { closesocket(S); }
+static int PollSocket(pollfd * Fds, int Timeout) { return WSAPoll(Fds, 1, Timeout); }
+static const int SendFlags = 0;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int Socket;
+static const Socket NoSocket = -1;
+static void CloseSocket(Socket S) { close(S); }
+static int PollSocket(pollfd * Fds, int Timeout) { return poll(Fds, 1, Timeout); }
+static const int SendFlags = MSG_NOSIGNAL;
+#endif
+using namespace std;
+
+// Tile and frame server on top of RenderService, one thread per connection and one response per connection
+//   GET /tile/Z/X/Y.png  256x256 tile X, Y of level Z. Level 0 is one tile over [-2,2] on both axes, every level halves it
+//   GET /frame.png       x, y, zoom, w and h like --center, --zoom and --size of MandelbrotCLI
+//   GET /cancel          cancels every request of client
+//   GET /stats           counters of the service, as JSON
+// Both renders take iterations (up to --max-iterations), smooth=1, fractal, julia=X,Y, aa, priority (interactive or batch, interactive by default)
+// and client. A frame from a client cancels the ones it was still waiting on, and closing the connection cancels too
+
+static void PrintUsage()
+{
+	cout << "Usage : MandelbrotServer [options]" << endl;
+	cout << "	--port N           Port to listen on (default 8080)" << endl;
+	cout << "	--bind ADDR        Address to listen on (default 127.0.0.1)" << endl;
+	cout << "	--connections N    Connections served at once, the others get a 503 (default 256)" << endl;
+	cout << "	--tile-size N      Size of the /tile tiles (default 256)" << endl;
+	cout << "	--max-iterations N Most iterations a render can ask for, more gets a 400 (default 65536)" << endl;
+	cout << "	--threads N        Worker count (default hardware concurrency, or the core count with --pin cores)" << endl;
+	cout << "	--pin P            none, cores or smt, see MandelbrotCLI" << endl;
+	cout << "	--isa NAME         Force a kernel : avx, avx2 or avx512 (default widest supported)" << endl;
+	cout << "	--palette N        Number of hues the colors cycle through, a power of 2 (default 32)" << endl;
+	cout << "	--cache DIR        Keep the iteration counts of rendered tiles in DIR and reuse them on later runs" << endl;
+	cout << "	--cache-size MB    Memory for cached tiles, compressed (default 256)" << endl;
+}
+
+// Biggest frame /frame renders, both ways
+static const uint32_t MaxFrameSize = 8192;
+
+// Time a client gets to send the whole request head, the connection is dropped after it
+static const chrono::milliseconds RequestTimeout(5000);
+
+// How often a connection waiting on its image checks whether the client went away
+static const chrono::milliseconds PeerCheckInterval(20);
+
+struct ServerConfig
+{
+	uint32_t TileSize = 256;
+	uint32_t MaxConnections = 256;
+	uint32_t MaxIterations = 65536;
+};
+
+struct HttpRequest
+{
+	string Method;
+	string Path;
+	map<string, string> Query;
+
+	string Get(const string& Name, const string& Default = "") const
+	{
+		auto found = Query.find(Name);
+		return found == Query.end() ? Default : found->second;
+	}
+};
+
+static string UrlDecode(const string& Text)
+{
+	string decoded;
+	for (size_t i = 0; i < Text.size(); i++)
+	{
+		if (Text[i] == '+')
+			decoded += ' ';
+		else if (Text[i] == '%' && i + 2 < Text.size())
+		{
+			decoded += char(strtoul(Text.substr(i + 1, 2).c_str(), nullptr, 16));
+			i += 2;
+		}
+		else
+			decoded += Text[i];
+	}
+	return decoded;
+}
+
+// Only the request line matters, headers are read and ignored
+// False if the head doesn't come within RequestTimeout, so a slow client can't hold a connection slot forever
+static bool ReadRequest(Socket Client, HttpRequest& Request)
+{
+	const auto deadline = chrono::steady_clock::now() + RequestTimeout;
+	string head;
+	char chunk[1024];
+	while (head.find("\r\n\r\n") == string::npos && head.size() < 8192)
+	{
+		const auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+		pollfd fd = {};
+		fd.fd = Client;
+		fd.events = POLLIN;
+		if (left <= 0 || PollSocket(&fd, int(left)) <= 0)
+			return false;
+
+		const int got = int(recv(Client, chunk, sizeof(chunk), 0));
+		if (got <= 0)
+			return false;
+		head.append(chunk, size_t(got));
+	}
+
+	istringstream line(head.substr(0, head.find("\r\n")));
+	string target;
+	if (!(line >> Request.Method >> target))
+		return false;
+
+	const size_t query = target.find('?');
+	Request.Path = UrlDecode(target.substr(0, query));
+	if (query == string::npos)
+		return true;
+
+	istringstream pairs(target.substr(query + 1));
+	string pair;
+	while (getline(pairs, pair, '&'))
+	{
+		const size_t equals = pair.find('=');
+		Request.Query[UrlDecode(pair.substr(0, equals))] = equals == string::npos ? "" : UrlDecode(pair.substr(equals + 1));
+	}
+	return true;
+}
+
+static void SendAll(Socket Client, const char * Data, size_t Size)
+{
+	while (Size > 0)
+	{
+		const int sent = int(send(Client, Data, int(min<size_t>(Size, 1 << 20)), SendFlags));
+		if (sent <= 0)
+			return;
+		Data += sent;
+		Size -= size_t(sent);
+	}
+}
+
+static void SendResponse(Socket Client, const char * Status, const char * Type, const string& Body)
+{
+	ostringstream head;
+	head << "HTTP/1.1 " << Status << "\r\nContent-Type: " << Type << "\r\nContent-Length: " << Body.size()
+		 << "\r\nAccess-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n";
+	const string text = head.str();
+	SendAll(Client, text.data(), text.size());
+	SendAll(Client, Body.data(), Body.size());
+}
+
+// True once the other side closed the connection (or it broke), the request was read so anything readable is the end
+static bool PeerClosed(Socket Client)
+{
+	pollfd fd = {};
+	fd.fd = Client;
+	fd.events = POLLIN;
+	if (PollSocket(&fd, 0) <= 0)
+		return false;
+	if (fd.revents & (POLLERR | POLLHUP))
+		return true;
+	char byte;
+	return recv(Client, &byte, 1, MSG_PEEK) <= 0;
+}
+
+// Parameters both /tile and /frame take, false with Error set if one of them is wrong
+static bool ParseRenderParams(const HttpRequest& Http, const ServerConfig& Config, RenderRequest& Request, string& Error)
+{
+	// Checked before narrowing, a huge count mustn't wrap around to a small one
+	const unsigned long iterations = strtoul(Http.Get("iterations", "256").c_str(), nullptr, 10);
+	Request.Iterations = uint32_t(min<uint64_t>(iterations, uint64_t(Config.MaxIterations) + 1));
+	Request.Smooth = Http.Get("smooth") == "1";
+	Request.AdaptiveAA = strtoul(Http.Get("aa", "0").c_str(), nullptr, 10);
+
+	const string fractal = Http.Get("fractal", "mandelbrot");
+	bool found = false;
+	for (Fractal formula : { Fractal::Mandelbrot, Fractal::BurningShip, Fractal::Tricorn, Fractal::Multibrot3, Fractal::Multibrot4 })
+	{
+		if (fractal == FractalName(formula))
+		{
+			Request.Formula = formula;
+			found = true;
+		}
+	}
+	if (!found)
+	{
+		Error = "unknown fractal " + fractal;
+		return false;
+	}
+
+	const string julia = Http.Get("julia");
+	if (!julia.empty())
+	{
+		Request.Julia = true;
+		if (sscanf(julia.c_str(), "%lf,%lf", &Request.JuliaX, &Request.JuliaY) != 2)
+		{
+			Error = "julia takes X,Y";
+			return false;
+		}
+	}
+
+	const string priority = Http.Get("priority", "interactive");
+	if (priority == "interactive")
+		Request.Priority = JobPriority::Interactive;
+	else if (priority == "batch")
+		Request.Priority = JobPriority::Batch;
+	else
+	{
+		Error = "unknown priority " + priority;
+		return false;
+	}
+
+	if (Request.Iterations == 0)
+	{
+		Error = "iterations has to be positive";
+		return false;
+	}
+	if (Request.Iterations > Config.MaxIterations)
+	{
+		Error = "iterations can't be over " + to_string(Config.MaxIterations);
+		return false;
+	}
+	return true;
+}
+
+// Tile X, Y of level Z is the region of a TileSize << Z frame centered on the origin at zoom 1
+static bool ParseTile(const HttpRequest& Http, const ServerConfig& Config, RenderRequest& Request, string& Error)
+{
+	uint32_t level, x, y;
+	char extension[8] = {};
+	if (sscanf(Http.Path.c_str(), "/tile/%u/%u/%u.%7s", &level, &x, &y, extension) != 4 || strcmp(extension, "png"))
+	{
+		Error = "tiles are /tile/Z/X/Y.png";
+		return false;
+	}
+	if ((uint64_t(Config.TileSize) << min(level, 32u)) > UINT32_MAX || x >= (1u << level) || y >= (1u << level))
+	{
+		Error = "no such tile";
+		return false;
+	}
+
+	Request.Width = Config.TileSize << level;
+	Request.Height = Request.Width;
+	Request.RegionX = x * Config.TileSize;
+	Request.RegionY = y * Config.TileSize;
+	Request.RegionWidth = Config.TileSize;
+	Request.RegionHeight = Config.TileSize;
+	return true;
+}
+
+static bool ParseFrame(const HttpRequest& Http, RenderRequest& Request, string& Error)
+{
+	Request.PreciseCenterX = Http.Get("x", "0");
+	Request.PreciseCenterY = Http.Get("y", "0");
+	Request.CenterX = atof(Request.PreciseCenterX.c_str());
+	Request.CenterY = atof(Request.PreciseCenterY.c_str());
+	Request.Zoom = atof(Http.Get("zoom", "1").c_str());
+	Request.Width = strtoul(Http.Get("w", "1024").c_str(), nullptr, 10);
+	Request.Height = strtoul(Http.Get("h", "1024").c_str(), nullptr, 10);
+	if (Request.Width == 0 || Request.Height == 0 || Request.Width > MaxFrameSize || Request.Height > MaxFrameSize || !(Request.Zoom > 0.0))
+	{
+		Error = "bad frame size or zoom";
+		return false;
+	}
+	return true;
+}
+
+static string StatsJson(const RenderService& Service, uint32_t Connections)
+{
+	const ServiceStats stats = Service.GetStats();
+	ostringstream json;
+	json << "{\"submitted\":" << stats.Submitted << ",\"coalesced\":" << stats.Coalesced << ",\"rendered\":" << stats.Rendered
+		 << ",\"cancelled\":" << stats.Cancelled << ",\"in_flight\":" << stats.InFlight << ",\"connections\":" << Connections << "}\n";
+	return json.str();
+}
+
+static mutex LogLock;
+
+static void Serve(Socket Client, RenderService& Service, const ServerConfig& Config, atomic<uint32_t>& Connections)
+{
+	const auto start = chrono::steady_clock::now();
+	HttpRequest http;
+	const char * status = "400 Bad Request";
+	if (!ReadRequest(Client, http))
+	{
+		CloseSocket(Client);
+		Connections--;
+		return;
+	}
+
+	RenderRequest request;
+	string error;
+	const string client = http.Get("client");
+	if (http.Method != "GET")
+	{
+		SendResponse(Client, status = "405 Method Not Allowed", "text/plain", "GET only\n");
+	}
+	else if (http.Path == "/stats")
+	{
+		SendResponse(Client, status = "200 OK", "application/json", StatsJson(Service, Connections));
+	}
+	else if (http.Path == "/cancel")
+	{
+		Service.CancelClient(client);
+		SendResponse(Client, status = "200 OK", "text/plain", "cancelled\n");
+	}
+	else if (http.Path.compare(0, 6, "/tile/") && http.Path != "/frame.png")
+	{
+		SendResponse(Client, status = "404 Not Found", "text/plain", "not found\n");
+	}
+	else if (!ParseRenderParams(http, Config, request, error) || !(http.Path == "/frame.png" ? ParseFrame(http, request, error) : ParseTile(http, Config, request, error)))
+	{
+		SendResponse(Client, status, "text/plain", error + "\n");
+	}
+	else
+	{
+		// A new frame means the client moved on from the last one, tiles of a view all come at once so they don't
+		if (http.Path == "/frame.png" && !client.empty())
+			Service.CancelClient(client);
+
+		auto ticket = Service.Submit(request, client);
+		bool failed = false;
+		try
+		{
+			while (!ticket->Wait(PeerCheckInterval))
+			{
+				if (PeerClosed(Client))
+					ticket->Cancel();
+			}
+		}
+		catch (const exception& e)
+		{
+			error = e.what();
+			failed = true;
+		}
+
+		auto pixels = ticket->GetPixels();
+		const FrameParams frame = MakeFrameParams(request);
+		vector<uint8_t> image;
+		if (failed)
+		{
+			SendResponse(Client, status = "500 Internal Server Error", "text/plain", error + "\n");
+		}
+		else if (!pixels)
+		{
+			// Closed connections don't read it, superseded frames do
+			SendResponse(Client, status = "409 Conflict", "text/plain", "cancelled\n");
+		}
+		else if (EncodePNG(pixels->data(), frame.Width, frame.Height, image))
+		{
+			SendResponse(Client, status = "200 OK", "image/png", string(image.begin(), image.end()));
+		}
+		else
+		{
+			EncodePPM(pixels->data(), frame.Width, frame.Height, image);
+			SendResponse(Client, status = "200 OK", "image/x-portable-pixmap", string(image.begin(), image.end()));
+		}
+	}
+
+	CloseSocket(Client);
+	Connections--;
+
+	const double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	lock_guard<mutex> lock(LogLock);
+	cout << http.Method << " " << http.Path << (client.empty() ? "" : " (" + client + ")") << " : " << status << " in " << ms << "ms" << endl;
+}
+
+int main(int argc, char ** argv)
+{
+	ServerConfig config;
+	uint16_t port = 8080;
+	string bind_address = "127.0.0.1";
+	uint32_t threads = 0; // 0 until --threads, then the default for the pinning
+	WorkerPinning pinning = WorkerPinning::None;
+	string isa_name;
+	Palette palette = HuePalette();
+	string cache_dir;
+	size_t cache_mb = 256;
+
+	for (int i = 1; i < argc; i++)
+	{
+		auto has_args = [&](int Count)
+		{
+			if (i + Count >= argc)
+			{
+				cerr << "Missing value for " << argv[i] << endl;
+				exit(1);
+			}
+			return true;
+		};
+
+		if (!strcmp(argv[i], "--port") && has_args(1))
+			port = uint16_t(strtoul(argv[++i], nullptr, 10));
+		else if (!strcmp(argv[i], "--bind") && has_args(1))
+			bind_address = argv[++i];
+		else if (!strcmp(argv[i], "--connections") && has_args(1))
+			config.MaxConnections = max(strtoul(argv[++i], nullptr, 10), 1ul);
+		else if (!strcmp(argv[i], "--tile-size") && has_args(1))
+			config.TileSize = min(max(strtoul(argv[++i], nullptr, 10), 16ul), 4096ul);
+		else if (!strcmp(argv[i], "--max-iterations") && has_args(1))
+			config.MaxIterations = max(strtoul(argv[++i], nullptr, 10), 1ul);
+		else if (!strcmp(argv[i], "--threads") && has_args(1))
+			threads = max(strtoul(argv[++i], nullptr, 10), 1ul);
+		else if (!strcmp(argv[i], "--pin") && has_args(1))
+		{
+			string pin = argv[++i];
+			if (pin == "none")
+				pinning = WorkerPinning::None;
+			else if (pin == "cores")
+				pinning = WorkerPinning::Cores;
+			else if (pin == "smt")
+				pinning = WorkerPinning::CoresThenSMT;
+			else
+			{
+				cerr << "Unknown pinning " << pin << endl;
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "--isa") && has_args(1))
+			isa_name = argv[++i];
+		else if (!strcmp(argv[i], "--palette") && has_args(1))
+		{
+			const uint32_t size = strtoul(argv[++i], nullptr, 10);
+			if (size == 0 || (size & (size - 1)))
+			{
+				cerr << "Palette size has to be a power of 2" << endl;
+				return 1;
+			}
+			palette = HuePalette(size);
+		}
+		else if (!strcmp(argv[i], "--cache") && has_args(1))
+			cache_dir = argv[++i];
+		else if (!strcmp(argv[i], "--cache-size") && has_args(1))
+			cache_mb = max(strtoul(argv[++i], nullptr, 10), 1ul);
+		else
+		{
+			PrintUsage();
+			return strcmp(argv[i], "--help") ? 1 : 0;
+		}
+	}
+
+	if (!threads)
+		threads = pinning == WorkerPinning::None ? thread::hardware_concurrency() : DefaultWorkerCount(DetectTopology(), pinning);
+	Renderer renderer(threads, pinning);
+
+	if (isa_name == "avx")
+		renderer.SetISA(KernelISA::AVX);
+	else if (isa_name == "avx2")
+		renderer.SetISA(KernelISA::AVX2);
+	else if (isa_name == "avx512")
+		renderer.SetISA(KernelISA::AVX512);
+	else if (!isa_name.empty())
+	{
+		cerr << "Unknown instruction set " << isa_name << endl;
+		return 1;
+	}
+	renderer.SetPalette(palette);
+
+	// Tiles of the same image share cache tiles, always on
+	renderer.SetIterationCache(make_shared<IterationCache>(cache_mb << 20, cache_dir));
+	RenderService service(renderer);
+
+#if defined(_WIN32)
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa))
+	{
+		cerr << "Can't start Winsock" << endl;
+		return 1;
+	}
+#endif
+
+	Socket listener = socket(AF_INET, SOCK_STREAM, 0);
+	const int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	if (listener == NoSocket || inet_pton(AF_INET, bind_address.c_str(), &address.sin_addr) != 1 ||
+		::bind(listener, (const sockaddr *)&address, sizeof(address)) || listen(listener, 128))
+	{
+		cerr << "Can't listen on " << bind_address << ":" << port << endl;
+		return 1;
+	}
+	cout << "Using " << ISAName(renderer.GetISA()) << " kernel, listening on " << bind_address << ":" << port << endl;
+
+	atomic<uint32_t> connections{ 0 };
+	while (true)
+	{
+		Socket client = accept(listener, nullptr, nullptr);
+		if (client == NoSocket)
+			continue;
+
+		// Past the limit, right away instead of queueing behind everybody else
+		if (++connections > config.MaxConnections)
+		{
+			SendResponse(client, "503 Service Unavailable", "text/plain", "busy\n");
+			CloseSocket(client);
+			connections--;
+			continue;
+		}
+
+		thread([client, &service, &config, &connections]() { Serve(client, service, config, connections); }).detach();
+	}
+}
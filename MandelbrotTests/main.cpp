@@ -0,0 +1,364 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Animation.h"
+#include "BigFixed.h"
+#include "ImageWriter.h"
+#include "IterationCache.h"
+#include "RenderService.h"
+#include "Renderer.h"
+using namespace std;
+
+// Every other way of rendering a frame against the direct render, on fixed views, for each supported instruction set
+// and precision. They are all meant to give the same counts (and so the same colors) as Direct, byte for byte
+// With "parts" it checks the pieces those lean on instead : BigFixed, the cache's compression, resuming a streamed
+// image, keyframe interpolation and the render service
+// Exits with 1 if any check fails, both run through ctest
+
+struct View
+{
+	const char * Name;
+	double CenterX;
+	double CenterY;
+	double Zoom;
+	Fractal Formula;
+	uint32_t Iterations;
+};
+
+static const View Views[] =
+{
+	{ "full", -0.5, 0.0, 1.0, Fractal::Mandelbrot, 256 },
+	{ "seahorse", -0.743643887, 0.131825904, 0.005, Fractal::Mandelbrot, 1024 },
+	{ "ship", -1.76, -0.03, 0.05, Fractal::BurningShip, 512 },
+	{ "parabolic", -0.75, 0.0001, 1e-5, Fractal::Mandelbrot, 200000 }, // Next to the cusp orbits crawl, most samples end on the cycle detection
+};
+
+// Not a multiple of the block or cache tile sizes, so partial tiles on the edges get checked too
+static const uint32_t FrameWidth = 200;
+static const uint32_t FrameHeight = 136;
+
+// Rows of each region for the banded render
+static const uint32_t BandHeight = 40;
+
+// Subdivision without verifying can fill over a filament thinner than a rectangle. At most one sample in this many
+// may come out wrong on the views above, they stay under one in 10000
+static const size_t SubdivisionTolerance = 1000;
+
+static uint32_t Failures = 0;
+
+template<typename A, typename B>
+static void Check(const string& What, const A& Expected, const B& Got)
+{
+	if (Expected.size() == Got.size() && equal(Expected.begin(), Expected.end(), Got.begin()))
+		return;
+
+	size_t wrong = 0;
+	for (size_t i = 0; i < min(Expected.size(), Got.size()); i++)
+		wrong += Expected[i] != Got[i];
+	cout << "FAILED " << What << " : " << wrong << " of " << Expected.size() << " differ" << (Expected.size() != Got.size() ? ", and the sizes too" : "") << endl;
+	Failures++;
+}
+
+static void Expect(const string& What, bool Ok)
+{
+	if (Ok)
+		return;
+
+	cout << "FAILED " << What << endl;
+	Failures++;
+}
+
+static void CheckView(Renderer& Render, const RenderRequest& Request, const string& Name)
+{
+	const FrameBuffer<uint32_t> iters = Render.RenderIterations(Request);
+	const FrameBuffer<uint8_t> pixels = Render.Colorize(Request, iters.data());
+
+	RenderRequest compact = Request;
+	compact.Mode = RenderMode::Compact;
+	Check(Name + " compact", iters, Render.RenderIterations(compact));
+
+	// Filled samples are iterated too, so the counts are the kernel's whatever the filling guessed
+	RenderRequest subdivide = Request;
+	subdivide.Mode = RenderMode::Subdivide;
+	Render.ResetSubdivisionStats();
+	Render.SetVerifySubdivision(true);
+	Check(Name + " subdivide", iters, Render.RenderIterations(subdivide));
+	Render.SetVerifySubdivision(false);
+	const uint64_t mismatched = Render.GetSubdivisionStats().Mismatched;
+
+	// Without verifying, the samples filled wrong are the ones verifying caught
+	const FrameBuffer<uint32_t> filled = Render.RenderIterations(subdivide);
+	size_t wrong = 0;
+	for (size_t i = 0; i < iters.size(); i++)
+		wrong += iters[i] != filled[i];
+	if (wrong * SubdivisionTolerance > iters.size() || wrong != mismatched)
+	{
+		cout << "FAILED " << Name << " subdivide unverified : " << wrong << " of " << iters.size() << " differ, verifying found " << mismatched << endl;
+		Failures++;
+	}
+
+	// Regions keep the whole frame's plane, so bands of it stacked up are the frame
+	vector<uint32_t> bands;
+	for (uint32_t top = 0; top < Request.Height; top += BandHeight)
+	{
+		RenderRequest band = Request;
+		band.RegionY = top;
+		band.RegionWidth = Request.Width;
+		band.RegionHeight = min(BandHeight, Request.Height - top);
+		const FrameBuffer<uint32_t> counts = Render.RenderIterations(band);
+		bands.insert(bands.end(), counts.begin(), counts.end());
+	}
+	Check(Name + " regions", iters, bands);
+
+	// Once computing the tiles, once taking them all from the cache
+	Render.SetIterationCache(make_shared<IterationCache>(size_t(16) << 20));
+	Check(Name + " cache miss", iters, Render.RenderIterations(Request));
+	Check(Name + " cache hit", iters, Render.RenderIterations(Request));
+	Render.SetIterationCache(nullptr);
+
+	// Only colors come out of these two, so they're checked against the direct frame's
+	vector<uint8_t> progressive(pixels.size());
+	FrameHistory history;
+	do
+	{
+		Render.RenderProgressiveAsync(Request, history, progressive.data()).get();
+	} while (!Render.IsProgressiveComplete(Request, history));
+	Check(Name + " progressive", pixels, progressive);
+
+	vector<uint8_t> budgeted(pixels.size());
+	BudgetedFrame state;
+	do
+	{
+		Render.RenderBudgetedAsync(Request, state, chrono::milliseconds(1), budgeted.data()).get();
+	} while (!Render.IsBudgetedComplete(Request, state));
+	Check(Name + " budgeted", pixels, budgeted);
+}
+
+static void CheckBigFixed()
+{
+	// Doubles come back as they went in while the precision holds them
+	for (double value : { 0.0, 1.5, -3.0, -0.743643887037158, 1e-20 })
+		Expect("BigFixed from double " + to_string(value), BigFixed::FromDouble(value, 4).ToDouble() == value);
+
+	BigFixed text, back;
+	Expect("BigFixed from string", BigFixed::FromString("-1.2345678901234567890123456789e-3", 4, text));
+	Expect("BigFixed to string", BigFixed::FromString(text.ToString(), 4, back) && fabs((text - back).ToDouble()) <= ldexp(1.0, -126));
+	Expect("BigFixed not a number", !BigFixed::FromString("1.2.3", 4, back) && !BigFixed::FromString("x", 4, back) && !BigFixed::FromString("", 4, back));
+
+	const BigFixed a = BigFixed::FromDouble(1.5, 4);
+	const BigFixed b = BigFixed::FromDouble(-2.25, 4);
+	Expect("BigFixed multiply signs", (a * b).ToDouble() == -3.375 && (b * b).ToDouble() == 5.0625 && (b * a).ToDouble() == -3.375);
+
+	// (1 + 2^-100)^2 = 1 + 2^-99 + 2^-200, past what a double resolves but not 7 limbs
+	const BigFixed one = BigFixed::FromDouble(1.0, 7);
+	const BigFixed tiny = BigFixed::FromDouble(ldexp(1.0, -100), 7);
+	const BigFixed square = (one + tiny) * (one + tiny);
+	Expect("BigFixed multiply precision", (square - one - tiny - tiny).ToDouble() == ldexp(1.0, -200));
+
+	BigFixed third;
+	BigFixed::FromString("0." + string(60, '3'), 7, third);
+	Expect("BigFixed multiply third", fabs((third * BigFixed::FromDouble(3.0, 7) - one).ToDouble()) < ldexp(1.0, -180));
+}
+
+static void CheckCompression()
+{
+	// Runs, steps both ways, wrapping around 32 bits and a stretch with no pattern
+	vector<uint32_t> counts = { 0, 0, 0, 5, 10, 15, 20, 7, 7, 0xFFFFFFFF, 0, 1, 3, 6, 0xFFFFFFFF, 0xFFFFFFFF };
+	uint32_t seed = 12345;
+	for (int i = 0; i < 1000; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		counts.push_back(seed >> (seed & 31));
+	}
+
+	vector<uint8_t> data;
+	CompressIterations(counts.data(), counts.size(), data);
+	vector<uint32_t> back(counts.size());
+	Expect("compression round trip", DecompressIterations(data.data(), data.size(), back.data(), back.size()) && back == counts);
+	Expect("compression cut short", !DecompressIterations(data.data(), data.size() - 1, back.data(), back.size()));
+	Expect("compression too many", !DecompressIterations(data.data(), data.size(), back.data(), back.size() - 1));
+	Expect("compression too few", !DecompressIterations(data.data(), data.size(), back.data(), back.size() + 1));
+
+	// A tile inside the set is one run
+	const vector<uint32_t> inside(4096, 1024);
+	CompressIterations(inside.data(), inside.size(), data);
+	Expect("compression inside", data.size() <= 8);
+}
+
+static void CheckStreamResume()
+{
+	const string path = "MandelbrotTests_stream.ppm";
+	const uint32_t width = 7, height = 5;
+	vector<uint8_t> rgba(width * height * 4);
+	for (size_t i = 0; i < rgba.size(); i++)
+		rgba[i] = (i & 3) == 3 ? 255 : uint8_t(i * 37);
+
+	// Two rows and a bit of the third, like a render that was stopped
+	ImageStream stream;
+	Expect("stream open", stream.Open(path, width, height) && stream.WriteRows(rgba.data(), 2, width * 4) && stream.Close());
+	if (FILE * file = fopen(path.c_str(), "ab"))
+	{
+		fwrite(rgba.data(), 1, 5, file);
+		fclose(file);
+	}
+
+	Expect("stream resume", stream.Open(path, width, height, true) && stream.GetRowsDone() == 2);
+	Expect("stream resume write", stream.WriteRows(rgba.data() + 2 * width * 4, height - 2, width * 4) && stream.Close());
+
+	vector<uint8_t> read;
+	uint32_t read_width = 0, read_height = 0;
+	Expect("stream resumed image", ReadImage(path, read, read_width, read_height) && read_width == width && read_height == height && read == rgba);
+
+	// Another size starts over
+	Expect("stream resume other size", stream.Open(path, width + 1, height, true) && stream.GetRowsDone() == 0);
+	stream.Close();
+	remove(path.c_str());
+}
+
+static bool Near(double A, double B, double Tolerance)
+{
+	return fabs(A - B) <= Tolerance * max(fabs(A), fabs(B));
+}
+
+static void CheckKeyframes()
+{
+	const vector<Keyframe> keyframes =
+	{
+		{ 0.0, "-0.5", "0", 1.0, 100 },
+		{ 2.0, "-0.75", "0.1", 1e-4, 1100 },
+		{ 3.0, "-0.75", "0.2", 1e-4, 1100 },
+	};
+	RenderRequest base;
+	base.Width = 320;
+	base.Height = 200;
+
+	// Clamped to both ends
+	const RenderRequest before = InterpolateKeyframes(keyframes, -1.0, base);
+	Expect("keyframes before", before.CenterX == -0.5 && before.CenterY == 0.0 && before.Zoom == 1.0 && before.Iterations == 100 && before.Width == 320);
+	const RenderRequest after = InterpolateKeyframes(keyframes, 10.0, base);
+	Expect("keyframes after", after.CenterX == -0.75 && Near(after.CenterY, 0.2, 1e-15) && Near(after.Zoom, 1e-4, 1e-12) && after.Iterations == 1100);
+
+	// Halfway the zoom is the geometric mean, and the center is where scaling around the one fixed point puts it
+	const RenderRequest half = InterpolateKeyframes(keyframes, 1.0, base);
+	const double ratio = 1e-4;
+	const double fixed_x = (-0.75 + 0.5 * ratio) / (1.0 - ratio);
+	const double fixed_y = 0.1 / (1.0 - ratio);
+	Expect("keyframes zoom", Near(half.Zoom, 1e-2, 1e-12) && half.Iterations == 600);
+	Expect("keyframes fixed point", Near(half.CenterX, fixed_x + (-0.5 - fixed_x) * half.Zoom, 1e-12) && Near(half.CenterY, fixed_y - fixed_y * half.Zoom, 1e-12));
+	Expect("keyframes precise center", Near(stod(half.PreciseCenterX), half.CenterX, 1e-15) && Near(stod(half.PreciseCenterY), half.CenterY, 1e-15));
+
+	// Same zoom on both sides is a straight pan
+	const RenderRequest pan = InterpolateKeyframes(keyframes, 2.5, base);
+	Expect("keyframes pan", Near(pan.CenterX, -0.75, 1e-15) && Near(pan.CenterY, 0.15, 1e-12) && Near(pan.Zoom, 1e-4, 1e-12));
+}
+
+static void CheckService(Renderer& Render)
+{
+	RenderRequest request;
+	request.CenterX = -0.743643887;
+	request.CenterY = 0.131825904;
+	request.Zoom = 0.005;
+	request.Iterations = 1024;
+	request.Width = FrameWidth;
+	request.Height = FrameHeight;
+	const FrameBuffer<uint8_t> expected = Render.Render(request);
+
+	// Next to the cusp at a bigger size, many tiles that each take a while, so it's still going when cancelled
+	RenderRequest slow = request;
+	slow.CenterX = -0.75;
+	slow.CenterY = 0.0001;
+	slow.Zoom = 1e-5;
+	slow.Iterations = 200000;
+	slow.Width = 4 * FrameWidth;
+	slow.Height = 4 * FrameHeight;
+
+	const chrono::seconds timeout(60);
+	RenderService service(Render);
+
+	// Two identical requests share one render
+	auto first = service.Submit(request, "a");
+	auto second = service.Submit(request, "b");
+	Expect("service wait", first->Wait(timeout) && second->Wait(timeout));
+	ServiceStats stats = service.GetStats();
+	Expect("service coalesced", stats.Submitted == 2 && stats.Coalesced == 1 && stats.Rendered == 1);
+	Expect("service shared pixels", first->GetPixels() && first->GetPixels() == second->GetPixels());
+	Expect("service pixels", first->GetPixels() && equal(expected.begin(), expected.end(), first->GetPixels()->begin()));
+
+	// A render goes on while anyone still waits on it
+	auto leaving = service.Submit(request);
+	auto staying = service.Submit(request);
+	leaving->Cancel();
+	Expect("service one cancel", staying->Wait(timeout) && staying->GetPixels() && equal(expected.begin(), expected.end(), staying->GetPixels()->begin()));
+	Expect("service cancelled pixels", leaving->Wait(chrono::milliseconds(0)) && !leaving->GetPixels());
+
+	// And stops once nobody does, later requests for it start over
+	auto cancelled = service.Submit(slow);
+	cancelled->Cancel();
+	Expect("service cancel", cancelled->Wait(chrono::milliseconds(0)) && !cancelled->GetPixels());
+	auto client = service.Submit(slow, "c");
+	service.CancelClient("c");
+	Expect("service cancel client", client->Wait(chrono::milliseconds(0)) && !client->GetPixels());
+	stats = service.GetStats();
+	Expect("service cancel stats", stats.Submitted == 6 && stats.Coalesced == 2 && stats.Rendered == 2 && stats.Cancelled == 2 && stats.InFlight == 0);
+}
+
+static int CheckParts()
+{
+	CheckBigFixed();
+	CheckCompression();
+	CheckStreamResume();
+	CheckKeyframes();
+
+	Renderer renderer;
+	CheckService(renderer);
+
+	cout << (Failures ? to_string(Failures) + " checks failed" : "Every part checks out") << endl;
+	return Failures ? 1 : 0;
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc > 1 && strcmp(argv[1], "parts") == 0)
+		return CheckParts();
+
+	Renderer renderer;
+	const KernelISA best = DetectISA();
+	for (KernelISA isa : { KernelISA::AVX, KernelISA::AVX2, KernelISA::AVX512 })
+	{
+		if (isa > best)
+			break;
+		renderer.SetISA(isa);
+
+		for (const View& view : Views)
+		{
+			for (KernelPrecision precision : { KernelPrecision::Single, KernelPrecision::Double })
+			{
+				for (bool smooth : { false, true })
+				{
+					RenderRequest request;
+					request.CenterX = view.CenterX;
+					request.CenterY = view.CenterY;
+					request.Zoom = view.Zoom;
+					request.Formula = view.Formula;
+					request.Iterations = view.Iterations;
+					request.Width = FrameWidth;
+					request.Height = FrameHeight;
+					request.Precision = precision;
+					request.Smooth = smooth;
+
+					const string name = string(ISAName(isa)) + " " + view.Name + (precision == KernelPrecision::Single ? " SP" : " DP") + (smooth ? " smooth" : "");
+					CheckView(renderer, request, name);
+				}
+			}
+		}
+	}
+
+	cout << (Failures ? to_string(Failures) + " checks failed" : "Everything matches the direct render") << endl;
+	return Failures ? 1 : 0;
+}
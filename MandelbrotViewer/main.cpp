@@ -0,0 +1,584 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include "Interactive.h"
+#include "Renderer.h"
+
+// After ours, Xlib defines None and friends as macros
+#include <X11/XKBlib.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#undef None
+using namespace std;
+
+// Interactive viewer for X11, the software framebuffer counterpart of MandelbrotDX
+// This thread only handles the window : events go into the view, which is published to the render loop right away,
+// and the newest frame the loop has is drawn whenever there's one. Until then the last frame is moved and scaled to
+// where the view is now, so panning and zooming answer at once no matter how long a frame takes
+
+static void PrintUsage()
+{
+	cout << "Usage : MandelbrotViewer [options]" << endl;
+	cout << "	--size W H         Window size (default 1024 1024)" << endl;
+	cout << "	--center X Y       Starting view, same as MandelbrotCLI (default 0 0)" << endl;
+	cout << "	--zoom Z           (default 1)" << endl;
+	cout << "	--iterations N     (default 100)" << endl;
+	cout << "	--fractal NAME     mandelbrot, burningship, tricorn, multibrot3 or multibrot4 (default mandelbrot)" << endl;
+	cout << "	--budget MS        Start in budgeted mode with this budget per frame (default 33 once toggled with B)" << endl;
+	cout << "	--threads N        Worker count (default hardware concurrency, or the core count with --pin cores)" << endl;
+	cout << "	--pin P            none, cores or smt, see MandelbrotCLI" << endl;
+	cout << "	--isa NAME         Force a kernel : avx, avx2 or avx512 (default widest supported)" << endl;
+	cout << "	--palette N        Number of hues the colors cycle through, a power of 2 (default 32)" << endl;
+}
+
+static void PrintKeys()
+{
+	cout << "Instructions : " << endl;
+	cout << "	Q,E = Zoom, or the mouse wheel" << endl;
+	cout << "	Arrows for movement, or drag with the left button" << endl;
+	cout << "	A,D = Less/More iterations" << endl;
+	cout << "	Shift + any of the above makes them faster" << endl;
+	cout << "	Press M to cycle the mode (progressive, subdivision, compact)" << endl;
+	cout << "	Press B to toggle budgeted frames, for views with more iterations than fit in a frame" << endl;
+	cout << "	Press F to cycle the fractal" << endl;
+	cout << "	Press J to toggle the Julia set of the point at the center" << endl;
+	cout << "	Press C to cycle the colors" << endl;
+	cout << "	Press S to toggle smooth coloring" << endl;
+	cout << "	Press R to go back to the starting view" << endl;
+	cout << "	Escape to quit" << endl;
+}
+
+static const Fractal Fractals[] = { Fractal::Mandelbrot, Fractal::BurningShip, Fractal::Tricorn, Fractal::Multibrot3, Fractal::Multibrot4 };
+
+static const char * ModeName(RenderMode Mode)
+{
+	switch (Mode)
+	{
+	case RenderMode::Subdivide: return "subdivision";
+	case RenderMode::Compact: return "compact";
+	default: return "progressive";
+	}
+}
+
+// Where a channel of a TrueColor visual goes, 8 bit channels are shifted down to the mask's width
+struct ChannelLayout
+{
+	uint32_t Shift = 0;
+	uint32_t Drop = 0;
+};
+
+static ChannelLayout LayoutOf(unsigned long Mask)
+{
+	ChannelLayout layout;
+	if (!Mask)
+		return layout;
+	while (!(Mask & 1))
+	{
+		Mask >>= 1;
+		layout.Shift++;
+	}
+	uint32_t bits = 0;
+	while (Mask & 1)
+	{
+		Mask >>= 1;
+		bits++;
+	}
+	layout.Drop = bits < 8 ? 8 - bits : 0;
+	return layout;
+}
+
+struct PixelLayout
+{
+	ChannelLayout R;
+	ChannelLayout G;
+	ChannelLayout B;
+};
+
+// Image the frames are drawn to before going to the window, one 32 bit pixel per pixel
+static XImage * MakeImage(Display * Dpy, Visual * Vis, int Depth, uint32_t Width, uint32_t Height)
+{
+	char * data = (char *)malloc(size_t(Width) * Height * 4);
+	XImage * image = XCreateImage(Dpy, Vis, Depth, ZPixmap, 0, data, Width, Height, 32, 0);
+	if (!image)
+	{
+		free(data);
+		return nullptr;
+	}
+
+	// Pixels are written in our byte order, Xlib swaps them if the server wants the other one
+	const uint16_t probe = 1;
+	image->byte_order = *(const uint8_t *)&probe ? LSBFirst : MSBFirst;
+	return image;
+}
+
+// Frame moved and scaled to View, pixels the frame doesn't cover are black
+// Each window pixel takes the frame pixel under its center, nearest is enough for the few frames until the next one
+static void DrawFrame(const ViewerFrame& Frame, const RenderRequest& View, const PixelLayout& Layout, XImage * Image, vector<int32_t>& Columns, vector<int32_t>& Rows)
+{
+	const uint32_t width = uint32_t(Image->width);
+	const uint32_t height = uint32_t(Image->height);
+	Columns.assign(width, -1);
+	Rows.assign(height, -1);
+	if (!Frame.Pixels.empty())
+	{
+		const FrameParams& from = Frame.Frame;
+		const FrameParams to = MakeFrameParams(View);
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const double fx = floor((to.CoeffA_X*(x + 0.5) + to.CoeffB_X - from.CoeffB_X) / from.CoeffA_X);
+			if (fx >= 0.0 && fx < double(from.Width))
+				Columns[x] = int32_t(fx);
+		}
+		for (uint32_t y = 0; y < height; y++)
+		{
+			const double fy = floor((to.CoeffA_Y*(y + 0.5) + to.CoeffB_Y - from.CoeffB_Y) / from.CoeffA_Y);
+			if (fy >= 0.0 && fy < double(from.Height))
+				Rows[y] = int32_t(fy);
+		}
+	}
+
+	const size_t frame_row = size_t(Frame.Frame.Width) * 4;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		uint32_t * out = (uint32_t *)(Image->data + size_t(y) * Image->bytes_per_line);
+		if (Rows[y] < 0)
+		{
+			memset(out, 0, size_t(width) * 4);
+			continue;
+		}
+
+		const uint8_t * row = Frame.Pixels.data() + size_t(Rows[y]) * frame_row;
+		for (uint32_t x = 0; x < width; x++)
+		{
+			if (Columns[x] < 0)
+			{
+				out[x] = 0;
+				continue;
+			}
+			const uint8_t * rgba = row + 4 * size_t(Columns[x]);
+			out[x] = (uint32_t(rgba[0] >> Layout.R.Drop) << Layout.R.Shift) | (uint32_t(rgba[1] >> Layout.G.Drop) << Layout.G.Shift) |
+				(uint32_t(rgba[2] >> Layout.B.Drop) << Layout.B.Shift);
+		}
+	}
+}
+
+// Keys that do something for as long as they're held
+struct HeldKeys
+{
+	bool ZoomOut = false;
+	bool ZoomIn = false;
+	bool Up = false;
+	bool Down = false;
+	bool Left = false;
+	bool Right = false;
+	bool More = false;
+	bool Less = false;
+	bool Shift = false;
+
+	bool Any() const { return ZoomOut || ZoomIn || Up || Down || Left || Right || More || Less; }
+};
+
+int main(int argc, char ** argv)
+{
+	ViewParams start;
+	uint32_t threads = 0; // 0 until --threads, then the default for the pinning
+	WorkerPinning pinning = WorkerPinning::None;
+	string isa_name;
+	Palette palette = HuePalette();
+
+	for (int i = 1; i < argc; i++)
+	{
+		auto has_args = [&](int Count)
+		{
+			if (i + Count >= argc)
+			{
+				cerr << "Missing value for " << argv[i] << endl;
+				exit(1);
+			}
+			return true;
+		};
+
+		if (!strcmp(argv[i], "--size") && has_args(2))
+		{
+			start.Request.Width = max(strtoul(argv[++i], nullptr, 10), 1ul);
+			start.Request.Height = max(strtoul(argv[++i], nullptr, 10), 1ul);
+		}
+		else if (!strcmp(argv[i], "--center") && has_args(2))
+		{
+			start.Request.CenterX = atof(argv[++i]);
+			start.Request.CenterY = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--zoom") && has_args(1))
+			start.Request.Zoom = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--iterations") && has_args(1))
+			start.Request.Iterations = max(strtoul(argv[++i], nullptr, 10), 1ul);
+		else if (!strcmp(argv[i], "--fractal") && has_args(1))
+		{
+			string name = argv[++i];
+			bool found = false;
+			for (Fractal formula : Fractals)
+			{
+				if (name == FractalName(formula))
+				{
+					start.Request.Formula = formula;
+					found = true;
+				}
+			}
+			if (!found)
+			{
+				cerr << "Unknown fractal " << name << endl;
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "--budget") && has_args(1))
+		{
+			start.Budgeted = true;
+			start.Budget = chrono::milliseconds(max(strtoul(argv[++i], nullptr, 10), 1ul));
+		}
+		else if (!strcmp(argv[i], "--threads") && has_args(1))
+			threads = max(strtoul(argv[++i], nullptr, 10), 1ul);
+		else if (!strcmp(argv[i], "--pin") && has_args(1))
+		{
+			string pin = argv[++i];
+			if (pin == "none")
+				pinning = WorkerPinning::None;
+			else if (pin == "cores")
+				pinning = WorkerPinning::Cores;
+			else if (pin == "smt")
+				pinning = WorkerPinning::CoresThenSMT;
+			else
+			{
+				cerr << "Unknown pinning " << pin << endl;
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "--isa") && has_args(1))
+			isa_name = argv[++i];
+		else if (!strcmp(argv[i], "--palette") && has_args(1))
+		{
+			const uint32_t size = strtoul(argv[++i], nullptr, 10);
+			if (size == 0 || (size & (size - 1)))
+			{
+				cerr << "Palette size has to be a power of 2" << endl;
+				return 1;
+			}
+			palette = HuePalette(size);
+		}
+		else
+		{
+			PrintUsage();
+			return strcmp(argv[i], "--help") ? 1 : 0;
+		}
+	}
+
+	Display * display = XOpenDisplay(nullptr);
+	if (!display)
+	{
+		cerr << "Can't open the display, is DISPLAY set?" << endl;
+		return 1;
+	}
+
+	const int screen = DefaultScreen(display);
+	Visual * visual = DefaultVisual(display, screen);
+	const int depth = DefaultDepth(display, screen);
+	if (visual->c_class != TrueColor || (depth != 24 && depth != 32))
+	{
+		cerr << "Only 24 and 32 bit TrueColor displays are supported" << endl;
+		return 1;
+	}
+	const PixelLayout layout = { LayoutOf(visual->red_mask), LayoutOf(visual->green_mask), LayoutOf(visual->blue_mask) };
+
+	Window window = XCreateSimpleWindow(display, RootWindow(display, screen), 0, 0, start.Request.Width, start.Request.Height, 0, 0, BlackPixel(display, screen));
+	XSelectInput(display, window, ExposureMask | KeyPressMask | KeyReleaseMask | ButtonPressMask | ButtonReleaseMask | PointerMotionMask | StructureNotifyMask);
+	Atom delete_window = XInternAtom(display, "WM_DELETE_WINDOW", False);
+	XSetWMProtocols(display, window, &delete_window, 1);
+	XStoreName(display, window, "Mandelbrot");
+	XMapWindow(display, window);
+	GC gc = XCreateGC(display, window, 0, nullptr);
+
+	// Held keys send one press and one release, not a stream of them
+	XkbSetDetectableAutoRepeat(display, True, nullptr);
+
+	XImage * image = MakeImage(display, visual, depth, start.Request.Width, start.Request.Height);
+	if (!image || image->bits_per_pixel != 32)
+	{
+		cerr << "Only 24 and 32 bit TrueColor displays are supported" << endl;
+		return 1;
+	}
+
+	if (!threads)
+		threads = pinning == WorkerPinning::None ? thread::hardware_concurrency() : DefaultWorkerCount(DetectTopology(), pinning);
+	Renderer renderer(threads, pinning);
+
+	if (isa_name == "avx")
+		renderer.SetISA(KernelISA::AVX);
+	else if (isa_name == "avx2")
+		renderer.SetISA(KernelISA::AVX2);
+	else if (isa_name == "avx512")
+		renderer.SetISA(KernelISA::AVX512);
+	else if (!isa_name.empty())
+	{
+		cerr << "Unknown instruction set " << isa_name << endl;
+		return 1;
+	}
+	renderer.SetPalette(palette);
+
+	// The render loop writes a byte here after every frame, which wakes this thread up from poll along with X events
+	int wake[2];
+	if (pipe(wake))
+	{
+		cerr << "Can't create a pipe" << endl;
+		return 1;
+	}
+	fcntl(wake[0], F_SETFL, O_NONBLOCK);
+	fcntl(wake[1], F_SETFL, O_NONBLOCK);
+
+	PrintKeys();
+
+	ViewParams view = start;
+	ViewChannel channel;
+	channel.Publish(view);
+	FrameMailbox frames;
+	bool running = true;
+	{
+		RenderLoop loop(renderer, channel, frames, [&]()
+		{
+			const char byte = 0;
+			const ssize_t written = write(wake[1], &byte, 1);
+			(void)written;
+		});
+
+		typedef chrono::steady_clock Clock;
+		HeldKeys held;
+		bool was_held = false;
+		Clock::time_point last_tick = Clock::now();
+		ViewParams before_julia = view;
+		bool dragging = false;
+		int drag_x = 0;
+		int drag_y = 0;
+		vector<int32_t> columns, rows;
+
+		while (running)
+		{
+			bool changed = false;
+			bool redraw = false;
+			auto pixel_size = [&]() { return 4.0 * view.Request.Zoom / double(min(view.Request.Width, view.Request.Height)); };
+
+			while (XPending(display))
+			{
+				XEvent event;
+				XNextEvent(display, &event);
+				switch (event.type)
+				{
+				case KeyPress:
+				case KeyRelease:
+				{
+					const bool down = event.type == KeyPress;
+					const KeySym key = XLookupKeysym(&event.xkey, 0);
+					switch (key)
+					{
+					case XK_q: held.ZoomOut = down; break;
+					case XK_e: held.ZoomIn = down; break;
+					case XK_Up: held.Up = down; break;
+					case XK_Down: held.Down = down; break;
+					case XK_Left: held.Left = down; break;
+					case XK_Right: held.Right = down; break;
+					case XK_d: held.More = down; break;
+					case XK_a: held.Less = down; break;
+					case XK_Shift_L:
+					case XK_Shift_R: held.Shift = down; break;
+					default: break;
+					}
+					if (!down)
+						break;
+
+					changed = true;
+					switch (key)
+					{
+					case XK_m:
+						view.Request.Mode = view.Request.Mode == RenderMode::Direct ? RenderMode::Subdivide
+							: view.Request.Mode == RenderMode::Subdivide ? RenderMode::Compact : RenderMode::Direct;
+						break;
+					case XK_b: view.Budgeted = !view.Budgeted; break;
+					case XK_c: view.ColorOffset++; break;
+					case XK_s: view.Request.Smooth = !view.Request.Smooth; break;
+					case XK_f:
+					{
+						const size_t count = sizeof(Fractals) / sizeof(Fractals[0]);
+						const size_t current = find(Fractals, Fractals + count, view.Request.Formula) - Fractals;
+						view.Request.Formula = Fractals[(current + 1) % count];
+						break;
+					}
+					case XK_j:
+						// The Julia set of the point at the center, starting from the whole set. Going back restores the view
+						if (!view.Request.Julia)
+						{
+							before_julia = view;
+							view.Request.Julia = true;
+							view.Request.JuliaX = view.Request.CenterX;
+							view.Request.JuliaY = view.Request.CenterY;
+							view.Request.CenterX = 0.0;
+							view.Request.CenterY = 0.0;
+							view.Request.Zoom = 1.0;
+						}
+						else
+						{
+							view.Request.Julia = false;
+							view.Request.CenterX = before_julia.Request.CenterX;
+							view.Request.CenterY = before_julia.Request.CenterY;
+							view.Request.Zoom = before_julia.Request.Zoom;
+						}
+						break;
+					case XK_r:
+						view.Request.CenterX = start.Request.CenterX;
+						view.Request.CenterY = start.Request.CenterY;
+						view.Request.Zoom = start.Request.Zoom;
+						view.Request.Iterations = start.Request.Iterations;
+						view.Request.Julia = false;
+						break;
+					case XK_Escape: running = false; break;
+					default: changed = false; break;
+					}
+					break;
+				}
+				case ButtonPress:
+					if (event.xbutton.button == Button1)
+					{
+						dragging = true;
+						drag_x = event.xbutton.x;
+						drag_y = event.xbutton.y;
+					}
+					else if (event.xbutton.button == Button4 || event.xbutton.button == Button5)
+					{
+						// Around the cursor, the point under it stays there
+						const double factor = event.xbutton.button == Button4 ? (held.Shift ? 0.5 : 0.8) : (held.Shift ? 2.0 : 1.25);
+						const double px = view.Request.CenterX + pixel_size() * (event.xbutton.x + 0.5 - 0.5 * view.Request.Width);
+						const double py = view.Request.CenterY + pixel_size() * (event.xbutton.y + 0.5 - 0.5 * view.Request.Height);
+						view.Request.CenterX = px - factor * (px - view.Request.CenterX);
+						view.Request.CenterY = py - factor * (py - view.Request.CenterY);
+						view.Request.Zoom *= factor;
+						changed = true;
+					}
+					break;
+				case ButtonRelease:
+					if (event.xbutton.button == Button1)
+						dragging = false;
+					break;
+				case MotionNotify:
+					if (dragging)
+					{
+						view.Request.CenterX -= pixel_size() * (event.xmotion.x - drag_x);
+						view.Request.CenterY -= pixel_size() * (event.xmotion.y - drag_y);
+						drag_x = event.xmotion.x;
+						drag_y = event.xmotion.y;
+						changed = true;
+					}
+					break;
+				case ConfigureNotify:
+				{
+					const uint32_t width = uint32_t(max(event.xconfigure.width, 1));
+					const uint32_t height = uint32_t(max(event.xconfigure.height, 1));
+					if (width != view.Request.Width || height != view.Request.Height)
+					{
+						XImage * resized = MakeImage(display, visual, depth, width, height);
+						if (resized)
+						{
+							XDestroyImage(image);
+							image = resized;
+							view.Request.Width = width;
+							view.Request.Height = height;
+							changed = true;
+						}
+					}
+					break;
+				}
+				case Expose:
+					redraw = true;
+					break;
+				case ClientMessage:
+					if (Atom(event.xclient.data.l[0]) == delete_window)
+						running = false;
+					break;
+				default:
+					break;
+				}
+			}
+
+			// Same speeds as MandelbrotDX, which moved every 25ms, whatever the time between ticks here
+			// A key that was just pressed moves by one of those right away
+			const Clock::time_point now = Clock::now();
+			const double ticks = was_held ? min(chrono::duration<double>(now - last_tick).count(), 0.1) / 0.025 : 1.0;
+			last_tick = now;
+			was_held = held.Any();
+			if (held.Any())
+			{
+				const double zoom_rate = pow(held.Shift ? 1.07 : 1.025, ticks);
+				const double move = (held.Shift ? 0.1 : 0.01) * ticks * view.Request.Zoom;
+				if (held.ZoomOut)
+					view.Request.Zoom *= zoom_rate;
+				if (held.ZoomIn)
+					view.Request.Zoom /= zoom_rate;
+				view.Request.CenterY += (held.Down ? move : 0.0) - (held.Up ? move : 0.0);
+				view.Request.CenterX += (held.Right ? move : 0.0) - (held.Left ? move : 0.0);
+
+				// One iteration per tick like MandelbrotDX, or a hundredth of them once that's more, ten times that with shift
+				const double step = max(1.0, view.Request.Iterations * 0.01) * (held.Shift ? 10.0 : 1.0) * ticks;
+				const double iterations = double(view.Request.Iterations) + (held.More ? step : 0.0) - (held.Less ? step : 0.0);
+				view.Request.Iterations = uint32_t(min(max(iterations + 0.5, 1.0), 4294967295.0));
+				changed = true;
+			}
+
+			if (changed)
+			{
+				channel.Publish(view);
+				redraw = true;
+			}
+
+			char drain[64];
+			while (read(wake[0], drain, sizeof(drain)) > 0)
+				;
+			if (frames.Acquire())
+			{
+				const ViewerFrame& frame = frames.Front();
+				char title[256];
+				snprintf(title, sizeof(title), "Mandelbrot - %.17g, %.17g  zoom %g  %u iterations  %s%s  %.1fms%s", view.Request.CenterX, view.Request.CenterY,
+					view.Request.Zoom, view.Request.Iterations, view.Budgeted ? "budgeted " : "", ModeName(view.Request.Mode), frame.RenderMs,
+					frame.Unresolved ? (string(", ") + to_string(frame.Unresolved) + " samples still going").c_str() : "");
+				XStoreName(display, window, title);
+				redraw = true;
+			}
+
+			if (redraw)
+			{
+				DrawFrame(frames.Front(), view.Request, layout, image, columns, rows);
+				XPutImage(display, window, gc, image, 0, 0, 0, 0, image->width, image->height);
+			}
+			XFlush(display);
+
+			// Sleep until the next event or frame, or the next tick while keys are held
+			if (running && !XPending(display))
+			{
+				pollfd fds[2] = { { ConnectionNumber(display), POLLIN, 0 }, { wake[0], POLLIN, 0 } };
+				poll(fds, 2, held.Any() ? 8 : -1);
+			}
+		}
+	}
+
+	close(wake[0]);
+	close(wake[1]);
+	XDestroyImage(image);
+	XFreeGC(display, gc);
+	XDestroyWindow(display, window);
+	XCloseDisplay(display);
+	return 0;
+}